@@ -6,7 +6,7 @@ BUILD_DIR="build"
 
 # Parse argument
 if [ "$#" -ne 1 ]; then
-    echo "Usage: $0 {fcds|concurrent}"
+    echo "Usage: $0 {fcds|concurrent|fc|sharded}"
     exit 1
 fi
 
@@ -15,14 +15,30 @@ case "$1" in
     fcds)
         FCDS_FLAG="-DFCDS=ON"
         CONC_FLAG="-DCONC_MINHASH=OFF"
+        FC_FLAG="-DFLAT_COMBINING=OFF"
+        SHARDED_FLAG="-DSHARDED=OFF"
         ;;
     concurrent)
         FCDS_FLAG="-DFCDS=OFF"
         CONC_FLAG="-DCONC_MINHASH=ON"
+        FC_FLAG="-DFLAT_COMBINING=OFF"
+        SHARDED_FLAG="-DSHARDED=OFF"
+        ;;
+    fc)
+        FCDS_FLAG="-DFCDS=OFF"
+        CONC_FLAG="-DCONC_MINHASH=OFF"
+        FC_FLAG="-DFLAT_COMBINING=ON"
+        SHARDED_FLAG="-DSHARDED=OFF"
+        ;;
+    sharded)
+        FCDS_FLAG="-DFCDS=OFF"
+        CONC_FLAG="-DCONC_MINHASH=OFF"
+        FC_FLAG="-DFLAT_COMBINING=OFF"
+        SHARDED_FLAG="-DSHARDED=ON"
         ;;
     *)
         echo "Unknown build mode: $1"
-        echo "Usage: $0 {fcds|concurrent}"
+        echo "Usage: $0 {fcds|concurrent|fc|sharded}"
         exit 1
         ;;
 esac
@@ -31,6 +47,6 @@ esac
 mkdir -p "$BUILD_DIR"
 cd "$BUILD_DIR"
 
-# Run CMake and compile
-cmake .. $FCDS_FLAG $CONC_FLAG
+# Run CMake and compile: the benchmarks run on the build host, vectorize the kernels for it
+cmake .. $FCDS_FLAG $CONC_FLAG $FC_FLAG $SHARDED_FLAG -DNATIVE_ARCH=ON -DHUGEPAGE_ARENA=ON
 make -j$(nproc)
@@ -0,0 +1,42 @@
+/**
+* Arena allocator for sketch storage: sketches, their copies, version records and tagged pointers.
+* Memory is mapped in 2MB huge pages (MAP_HUGETLB, or transparent huge pages through madvise when no
+* huge page is reserved) and carved into power-of-two size classes. Every thread keeps its own free
+* list per class, so that allocations and frees on the hot paths take no lock. With the
+* HUGEPAGE_ARENA build option off the functions fall back to malloc/free.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils.h>
+
+#define ARENA_PAGE (2UL << 20)   // huge page size, unit of every mapping
+#define ARENA_MIN_SHIFT 4        // smallest class: 16 bytes, the size of a tagged pointer
+#define ARENA_MAX_SHIFT 20       // largest class: 1MB, bigger blocks get their own mapping
+#define ARENA_CLASSES (ARENA_MAX_SHIFT - ARENA_MIN_SHIFT + 1)
+
+typedef struct arena_usage {
+	size_t hugetlb_bytes;  /// mapped with MAP_HUGETLB
+	size_t thp_bytes;      /// mapped with 4KB pages and advised for transparent huge pages
+	size_t large_bytes;    /// of the above, mapped for blocks above the largest class
+} arena_usage;
+
+// allocate size bytes, aligned to 16 bytes (64 bytes from 64 bytes up). Exits on failure
+void *arena_alloc(size_t size);
+
+// free memory returned by arena_alloc, size must be the requested size.
+// The block goes to the free list of the calling thread, whichever thread allocated it
+void arena_free(void *ptr, size_t size);
+
+// bytes mapped so far
+void arena_get_usage(arena_usage *usage);
+
+// array of size sketch slots, freed by sketch_free
+sketch_t *sketch_alloc(uint64_t size);
+void sketch_free(sketch_t *sketch, uint64_t size);
+
+#endif
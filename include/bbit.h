@@ -0,0 +1,41 @@
+/**
+* b-bit MinHash: compressed representation of a sketch for storage and batch comparison
+*/
+
+#ifndef BBIT_H
+#define BBIT_H
+
+#include <stdint.h>
+#include <utils.h>
+
+/** Only the lowest b bits of each slot are kept, with b in {1, 2, 4, 8}.
+ *  Slots are packed little-endian into 64-bit words, 64/b slots per word, so a slot never
+ *  straddles two words. Unused bits of the last word are zero */
+typedef struct bbit_sketch {
+	uint32_t b;       /// bits kept per slot
+	uint64_t size;    /// number of slots of the original sketch
+	uint64_t words;   /// number of 64-bit words of bits
+	uint64_t *bits;   /// packed slots
+} bbit_sketch;
+
+
+// return non zero if b is a supported number of bits per slot
+int bbit_valid(uint32_t b);
+
+// number of 64-bit words needed to pack size slots with b bits each
+uint64_t bbit_words(uint64_t size, uint32_t b);
+
+// pack the lowest b bits of each slot of sketch into out, which holds bbit_words(size, b) words
+void bbit_pack(const sketch_t *sketch, uint64_t size, uint32_t b, uint64_t *out);
+
+// allocate a b-bit sketch and fill it with the compression of sketch
+bbit_sketch *bbit_compress(const sketch_t *sketch, uint64_t size, uint32_t b);
+void bbit_free(bbit_sketch *sketch);
+
+// number of slots whose lowest b bits are equal in the two packed sketches
+uint64_t bbit_matches(const uint64_t *x, const uint64_t *y, uint64_t size, uint32_t b);
+
+// bias-corrected similarity estimate between two b-bit sketches built with the same hash functions and b
+float bbit_query(const bbit_sketch *sketch, const bbit_sketch *otherSketch);
+
+#endif
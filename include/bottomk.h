@@ -0,0 +1,90 @@
+/**
+* Bottom-k (KMV) sketch: the k smallest distinct hash values of a set under a single hash function.
+* One hash evaluation per element instead of one per slot, and most elements are rejected by one
+* comparison against the largest value held. Only the first function of the hash family is used
+*/
+
+#ifndef BOTTOMK_H
+#define BOTTOMK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils.h>
+
+typedef struct bottomk_sketch {
+	uint64_t k;              /// capacity
+	uint64_t count;          /// values held, k once the set has k distinct hash values
+	sketch_t *values;        /// the count smallest distinct hash values, ascending
+
+	// hash functions
+	uint32_t hash_type;
+	void *hash_functions;
+} bottomk_sketch;
+
+
+/** INIT AND CLEAR OPERATIONS */
+void init_bottomk(bottomk_sketch **sketch, void *hash_functions, uint64_t k, int init_size, uint32_t hash_type);
+void init_values_bottomk(bottomk_sketch *sketch, uint64_t size);
+void free_bottomk(bottomk_sketch *sketch);
+
+/** SKETCH OPERATIONS */
+// insert elem, returns true if its hash value entered the sketch
+int insert_bottomk(bottomk_sketch *sketch, uint64_t elem);
+void insert_bottomk_batch(bottomk_sketch *sketch, const uint64_t *elems, size_t n);
+void bottomk_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+
+// bottom-k estimate of the Jaccard similarity: the share of the k smallest values of the union held by both sketches
+float query_bottomk(bottomk_sketch *sketch, bottomk_sketch *otherSketch);
+
+// number of distinct elements: exact below k values, (k - 1) / (v_k / M) above
+double bottomk_cardinality(const bottomk_sketch *sketch);
+
+
+/** CONCURRENT BOTTOM-K */
+
+/** Private buffer of a writer: a bottom-k of the elements inserted since its last merge */
+typedef struct bottomk_writer {
+	bottomk_sketch local;
+	uint32_t accepted;     // values entered in local since the last merge
+} __attribute__((aligned(64))) bottomk_writer;
+
+typedef struct conc_bottomk {
+	uint32_t N;		   // number of writing threads
+	uint32_t b;		   // threshold for propagation: a writer merges its buffer after b accepted values
+
+	uint64_t k;
+
+	// hash functions
+	uint32_t hash_type;
+	void *hash_functions;
+
+	bottomk_writer *writers;  // writers[i] is accessed by T_i only
+
+	/** Shared sketch, rebuilt by the merges and read by the queries. seq is odd while a merge
+	 *  publishes it; threshold is its largest value once full, INFTY before */
+	bottomk_sketch *global;
+	sketch_t *scratch;             // merge output, swapped with global->values
+	_Atomic sketch_t threshold;    // hash values not below it can not enter global and are dropped by the writers
+	_Atomic uint64_t seq;          // sequence counter protecting global
+	_Atomic uint32_t merge_lock;   // held by the writer which merges its buffer
+
+} conc_bottomk;
+
+
+/** INIT AND CLEAR OPERATIONS */
+void init_conc_bottomk(conc_bottomk **sketch, void *hash_functions, uint64_t k, int init_size, uint32_t hash_type, uint32_t N, uint32_t b);
+void free_conc_bottomk(conc_bottomk *sketch);
+
+/* SKETCH OPERATIONS */
+void insert_conc_bottomk(conc_bottomk *sketch, uint32_t tid, uint64_t elem);
+void insert_conc_bottomk_batch(conc_bottomk *sketch, uint32_t tid, const uint64_t *elems, size_t n);
+void conc_bottomk_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+// merge the buffer of writer tid into the shared sketch, called by the writer itself, e.g. when its stream ends
+void conc_bottomk_flush(conc_bottomk *sketch, uint32_t tid);
+
+// copy the shared sketch into out, a bottom-k sketch with the same k
+void conc_bottomk_snapshot(conc_bottomk *sketch, bottomk_sketch *out);
+float query_conc_bottomk(conc_bottomk *sketch, bottomk_sketch *otherSketch);
+double conc_bottomk_cardinality(conc_bottomk *sketch);
+
+#endif
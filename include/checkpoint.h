@@ -0,0 +1,70 @@
+/**
+* Checkpoints of a running sketch: a background thread copies a consistent state of the engine every
+* interval and writes it to disk, so that a crash loses the insertions of one interval at most instead
+* of the whole sketch.
+*
+* Checkpoints alternate between path.0 and path.1 (double buffering): each one is written to path.tmp,
+* synced and renamed over the older of the two, so a file is always either a whole checkpoint or the
+* previous one. The header carries a sequence number and checksums, recovery loads the newest valid file
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <utils.h>
+
+#define CHECKPOINT_MAGIC 0x54504B4348534D4DULL  // "MMSHCKPT"
+#define CHECKPOINT_VERSION 1
+
+typedef struct checkpoint_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t slot_bytes;        /// sizeof(sketch_t) of the writer
+	uint64_t size;              /// slots of the sketch
+	uint64_t sequence;          /// the newest valid checkpoint has the largest one
+	uint64_t timestamp;         /// microseconds since the epoch
+	uint64_t fingerprint;       /// of the hash functions, see checkpoint_fingerprint
+	uint64_t payload_checksum;  /// of the size slots following the header
+	uint64_t header_checksum;   /// of the fields above
+} checkpoint_header;
+
+/** Copies a consistent state of the engine ctx into out, while its writers go on */
+typedef void (*checkpoint_source)(void *ctx, sketch_t *out);
+
+typedef struct checkpointer {
+	char *path;
+	checkpoint_source source;
+	void *ctx;
+	uint64_t size;
+	uint64_t fingerprint;
+	uint64_t interval_ms;
+	uint64_t sequence;          /// of the last checkpoint on disk, 0 for none
+	sketch_t *snapshot;
+	sketch_t *last;             /// state of the last checkpoint: an unchanged sketch is not written again
+	uint64_t written, skipped, failed;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	int stop;
+} checkpointer;
+
+// a sketch is only meaningful with the hash functions that built it: digest of the values of a probe element
+uint64_t checkpoint_fingerprint(void *hash_functions, uint32_t hash_type, uint64_t size);
+
+// write sketch as checkpoint sequence of path. Returns 0, or -1 with errno set
+int checkpoint_write(const char *path, uint64_t sequence, const sketch_t *sketch, uint64_t size, uint64_t fingerprint);
+// read the checkpoint file into out. Returns its sequence, or 0 if it is missing, torn, corrupted or of other hash functions
+uint64_t checkpoint_read(const char *file, sketch_t *out, uint64_t size, uint64_t fingerprint);
+// load the newest valid checkpoint of path into out. Returns its sequence, 0 when there is none and out is untouched
+uint64_t checkpoint_recover(const char *path, sketch_t *out, uint64_t size, uint64_t fingerprint);
+
+// start the thread checkpointing source every interval_ms, numbering after the checkpoints already in path
+void checkpointer_start(checkpointer *cp, const char *path, checkpoint_source source, void *ctx, uint64_t size, uint64_t fingerprint, uint64_t interval_ms);
+// take a checkpoint now, from the calling thread. Returns 0, or -1 if it could not be written
+int checkpointer_flush(checkpointer *cp);
+// stop the thread after a last checkpoint
+void checkpointer_stop(checkpointer *cp);
+
+#endif
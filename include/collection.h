@@ -0,0 +1,62 @@
+/**
+* Sketch collection: many sets, one sketch each, stored back to back in a single slab and built with
+* one shared hash family. Sets are addressed by a dense id in [0, n_sets)
+*/
+
+#ifndef COLLECTION_H
+#define COLLECTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils.h>
+#include <estimate.h>
+
+typedef struct sketch_collection {
+	uint64_t n_sets;
+	uint64_t size;           /// slots of each sketch
+	uint64_t stride;         /// slots between two consecutive sketches, size rounded up to a cache line
+	uint32_t hash_type;
+	void *hash_functions;    /// shared by every set
+	sketch_t *slab;          /// n_sets * stride slots
+} sketch_collection;
+
+// allocate a collection of n_sets empty sketches of size slots
+void collection_init(sketch_collection **collection, void *hash_functions, uint64_t size, uint32_t hash_type, uint64_t n_sets);
+void collection_free(sketch_collection *collection);
+
+// sketch of set, size slots
+static inline sketch_t *collection_sketch(const sketch_collection *collection, uint64_t set) {
+	return collection->slab + set * collection->stride;
+}
+
+// insert elem into the sketch of set. collection_insert needs a single writer per set,
+// collection_insert_concurrent updates the slots with CAS and can be called by any thread
+void collection_insert(sketch_collection *collection, uint64_t set, uint64_t elem);
+void collection_insert_concurrent(sketch_collection *collection, uint64_t set, uint64_t elem);
+
+// insert elems[i] into sets[i] for i < n. Pairs are grouped by set first, so that each sketch is
+// loaded once per batch instead of once per element. Single writer per set
+void collection_insert_batch(sketch_collection *collection, const uint64_t *sets, const uint64_t *elems, size_t n);
+
+// insert an element already hashed by the caller (see fanout.h), single writer per set
+void collection_insert_values(sketch_collection *collection, uint64_t set, const sketch_t *values);
+
+/** Target of a fan-out insertion: one set of a collection, updated with CAS */
+typedef struct collection_slot {
+	sketch_collection *collection;
+	uint64_t set;
+} collection_slot;
+
+// values_sink of a collection: ctx is a collection_slot, tid is ignored
+void collection_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+
+// similarity between the sketches of two sets
+float collection_query(const sketch_collection *collection, uint64_t set, uint64_t other_set);
+
+// similarity of other (size slots, same hash family) to every set: out[s] for s < n_sets
+void collection_query_all(const sketch_collection *collection, const sketch_t *other, float *out);
+
+// set size estimates of set and other_set (see estimate.h), read in place from the slab
+void collection_estimate(const sketch_collection *collection, uint64_t set, uint64_t other_set, set_estimates *out);
+
+#endif
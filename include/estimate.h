@@ -0,0 +1,36 @@
+/**
+* Set size estimators on MinHash sketches: distinct count, union, intersection and containment,
+* computed from the same slots the similarity query reads
+*/
+
+#ifndef ESTIMATE_H
+#define ESTIMATE_H
+
+#include <stdint.h>
+#include <utils.h>
+
+/** Estimates for a pair of sets A (the sketch) and B (the other sketch) */
+typedef struct set_estimates {
+	double cardinality;         /// |A|
+	double other_cardinality;   /// |B|
+	double union_size;          /// |A u B|
+	double jaccard;             /// |A n B| / |A u B|, the similarity returned by the queries
+	double intersection;        /// |A n B|
+	double containment;         /// |A n B| / |A|
+	double other_containment;   /// |A n B| / |B|
+} set_estimates;
+
+// modulus M of the hash family: every hash value, and so every slot but an empty one, is in [0, M)
+uint64_t hash_functions_modulus(void *hash_functions, uint32_t hash_type);
+
+// number of distinct elements inserted in sketch, 0 for an empty sketch
+double estimate_cardinality(const sketch_t *sketch, uint64_t size, uint64_t M);
+
+// number of distinct elements of the union of the two sets, from their slot-wise minimum computed on the fly
+double estimate_union(const sketch_t *sketch, const sketch_t *otherSketch, uint64_t size, uint64_t M);
+
+// all the estimates of the pair in a single pass over the two sketches.
+// otherSketch may be NULL: only cardinality is estimated and every other field is 0
+void estimate_sets(const sketch_t *sketch, const sketch_t *otherSketch, uint64_t size, uint64_t M, set_estimates *out);
+
+#endif
@@ -0,0 +1,47 @@
+/**
+* Fan-out insertion: an element is hashed once into a hash vector, which is then applied as a
+* min-update to several targets of any engine. Every target must be built with the same hash
+* family and sketch size as the vector
+*/
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils.h>
+
+/** Apply the hash vector of an element (size slots) to the target ctx, tid is the calling writer.
+ *  Each engine provides one (see minhash.h), e.g. fcds_values_sink with an array of fcds_writer */
+typedef void (*values_sink)(void *ctx, uint32_t tid, const sketch_t *values);
+
+typedef struct fanout_target {
+	values_sink sink;
+	void *ctx;
+} fanout_target;
+
+/** Hash values of the last element, owned by one thread and reused across elements */
+typedef struct hash_vector {
+	uint64_t size;
+	uint32_t hash_type;
+	void *hash_functions;
+	uint64_t elem;      /// element the values belong to
+	sketch_t *values;   /// values[i] = h_i(elem)
+} hash_vector;
+
+void hash_vector_init(hash_vector *vector, void *hash_functions, uint32_t hash_type, uint64_t size);
+void hash_vector_free(hash_vector *vector);
+
+// hash elem with every function of the family, the result stays in vector->values until the next call
+const sketch_t *hash_vector_compute(hash_vector *vector, uint64_t elem);
+
+// weighted keys of elem (see weighted.h), kept in vector->values like the hash values
+const sketch_t *hash_vector_compute_weighted(hash_vector *vector, uint64_t elem, double weight);
+
+// hash elem once and apply its values to the n_targets targets
+void fanout_insert(hash_vector *vector, const fanout_target *targets, uint32_t n_targets, uint32_t tid, uint64_t elem);
+// weighted insertion into targets of any engine, which must hold weighted insertions only
+void fanout_insert_weighted(hash_vector *vector, const fanout_target *targets, uint32_t n_targets, uint32_t tid, uint64_t elem, double weight);
+void fanout_insert_batch(hash_vector *vector, const fanout_target *targets, uint32_t n_targets, uint32_t tid, const uint64_t *elems, size_t n);
+
+#endif
@@ -12,17 +12,51 @@ typedef struct pairwise_hash { ///TODO change struct name to allow different has
 } pairwise_hash;
 
 
+/** Mersenne prime 2^31 - 1, the default modulus: x mod M can be computed with shifts and adds */
+#define MERSENNE_31 0x7FFFFFFFULL
+
+/** One step of lazy reduction modulo MERSENNE_31: the result is congruent to x and below 2^33 + 2^31 */
+static inline uint64_t mersenne_fold(uint64_t x) {
+	return (x & MERSENNE_31) + (x >> 31);
+}
+
 typedef struct kwise_hash {
 	uint32_t k; /// polynomial degree
 	uint64_t M; /// modulus
-	uint32_t *coefficients; /// array of coefficients
+	uint32_t *coefficients; /// array of coefficients, coefficient j is coefficients[j * stride]
+	uint64_t stride; /// distance between consecutive coefficients, the table is degree-major across slots
 	uint64_t (*hash_function) (struct kwise_hash *self, uint64_t x);
 } kwise_hash;
 
 
+/** Tabulation hashing: the 64-bit key is split in TAB_CHARS chars of 8 bits, each indexing a table of random words.
+ *  The tables of all slots are interleaved, [char][byte value][slot], so that for a given key
+ *  each char selects a row that is contiguous across slots: one key reads TAB_CHARS rows of the
+ *  table sequentially, XORed with vector loads.
+ *  Every slot has its own tables, TAB_CHARS * TAB_ENTRIES * 4 bytes = 8KB, so the whole table is
+ *  8MB at 1024 slots: it is not L1/L2 resident, the layout only makes the rows of a key streamed */
+#define TAB_CHARS 8
+#define TAB_ENTRIES 256
+
+typedef struct tabulation_hash {
+	uint64_t M; /// modulus, hash values are mapped into [0, M)
+	uint64_t stride; /// number of interleaved slots, entry (c, v) of this slot is at [(c * TAB_ENTRIES + v) * stride]
+	uint32_t *table; /// 32-bit random words of all chars (simple) or of the last char only (twisted)
+	uint64_t *twisted_table; /// twisted tabulation, all chars but the last: the high 32 bits are the hash, the low 8 bits twist the last char
+	uint64_t (*hash_function) (struct tabulation_hash *self, uint64_t x);
+} tabulation_hash;
+
+/** Map a uniform 32-bit value into [0, M) with a multiplication instead of a division */
+static inline uint64_t tabulation_range(uint32_t h, uint64_t M) {
+	return ((uint64_t) h * M) >> 32;
+}
+
+
 extern pairwise_hash *p_hash_funcs;
 extern kwise_hash *k_hash_funcs;
 uint64_t pairwise_func(pairwise_hash *self, uint64_t x);
 uint64_t kwise_func(kwise_hash *self, uint64_t x);
+uint64_t tabulation_func(tabulation_hash *self, uint64_t x);
+uint64_t twisted_tabulation_func(tabulation_hash *self, uint64_t x);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,96 @@
+/**
+* Ingestion layer: turn byte buffers into 64-bit keys (shingles) and feed them to a sketch in batches
+*/
+
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <runtime.h>
+
+#define SHINGLE_CHAR 0   // k consecutive bytes
+#define SHINGLE_WORD 1   // k consecutive words, a word is a maximal run of alphanumeric (or non-ASCII) bytes
+
+#define INGEST_BATCH 256     // keys handed to the sink at once
+#define INGEST_MAX_WORDS 64  // largest k for word shingles
+
+/** Receives a batch of keys produced by thread tid. ctx is the engine (or per writer state) the keys go to.
+ *  Each engine provides a sink wrapping its batched insertion, see minhash.h */
+typedef void (*ingest_sink)(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+
+typedef struct ingest_conf {
+	uint32_t mode;     /// SHINGLE_CHAR or SHINGLE_WORD
+	uint32_t k;        /// shingle length, in bytes or words
+	uint64_t seed;     /// seed of the prehash, the same seed gives the same keys
+	ingest_sink sink;  /// where the keys go
+	void *ctx;         /// first argument of sink
+} ingest_conf;
+
+
+/** Formats of a key file */
+#define INGEST_BINARY 0   // native endian uint64_t keys
+#define INGEST_DECIMAL 1  // one unsigned decimal key per line
+#define INGEST_LINES 2    // one key per line, any bytes: the key is the prehash of the line
+
+/** A key file mapped in memory, read-only */
+typedef struct ingest_file {
+	int fd;
+	uint32_t format;      /// INGEST_BINARY, INGEST_DECIMAL or INGEST_LINES
+	const uint8_t *data;  /// mapping of the whole file, NULL if the file is empty
+	size_t len;           /// length of the file in bytes
+} ingest_file;
+
+
+// fast 64-bit hash of a byte string (wyhash construction)
+uint64_t prehash64(const void *data, size_t len, uint64_t seed);
+
+// shingle a document and feed the keys to conf->sink on behalf of thread tid. Returns the number of keys produced
+uint64_t ingest_document(const ingest_conf *conf, uint32_t tid, const void *data, size_t len);
+
+
+// map a key file with sequential and huge page hints
+void ingest_file_open(ingest_file *file, const char *path, uint32_t format);
+void ingest_file_close(ingest_file *file);
+
+// byte range [begin, end) of the file handled by writer tid out of N. Text ranges start and end on line boundaries
+void ingest_file_chunk(const ingest_file *file, uint32_t N, uint32_t tid, size_t *begin, size_t *end);
+
+// feed the keys of the byte range [begin, end) to sink on behalf of thread tid. Returns the number of keys
+uint64_t ingest_file_range(const ingest_file *file, size_t begin, size_t end, ingest_sink sink, void *ctx, uint32_t tid, uint64_t seed);
+
+// feed the whole file with N writer threads, thread tid handling chunk tid. Returns the number of keys
+uint64_t ingest_file_parallel(const ingest_file *file, uint32_t N, ingest_sink sink, void *ctx, uint64_t seed);
+
+// same, with the (pinned) workers of a running pool: worker tid handles chunk tid out of pool->n
+uint64_t ingest_file_pool(const ingest_file *file, worker_pool *pool, ingest_sink sink, void *ctx, uint64_t seed);
+
+
+/** Pipelined ingest: a reader issues io_uring reads of large blocks into a ring of buffers, filled buffers
+ *  go through a lock-free queue to the worker threads, which parse the keys and feed the sink.
+ *  Disk reads, parsing/hashing and sketch updates of different blocks overlap */
+#define PIPELINE_MAX_LINE 4096  // longest text line; each text read overlaps the next block by this much
+
+typedef struct ingest_pipeline_conf {
+	uint32_t format;     /// INGEST_BINARY, INGEST_DECIMAL or INGEST_LINES
+	uint32_t workers;    /// parsing/insert threads, worker w calls the sink with tid w
+	uint32_t buffers;    /// buffers in the ring, bounding the reads in flight
+	size_t block_size;   /// bytes per read, a multiple of 8 so that binary keys never straddle two blocks
+	int use_io_uring;    /// 0 forces the pread fallback, otherwise io_uring is used when the kernel allows it
+	ingest_sink sink;
+	void *ctx;
+	uint64_t seed;       /// prehash seed of INGEST_LINES
+	const cpu_topology *topo;  /// NULL leaves the workers unpinned
+	uint32_t pin_policy;       /// placement of the workers in topo, see runtime.h
+} ingest_pipeline_conf;
+
+typedef struct ingest_pipeline_stats {
+	uint64_t keys;       /// keys fed to the sink
+	uint64_t bytes;      /// bytes read
+	double seconds;      /// end-to-end time, from the first read to the last insertion
+	int io_uring;        /// 1 if the reads went through io_uring, 0 if through pread
+} ingest_pipeline_stats;
+
+void ingest_pipeline(const char *path, const ingest_pipeline_conf *conf, ingest_pipeline_stats *stats);
+
+#endif
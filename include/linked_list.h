@@ -12,7 +12,7 @@
  * */
 union tagged_pointer {
     struct {
-        uint64_t* sketch;               // 64-bit pointer to the sketch
+        sketch_t* sketch;               // 64-bit pointer to the sketch
         int64_t counter;              	// 64-bit counter
     };
     __int128_t packed_value;           // The 128-bit representation for atomics
@@ -28,7 +28,7 @@ typedef struct q_list {
 int atomic_compare_exchange_tagged_ptr( volatile union tagged_pointer* obj, union tagged_pointer* expected,
     union tagged_pointer desired);
 
-union tagged_pointer* alloc_aligned_tagged_pointer(uint64_t* ptr_val, uint64_t counter_val);
+union tagged_pointer* alloc_aligned_tagged_pointer(sketch_t* ptr_val, uint64_t counter_val);
 
 
 void cache_query_sketch(void);
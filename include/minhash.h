@@ -6,7 +6,7 @@
 #include <unistd.h>
 #include <stdint.h>
 #include <stdio.h>
-#if defined(LOCKS) || defined(RW_LOCKS) || defined(FCDS) || defined(CONC_MINHASH)
+#if defined(LOCKS) || defined(RW_LOCKS) || defined(FCDS) || defined(CONC_MINHASH) || defined(FLAT_COMBINING) || defined(SHARDED)
     #include <pthread.h>
 #endif
 #if defined(FCDS)
@@ -17,18 +17,22 @@
 #endif
 #include <hash.h>
 #include <utils.h>
+#include <estimate.h>
+#include <weighted.h>
+#include <watch.h>
 
 
 
-#define INFTY UINT64_MAX
+#define INFTY SKETCH_MAX
 #define IS_EQUAL(x, y) ((x) == (y))
 
 typedef struct minhash_sketch {
 
 	uint64_t size;				/// number of elements of the sketch
-	uint64_t *sketch;			/// ptr to the sketch
+	sketch_t *sketch;			/// ptr to the sketch
 	uint32_t hash_type;			/// type of hash function
 	void *hash_functions;		/// ptr to hash funcs
+	watch_list watches;			/// reference sketches whose similarity is kept by the insertions (see watch.h)
 #ifdef LOCKS
 	pthread_mutex_t lock;	
 #endif
@@ -56,9 +60,35 @@ void minhash_free(minhash_sketch *mh);
 void insert(minhash_sketch *sketch, uint64_t elem);
 float query(minhash_sketch *sketch, minhash_sketch *otherSketch);
 
+/** BATCHED INSERTION, the sinks plug an engine into the ingestion layer (see ingest.h) */
+void insert_batch(minhash_sketch *sketch, const uint64_t *elems, size_t n);
+void minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+
+/** INSERTION OF A HASH VECTOR, the values sinks plug an engine into the fan-out insertion (see fanout.h) */
+void insert_values(minhash_sketch *sketch, const sketch_t *values);
+void minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+
+/** WEIGHTED INSERTION (see weighted.h), the other engines take weighted elements through fanout_insert_weighted */
+void insert_weighted(minhash_sketch *sketch, uint64_t elem, double weight);
+
+/** SET SIZE ESTIMATES, read in place from the sketch the queries read (see estimate.h).
+ *  otherSketch is a plain array built with the same hash functions, or NULL for the cardinality only */
+void estimate_minhash(minhash_sketch *sketch, const sketch_t *otherSketch, set_estimates *out);
+
+/** WATCHED PAIRS (see watch.h): query_watched is O(1). The lock-based insertions keep them too,
+ *  minhash_watch and minhash_unwatch must then not run concurrently with them */
+int minhash_watch(minhash_sketch *sketch, const sketch_t *reference);
+void minhash_unwatch(minhash_sketch *sketch, int id);
+float query_watched(minhash_sketch *sketch, int id);
+
 
 void insert_parallel(minhash_sketch *sketch, uint64_t elem);
 float query_parallel(minhash_sketch *sketch, minhash_sketch *otherSketch);
+void insert_parallel_batch(minhash_sketch *sketch, const uint64_t *elems, size_t n);
+void minhash_parallel_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+void insert_parallel_values(minhash_sketch *sketch, const sketch_t *values);
+void minhash_parallel_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+void estimate_parallel(minhash_sketch *sketch, const sketch_t *otherSketch, set_estimates *out);
 
 
 
@@ -72,13 +102,13 @@ typedef struct fcds_sketch {
 	uint32_t b;		   // threshold for propagation
 	
 	uint64_t size;
-	uint64_t *global_sketch;   // accessed by query threads in read only fashion, T_N+1 only writer threads
+	sketch_t *global_sketch;   // accessed by query threads in read only fashion, T_N+1 only writer threads
 	
 	// hash functions
 	uint32_t hash_type;
 	void *hash_functions;
 	
-	uint64_t **local_sketches; // position i is a sketch accessed by T_i and T_N+1 only
+	sketch_t **local_sketches; // position i is a sketch accessed by T_i and T_N+1 only
 	_Atomic uint32_t *prop;    // synchronize access to local_sketches: array of N atomic variables. TODO: check actual data type, it takes boolean values only
 
 	// TODO CHECK
@@ -88,6 +118,11 @@ typedef struct fcds_sketch {
         // The *data* it points to will be 16-byte aligned.
         _Atomic(union tagged_pointer*) sketch_list;  // use for double collect mechanism. TODO: check how it works since we have a single writers who writes multiple locations
 
+	// NUMA placement (see numa_alloc.h). With a single node the arrays hold the shared hash_functions and global_sketch
+	int nodes;
+	void **node_hash_functions;       // read-only copy of the hash tables for each node
+	sketch_t **node_global_sketches;  // copy of global_sketch for each node, refreshed by the propagator after a merge
+	int *writer_node;                 // node local_sketches[i] is placed on, moved by fcds_writer_bind
 
 } fcds_sketch;
 
@@ -98,11 +133,30 @@ void init_empty_sketch_fcds(fcds_sketch *sketch);
 void init_values_fcds(fcds_sketch *sketch, uint64_t size);
 void free_fcds(fcds_sketch *sketch);
 
-void insert_fcds(uint64_t *local_sketch, void *hash_functions, uint32_t hash_type, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, uint64_t elem);
+// called by writer tid once pinned: moves its local sketch to the node it runs on
+void fcds_writer_bind(fcds_sketch *sketch, uint32_t tid);
+// hash functions writer tid reads, placed on the node of its local sketch
+void *fcds_writer_hash_functions(fcds_sketch *sketch, uint32_t tid);
+
+void insert_fcds(sketch_t *local_sketch, void *hash_functions, uint32_t hash_type, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, uint64_t elem);
 void *propagator(fcds_sketch *arg);
 
-uint64_t *get_global_sketch(fcds_sketch *sketch);
-float query_fcds(fcds_sketch *sketch,  uint64_t *otherSketch);
+/** State of a writer thread for the batched insertion: the sink takes an array of N writers indexed by tid */
+typedef struct fcds_writer {
+	fcds_sketch *sketch;
+	uint32_t insertion_counter;  // successful insertions since the last propagation, as in insert_fcds
+} __attribute__((aligned(64))) fcds_writer;
+
+void insert_fcds_batch(sketch_t *local_sketch, void *hash_functions, uint32_t hash_type, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, const uint64_t *elems, size_t n);
+void fcds_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+void insert_fcds_values(sketch_t *local_sketch, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, const sketch_t *values);
+void fcds_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+
+sketch_t *get_global_sketch(fcds_sketch *sketch);
+// checkpoint_source of the FCDS sketch (see checkpoint.h): ctx is the fcds_sketch
+void fcds_snapshot_source(void *ctx, sketch_t *out);
+float query_fcds(fcds_sketch *sketch,  sketch_t *otherSketch);
+void estimate_fcds(fcds_sketch *sketch, const sketch_t *otherSketch, set_estimates *out);
 
 
 //removed _Atomic as return type, warning says it is not meaningful it just must be declared as atomic
@@ -112,8 +166,118 @@ void garbage_collector_list(fcds_sketch *sketch);
 
 #endif
 
+#ifdef FLAT_COMBINING
+
+/** FLAT COMBINING */
+
+/** Publication slot of a writer thread. Each slot sits on its own cache line so that
+ *  writers spinning on their own request do not interfere with each other */
+typedef struct fc_request {
+	_Atomic uint32_t pending;   // 1 while the request waits for a combiner, reset to 0 once applied
+	uint64_t elem;              // element to be inserted
+	const sketch_t *values;     // or, when not NULL, hash vector of an element hashed by the writer (see fanout.h)
+} __attribute__((aligned(64))) fc_request;
+
+typedef struct fc_minhash {
+	uint32_t N;		   // number of writing threads (one publication slot each)
+
+	uint64_t size;     // size of the sketch
+	sketch_t *sketch;  // the only sketch, written by the combiner and read by query threads
+
+	// hash functions
+	uint32_t hash_type;
+	void *hash_functions;
+
+	fc_request *requests;           // array of N publication slots
+	_Atomic uint32_t combiner_lock; // held by the thread which is currently combining
+
+	// combiner private scratch memory, only accessed while holding combiner_lock
+	sketch_t *batch_min;   // per slot minimum of the batch being combined
+	uint64_t *batch;       // elements collected from the publication slots
+	const sketch_t **batch_values;  // hash vectors collected from the publication slots
+	uint32_t *served;      // publication slots collected in the batch
+
+} fc_minhash;
+
+
+/** INIT AND CLEAR OPERATIONS */
+void init_fc_minhash(fc_minhash **sketch, void *hash_functions, uint64_t sketch_size, int init_size, uint32_t hash_type, uint32_t N);
+void init_values_fc_minhash(fc_minhash *sketch, uint64_t size);
+void free_fc_minhash(fc_minhash *sketch);
+
+/* SKETCH OPERATIONS */
+void insert_fc_minhash(fc_minhash *sketch, uint32_t tid, uint64_t elem);
+void fc_combine(fc_minhash *sketch);
+void insert_fc_minhash_batch(fc_minhash *sketch, uint32_t tid, const uint64_t *elems, size_t n);
+void fc_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+void insert_fc_minhash_values(fc_minhash *sketch, uint32_t tid, const sketch_t *values);
+void fc_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+float query_fc_minhash(fc_minhash *sketch, sketch_t *otherSketch);
+void estimate_fc_minhash(fc_minhash *sketch, const sketch_t *otherSketch, set_estimates *out);
+
+#endif
+
+#ifdef SHARDED
+
+/** PER-CORE SHARDED SKETCH */
+
+/** Version counter of a shard, on its own cache line. It is written only by the owner of the shard
+ *  and incremented each time an insertion changes at least one slot of the shard */
+typedef struct shard_version {
+	_Atomic uint64_t version;
+} __attribute__((aligned(64))) shard_version;
+
+typedef struct sharded_minhash {
+	uint32_t N;		   // number of shards, one per writing thread
+
+	uint64_t size;     // size of the sketch
+
+	// hash functions
+	uint32_t hash_type;
+	void *hash_functions;
+
+	sketch_t **shards;        // shards[i] is written by T_i only, with plain stores
+	shard_version *versions;  // versions[i] is the version of shards[i]
+
+	/** Merged view of the shards, cached for queries. It is rebuilt lazily when the
+	 *  shard versions changed since the last merge. seq is odd while a rebuild is in progress */
+	sketch_t *merged;
+	_Atomic uint64_t merged_stamp;  // sum of the shard versions the merged view was built from
+	_Atomic uint64_t seq;           // sequence counter protecting merged
+	_Atomic uint32_t merge_lock;    // held by the query thread which rebuilds the merged view
+
+} sharded_minhash;
+
+
+/** INIT AND CLEAR OPERATIONS */
+void init_sharded_minhash(sharded_minhash **sketch, void *hash_functions, uint64_t sketch_size, int init_size, uint32_t hash_type, uint32_t N);
+void init_values_sharded_minhash(sharded_minhash *sketch, uint64_t size);
+void free_sharded_minhash(sharded_minhash *sketch);
+
+/* SKETCH OPERATIONS */
+void insert_sharded_minhash(sharded_minhash *sketch, uint32_t shard, uint64_t elem);
+void insert_sharded_minhash_batch(sharded_minhash *sketch, uint32_t shard, const uint64_t *elems, size_t n);
+void sharded_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+void insert_sharded_minhash_values(sharded_minhash *sketch, uint32_t shard, const sketch_t *values);
+void sharded_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+uint64_t sharded_stamp(sharded_minhash *sketch);
+void sharded_snapshot(sharded_minhash *sketch, sketch_t *out);
+// checkpoint_source of the sharded sketch (see checkpoint.h): ctx is the sharded_minhash
+void sharded_snapshot_source(void *ctx, sketch_t *out);
+float query_sharded_minhash(sharded_minhash *sketch, sketch_t *otherSketch);
+void estimate_sharded_minhash(sharded_minhash *sketch, const sketch_t *otherSketch, set_estimates *out);
+
+#endif
+
 #ifdef CONC_MINHASH
 
+/** Copy of the query sketch on one NUMA node: two buffers, a merge rewrites the unpublished one and swaps them */
+typedef struct node_query {
+	_Atomic(sketch_t *) sketch;   // the published buffer
+	sketch_t *buffers[2];
+	_Atomic uint64_t version;     // odd while a merge rewrites a buffer, readers of a stale buffer retry
+} node_query;
+
 typedef struct conc_minhash {
 
     uint32_t N;		   // number of writing threads
@@ -136,13 +300,19 @@ typedef struct conc_minhash {
 	_Atomic uint64_t reclaiming; // flag to advise that reclamation is in progress
     _Atomic(struct q_list *) head;  // doubly linked list for query sketches
 
+	// NUMA placement (see numa_alloc.h), used when there is more than one node
+	int nodes;
+	void **node_hash_functions;                 // read-only copy of the hash tables for each node
+	node_query *node_queries;                   // copy of the query sketch for each node, rewritten by every merge
+
+	watch_list watches;  // reference sketches compared with the query sketch, adjusted by every merge (see watch.h)
 
 } conc_minhash;
 
 
 /** INIT AND CLEAR OPERATIONS */
 void init_conc_minhash(conc_minhash **sketch, void *hash_functions, uint64_t sketch_size, int init_size, uint32_t hash_type, uint32_t N, uint32_t b);
-void init_empty_sketch_conc_minhash(uint64_t *sketch, uint64_t size);
+void init_empty_sketch_conc_minhash(sketch_t *sketch, uint64_t size);
 void init_values_conc_minhash(conc_minhash *sketch, uint64_t size);
 void free_conc_minhash(conc_minhash *sketch);
 
@@ -152,12 +322,176 @@ union tagged_pointer *FetchAndInc128(_Atomic (union tagged_pointer *) *ins_sketc
 /* SKETCH OPERATIONS */
 void insert_conc_minhash_0(conc_minhash *sketch, uint64_t val);
 void insert_conc_minhash(conc_minhash *sketch, uint64_t val);
+void insert_conc_minhash_batch(conc_minhash *sketch, const uint64_t *elems, size_t n);
+void conc_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+void insert_conc_minhash_values(conc_minhash *sketch, const sketch_t *values);
+void conc_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
 void concurrent_merge_0(conc_minhash *sketch);
 void concurrent_merge(conc_minhash *sketch);
-float concurrent_query(conc_minhash *sketch, uint64_t *otherSketch);
-void concurrent_basic_insert(uint64_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem);
+float concurrent_query(conc_minhash *sketch, sketch_t *otherSketch);
+// the query sketch as read by the caller's node: read the values, then start again while conc_query_retry(sketch, version)
+const sketch_t *conc_query_values(conc_minhash *sketch, uint64_t *version);
+int conc_query_retry(conc_minhash *sketch, uint64_t version);
+void concurrent_estimate(conc_minhash *sketch, const sketch_t *otherSketch, set_estimates *out);
+
+/** SNAPSHOT: copy of the freshest state into out, the slot-wise minimum of the query and the insert
+ *  sketch, taken without stopping or waiting for the writers: the insertions in flight are in it in
+ *  part or not at all. Returns 1. Only as a last resort, when SNAPSHOT_RETRIES collects all overlapped
+ *  a merge, returns 0 with the query sketch in out, the state of the last merge */
+#define SNAPSHOT_RETRIES 8
+int conc_minhash_snapshot(conc_minhash *sketch, sketch_t *out);
+// checkpoint_source of conc_minhash (see checkpoint.h): ctx is the conc_minhash
+void conc_minhash_snapshot_source(void *ctx, sketch_t *out);
+
+/** WATCHED PAIRS: the similarity of the query sketch to a reference in O(1), as concurrent_query would
+ *  return it. conc_minhash_watch and conc_minhash_unwatch must not run concurrently with a merge */
+int conc_minhash_watch(conc_minhash *sketch, const sketch_t *reference);
+void conc_minhash_unwatch(conc_minhash *sketch, int id);
+float concurrent_query_watched(conc_minhash *sketch, int id);
+void concurrent_basic_insert(sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem);
 void sketch_values_update(conc_minhash *sketch);
 
+
+/** SLIDING WINDOW */
+
+/** Window of the last W buckets of a stream, each bucket a conc_minhash taking the insertions of one
+ *  time interval. Closed buckets are aggregated with two stacks: the front holds suffix minima, rebuilt
+ *  from the closed buckets when its last bucket expires, the back the minimum of the buckets closed
+ *  since. Each rotation costs O(1) merges amortized, instead of a merge of the whole window */
+typedef struct window_minhash {
+
+	uint32_t W;                 // buckets in the window, the open one included
+	uint64_t width;             // duration of a bucket, in the unit of the times passed to window_advance
+	uint64_t start;             // time the open bucket started at
+
+	uint64_t size;
+	uint32_t hash_type;
+	void *hash_functions;
+	uint32_t N, b;              // writers and threshold of the conc_minhash of each bucket
+
+	conc_minhash **buckets;     // ring: bucket i of the stream is buckets[i % W]
+	_Atomic uint64_t current;   // index of the open bucket, taking the insertions
+	_Atomic uint64_t *writers;  // writers[i % W]: writers inside an insertion into bucket i, drained before it is merged
+	conc_minhash *retired;      // bucket expired by the last rotation, freed by the next one
+
+	// closed buckets current - W + 1 .. current - 1: front_begin .. front_end, then the back
+	sketch_t **suffix;          // suffix[i % W]: minimum of the front buckets i .. front_end
+	uint64_t front_begin, front_end;  // the front is empty when front_begin > front_end
+	sketch_t *back;             // minimum of the closed buckets after front_end
+	sketch_t *closed;           // minimum of every closed bucket of the window, read by the queries
+	_Atomic uint64_t seq;       // sequence counter protecting closed, odd while a rotation rewrites it
+
+} window_minhash;
+
+void init_window_minhash(window_minhash **window, void *hash_functions, uint64_t sketch_size, uint32_t hash_type, uint32_t N, uint32_t b, uint32_t W, uint64_t width, uint64_t now);
+void free_window_minhash(window_minhash *window);
+
+// insertion into the open bucket, by any writer
+void insert_window_minhash(window_minhash *window, uint64_t elem);
+void insert_window_minhash_batch(window_minhash *window, const uint64_t *elems, size_t n);
+void window_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+
+// close the open bucket and open a new one, expiring the oldest, once the writers of the closed one are done. Called by a single thread
+void window_rotate(window_minhash *window);
+// rotate once per bucket elapsed until now, at most W times. Called by a single thread
+void window_advance(window_minhash *window, uint64_t now);
+
+// minimum of the closed buckets and of the query sketch of the open one, merged when read
+void window_snapshot(window_minhash *window, sketch_t *out);
+float query_window_minhash(window_minhash *window, sketch_t *otherSketch);
+
+
+/** SHARED MEMORY SKETCH */
+
+/** conc_minhash in a POSIX shared memory segment, inserted into and queried by several processes.
+ *  The segment holds the header, SHM_RECORDS version records, their sketches and the image of the hash
+ *  functions, and it refers to them by offsets, so that each process may map it at its own address.
+ *  The tagged pointers of conc_minhash become tagged words of the records, with the sketch pointer
+ *  replaced by a generation bumped each time a retired record is recycled: the insertion and merge
+ *  protocol is the same, with the 128-bit CAS on the words shared by the processes.
+ *
+ *  The pending counts are not in the words but in the slot of each attached process, so that the
+ *  insertions of a process killed in the middle can be told apart: a merge waiting for them checks
+ *  whether the process is alive (kill(pid, 0), zombies count as dead), drops its counts and goes on.
+ *  The insertion it was doing may be applied in part. The merges are serialized by the pid of the
+ *  merging process in the header: the writers waiting for a merge check it the same way, and one of
+ *  them takes over the merge of a dead merger and restarts it. A pid reused meanwhile keeps the slot
+ *  or the merge alive */
+#define SHM_MAGIC 0x314D53484E494D4DULL  // "MMINHSM1"
+#define SHM_VERSION 3
+#define SHM_RECORDS 4   // the query record, the insert one and the retired ones, recycled round robin
+#define SHM_PROCS 64    // processes attached at once
+
+union shm_tagged {
+    struct {
+        uint64_t generation;       // of the record, the pointer of union tagged_pointer
+        int64_t counter;           // insert_cnt of conc_minhash, the pending counts are in shm_proc
+    };
+    __int128_t packed_value;
+} __attribute__((aligned(16)));
+
+typedef struct shm_record {
+    union shm_tagged word;
+    uint64_t sketch;               // offset of the slots of the record in the segment
+} __attribute__((aligned(64))) shm_record;
+
+/** Slot of an attached process: its insertions in progress on each record */
+typedef struct shm_proc {
+    _Atomic int32_t pid;                     // 0 when free, -1 while the slot of a dead process is reclaimed
+    _Atomic uint32_t pending[SHM_RECORDS];
+} __attribute__((aligned(64))) shm_proc;
+
+/** Header at offset 0 of the segment */
+typedef struct shm_segment {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_bytes;           // sizeof(sketch_t) of the creator
+    uint64_t bytes;                // size of the segment
+    uint64_t size;
+    uint32_t hash_type;
+    uint32_t N;                    // writing threads of every process together
+    uint32_t b;
+    uint64_t hash_image;           // offset of the image of the hash functions (see numa_alloc.h)
+    uint64_t records;              // offset of the SHM_RECORDS records
+    _Atomic uint64_t sketches[2];  // offsets of the query and of the insert record
+    _Atomic uint64_t merges;       // completed merges
+    _Atomic int32_t merger;        // pid of the process merging, 0 when none
+    _Atomic uint32_t ready;        // set once the creator initialized the segment
+    _Atomic uint32_t attached;     // processes attached to the segment, the dead ones until their slot is reclaimed
+    shm_proc procs[SHM_PROCS];
+} __attribute__((aligned(64))) shm_segment;
+
+/** Handle of one process on the segment */
+typedef struct shm_minhash {
+    shm_segment *segment;          // mapping of the segment in this process
+    shm_proc *proc;                // slot of this process in the segment
+    void *hash_functions;          // imported from the segment, private to this process
+    uint64_t size;
+    uint32_t hash_type;
+    uint32_t N;
+    uint32_t b;
+} shm_minhash;
+
+// create the segment name (e.g. "/minhash") with an empty sketch, and attach to it. Exits if it exists
+void create_shm_minhash(shm_minhash **sketch, const char *name, void *hash_functions, uint64_t sketch_size, uint32_t hash_type, uint32_t N, uint32_t b);
+// attach to the segment created by another process, waiting until it is initialized. A forked child attaches
+// itself instead of using the handle of its parent, whose slot it would share
+void attach_shm_minhash(shm_minhash **sketch, const char *name);
+void detach_shm_minhash(shm_minhash *sketch);
+// remove the name of the segment, which is freed once every process detached
+void unlink_shm_minhash(const char *name);
+
+void insert_shm_minhash(shm_minhash *sketch, uint64_t elem);
+void insert_shm_minhash_batch(shm_minhash *sketch, const uint64_t *elems, size_t n);
+void shm_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n);
+void insert_shm_minhash_values(shm_minhash *sketch, const sketch_t *values);
+void shm_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values);
+
+float query_shm_minhash(shm_minhash *sketch, sketch_t *otherSketch);
+// as conc_minhash_snapshot: the insertions since the last merge included, 0 when out holds the query sketch
+int shm_minhash_snapshot(shm_minhash *sketch, sketch_t *out);
+void shm_minhash_snapshot_source(void *ctx, sketch_t *out);
+
 #endif
 
 
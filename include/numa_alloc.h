@@ -0,0 +1,38 @@
+/**
+* NUMA placement: allocation on a given node and lookup of the node a thread runs on.
+* With the NUMA build option the functions go through libnuma, otherwise the machine is a single
+* node and they fall back to malloc/free.
+*/
+
+#ifndef NUMA_ALLOC_H
+#define NUMA_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// number of nodes memory can be placed on, 1 without NUMA support
+int node_count(void);
+
+// node of the CPU the calling thread is running on, stable once the thread is pinned
+int current_node(void);
+
+// allocate size bytes backed by memory of node. Exits on failure
+void *node_alloc(size_t size, int node);
+
+// free memory returned by node_alloc, size must be the allocated size
+void node_free(void *ptr, size_t size);
+
+// copy of hash_functions (as returned by hash_functions_init) and of their tables, placed on node
+void *hash_functions_replicate(void *hash_functions, uint64_t hf_id, uint64_t size, int node);
+
+// free a replica returned by hash_functions_replicate
+void hash_functions_replica_free(void *replica, uint64_t hf_id, uint64_t size);
+
+// bytes of the image of hash_functions: the replica layout, with the tables after the array of hash functions
+size_t hash_functions_image_bytes(void *hash_functions, uint64_t hf_id, uint64_t size);
+// write the image of hash_functions at image, e.g. into a shared memory segment
+void hash_functions_export(void *hash_functions, uint64_t hf_id, uint64_t size, void *image);
+// hash functions of the calling process reading the tables of image in place, freed with free()
+void *hash_functions_import(void *image, uint64_t hf_id, uint64_t size);
+
+#endif
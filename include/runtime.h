@@ -0,0 +1,86 @@
+/**
+* Thread runtime: CPU topology discovered from sysfs, pinning policies and a reusable pool of
+* pinned worker threads, shared by the engines and the benchmark drivers
+*/
+
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+/** Pinning policies: thread i of a group is placed on */
+#define PIN_NONE 0      // any CPU, the scheduler decides
+#define PIN_COMPACT 1   // the i-th CPU filling cores (SMT siblings first), then packages, then nodes
+#define PIN_SCATTER 2   // round robin across packages, one thread per physical core before using siblings
+#define PIN_PHYSICAL 3  // one thread per physical core in compact order, siblings only when the cores are exhausted
+#define PIN_NODE 4      // any CPU of the (i mod nodes)-th NUMA node
+
+typedef struct cpu_info {
+	int cpu;      /// logical CPU id
+	int core;     /// physical core, dense index over the whole machine
+	int package;  /// socket (physical_package_id)
+	int node;     /// NUMA node, 0 without NUMA
+	int smt;      /// index of the CPU among the SMT siblings of its core
+} cpu_info;
+
+typedef struct cpu_topology {
+	uint32_t n_cpus;     /// CPUs the process is allowed to run on
+	uint32_t n_cores;
+	uint32_t n_packages;
+	uint32_t n_nodes;
+	cpu_info *cpus;
+	uint32_t *compact;   /// order of the CPUs (indexes in cpus) for PIN_COMPACT
+	uint32_t *scatter;   /// order for PIN_SCATTER
+	uint32_t *physical;  /// order for PIN_PHYSICAL
+	int *nodes;          /// node ids, n_nodes of them
+} cpu_topology;
+
+// read the topology of the allowed CPUs from /sys/devices/system/cpu
+void topology_discover(cpu_topology *topo);
+void topology_free(cpu_topology *topo);
+void topology_print(const cpu_topology *topo);
+
+// "none", "compact", "scatter", "physical" or "node". Exits on anything else
+uint32_t parse_pin_policy(const char *arg);
+const char *pin_policy_name(uint32_t policy);
+
+// logical CPU of thread i under policy, -1 for PIN_NONE and PIN_NODE
+int topology_cpu(const cpu_topology *topo, uint32_t policy, uint32_t i);
+
+// pin the calling thread as thread i of policy. Returns 0 on success
+int topology_pin(const cpu_topology *topo, uint32_t policy, uint32_t i);
+
+
+/** Task run by every worker of a pool, tid is the index of the worker */
+typedef void (*pool_task)(void *arg, uint32_t tid);
+
+typedef struct worker_pool {
+	uint32_t n;
+	pthread_t *threads;
+	struct pool_worker *workers;
+	const cpu_topology *topo;  /// NULL or policy PIN_NONE: workers are not pinned
+	uint32_t policy;
+	pthread_barrier_t start;   /// workers and caller: a task is published
+	pthread_barrier_t done;    /// workers and caller: the task is finished
+	pthread_barrier_t barrier; /// workers only, see worker_pool_barrier
+	pool_task task;
+	void *arg;
+	int stop;
+} worker_pool;
+
+// start n > 0 workers, worker w pinned as thread w of policy
+void worker_pool_start(worker_pool *pool, uint32_t n, const cpu_topology *topo, uint32_t policy);
+
+// run task on every worker; submit returns at once, wait returns when every worker is done
+void worker_pool_submit(worker_pool *pool, pool_task task, void *arg);
+void worker_pool_wait(worker_pool *pool);
+void worker_pool_run(worker_pool *pool, pool_task task, void *arg);
+
+// called inside a task: wait until every worker reaches the barrier
+void worker_pool_barrier(worker_pool *pool);
+
+// join the workers, the pool can be started again
+void worker_pool_stop(worker_pool *pool);
+
+#endif
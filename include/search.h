@@ -0,0 +1,42 @@
+/**
+* Exact similarity search over a sketch collection (see collection.h), under the IS_EQUAL semantics of the
+* queries: the k sets whose sketches have the most slots equal to a query sketch, and the join of every
+* pair of sets above a similarity threshold
+*/
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils.h>
+#include <collection.h>
+#include <runtime.h>
+
+// slots compared between two checks of the early abandoning
+#define SEARCH_BLOCK 128
+// bytes of sketches in a tile of the join: two tiles are compared against each other while they stay in L2
+#define JOIN_TILE_BYTES (256 * 1024)
+
+typedef struct search_hit {
+	uint64_t set;
+	uint64_t equal;      /// slots equal to the query
+	float similarity;    /// equal / size, what collection_query returns
+} search_hit;
+
+// k most similar sets to query (size slots, same hash family), best first, ties broken by the lower set id.
+// out holds k hits; returns the number of hits, min(k, n_sets)
+size_t collection_top_k(const sketch_collection *collection, const sketch_t *query, size_t k, search_hit *out);
+
+// same result, the sets partitioned among the workers of pool
+size_t collection_top_k_parallel(const sketch_collection *collection, const sketch_t *query, size_t k, search_hit *out, worker_pool *pool);
+
+
+/** Receives a pair of the join, set < other_set, from worker tid. Workers call it concurrently */
+typedef void (*join_sink)(void *ctx, uint32_t tid, uint64_t set, uint64_t other_set, float similarity);
+
+// every pair of sets with similarity >= threshold, streamed to sink as the tiles are compared.
+// pool may be NULL: the caller compares every tile as worker 0. Returns the number of pairs
+uint64_t collection_join(const sketch_collection *collection, float threshold, join_sink sink, void *ctx, worker_pool *pool);
+
+#endif
@@ -34,7 +34,7 @@ typedef struct sketch_record {
     union tagged_pointer *next;
 
     // min hash sketch:
-    uint64_t *sketch;
+    sketch_t *sketch;
 
 } sketch_record;
 
@@ -57,10 +57,10 @@ typedef struct sketch_record {
 
 
 
-// Helper to allocate a 16-byte aligned tagged_pointer on the heap
+// Helper to allocate a 16-byte aligned tagged_pointer from the arena, freed by arena_free
 union tagged_pointer* alloc_aligned_tagged_pointer(struct sketch_record* ptr_val, uint64_t counter_val);
-// Helper to allocate a sketch_record
-sketch_record* alloc_sketch_record(uint64_t *sketch);
+// Helper to allocate a sketch_record from the arena, freed by arena_free
+sketch_record* alloc_sketch_record(sketch_t *sketch);
 
 
 
@@ -90,8 +90,8 @@ int atomic_compare_exchange_tagged_pointer_ptr(
     
 
 // TODO methods for managing list
-void create_and_push_new_node(_Atomic(union tagged_pointer*) *head_sl, uint64_t *version_sketch, uint64_t size);
-void delete_node(sketch_record *prev);
+void create_and_push_new_node(_Atomic(union tagged_pointer*) *head_sl, sketch_t *version_sketch, uint64_t size);
+void delete_node(sketch_record *prev, uint64_t size);  // size of the sketch of the deleted record
 
 
 
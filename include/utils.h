@@ -8,20 +8,43 @@
 #include <stdlib.h>
 #include <hash.h>
 
-#if defined(FCDS) || defined(CONC_MINHASH)
+/** Width of a sketch slot. Hash values are reduced modulo a 32-bit prime (see hash_functions_init),
+ *  so they always fit in 32 bits with UINT32_MAX left free as the empty slot marker.
+ *  SKETCH_32BIT halves the memory and bandwidth of every sketch, the 64-bit layout is the default */
+#ifdef SKETCH_32BIT
+	typedef uint32_t sketch_t;
+	#define SKETCH_MAX UINT32_MAX
+#else
+	typedef uint64_t sketch_t;
+	#define SKETCH_MAX UINT64_MAX
+#endif
+
+#if defined(FCDS) || defined(CONC_MINHASH) || defined(FLAT_COMBINING) || defined(SHARDED)
 	#include <stdatomic.h>
 	typedef __int128_t aligned_int128 __attribute__((aligned(16)));
 
 #endif
 
+// number of slots processed per block by the min-update kernels
+#define MIN_UPDATE_BLOCK 64
+
 // insert the element in the sketch: if elem's hash value is the actual minimum, the function return true, false otherwise
-int basic_insert(uint64_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem);
+int basic_insert(sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem);
+
+// compute the hash values of elem for the slots [first, first + count) of the sketch
+void hash_values(void *hash_functions, uint32_t hash_type, uint64_t first, uint64_t count, uint64_t elem, sketch_t *values);
+
+// slot-wise minimum of values into sketch for a single writer. Returns true if at least one slot changed
+int min_update(sketch_t *sketch, const sketch_t *values, uint64_t size);
+
+// concurrent slot-wise minimum of values into sketch, CAS is issued only on slots where values can win. Returns the number of updated slots
+uint64_t concurrent_min_update(sketch_t *sketch, const sketch_t *values, uint64_t size);
 // Merge other_sketch and sketch. The resulting sketch is written into sketch itself
 
 // Copy the sketch
-uint64_t *copy_sketch(const uint64_t *sketch, uint64_t size);
+sketch_t *copy_sketch(const sketch_t *sketch, uint64_t size);  // allocated with sketch_alloc, freed by sketch_free
 
-int merge(uint64_t *sketch, uint64_t *other_sketch, uint64_t size);
+int merge(sketch_t *sketch, sketch_t *other_sketch, uint64_t size);
 
 
 
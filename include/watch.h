@@ -0,0 +1,46 @@
+/**
+* Watched pairs: a sketch keeps, for each registered reference sketch, the number of its slots equal
+* to the reference. The count is adjusted only on the slots an insertion or a merge changes, so the
+* similarity of a watched pair is read in O(1) instead of comparing the whole sketches.
+*
+* The reference must stay allocated and unchanged while it is watched
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdint.h>
+#include <utils.h>
+
+#define WATCH_MAX 8
+
+typedef struct watched_pair {
+	const sketch_t *reference;   /// NULL for a free entry
+	_Atomic uint64_t equal;      /// slots of the sketch equal to the reference
+} watched_pair;
+
+typedef struct watch_list {
+	uint32_t count;              /// entries in use or freed, the next id
+	watched_pair pairs[WATCH_MAX];
+} watch_list;
+
+void watch_init(watch_list *watches);
+
+// register reference, counting the slots of sketch equal to it. Returns the id of the pair
+int watch_add(watch_list *watches, const sketch_t *reference, const sketch_t *sketch, uint64_t size);
+void watch_remove(watch_list *watches, int id);
+
+// similarity of the pair id, the count over size
+float watch_similarity(const watch_list *watches, int id, uint64_t size);
+
+// min_update of the count slots of sketch starting at first, values[i] being the value of slot first + i,
+// adjusting the counts on the slots it changes. Returns true if at least one slot changed
+int watch_min_update(watch_list *watches, sketch_t *sketch, const sketch_t *values, uint64_t first, uint64_t count);
+
+// watched counterpart of basic_insert
+int watch_insert(watch_list *watches, sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem);
+
+// adjust the counts for sketch old replaced by sketch new, e.g. a query sketch replaced by a merge
+void watch_replace(watch_list *watches, const sketch_t *old, const sketch_t *new, uint64_t size);
+
+#endif
@@ -0,0 +1,31 @@
+/**
+* Weighted MinHash by Improved Consistent Weighted Sampling (Ioffe, 2010).
+*
+* For an element of weight S, slot i draws r, c ~ Gamma(2, 1) and beta ~ U(0, 1) from h_i(elem), and
+* takes t = floor(ln S / r + beta) and ln a = ln c - r (t - beta + 1). The sample of the set minimizing a
+* is the same in two weighted sets with probability equal to their weighted Jaccard similarity
+* sum min(S_A, S_B) / sum max(S_A, S_B). The slot stores ln a mapped to an unsigned key of the same
+* order: the min-update and query kernels, and the engines through their values sinks (see fanout.h),
+* work unchanged on weighted sketches. Equal keys stand for the same sample; with SKETCH_32BIT the key
+* is a float and two samples collide with probability about 2^-24.
+*
+* A sketch must hold weighted insertions only, and the cardinality estimators (estimate.h) do not apply to it
+*/
+
+#ifndef WEIGHTED_H
+#define WEIGHTED_H
+
+#include <stdint.h>
+#include <utils.h>
+
+// weighted keys of elem for the count slots starting at first: values[i] is the key of slot first + i.
+// A weight <= 0 leaves the element out of the set, every key is then INFTY
+void weighted_values(void *hash_functions, uint32_t hash_type, uint64_t first, uint64_t count, uint64_t elem, double weight, sketch_t *values);
+
+// key of a single slot, slot by slot reference of weighted_values
+sketch_t weighted_value(void *hash_functions, uint32_t hash_type, uint64_t slot, uint64_t elem, double weight);
+
+// weighted counterpart of basic_insert. Returns true if at least one slot changed
+int weighted_insert(sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem, double weight);
+
+#endif
@@ -33,6 +33,8 @@ ALGORITHM=1
 PERF_EVENTS="cache-references,cache-misses,L1-dcache-load-misses,LLC-load-misses"
 
 ./compile.sh fcds
+./compile.sh fc
+./compile.sh sharded
 ./compile.sh concurrent
 cd build
 mkdir -p "$OUTPUT_DIR"
@@ -56,6 +58,26 @@ for THREADS in "${THREAD_COUNTS[@]}"; do
                 "${TEST_DIR}/test_fcds_prob" "$NUM_OPS" "$SKETCH_SIZE" "$INITIAL_SIZE" "$THREADS" "$THRESHOLD_INSERTION" "$WP" "$HASH_COEFF" > /dev/null 2>&1
             fi
 
+            # --- FLAT COMBINING TEST ---
+            BASE_FC="fc_prob_ops${NUM_OPS}_size${SKETCH_SIZE}_init${INITIAL_SIZE}_wp${WP}_threads${THREADS}_run${RUN}"
+
+            # Run test and capture program output
+            "${TEST_DIR}/test_fc_prob" "$NUM_OPS" "$SKETCH_SIZE" "$INITIAL_SIZE" "$THREADS" "$WP" "$HASH_COEFF" > "${OUTPUT_DIR}/${BASE_FC}.txt" 2>&1
+
+            # Run again with perf
+            perf stat -x, -e "$PERF_EVENTS" -o "${OUTPUT_DIR}/${BASE_FC}.perf" \
+            "${TEST_DIR}/test_fc_prob" "$NUM_OPS" "$SKETCH_SIZE" "$INITIAL_SIZE" "$THREADS" "$WP" "$HASH_COEFF" > /dev/null 2>&1
+
+            # --- SHARDED TEST ---
+            BASE_SHARDED="sharded_prob_ops${NUM_OPS}_size${SKETCH_SIZE}_init${INITIAL_SIZE}_wp${WP}_threads${THREADS}_run${RUN}"
+
+            # Run test and capture program output
+            "${TEST_DIR}/test_sharded_prob" "$NUM_OPS" "$SKETCH_SIZE" "$INITIAL_SIZE" "$THREADS" "$WP" "$HASH_COEFF" > "${OUTPUT_DIR}/${BASE_SHARDED}.txt" 2>&1
+
+            # Run again with perf
+            perf stat -x, -e "$PERF_EVENTS" -o "${OUTPUT_DIR}/${BASE_SHARDED}.perf" \
+            "${TEST_DIR}/test_sharded_prob" "$NUM_OPS" "$SKETCH_SIZE" "$INITIAL_SIZE" "$THREADS" "$WP" "$HASH_COEFF" > /dev/null 2>&1
+
             # --- CONCURRENT TEST ---
             BASE_CONC="conc_prob_ops${NUM_OPS}_size${SKETCH_SIZE}_init${INITIAL_SIZE}_b${THRESHOLD_INSERTION}_alg${ALGORITHM}_wp${WP}_threads${THREADS}_run${RUN}"
             
@@ -0,0 +1,335 @@
+#include <bottomk.h>
+#include <minhash.h>
+#include <estimate.h>
+#include <arena.h>
+
+
+static inline sketch_t bottomk_hash(const bottomk_sketch *sketch, uint64_t elem) {
+
+	sketch_t h;
+	hash_values(sketch->hash_functions, sketch->hash_type, 0, 1, elem, &h);
+	return h;
+}
+
+/**
+ * Insert h into the ascending array values of count values and capacity k. A full array rejects h
+ * with one comparison; otherwise h is placed by binary search and the largest value falls off.
+ * Returns true if h entered the array, false if it was too large or already held.
+ */
+static int bottomk_add(sketch_t *values, uint64_t *count, uint64_t k, sketch_t h) {
+
+	if (*count == k && h >= values[k - 1])
+		return 0;
+
+	uint64_t lo = 0, hi = *count, mid;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (values[mid] < h)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo < *count && values[lo] == h)
+		return 0;  // same hash value, the element (or a colliding one) is already held
+
+	uint64_t kept = *count < k ? *count : k - 1;
+	memmove(values + lo + 1, values + lo, (kept - lo) * sizeof(sketch_t));
+	values[lo] = h;
+	if (*count < k)
+		(*count)++;
+	return 1;
+}
+
+/** Bottom-k of the union of two ascending arrays, written into out (k values at most). Returns the values written */
+static uint64_t bottomk_merge(const sketch_t *x, uint64_t nx, const sketch_t *y, uint64_t ny, uint64_t k, sketch_t *out) {
+
+	uint64_t i = 0, j = 0, n = 0;
+	while (n < k && (i < nx || j < ny)) {
+		if (j == ny || (i < nx && x[i] < y[j]))
+			out[n++] = x[i++];
+		else if (i == nx || y[j] < x[i])
+			out[n++] = y[j++];
+		else {
+			out[n++] = x[i++];
+			j++;
+		}
+	}
+	return n;
+}
+
+/**
+ * Bottom-k Jaccard estimator. The k smallest values of the union are the k smallest of x and y
+ * together, and one of them belongs to both sets exactly when it is held by both sketches.
+ */
+static float bottomk_jaccard(const sketch_t *x, uint64_t nx, const sketch_t *y, uint64_t ny, uint64_t k) {
+
+	uint64_t i = 0, j = 0, n = 0, common = 0;
+	while (n < k && (i < nx || j < ny)) {
+		if (j == ny || (i < nx && x[i] < y[j]))
+			i++;
+		else if (i == nx || y[j] < x[i])
+			j++;
+		else {
+			common++;
+			i++;
+			j++;
+		}
+		n++;
+	}
+	return n ? common / (float) n : 0;
+}
+
+static double kmv_cardinality(const sketch_t *values, uint64_t count, uint64_t k, uint64_t M) {
+
+	if (count < k)
+		return count;
+	// v_k / M estimates k / (n + 1), the midpoint of the slot as in estimate.c
+	return (k - 1) / ((values[k - 1] + 0.5) / (double) M);
+}
+
+
+static void bottomk_alloc(bottomk_sketch *sketch, void *hash_functions, uint64_t k, uint32_t hash_type) {
+
+	if (k < 2) {
+		fprintf(stderr, "Bottom-k sketch needs k >= 2, got %lu\n", k);
+		exit(1);
+	}
+	sketch->k = k;
+	sketch->count = 0;
+	sketch->values = sketch_alloc(k);
+	sketch->hash_type = hash_type;
+	sketch->hash_functions = hash_functions;
+}
+
+
+void init_bottomk(bottomk_sketch **sketch, void *hash_functions, uint64_t k, int init_size, uint32_t hash_type) {
+
+	*sketch = malloc(sizeof(bottomk_sketch));
+	if (*sketch == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating bottomk_sketch\n");
+		exit(1);
+	}
+	bottomk_alloc(*sketch, hash_functions, k, hash_type);
+
+	if (init_size > 0)
+		init_values_bottomk(*sketch, init_size);
+}
+
+void init_values_bottomk(bottomk_sketch *sketch, uint64_t size) {
+
+	uint64_t i;
+	for (i = 0; i < size; i++)
+		insert_bottomk(sketch, i);
+}
+
+void free_bottomk(bottomk_sketch *sketch) {
+
+	sketch_free(sketch->values, sketch->k);
+	free(sketch);
+}
+
+
+int insert_bottomk(bottomk_sketch *sketch, uint64_t elem) {
+
+	return bottomk_add(sketch->values, &sketch->count, sketch->k, bottomk_hash(sketch, elem));
+}
+
+void insert_bottomk_batch(bottomk_sketch *sketch, const uint64_t *elems, size_t n) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		bottomk_add(sketch->values, &sketch->count, sketch->k, bottomk_hash(sketch, elems[i]));
+}
+
+/** ingest_sink of the bottom-k sketch: ctx is the bottomk_sketch, tid is ignored */
+void bottomk_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+	(void) tid;
+	insert_bottomk_batch((bottomk_sketch *) ctx, keys, n);
+}
+
+
+float query_bottomk(bottomk_sketch *sketch, bottomk_sketch *otherSketch) {
+
+	uint64_t k = sketch->k < otherSketch->k ? sketch->k : otherSketch->k;
+	return bottomk_jaccard(sketch->values, sketch->count, otherSketch->values, otherSketch->count, k);
+}
+
+double bottomk_cardinality(const bottomk_sketch *sketch) {
+
+	return kmv_cardinality(sketch->values, sketch->count, sketch->k, hash_functions_modulus(sketch->hash_functions, sketch->hash_type));
+}
+
+
+/** --- Concurrent bottom-k --- */
+
+void init_conc_bottomk(conc_bottomk **sketch, void *hash_functions, uint64_t k, int init_size, uint32_t hash_type, uint32_t N, uint32_t b) {
+
+	*sketch = malloc(sizeof(conc_bottomk));
+	if (*sketch == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating conc_bottomk\n");
+		exit(1);
+	}
+
+	(*sketch)->N = N;
+	(*sketch)->b = b;
+	(*sketch)->k = k;
+	(*sketch)->hash_type = hash_type;
+	(*sketch)->hash_functions = hash_functions;
+
+	if (posix_memalign((void **) &(*sketch)->writers, _Alignof(bottomk_writer), N * sizeof(bottomk_writer)) != 0) {
+		perror("posix_memalign failed for bottom-k writers");
+		exit(EXIT_FAILURE);
+	}
+	uint32_t t;
+	for (t = 0; t < N; t++) {
+		bottomk_alloc(&(*sketch)->writers[t].local, hash_functions, k, hash_type);
+		(*sketch)->writers[t].accepted = 0;
+	}
+
+	init_bottomk(&(*sketch)->global, hash_functions, k, 0, hash_type);
+	(*sketch)->scratch = sketch_alloc(k);
+
+	__atomic_store_n(&(*sketch)->threshold, INFTY, __ATOMIC_RELAXED);
+	__atomic_store_n(&(*sketch)->seq, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&(*sketch)->merge_lock, 0, __ATOMIC_RELEASE);
+
+	if (init_size > 0) {
+		uint64_t i;
+		for (i = 0; i < (uint64_t) init_size; i++)
+			insert_conc_bottomk(*sketch, 0, i);
+		conc_bottomk_flush(*sketch, 0);
+	}
+}
+
+void free_conc_bottomk(conc_bottomk *sketch) {
+
+	uint32_t t;
+	for (t = 0; t < sketch->N; t++)
+		sketch_free(sketch->writers[t].local.values, sketch->k);
+	free(sketch->writers);
+	free_bottomk(sketch->global);
+	sketch_free(sketch->scratch, sketch->k);
+	free(sketch);
+}
+
+
+/**
+ * Insert an element through the buffer of writer tid.
+ *
+ * Hash values not below the threshold of the shared sketch are dropped without touching the buffer.
+ * The others enter the buffer, which is merged into the shared sketch every b accepted values: the
+ * shared sketch lags the insertions by at most b values per writer, as with conc_minhash.
+ */
+void insert_conc_bottomk(conc_bottomk *sketch, uint32_t tid, uint64_t elem) {
+
+	bottomk_writer *writer = &sketch->writers[tid];
+	sketch_t h = bottomk_hash(&writer->local, elem);
+
+	if (h >= __atomic_load_n(&sketch->threshold, __ATOMIC_RELAXED))
+		return;
+	if (bottomk_add(writer->local.values, &writer->local.count, sketch->k, h) && ++writer->accepted >= sketch->b)
+		conc_bottomk_flush(sketch, tid);
+}
+
+void insert_conc_bottomk_batch(conc_bottomk *sketch, uint32_t tid, const uint64_t *elems, size_t n) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		insert_conc_bottomk(sketch, tid, elems[i]);
+}
+
+/** ingest_sink of the concurrent bottom-k: ctx is the conc_bottomk, tid is the writer */
+void conc_bottomk_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+	insert_conc_bottomk_batch((conc_bottomk *) ctx, tid, keys, n);
+}
+
+
+/**
+ * Merge the buffer of writer tid into the shared sketch.
+ *
+ * Merges are serialized by merge_lock. The union is built in scratch, then published by swapping
+ * it with the values of the shared sketch inside an odd sequence number, so that queries retry
+ * instead of reading a half published sketch. The buffer restarts empty.
+ */
+void conc_bottomk_flush(conc_bottomk *sketch, uint32_t tid) {
+
+	bottomk_writer *writer = &sketch->writers[tid];
+	if (writer->local.count == 0)
+		return;
+
+	uint32_t expected = 0;
+	while (__atomic_load_n(&sketch->merge_lock, __ATOMIC_RELAXED) != 0 ||
+	       !__atomic_compare_exchange_n(&sketch->merge_lock, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		expected = 0;
+
+	bottomk_sketch *global = sketch->global;
+	uint64_t n = bottomk_merge(global->values, global->count, writer->local.values, writer->local.count, sketch->k, sketch->scratch);
+
+	uint64_t s = __atomic_load_n(&sketch->seq, __ATOMIC_RELAXED);
+	__atomic_store_n(&sketch->seq, s + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	sketch_t *old = global->values;
+	global->values = sketch->scratch;
+	global->count = n;
+	sketch->scratch = old;
+
+	__atomic_store_n(&sketch->seq, s + 2, __ATOMIC_RELEASE);
+	if (n == sketch->k)
+		__atomic_store_n(&sketch->threshold, global->values[n - 1], __ATOMIC_RELAXED);
+
+	__atomic_store_n(&sketch->merge_lock, 0, __ATOMIC_RELEASE);
+
+	writer->local.count = 0;
+	writer->accepted = 0;
+}
+
+
+/** Wait for a published shared sketch, returns the (even) sequence number the reads are validated against */
+static uint64_t conc_bottomk_read_begin(conc_bottomk *sketch) {
+
+	uint64_t s;
+	while ((s = __atomic_load_n(&sketch->seq, __ATOMIC_ACQUIRE)) & 1)
+		;
+	return s;
+}
+
+static int conc_bottomk_read_retry(conc_bottomk *sketch, uint64_t s) {
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sketch->seq, __ATOMIC_RELAXED) != s;
+}
+
+void conc_bottomk_snapshot(conc_bottomk *sketch, bottomk_sketch *out) {
+
+	uint64_t s;
+	do {
+		s = conc_bottomk_read_begin(sketch);
+		out->count = sketch->global->count;
+		memcpy(out->values, sketch->global->values, out->count * sizeof(sketch_t));
+	} while (conc_bottomk_read_retry(sketch, s));
+}
+
+float query_conc_bottomk(conc_bottomk *sketch, bottomk_sketch *otherSketch) {
+
+	uint64_t k = sketch->k < otherSketch->k ? sketch->k : otherSketch->k;
+	uint64_t s;
+	float similarity;
+	do {
+		s = conc_bottomk_read_begin(sketch);
+		similarity = bottomk_jaccard(sketch->global->values, sketch->global->count, otherSketch->values, otherSketch->count, k);
+	} while (conc_bottomk_read_retry(sketch, s));
+	return similarity;
+}
+
+double conc_bottomk_cardinality(conc_bottomk *sketch) {
+
+	uint64_t M = hash_functions_modulus(sketch->hash_functions, sketch->hash_type);
+	uint64_t s;
+	double cardinality;
+	do {
+		s = conc_bottomk_read_begin(sketch);
+		cardinality = kmv_cardinality(sketch->global->values, sketch->global->count, sketch->k, M);
+	} while (conc_bottomk_read_retry(sketch, s));
+	return cardinality;
+}
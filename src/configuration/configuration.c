@@ -2,6 +2,7 @@
 
 #include <configuration.h>
 #include <minhash.h>
+#include <arena.h>
 
 #include <math.h>
 #include <inttypes.h>
@@ -9,49 +10,33 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <string.h>
 
 /** --- Core pinning --- */
 
+/**
+ * Pin the calling thread to the logical CPU core_id. Errors are reported, success is silent.
+ * See runtime.h for topology-aware placement
+ */
 int pin_thread_to_core(unsigned int core_id) {
 
     cpu_set_t cpuset;
-    pthread_t thread;
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
+    long num_cores = sysconf(_SC_NPROCESSORS_ONLN);
 
-    if (core_id < 0 || core_id >= num_cores) {
-        fprintf(stderr, "Error: core_id %d is out of range (0-%d)\n",
+    if (core_id >= num_cores) {
+        fprintf(stderr, "Error: core_id %u is out of range (0-%ld)\n",
                 core_id, num_cores - 1);
         return -1;
     }
 
-    // Get the calling thread
-    thread = pthread_self();
-
-    // Initialize and set CPU set
     CPU_ZERO(&cpuset);
     CPU_SET(core_id, &cpuset);
 
-    // Set affinity
-    int ret = pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
-    if (ret != 0) {
-        perror("pthread_setaffinity_np");
-        return ret;
-    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (ret != 0)
+        fprintf(stderr, "Failed to pin thread to core %u: %s\n", core_id, strerror(ret));
 
-    // Optional: verify
-    CPU_ZERO(&cpuset);
-    ret = pthread_getaffinity_np(thread, sizeof(cpu_set_t), &cpuset);
-    if (ret != 0) {
-        perror("pthread_getaffinity_np");
-        return ret;
-    }
-
-    if (CPU_ISSET(core_id, &cpuset))
-        printf("Thread successfully pinned to core %d\n", core_id);
-    else
-        fprintf(stderr, "Failed to pin thread to core %d\n", core_id);
-
-    return 0;
+    return ret;
 
 }
 
@@ -94,6 +79,51 @@ void read_configuration(struct minhash_configuration global_config) {
            global_config.sketch_size, global_config.prime_modulus);
 }
 
+/** random() returns 31 random bits: compose two or three calls to fill the table words */
+static uint32_t random32(void) {
+    return ((uint32_t) random() << 16) ^ (uint32_t) random();
+}
+
+static uint64_t random64(void) {
+    return ((uint64_t) random() << 33) ^ ((uint64_t) random() << 2) ^ (uint64_t) random();
+}
+
+static tabulation_hash *tabulation_hash_init(uint64_t size, uint32_t prime_modulus, int twisted) {
+
+    tabulation_hash *t_hash_functions = malloc(size * sizeof(tabulation_hash));
+    if (t_hash_functions == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating tabulation hash functions\n");
+        exit(1);
+    }
+
+    // one table for all slots, interleaved as [char][byte value][slot]. Twisted tabulation keeps
+    // 64-bit words (hash and twist) for all chars but the last, whose 32-bit words go in table
+    uint64_t entries = (uint64_t) TAB_CHARS * TAB_ENTRIES * size;
+    uint64_t twisted_entries = twisted ? (uint64_t) (TAB_CHARS - 1) * TAB_ENTRIES * size : 0;
+    uint32_t *table = malloc((entries - twisted_entries) * sizeof(uint32_t));
+    uint64_t *twisted_table = twisted ? malloc(twisted_entries * sizeof(uint64_t)) : NULL;
+    if (table == NULL || (twisted && twisted_table == NULL)) {
+        fprintf(stderr, "Error in malloc() when allocating tabulation hash tables\n");
+        exit(1);
+    }
+
+    uint64_t e;
+    for (e = 0; e < twisted_entries; e++)
+        twisted_table[e] = random64();
+    for (e = 0; e < entries - twisted_entries; e++)
+        table[e] = random32();
+
+    uint64_t i;
+    for (i = 0; i < size; i++) {
+        t_hash_functions[i].M = prime_modulus;
+        t_hash_functions[i].stride = size;
+        t_hash_functions[i].table = table + i;
+        t_hash_functions[i].twisted_table = twisted ? twisted_table + i : NULL;
+        t_hash_functions[i].hash_function = twisted ? twisted_tabulation_func : tabulation_func;
+    }
+    return t_hash_functions;
+}
+
 void * hash_functions_init(uint64_t hf_id, uint64_t size, uint32_t prime_modulus, uint32_t k) {
     uint64_t i;
     switch (hf_id) {
@@ -105,21 +135,31 @@ void * hash_functions_init(uint64_t hf_id, uint64_t size, uint32_t prime_modulus
                 fprintf(stderr, "Error in malloc() when allocating kwise hash functions\n");
                 exit(1);
             }
+            // one table for all slots, degree-major: coefficient j of slot i is at j * size + i,
+            // so the coefficients of a given degree are contiguous across slots
+            uint32_t *coefficients = malloc((uint64_t) (k + 1) * size * sizeof(uint32_t));
+            if (coefficients == NULL) {
+                fprintf(stderr, "Error in malloc() when allocating kwise hash functions coefficients\n");
+                exit(1);
+            }
             for (i=0; i < size; i++) {
                 k_hash_functions[i].M = prime_modulus;
                 k_hash_functions[i].k = k;
-                k_hash_functions[i].coefficients = malloc((k_hash_functions[i].k + 1) * sizeof(uint32_t));
-                if (k_hash_functions[i].coefficients == NULL) {
-                    fprintf(stderr, "Error in malloc() when allocating kwise hash functions coefficients\n");
-                    exit(1);
-                }
+                k_hash_functions[i].coefficients = coefficients + i;
+                k_hash_functions[i].stride = size;
                 uint32_t j;
                 for (j = 0; j <= k; j++) {
-                    k_hash_functions[i].coefficients[j] = random();
+                    k_hash_functions[i].coefficients[j * size] = random();
                 }
                 k_hash_functions[i].hash_function = kwise_func;
             }
             return k_hash_functions;
+        case 2:
+            printf("Simple tabulation hash\n");
+            return tabulation_hash_init(size, prime_modulus, 0);
+        case 3:
+            printf("Twisted tabulation hash\n");
+            return tabulation_hash_init(size, prime_modulus, 1);
         default:
             printf("Pairwise hash\n");
             pairwise_hash *p_hash_functions;
@@ -167,11 +207,7 @@ void minhash_init(minhash_sketch **sketch, void *hash_functions, uint64_t sketch
     (*sketch)->hash_type = hash_type;
 
     
-    (*sketch)->sketch = malloc(sketch_size * sizeof(uint64_t));
-    if ((*sketch)->sketch == NULL) {
-        fprintf(stderr, "Error in malloc() when allocating sketch array\n");
-        exit(1);
-    }
+    (*sketch)->sketch = sketch_alloc(sketch_size);
 
 
 #ifdef LOCKS
@@ -185,6 +221,7 @@ void minhash_init(minhash_sketch **sketch, void *hash_functions, uint64_t sketch
 
 	
     (*sketch)->hash_functions = hash_functions;
+    watch_init(&(*sketch)->watches);
 
     init_empty_values(*sketch);
 
@@ -207,6 +244,6 @@ void minhash_free(minhash_sketch *sketch) {
     pthread_rwlock_destroy(&sketch->rw_lock);
 #endif
     // free(sketch->hash_functions); TODO: I removed it here since if we have two or more sketches it will cause double free
-    free(sketch->sketch);
+    sketch_free(sketch->sketch, sketch->size);
     free(sketch);
 }
@@ -1,4 +1,5 @@
 #include <linked_list.h>
+#include <arena.h>
 
 int atomic_compare_exchange_tagged_ptr(
     volatile union tagged_pointer* obj,
@@ -67,14 +68,9 @@ int atomic_compare_exchange_tagged_ptr_machine(
 
 
 
-// Helper to allocate a 16-byte aligned tagged_pointer on the heap
-union tagged_pointer* alloc_aligned_tagged_pointer(uint64_t* ptr_val, uint64_t counter_val) {
-    union tagged_pointer* new_tp;
-    // posix_memalign is a standard way to get aligned memory on POSIX systems
-    if (posix_memalign((void**)&new_tp, _Alignof(union tagged_pointer), sizeof(union tagged_pointer)) != 0) {
-        perror("posix_memalign failed for tagged_pointer");
-        exit(EXIT_FAILURE);
-    }
+// Helper to allocate a 16-byte aligned tagged_pointer from the arena (its smallest class is 16-byte aligned)
+union tagged_pointer* alloc_aligned_tagged_pointer(sketch_t* ptr_val, uint64_t counter_val) {
+    union tagged_pointer* new_tp = arena_alloc(sizeof(union tagged_pointer));
     new_tp->sketch = ptr_val;
     new_tp->counter = counter_val;
     return new_tp;
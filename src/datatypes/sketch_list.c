@@ -1,8 +1,9 @@
 #include <sketch_list.h>
+#include <arena.h>
 
 
 // methods implementation for managing list LIFO
-void create_and_push_new_node(_Atomic(union tagged_pointer*) *head_sl, uint64_t *version_sketch, uint64_t size) {
+void create_and_push_new_node(_Atomic(union tagged_pointer*) *head_sl, sketch_t *version_sketch, uint64_t size) {
 
 	/*sketch_record *new_node = malloc(sizeof(sketch_record));
 	OLD VERSION START
@@ -159,7 +160,7 @@ void create_and_push_new_node(_Atomic(union tagged_pointer*) *head_sl, uint64_t
 
 // Delete the node after prev. Prev will point to prev->next->next
 // the method suppose that no reader is on prev->next and there won't be any. Hence, the node may be safely delete 
-void delete_node(sketch_record *prev){
+void delete_node(sketch_record *prev, uint64_t size){
 
     _Atomic(union tagged_pointer*) tp_to_del_node = __atomic_load_n(&prev->next, __ATOMIC_ACQUIRE);   // tagged_pointer which points to the node to be deleted
 
@@ -169,35 +170,26 @@ void delete_node(sketch_record *prev){
     prev->next = node_to_del->next;	// link prev to prev->next->next that is keep the list linked 
     //fprintf(stderr, "prev->next = %p\n", prev->next);
     // Now we can safely free the node and the tagged_pointer to that node
-    free(tp_to_del_node);	       // free the tagged_pointer that points to node_to_del
-    free(node_to_del->sketch);         // free the area of the sketch
-    free(node_to_del);		       // free the node
+    arena_free(tp_to_del_node, sizeof(union tagged_pointer));	// free the tagged_pointer that points to node_to_del
+    sketch_free(node_to_del->sketch, size);                        // free the area of the sketch
+    arena_free(node_to_del, sizeof(sketch_record));                // free the node
 
 
 }
 
 
 
-// Helper to allocate a 16-byte aligned tagged_pointer on the heap
+// Helper to allocate a 16-byte aligned tagged_pointer from the arena (its smallest class is 16-byte aligned)
 union tagged_pointer* alloc_aligned_tagged_pointer(struct sketch_record* ptr_val, uint64_t counter_val) {
-    union tagged_pointer* new_tp;
-    // posix_memalign is a standard way to get aligned memory on POSIX systems
-    if (posix_memalign((void**)&new_tp, _Alignof(union tagged_pointer), sizeof(union tagged_pointer)) != 0) {
-        perror("posix_memalign failed for tagged_pointer");
-        exit(EXIT_FAILURE);
-    }
+    union tagged_pointer* new_tp = arena_alloc(sizeof(union tagged_pointer));
     new_tp->ptr = ptr_val;
     new_tp->counter = counter_val;
     return new_tp;
 }
 
 // Helper to allocate a sketch_record
-sketch_record* alloc_sketch_record(uint64_t *sketch) {
-    sketch_record* rec = (sketch_record*)malloc(sizeof(sketch_record));
-    if (rec == NULL) {
-        perror("malloc failed for sketch_record");
-        exit(EXIT_FAILURE);
-    }
+sketch_record* alloc_sketch_record(sketch_t *sketch) {
+    sketch_record* rec = (sketch_record*)arena_alloc(sizeof(sketch_record));
     rec->next = NULL;     // Initialize to NULL pointer (will point to tagged_pointer later)
     rec->sketch = sketch; // Initialize or allocate as needed
     return rec;
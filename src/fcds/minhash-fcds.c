@@ -1,6 +1,8 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <numa_alloc.h>
+#include <arena.h>
 
 
 
@@ -54,11 +56,7 @@ void init_fcds(fcds_sketch **sketch, void *hash_functions, uint64_t sketch_size,
     (*sketch)->hash_functions = hash_functions;
 
     
-    (*sketch)->global_sketch = malloc(sketch_size * sizeof(uint64_t));
-    if ((*sketch)->global_sketch == NULL) {
-        fprintf(stderr, "Error in malloc() when allocating global_sketch array\n");
-        exit(1);
-    }
+    (*sketch)->global_sketch = sketch_alloc(sketch_size);
 
     // init double collect list for versioned sketch
     /*(*sketch)->sketch_list = malloc(sizeof(unsigned long) * 2);
@@ -82,18 +80,22 @@ void init_fcds(fcds_sketch **sketch, void *hash_functions, uint64_t sketch_size,
         __atomic_store_n(&(*sketch)->prop[i], 0, __ATOMIC_RELAXED); // TODO: check if atomic_relaxed is correct
     }
     
-    (*sketch)->local_sketches = malloc(N * sizeof(uint64_t *));
+    (*sketch)->local_sketches = malloc(N * sizeof(sketch_t *));
     if ((*sketch)->local_sketches == NULL) {
         fprintf(stderr, "Error in malloc() when allocating local_sketches array\n");
         exit(1);
     }    		
     
+    // local sketches start on the node of the initializing thread, each writer moves its own with fcds_writer_bind
+    (*sketch)->writer_node = malloc(N * sizeof(int));
+    if ((*sketch)->writer_node == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating writer_node array\n");
+        exit(1);
+    }
+    int node = current_node();
     for(i = 0; i < N; i++){
-        (*sketch)->local_sketches[i] = malloc(sketch_size * sizeof(uint64_t));
-        if ((*sketch)->local_sketches[i] == NULL) {
-            fprintf(stderr, "Error in malloc() when allocating local_sketches[%d] array\n", i);
-            exit(1);
-        }
+        (*sketch)->local_sketches[i] = node_alloc(sketch_size * sizeof(sketch_t), node);
+        (*sketch)->writer_node[i] = node;
     }
     
     
@@ -101,10 +103,29 @@ void init_fcds(fcds_sketch **sketch, void *hash_functions, uint64_t sketch_size,
     
     if (init_size > 0)
         init_values_fcds(*sketch, init_size);
+
+    // per node copies of the read-only hash tables and of the global sketch
+    (*sketch)->nodes = node_count();
+    (*sketch)->node_hash_functions = malloc((*sketch)->nodes * sizeof(void *));
+    (*sketch)->node_global_sketches = malloc((*sketch)->nodes * sizeof(sketch_t *));
+    if ((*sketch)->node_hash_functions == NULL || (*sketch)->node_global_sketches == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating per node replicas\n");
+        exit(1);
+    }
+    for (node = 0; node < (*sketch)->nodes; node++) {
+        if ((*sketch)->nodes == 1) {
+            (*sketch)->node_hash_functions[node] = hash_functions;
+            (*sketch)->node_global_sketches[node] = (*sketch)->global_sketch;
+        } else {
+            (*sketch)->node_hash_functions[node] = hash_functions_replicate(hash_functions, hash_type, sketch_size, node);
+            (*sketch)->node_global_sketches[node] = node_alloc(sketch_size * sizeof(sketch_t), node);
+            memcpy((*sketch)->node_global_sketches[node], (*sketch)->global_sketch, sketch_size * sizeof(sketch_t));
+        }
+    }
         
         
     // Initialize the head of the list to point to a copy of global_sketch
-    uint64_t *copy = copy_sketch((*sketch)->global_sketch, sketch_size);
+    sketch_t *copy = copy_sketch((*sketch)->global_sketch, sketch_size);
     sketch_record *sr = alloc_sketch_record(copy);   // Pointer to the new list record
     union tagged_pointer *tp = alloc_aligned_tagged_pointer(sr, 0);
     sr->next = alloc_aligned_tagged_pointer(NULL, 0);
@@ -120,15 +141,24 @@ void init_fcds(fcds_sketch **sketch, void *hash_functions, uint64_t sketch_size,
 void free_fcds(fcds_sketch *sketch){
 
     //TODO free the version list of sketches
-    free(sketch->sketch_list);
+    arena_free(sketch->sketch_list, sizeof(union tagged_pointer));
 
-    free(sketch->global_sketch);
+    sketch_free(sketch->global_sketch, sketch->size);
     free(sketch->prop);
     
     uint32_t i;
     for (i = 0; i < sketch->N; i++)
-        free(sketch->local_sketches[i]);
+        node_free(sketch->local_sketches[i], sketch->size * sizeof(sketch_t));
     free(sketch->local_sketches);
+    free(sketch->writer_node);
+
+    int node;
+    for (node = 0; sketch->nodes > 1 && node < sketch->nodes; node++) {
+        hash_functions_replica_free(sketch->node_hash_functions[node], sketch->hash_type, sketch->size);
+        node_free(sketch->node_global_sketches[node], sketch->size * sizeof(sketch_t));
+    }
+    free(sketch->node_hash_functions);
+    free(sketch->node_global_sketches);
   
     free(sketch);
 }
@@ -146,12 +176,35 @@ void free_fcds(fcds_sketch *sketch){
 
 
 
-void insert_fcds(uint64_t *local_sketch, void *hash_functions, uint32_t hash_type, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, uint64_t elem) {
 /**
-* The function inserts a new element n the local sketch. If the threshold b is reached, the thread wait for the propagation
-* The insertion is first done through basic_insert. Insert_counter is passed as pointer and takes track of the number of successfull insertions. prop is a pointer to an atomic variable
+* Move the local sketch of writer tid to the node the calling thread runs on. It must be called by the writer itself
+* (after pinning, before inserting), so that no propagation of the local sketch can be in progress
 */
-    int insertion = basic_insert(local_sketch, sketch_size, hash_functions, hash_type, elem); // no need for synchronization here
+void fcds_writer_bind(fcds_sketch *sketch, uint32_t tid) {
+
+    int node = current_node();
+    if (node == sketch->writer_node[tid])
+        return;
+
+    sketch_t *local_sketch = node_alloc(sketch->size * sizeof(sketch_t), node);
+    memcpy(local_sketch, sketch->local_sketches[tid], sketch->size * sizeof(sketch_t));
+    node_free(sketch->local_sketches[tid], sketch->size * sizeof(sketch_t));
+    sketch->local_sketches[tid] = local_sketch;
+    sketch->writer_node[tid] = node;
+}
+
+void *fcds_writer_hash_functions(fcds_sketch *sketch, uint32_t tid) {
+
+    return sketch->node_hash_functions[sketch->nodes > 1 ? sketch->writer_node[tid] : 0];
+}
+
+
+/**
+* Count a successful insertion of a writer and, once b of them are reached, wait for the propagator to merge
+* the local sketch. Shared by insert_fcds and insert_fcds_values
+*/
+static void count_insertion(int insertion, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b) {
+
     *insertion_counter += insertion;
     
     if(*insertion_counter == b){
@@ -184,6 +237,26 @@ void insert_fcds(uint64_t *local_sketch, void *hash_functions, uint32_t hash_typ
 }
 
 
+void insert_fcds(sketch_t *local_sketch, void *hash_functions, uint32_t hash_type, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, uint64_t elem) {
+/**
+* The function inserts a new element n the local sketch. If the threshold b is reached, the thread wait for the propagation
+* The insertion is first done through basic_insert. Insert_counter is passed as pointer and takes track of the number of successfull insertions. prop is a pointer to an atomic variable
+*/
+    int insertion = basic_insert(local_sketch, sketch_size, hash_functions, hash_type, elem); // no need for synchronization here
+    count_insertion(insertion, insertion_counter, prop, b);
+}
+
+
+/**
+* Insert an element already hashed by the caller (see fanout.h) in the local sketch, with the same propagation protocol of insert_fcds
+*/
+void insert_fcds_values(sketch_t *local_sketch, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, const sketch_t *values) {
+
+    int insertion = min_update(local_sketch, values, sketch_size); // no need for synchronization here
+    count_insertion(insertion, insertion_counter, prop, b);
+}
+
+
 
 
 
@@ -192,15 +265,17 @@ void insert_fcds(uint64_t *local_sketch, void *hash_functions, uint32_t hash_typ
 * if a modification occured in the middle. If so, the last sketch in the shared list is returned.
 * This algorithm should guarantee overall correctness since the returned sketch is a valid state in the query's time interval
 */
-uint64_t *get_global_sketch(fcds_sketch *sketch){
+sketch_t *get_global_sketch(fcds_sketch *sketch){
 
-  uint64_t *copy = copy_sketch(sketch->global_sketch, sketch->size);
+  // read the copy of global_sketch on the node of the caller, it is refreshed by the propagator like global_sketch itself
+  sketch_t *global_sketch = sketch->node_global_sketches[sketch->nodes > 1 ? current_node() : 0];
+  sketch_t *copy = copy_sketch(global_sketch, sketch->size);
   
   // Check if global was changed while copy was generated
   uint64_t i;
   int valid = 1;  // a boolean variable, it is true if copy is a valid sketch (i.e., it can be returned)
   for (i = 0; i < sketch->size; i++){
-      if (copy[i] != sketch->global_sketch[i]){
+      if (copy[i] != global_sketch[i]){
           valid = 0;  // global_sketch has been changed during the copy_sketch function. It is not safe to return it
           break;
       }
@@ -221,9 +296,45 @@ uint64_t *get_global_sketch(fcds_sketch *sketch){
 
 }
 
-float query_fcds(fcds_sketch *sketch, uint64_t *otherSketch) { // TODO: change the signature: do we need to compare two fcds sketch? Can the latter be just a simple sketch (array)?
+void fcds_snapshot_source(void *ctx, sketch_t *out) {
+
+    fcds_sketch *sketch = (fcds_sketch *) ctx;
+    sketch_t *copy = get_global_sketch(sketch);
+    memcpy(out, copy, sketch->size * sizeof(sketch_t));
+    sketch_free(copy, sketch->size);
+}
+
+/**
+ * Insert a batch of elements into the local sketch, with the same propagation protocol of insert_fcds.
+ */
+void insert_fcds_batch(sketch_t *local_sketch, void *hash_functions, uint32_t hash_type, uint64_t sketch_size, uint32_t *insertion_counter, _Atomic uint32_t *prop, uint32_t b, const uint64_t *elems, size_t n) {
+
+    size_t i;
+    for (i = 0; i < n; i++)
+        insert_fcds(local_sketch, hash_functions, hash_type, sketch_size, insertion_counter, prop, b, elems[i]);
+}
+
+/** ingest_sink of the FCDS sketch: ctx is an array of N fcds_writer, thread tid inserts into its local sketch */
+void fcds_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+
+    fcds_writer *writer = &((fcds_writer *) ctx)[tid];
+    fcds_sketch *sketch = writer->sketch;
+    insert_fcds_batch(sketch->local_sketches[tid], fcds_writer_hash_functions(sketch, tid), sketch->hash_type, sketch->size,
+                      &writer->insertion_counter, &(sketch->prop[tid]), sketch->b, keys, n);
+}
+
+/** values_sink of the FCDS sketch: ctx is an array of N fcds_writer, as for fcds_sink */
+void fcds_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+
+    fcds_writer *writer = &((fcds_writer *) ctx)[tid];
+    fcds_sketch *sketch = writer->sketch;
+    insert_fcds_values(sketch->local_sketches[tid], sketch->size, &writer->insertion_counter, &(sketch->prop[tid]), sketch->b, values);
+}
+
 
-    uint64_t *actual_sketch = get_global_sketch(sketch);   // here we have a a deep copy
+float query_fcds(fcds_sketch *sketch, sketch_t *otherSketch) { // TODO: change the signature: do we need to compare two fcds sketch? Can the latter be just a simple sketch (array)?
+
+    sketch_t *actual_sketch = get_global_sketch(sketch);   // here we have a a deep copy
     //uint64_t *second = get_global_sketch(otherSketch);
     
     uint64_t i;
@@ -235,13 +346,24 @@ float query_fcds(fcds_sketch *sketch, uint64_t *otherSketch) { // TODO: change t
     //fprintf(stderr, "[query] actual count %d\n", count);
     //if(count != sketch->size)fprintf(stderr, "[query] actual count %d\n", count);
     
-    free(actual_sketch); // they are just array, standard free suffices
+    sketch_free(actual_sketch, sketch->size); // copies come from the arena
     //free(second);
     return count/(float)sketch->size;
 
 }
 
 
+/**
+ * Set size estimates read in place from the global sketch of the node of the caller, without the copy
+ * of query_fcds: the propagator only lowers slots, so a read racing with a merge still sees valid minima.
+ */
+void estimate_fcds(fcds_sketch *sketch, const sketch_t *otherSketch, set_estimates *out) {
+
+    sketch_t *global_sketch = sketch->node_global_sketches[sketch->nodes > 1 ? current_node() : 0];
+    estimate_sets(global_sketch, otherSketch, sketch->size, hash_functions_modulus(sketch->hash_functions, sketch->hash_type), out);
+}
+
+
 
 
 
@@ -290,8 +412,12 @@ void *propagator(fcds_sketch *sketch) {
                         // if(0) minhash_print(sketch);
 
                         //TODO create new node in list of sketch_list
-                        uint64_t *version_sketch = copy_sketch(sketch->global_sketch, sketch->size);
+                        sketch_t *version_sketch = copy_sketch(sketch->global_sketch, sketch->size);
                         create_and_push_new_node(&sketch->sketch_list, version_sketch, sketch->size);
+
+                        // refresh the copies read by the queries on the other nodes
+                        for (int node = 0; sketch->nodes > 1 && node < sketch->nodes; node++)
+                            memcpy(sketch->node_global_sketches[node], sketch->global_sketch, sketch->size * sizeof(sketch_t));
                     }
 
                     // After propagation is complete, atomically set the flag back to 0.
@@ -419,7 +545,7 @@ void garbage_collector_list(fcds_sketch *sketch){
        
 
             //We can safely remove the record pointed by tp->ptr; tp is stored in prev
-            delete_node(prev);
+            delete_node(prev, sketch->size);
             
             node = prev->next->ptr;
         } else {
@@ -1,5 +1,7 @@
 #include <minhash.h>
 #include <configuration.h>
+#include <numa_alloc.h>
+#include <arena.h>
 #include <stdarg.h>
 #include <unistd.h>
 
@@ -23,7 +25,7 @@ static inline void trace(int fd,const char *fmt, ...) {
     }
 }
 
-void init_empty_sketch_conc_minhash(uint64_t *sketch, uint64_t size) {
+void init_empty_sketch_conc_minhash(sketch_t *sketch, uint64_t size) {
 
     uint64_t i;
     for (i=0; i < size; i++){
@@ -62,19 +64,11 @@ void init_conc_minhash(conc_minhash **sketch, void *hash_functions, uint64_t ske
 
     
     
-    uint64_t *s = malloc(sketch_size * sizeof(uint64_t));
-    if (s == NULL) {
-        fprintf(stderr, "Error in malloc() when allocating sketch\n");
-        exit(1);
-    }
+    sketch_t *s = sketch_alloc(sketch_size);
 
 	(*sketch)->sketches[0] = alloc_aligned_tagged_pointer(s, 0); 
 	
-	s = malloc(sketch_size * sizeof(uint64_t));
-    if (s == NULL) {
-        fprintf(stderr, "Error in malloc() when allocating second sketch\n");
-        exit(1);
-    }
+	s = sketch_alloc(sketch_size);
 	(*sketch)->sketches[1] = alloc_aligned_tagged_pointer(s, 0); 
    
     (*sketch)->insert_counter = 0;
@@ -92,6 +86,31 @@ void init_conc_minhash(conc_minhash **sketch, void *hash_functions, uint64_t ske
         
         
     (*sketch)->head = NULL;
+    watch_init(&(*sketch)->watches);
+
+    // with more than one node, writers hash with the tables of their node and queries read the copy of their node
+    (*sketch)->nodes = node_count();
+    (*sketch)->node_hash_functions = NULL;
+    (*sketch)->node_queries = NULL;
+    if ((*sketch)->nodes > 1) {
+        (*sketch)->node_hash_functions = malloc((*sketch)->nodes * sizeof(void *));
+        (*sketch)->node_queries = malloc((*sketch)->nodes * sizeof(node_query));
+        if ((*sketch)->node_hash_functions == NULL || (*sketch)->node_queries == NULL) {
+            fprintf(stderr, "Error in malloc() when allocating per node replicas\n");
+            exit(1);
+        }
+        int node;
+        for (node = 0; node < (*sketch)->nodes; node++) {
+            (*sketch)->node_hash_functions[node] = hash_functions_replicate(hash_functions, hash_type, sketch_size, node);
+            node_query *q = &(*sketch)->node_queries[node];
+            int k;
+            for (k = 0; k < 2; k++)
+                q->buffers[k] = node_alloc(sketch_size * sizeof(sketch_t), node);
+            memcpy(q->buffers[0], (*sketch)->sketches[0]->sketch, sketch_size * sizeof(sketch_t));
+            __atomic_store_n(&q->version, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&q->sketch, q->buffers[0], __ATOMIC_RELEASE);
+        }
+    }
 
     trace(STDOUT_FILENO ,"[init_conc_minhash] insert tagged pointer sketch = %p query tagged pointer sketch = %p\n \t\t insert sketch = %p query sketch = %p \n", 
     	(*sketch)->sketches[1], (*sketch)->sketches[0], (*sketch)->sketches[1]->sketch, (*sketch)->sketches[0]->sketch);
@@ -105,8 +124,19 @@ void free_conc_minhash(conc_minhash *sketch){
     //TODO free the version list of sketches
     if (sketch->head != NULL) free(sketch->head);
 
-    free(sketch->sketches[0]->sketch);
-    free(sketch->sketches[1]->sketch);
+    sketch_free(sketch->sketches[0]->sketch, sketch->size);
+    sketch_free(sketch->sketches[1]->sketch, sketch->size);
+    arena_free(sketch->sketches[0], sizeof(union tagged_pointer));
+    arena_free(sketch->sketches[1], sizeof(union tagged_pointer));
+
+    int node;
+    for (node = 0; sketch->nodes > 1 && node < sketch->nodes; node++) {
+        hash_functions_replica_free(sketch->node_hash_functions[node], sketch->hash_type, sketch->size);
+        node_free(sketch->node_queries[node].buffers[0], sketch->size * sizeof(sketch_t));
+        node_free(sketch->node_queries[node].buffers[1], sketch->size * sizeof(sketch_t));
+    }
+    free(sketch->node_hash_functions);
+    free(sketch->node_queries);
 
     free(sketch);
 }
@@ -134,7 +164,7 @@ void free_conc_minhash(conc_minhash *sketch){
  * @return A pointer to the union tagged_pointer structure representing
  *         the version *before* the increment (a safe snapshot for the caller).
  */
-union tagged_pointer *FetchAndInc128(_Atomic (union tagged_pointer *) *ins_sketch, int64_t increment) {
+static union tagged_pointer *fetch_and_inc_counter(_Atomic (union tagged_pointer *) *ins_sketch, int64_t increment, int64_t *counter) {
 
 	union tagged_pointer current_value; // local copy of the tagged pointer
     union tagged_pointer new_value;		// updated tagged pointer
@@ -168,9 +198,15 @@ union tagged_pointer *FetchAndInc128(_Atomic (union tagged_pointer *) *ins_sketc
              // If the CAS fails it means either another query thread has changed the counter or the sketch list's head changes. 
 	         // In the latter case we have to take the new head. NOtice that if CAS fails no modification occurs to *head_ptr
 
+	if (counter != NULL)
+		*counter = new_value.counter;
 	return ptr;
 }
 
+union tagged_pointer *FetchAndInc128(_Atomic (union tagged_pointer *) *ins_sketch, int64_t increment) {
+	return fetch_and_inc_counter(ins_sketch, increment, NULL);
+}
+
 
 
 /* OPERATIONS IMPLEMENTATION */
@@ -184,13 +220,7 @@ void sketch_values_update(conc_minhash *sketch) {
 
 	trace(STDOUT_FILENO,"[sketch_values_update] query = %p \t insert = %p \n", query_sketch, insert_sketch);
 
-	uint64_t i, dest;
-	for (i = 0; i < sketch->size; i++) {
-		uint64_t src = query_sketch->sketch[i];
-		do {
-			dest = insert_sketch->sketch[i];
-		} while (src < dest && !__atomic_compare_exchange_n(&(insert_sketch->sketch[i]), &dest, src, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
-	}
+	concurrent_min_update(insert_sketch->sketch, query_sketch->sketch, sketch->size);
 
 	query_sketch = FetchAndInc128(&(sketch->sketches[0]), -1);
 	insert_sketch = FetchAndInc128(&(sketch->sketches[1]), -1);
@@ -199,6 +229,34 @@ void sketch_values_update(conc_minhash *sketch) {
 }
 
 
+/**
+ * The values a query reads: the query sketch, or with more than one node the copy published on the
+ * node of the caller. A merge rewrites the other buffer of that copy, so a reader which loaded a
+ * buffer before the previous swap may see it change: version tells, see conc_query_retry.
+ */
+const sketch_t *conc_query_values(conc_minhash *sketch, uint64_t *version) {
+
+	if (sketch->nodes <= 1) {
+		*version = 0;
+		return __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_ACQUIRE)->sketch;
+	}
+	node_query *q = &sketch->node_queries[current_node()];
+	uint64_t v;
+	while ((v = __atomic_load_n(&q->version, __ATOMIC_ACQUIRE)) & 1)
+		;
+	*version = v;
+	return __atomic_load_n(&q->sketch, __ATOMIC_ACQUIRE);
+}
+
+int conc_query_retry(conc_minhash *sketch, uint64_t version) {
+
+	if (sketch->nodes <= 1)
+		return 0;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&sketch->node_queries[current_node()].version, __ATOMIC_RELAXED) != version;
+}
+
+
 /**
  * This function performs the query on the MinHash sketch.
  *
@@ -209,22 +267,28 @@ void sketch_values_update(conc_minhash *sketch) {
  * @param otherSketch Pointer to another MinHash sketch to compare against.
  * @return float Similarity between the two sketches
  */
-float concurrent_query(conc_minhash *sketch, uint64_t *otherSketch) {
+float concurrent_query(conc_minhash *sketch, sketch_t *otherSketch) {
 
 	// acquire a consistent view of the query sketch
 	// <sketch_ptr, pending_cnt, insert_cnt> where insert_cnt is a don't-care value
 	// while pending_cnt represents the number of ongoing queries on that sketch, and it
 	// must be used for garbage collection in the future
-	union tagged_pointer *query_sketch = sketch->sketches[0];//FetchAndInc128(&(sketch->sketches[0]), (1ULL<<PENDING_OFFSET));
-	uint64_t i;
-	int count = 0;
+	//union tagged_pointer *query_sketch = FetchAndInc128(&(sketch->sketches[0]), (1ULL<<PENDING_OFFSET));
+	uint64_t i, version;
+	int count;
 
-	// comparison of the sketches values
-	for (i = 0; i < sketch->size; i++) {
-		if (IS_EQUAL(query_sketch->sketch[i], otherSketch[i])) {
-    	    count++;
+	// with more than one node, read the copy of the query sketch published on the node of the caller
+	do {
+		const sketch_t *values = conc_query_values(sketch, &version);
+		count = 0;
+
+		// comparison of the sketches values
+		for (i = 0; i < sketch->size; i++) {
+			if (IS_EQUAL(values[i], otherSketch[i])) {
+	    	    count++;
+			}
 		}
-	}
+	} while (conc_query_retry(sketch, version));
 
 	// decrement pending counter to allow future garbage collection
 	//FetchAndInc128(&query_sketch, -((int64_t)1<<PENDING_OFFSET)); 
@@ -233,16 +297,96 @@ float concurrent_query(conc_minhash *sketch, uint64_t *otherSketch) {
 }
 
 
+/**
+ * Set size estimates on the query sketch, read in place like in concurrent_query: they
+ * do not see the insertions still pending in the insert sketch.
+ */
+void concurrent_estimate(conc_minhash *sketch, const sketch_t *otherSketch, set_estimates *out) {
+
+	uint64_t version;
+	do {
+		const sketch_t *values = conc_query_values(sketch, &version);
+		estimate_sets(values, otherSketch, sketch->size, hash_functions_modulus(sketch->hash_functions, sketch->hash_type), out);
+	} while (conc_query_retry(sketch, version));
+}
+
+
+/**
+ * Linearizable snapshot of the sketch: the slot-wise minimum of the insert and the query sketch,
+ * validated by the generation of the insert sketch.
+ *
+ * Every merge publishes a new tagged pointer as the insert sketch, so the pointer is its generation.
+ * The insert sketch is collected and the query sketch min-updated into the copy; if afterwards the
+ * same tagged pointers are published and no merge is running, out holds every insertion completed
+ * before the collect. The insertions in flight are in out in part or not at all: slots only decrease,
+ * so each slot of out is between its values at the start and at the end of the collect, which is a
+ * state of the sketch. The query sketch covers the merges of concurrent_merge_0, whose new insert
+ * sketch starts empty and gets the query sketch only at the end of the merge, while insert_counter
+ * is negative. Writers are never waited for: only when SNAPSHOT_RETRIES collects all overlap a merge,
+ * as a last resort, the query sketch is copied instead, the state of the last merge.
+ *
+ * @param sketch Pointer to the concurrent MinHash structure.
+ * @param out Array of size slots receiving the snapshot.
+ * @return int 1 if out holds the freshest state, 0 if it holds the query sketch
+ */
+int conc_minhash_snapshot(conc_minhash *sketch, sketch_t *out) {
+
+	int r;
+	for (r = 0; r < SNAPSHOT_RETRIES; r++) {
+		if (__atomic_load_n(&(sketch->insert_counter), __ATOMIC_ACQUIRE) < 0)
+			continue;
+		union tagged_pointer *insert_sketch = __atomic_load_n(&(sketch->sketches[1]), __ATOMIC_ACQUIRE);
+		union tagged_pointer *query_sketch = __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_ACQUIRE);
+
+		memcpy(out, insert_sketch->sketch, sketch->size * sizeof(sketch_t));
+		min_update(out, query_sketch->sketch, sketch->size);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&(sketch->sketches[1]), __ATOMIC_RELAXED) == insert_sketch
+			&& __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_RELAXED) == query_sketch
+			&& __atomic_load_n(&(sketch->insert_counter), __ATOMIC_RELAXED) >= 0)
+			return 1;
+	}
+
+	union tagged_pointer *query_sketch = __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_ACQUIRE);
+	memcpy(out, query_sketch->sketch, sketch->size * sizeof(sketch_t));
+	return 0;
+}
+
+void conc_minhash_snapshot_source(void *ctx, sketch_t *out) {
+	conc_minhash_snapshot((conc_minhash *) ctx, out);
+}
+
+
+/**
+ * Watch the similarity of the query sketch to reference. Every merge adjusts the count of equal
+ * slots on the slots it changes, so concurrent_query_watched costs O(1) whatever the sketch size.
+ *
+ * @return int id of the pair, for concurrent_query_watched and conc_minhash_unwatch
+ */
+int conc_minhash_watch(conc_minhash *sketch, const sketch_t *reference) {
+
+	union tagged_pointer *query_sketch = __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_ACQUIRE);
+	return watch_add(&sketch->watches, reference, query_sketch->sketch, sketch->size);
+}
+
+void conc_minhash_unwatch(conc_minhash *sketch, int id) {
+
+	watch_remove(&sketch->watches, id);
+}
+
+float concurrent_query_watched(conc_minhash *sketch, int id) {
+
+	return watch_similarity(&sketch->watches, id, sketch->size);
+}
+
+
 void concurrent_merge_0(conc_minhash *sketch) {
 
 	trace(STDOUT_FILENO,"Thread %ld - MERGE START\n", pthread_self());
 	// creation of new insert sketch
 	union tagged_pointer *insert_sketch, *query_sketch;
-	uint64_t *new_insert_sketch = malloc(sketch->size * sizeof(uint64_t));
-	if (new_insert_sketch == NULL) {
-		fprintf(stderr, "Error in malloc() for allocation of new insert sketch in merge \n");
-		exit(1);
-	}
+	sketch_t *new_insert_sketch = sketch_alloc(sketch->size);
 	trace(STDOUT_FILENO,"[concurrent_merge] BEFORE alloc aligned insert sketch = %p sketch = %p \n",sketch->sketches[1], sketch->sketches[1]->sketch);
 	
 	init_empty_sketch_conc_minhash(new_insert_sketch, sketch->size);
@@ -268,6 +412,8 @@ void concurrent_merge_0(conc_minhash *sketch) {
 	do { // fail retry to publish new query sketch (which is pointed by insert_sketch)
 		query_sketch =  __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_SEQ_CST);//FetchAndInc128(&(sketch->sketches[0]), 0); // acquire query sketch
 	} while (!__atomic_compare_exchange_n(&(sketch->sketches[0]), &query_sketch, insert_sketch, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	if (sketch->watches.count)
+		watch_replace(&sketch->watches, query_sketch->sketch, insert_sketch->sketch, sketch->size);
 	trace(STDOUT_FILENO,"[concurrent_merge] query = %p \t insert = %p\n\t\t  sketch q = %p sketch ins = %p \n", 
 		sketch->sketches[0], sketch->sketches[1], sketch->sketches[0]->sketch, sketch->sketches[1]->sketch);
 	
@@ -322,21 +468,35 @@ void concurrent_merge(conc_minhash *sketch) {
 	do { // fail retry to publish new query sketch (which is pointed by insert_sketch)
 		query_sketch =  __atomic_load_n(&(sketch->sketches[0]), __ATOMIC_SEQ_CST);
 	} while (!__atomic_compare_exchange_n(&(sketch->sketches[0]), &query_sketch, insert_sketch, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+	// the watched counts follow the query sketch: only the slots the insertions since the last merge changed are compared
+	if (sketch->watches.count)
+		watch_replace(&sketch->watches, query_sketch->sketch, insert_sketch->sketch, sketch->size);
 	
 	// TODO: enqueue the old query sketch for garbage collection (safe reclamation later)
 
 	trace(STDERR_FILENO, "Query sketch is now fresh\n");
 
 	//Step 3: create new insert sketch and initialize its content
-	uint64_t *new_insert_sketch = malloc(sketch->size * sizeof(uint64_t));
-	if (new_insert_sketch == NULL) {
-		fprintf(stderr, "Error in malloc() for allocation of new insert sketch in merge \n");
-		exit(1);
-	}
+	sketch_t *new_insert_sketch = sketch_alloc(sketch->size);
 	
 	for (i=0; i < sketch->size; i++) 
 		new_insert_sketch[i] = insert_sketch->sketch[i];
 
+	// the new query sketch is quiescent until step 4: copy it into the unpublished buffer of every node and swap.
+	// Merges do not overlap, the version only makes the readers of the rewritten buffer retry
+	int node;
+	for (node = 0; sketch->nodes > 1 && node < sketch->nodes; node++) {
+		node_query *q = &sketch->node_queries[node];
+		sketch_t *published = __atomic_load_n(&q->sketch, __ATOMIC_RELAXED);
+		sketch_t *next = published == q->buffers[0] ? q->buffers[1] : q->buffers[0];
+		__atomic_fetch_add(&q->version, 1, __ATOMIC_ACQ_REL);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+		memcpy(next, insert_sketch->sketch, sketch->size * sizeof(sketch_t));
+		__atomic_store_n(&q->sketch, next, __ATOMIC_RELEASE);
+		__atomic_fetch_add(&q->version, 1, __ATOMIC_RELEASE);
+	}
+
 	// Step 4: Publish insertion sketch and reset all counters 
 	// insertion counter being 0 allows new insertion thread to progress
 	_Atomic (union tagged_pointer *)new_tp = alloc_aligned_tagged_pointer(new_insert_sketch, 0); 
@@ -359,9 +519,10 @@ void concurrent_merge(conc_minhash *sketch) {
  * provided element using either *pairwise-independent* or *k-wise-independent* hash
  * functions, depending on the hash type.
  *
- * Each cell is updated atomically via a compare-and-swap (CAS)
- * operation that ensures only smaller hash values replace existing ones, maintaining
- * the MinHash property.
+ * The hash values are precomputed one block of MIN_UPDATE_BLOCK slots at a time and
+ * handed to concurrent_min_update, which filters the slots where the element cannot win
+ * and updates the others atomically via compare-and-swap (CAS), so that only smaller
+ * hash values replace existing ones, maintaining the MinHash property.
  *
  * @param sketch          Pointer to the array of MinHash sketch
  * @param size            Number of sketch entries
@@ -369,35 +530,15 @@ void concurrent_merge(conc_minhash *sketch) {
  * @param hash_type       Type of hash functions (1 = k-wise, otherwise = pairwise).
  * @param elem            Element to be inserted into the sketch.
  */
-void concurrent_basic_insert(uint64_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem){
-
-	uint64_t i, old;
-	switch (hash_type) {
-	case 1: {
-		// k-wise hash function
-		kwise_hash *kwise_h_func = (kwise_hash *) hash_functions;
-		for (i = 0; i < size; i++) {
-			uint64_t val = kwise_h_func[i].hash_function(&kwise_h_func[i], elem);
-			do {
-				old = sketch[i];
-			} while (val < old && !__atomic_compare_exchange_n(&(sketch[i]), &old, val, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
-		}
-		break;
-	    }
-	default: {
-		// pairwise hash function
-		pairwise_hash *pairwise_h_func = (pairwise_hash *) hash_functions; /// pairwise_h_func is the pairwise struct
-		for (i = 0; i < size; i++) {
-			uint64_t val = pairwise_h_func[i].hash_function(&pairwise_h_func[i], elem);
-			do {
-				old = sketch[i];
-			} while (val < old && !__atomic_compare_exchange_n(&(sketch[i]), &old, val, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
-		}
-		break;
-	    }
+void concurrent_basic_insert(sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem){
+
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, n;
+	for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+		n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+		hash_values(hash_functions, hash_type, i, n, elem, values);
+		concurrent_min_update(sketch + i, values, n);
 	}
-	
-
 }
 
 
@@ -455,16 +596,20 @@ void insert_conc_minhash_0(conc_minhash *sketch, uint64_t val) {
  * When the total number of insertions reaches a threshold, a merge
  * operation is triggered to align sketches for queries.
  *
+ * This is the acquire step, shared by insert_conc_minhash and insert_conc_minhash_values:
+ * it returns the insert sketch with the pending insertion of the caller counted.
+ *
  * @param sketch The concurrent MinHash data structure.
- * @param val The value to be inserted 
+ * @return The tagged pointer of the insert sketch, to be released by conc_insert_release
  */
-void insert_conc_minhash(conc_minhash *sketch, uint64_t val) {
+static union tagged_pointer *conc_insert_acquire(conc_minhash *sketch) {
 
 	_Atomic(union tagged_pointer *) insert_sketch; //128-bit ptr → <sketch_ptr, pending_cnt, insert_cnt>
 	union tagged_pointer new_val, old_val;
-	uint64_t *Icur, *Inew;
+	sketch_t *Icur, *Inew;
 	uint32_t pending_cnt; // pending insertion of each thread
 	int32_t insert_cnt; // completed insertions
+	int64_t counter;    // counter of the insert sketch after the increment of this thread
 	unsigned long res_cas = 0;
 	trace(STDERR_FILENO,"[%u ]START Icur %p \t sketch->sketches[1]->sketch %p\n", gettid()%sketch->N,Icur, sketch->sketches[1]->sketch);
 
@@ -478,12 +623,13 @@ void insert_conc_minhash(conc_minhash *sketch, uint64_t val) {
          *    +1 to insert_cnt
          *    +1 << PENDING_OFFSET to pending_cnt
          */
-		insert_sketch = FetchAndInc128(&(sketch->sketches[1]), 1 + (1ULL<<PENDING_OFFSET));
+		insert_sketch = fetch_and_inc_counter(&(sketch->sketches[1]), 1 + (1ULL<<PENDING_OFFSET), &counter);
 
-		//unmarshaling of each field
+		// unmarshaling of each field, from the counter written by the increment: the counter read again
+		// afterwards may include the failed attempts of other writers during a merge, and look non negative
 		Icur = insert_sketch->sketch;
-		insert_cnt = (int32_t) insert_sketch->counter & MASK;
-		pending_cnt = (uint32_t) ((insert_sketch->counter >> PENDING_OFFSET) & MASK);
+		insert_cnt = (int32_t) (counter & MASK);
+		pending_cnt = (uint32_t) ((counter >> PENDING_OFFSET) & MASK);
 
 		trace(STDOUT_FILENO,"BEFORE INSERTION \n");
 		trace(STDOUT_FILENO,"counter = 0x%016llX\n", (unsigned long long)insert_sketch->counter);
@@ -491,10 +637,17 @@ void insert_conc_minhash(conc_minhash *sketch, uint64_t val) {
     	trace(STDOUT_FILENO,"insert_cnt (int32_t)  = 0x%08X (%d) \t threshold %d \n", (int32_t)insert_cnt, insert_cnt, (int32_t)((sketch->b-1)*sketch->N));
 
     	//threshold not reached, do the insertion
-		if (insert_cnt >= 0 && insert_cnt <= (int32_t)((sketch->b-1)*sketch->N)) break; 
+		if (insert_cnt >= 0 && insert_cnt <= (int32_t)((sketch->b-1)*sketch->N)) {
+			// the counter was incremented on the sketch loaded before a merge published a new one: that is
+			// the query sketch now, and its counter grows back from -N with the late attempts. Retry on the new one
+			if (__atomic_load_n(&(sketch->sketches[1]), __ATOMIC_SEQ_CST) == insert_sketch) break;
+			FetchAndInc128(&insert_sketch, -((int64_t)1<<PENDING_OFFSET));
+			continue;
+		}
 
 		// otherwise an insertions or a merge might happen, decrement pending counter
 		FetchAndInc128(&insert_sketch, -((int64_t)1<<PENDING_OFFSET));
+		res_cas = 0; // a merge won in a previous round is done, only a new CAS can start another
     	
     	// if above threshold check if a merge is needed
 		if (insert_cnt > (int32_t)((sketch->b-1)*sketch->N)) { 
@@ -553,19 +706,72 @@ void insert_conc_minhash(conc_minhash *sketch, uint64_t val) {
 
 	} //end outer while true
 
+	return insert_sketch;
+}
+
+/** Insertion on the acquired insert sketch completed: decrement its pending counter */
+static void conc_insert_release(conc_minhash *sketch, _Atomic(union tagged_pointer *) insert_sketch) {
+
+	FetchAndInc128(&insert_sketch, -((int64_t)1<<PENDING_OFFSET));
+
+   	trace(STDERR_FILENO, "[%u] has finished insertion! \n", gettid()%sketch->N);
+	trace(STDOUT_FILENO,"AFTER INSERTION \n");
+	trace(STDOUT_FILENO,"counter = 0x%016llX\n", (unsigned long long)insert_sketch->counter);
+}
+
+/**
+ * Concurrent insertion of val: acquire the insert sketch, hash val into it, release it.
+ *
+ * @param sketch The concurrent MinHash data structure.
+ * @param val The value to be inserted 
+ */
+void insert_conc_minhash(conc_minhash *sketch, uint64_t val) {
+
+	union tagged_pointer *insert_sketch = conc_insert_acquire(sketch);
 
     /**
      * Perform the actual MinHash insertion on the current sketch.
      * This updates local sketch state concurrently via CAS.
      */
-	concurrent_basic_insert(insert_sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, val);
+	void *hash_functions = sketch->nodes > 1 ? sketch->node_hash_functions[current_node()] : sketch->hash_functions;
+	concurrent_basic_insert(insert_sketch->sketch, sketch->size, hash_functions, sketch->hash_type, val);
 
 	// insertion completed, decrement pending counter
-	FetchAndInc128(&insert_sketch, -((int64_t)1<<PENDING_OFFSET)); // TODO check if this is correct
+	conc_insert_release(sketch, insert_sketch);
+}
 
-   	trace(STDERR_FILENO, "[%u] has finished insertion! \n", gettid()%sketch->N);
-	trace(STDOUT_FILENO,"AFTER INSERTION \n");
-	trace(STDOUT_FILENO,"counter = 0x%016llX\n", (unsigned long long)insert_sketch->counter);
-    trace(STDOUT_FILENO,"pending_cnt (uint32_t)  = 0x%08X (%u)\n", pending_cnt, pending_cnt);
-    trace(STDOUT_FILENO,"insert_cnt (int32_t)  = 0x%08X (%d)\n", (int32_t)insert_cnt, insert_cnt);
+
+/**
+ * Insert an element already hashed by the caller (see fanout.h): same protocol as insert_conc_minhash,
+ * with the hash vector applied to the insert sketch by concurrent_min_update.
+ */
+void insert_conc_minhash_values(conc_minhash *sketch, const sketch_t *values) {
+
+	union tagged_pointer *insert_sketch = conc_insert_acquire(sketch);
+	concurrent_min_update(insert_sketch->sketch, values, sketch->size);
+	conc_insert_release(sketch, insert_sketch);
+}
+
+
+/**
+ * Insert a batch of elements, e.g. the keys produced by the ingestion layer.
+ * Each element is an insertion of insert_conc_minhash and counts towards the merge threshold.
+ */
+void insert_conc_minhash_batch(conc_minhash *sketch, const uint64_t *elems, size_t n) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		insert_conc_minhash(sketch, elems[i]);
+}
+
+/** ingest_sink of the concurrent sketch: ctx is the conc_minhash, tid is ignored */
+void conc_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+	(void) tid;
+	insert_conc_minhash_batch((conc_minhash *) ctx, keys, n);
+}
+
+/** values_sink of the concurrent sketch: ctx is the conc_minhash, tid is ignored */
+void conc_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+	(void) tid;
+	insert_conc_minhash_values((conc_minhash *) ctx, values);
 }
@@ -0,0 +1,255 @@
+#include <minhash.h>
+#include <configuration.h>
+#include <arena.h>
+
+
+void init_values_fc_minhash(fc_minhash *sketch, uint64_t size) {
+/**
+* Insert the elements from 0 to size into the sketch that is, generate a sketch for the set composed by the elements in [0, size]
+*/
+
+    uint64_t i;
+    for (i = 0; i < size; i++) {
+        basic_insert(sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, i);
+    }
+}
+
+
+void init_fc_minhash(fc_minhash **sketch, void *hash_functions, uint64_t sketch_size, int init_size, uint32_t hash_type, uint32_t N) {
+
+    *sketch = malloc(sizeof(fc_minhash));
+    if (*sketch == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating fc_minhash\n");
+        exit(1);
+    }
+
+    (*sketch)->N = N;
+    (*sketch)->size = sketch_size;
+
+    (*sketch)->hash_type = hash_type;
+    (*sketch)->hash_functions = hash_functions;
+
+    (*sketch)->sketch = sketch_alloc(sketch_size);
+    (*sketch)->batch_min = sketch_alloc(sketch_size);
+
+    (*sketch)->batch = malloc(N * sizeof(uint64_t));
+    if ((*sketch)->batch == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating combiner batch array\n");
+        exit(1);
+    }
+
+    (*sketch)->batch_values = malloc(N * sizeof(sketch_t *));
+    if ((*sketch)->batch_values == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating combiner batch_values array\n");
+        exit(1);
+    }
+
+    (*sketch)->served = malloc(N * sizeof(uint32_t));
+    if ((*sketch)->served == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating combiner served array\n");
+        exit(1);
+    }
+
+    // publication slots are cache line aligned, one per writer
+    if (posix_memalign((void **) &(*sketch)->requests, _Alignof(fc_request), N * sizeof(fc_request)) != 0) {
+        perror("posix_memalign failed for publication slots");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t t;
+    for (t = 0; t < N; t++) {
+        (*sketch)->requests[t].elem = 0;
+        (*sketch)->requests[t].values = NULL;
+        __atomic_store_n(&(*sketch)->requests[t].pending, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&(*sketch)->combiner_lock, 0, __ATOMIC_RELEASE);
+
+    uint64_t i;
+    for (i = 0; i < sketch_size; i++)
+        (*sketch)->sketch[i] = INFTY;
+
+    if (init_size > 0)
+        init_values_fc_minhash(*sketch, init_size);
+}
+
+
+void free_fc_minhash(fc_minhash *sketch) {
+
+    free(sketch->requests);
+    free(sketch->served);
+    free(sketch->batch);
+    free(sketch->batch_values);
+    sketch_free(sketch->batch_min, sketch->size);
+    sketch_free(sketch->sketch, sketch->size);
+    free(sketch);
+}
+
+
+/**
+ * This function applies all the published requests to the sketch.
+ *
+ * It must be called while holding the combiner lock. The combiner
+ *   1. collects the pending requests, skipping elements already present in the batch
+ *      (requests carrying a hash vector are collected apart, they need no hashing)
+ *   2. reduces the batch into a per slot minimum (identical minima collapse here)
+ *   3. writes the sketch in a single pass, only where the batch minimum wins
+ *   4. releases the served writers by resetting their pending flag
+ *
+ * Steps 2-3 touch the sketch once per batch instead of once per element,
+ * keeping it in the combiner's cache while other writers only spin on their own slot.
+ *
+ * @param sketch Pointer to the flat-combining MinHash structure.
+ */
+void fc_combine(fc_minhash *sketch) {
+
+    uint32_t t, j, n = 0, m = 0, served = 0;
+
+    // Step 1: collect pending requests
+    for (t = 0; t < sketch->N; t++) {
+        if (!__atomic_load_n(&(sketch->requests[t].pending), __ATOMIC_ACQUIRE))
+            continue;
+
+        sketch->served[served++] = t;
+        if (sketch->requests[t].values != NULL) {
+            sketch->batch_values[m++] = sketch->requests[t].values;
+            continue;
+        }
+
+        uint64_t elem = sketch->requests[t].elem;
+        for (j = 0; j < n; j++)
+            if (sketch->batch[j] == elem) break;
+        if (j == n)
+            sketch->batch[n++] = elem;
+    }
+
+    if (served == 0) return;
+
+    // Steps 2-3: a single element or hash vector goes straight to the sketch, otherwise reduce first
+    if (n + m == 1) {
+        if (n == 1)
+            basic_insert(sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, sketch->batch[0]);
+        else
+            min_update(sketch->sketch, sketch->batch_values[0], sketch->size);
+    } else {
+        uint64_t i;
+        for (i = 0; i < sketch->size; i++)
+            sketch->batch_min[i] = INFTY;
+        for (j = 0; j < n; j++)
+            basic_insert(sketch->batch_min, sketch->size, sketch->hash_functions, sketch->hash_type, sketch->batch[j]);
+        for (j = 0; j < m; j++)
+            min_update(sketch->batch_min, sketch->batch_values[j], sketch->size);
+        merge(sketch->sketch, sketch->batch_min, sketch->size);
+    }
+
+    // Step 4: release the served writers, making the sketch updates visible to them
+    for (j = 0; j < served; j++)
+        __atomic_store_n(&(sketch->requests[sketch->served[j]].pending), 0, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Spin on the request of the calling writer, becoming the combiner whenever the lock is free,
+ * until a combiner has applied it.
+ */
+static void fc_wait(fc_minhash *sketch, fc_request *req) {
+
+    while (__atomic_load_n(&(req->pending), __ATOMIC_ACQUIRE)) {
+
+        uint32_t expected = 0;
+        // test-and-test-and-set: only try the CAS when the lock looks free
+        if (__atomic_load_n(&(sketch->combiner_lock), __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&(sketch->combiner_lock), &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+
+            fc_combine(sketch);
+            __atomic_store_n(&(sketch->combiner_lock), 0, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+
+/**
+ * This function performs a flat-combining insertion into the MinHash sketch.
+ *
+ * The writer publishes the element in its own slot and then either becomes the
+ * combiner, applying every pending request, or spins until a combiner has served it.
+ *
+ * @param sketch Pointer to the flat-combining MinHash structure.
+ * @param tid    Index of the publication slot owned by the calling thread (0 <= tid < N)
+ * @param elem   Element to be inserted into the sketch.
+ */
+void insert_fc_minhash(fc_minhash *sketch, uint32_t tid, uint64_t elem) {
+
+    fc_request *req = &(sketch->requests[tid]);
+
+    req->elem = elem;
+    req->values = NULL;
+    __atomic_store_n(&(req->pending), 1, __ATOMIC_RELEASE);
+
+    fc_wait(sketch, req);
+}
+
+
+/**
+ * Insert a batch of elements, each one published and combined as in insert_fc_minhash.
+ */
+void insert_fc_minhash_batch(fc_minhash *sketch, uint32_t tid, const uint64_t *elems, size_t n) {
+
+    size_t i;
+    for (i = 0; i < n; i++)
+        insert_fc_minhash(sketch, tid, elems[i]);
+}
+
+/** ingest_sink of the flat-combining sketch: ctx is the fc_minhash, tid is the publication slot */
+void fc_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    insert_fc_minhash_batch((fc_minhash *) ctx, tid, keys, n);
+}
+
+
+/**
+ * Publish the hash vector of an element already hashed by the writer (see fanout.h).
+ * The combiner applies it with a min-update instead of hashing the element again;
+ * values must stay valid until the call returns, which it does once the request is served.
+ */
+void insert_fc_minhash_values(fc_minhash *sketch, uint32_t tid, const sketch_t *values) {
+
+    fc_request *req = &(sketch->requests[tid]);
+
+    req->values = values;
+    __atomic_store_n(&(req->pending), 1, __ATOMIC_RELEASE);
+
+    fc_wait(sketch, req);
+}
+
+/** values_sink of the flat-combining sketch: ctx is the fc_minhash, tid is the publication slot */
+void fc_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+    insert_fc_minhash_values((fc_minhash *) ctx, tid, values);
+}
+
+
+/**
+ * This function performs the query on the MinHash sketch.
+ *
+ * Slots only decrease and are written by one combiner at a time,
+ * so the query reads the sketch directly as concurrent_query does.
+ *
+ * @param sketch Pointer to the flat-combining MinHash structure.
+ * @param otherSketch Pointer to another MinHash sketch to compare against.
+ * @return float Similarity between the two sketches
+ */
+float query_fc_minhash(fc_minhash *sketch, sketch_t *otherSketch) {
+
+    uint64_t i;
+    int count = 0;
+    for (i = 0; i < sketch->size; i++) {
+        if (IS_EQUAL(sketch->sketch[i], otherSketch[i]))
+            count++;
+    }
+
+    return count/(float)sketch->size;
+}
+
+/** Set size estimates on the sketch itself: the combiner only lowers slots, so a concurrent read sees valid minima */
+void estimate_fc_minhash(fc_minhash *sketch, const sketch_t *otherSketch, set_estimates *out) {
+
+    estimate_sets(sketch->sketch, otherSketch, sketch->size, hash_functions_modulus(sketch->hash_functions, sketch->hash_type), out);
+}
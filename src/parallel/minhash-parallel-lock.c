@@ -11,7 +11,7 @@ void insert_parallel(minhash_sketch *sketch, uint64_t elem) {
     pthread_rwlock_wrlock(&(sketch->rw_lock));
 #endif
 
-        basic_insert(sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, elem);
+        insert(sketch, elem);
 
 	
 
@@ -25,6 +25,63 @@ void insert_parallel(minhash_sketch *sketch, uint64_t elem) {
 
 
 
+/**
+ * Insert a batch of elements taking the lock once for the whole batch.
+ */
+void insert_parallel_batch(minhash_sketch *sketch, const uint64_t *elems, size_t n) {
+
+#ifdef LOCKS
+    pthread_mutex_lock(&(sketch->lock));
+#elif defined(RW_LOCKS)
+    pthread_rwlock_wrlock(&(sketch->rw_lock));
+#endif
+
+    size_t i;
+    for (i = 0; i < n; i++)
+        insert(sketch, elems[i]);
+
+#ifdef LOCKS
+    pthread_mutex_unlock(&(sketch->lock));
+#elif defined(RW_LOCKS)
+    pthread_rwlock_unlock(&(sketch->rw_lock));
+#endif
+}
+
+/** ingest_sink of the lock-based sketch: ctx is the minhash_sketch, tid is ignored */
+void minhash_parallel_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    (void) tid;
+    insert_parallel_batch((minhash_sketch *) ctx, keys, n);
+}
+
+
+/**
+ * Insert an element already hashed by the caller (see fanout.h): only the min-update runs under the lock.
+ */
+void insert_parallel_values(minhash_sketch *sketch, const sketch_t *values) {
+
+#ifdef LOCKS
+    pthread_mutex_lock(&(sketch->lock));
+#elif defined(RW_LOCKS)
+    pthread_rwlock_wrlock(&(sketch->rw_lock));
+#endif
+
+    insert_values(sketch, values);
+
+#ifdef LOCKS
+    pthread_mutex_unlock(&(sketch->lock));
+#elif defined(RW_LOCKS)
+    pthread_rwlock_unlock(&(sketch->rw_lock));
+#endif
+}
+
+/** values_sink of the lock-based sketch: ctx is the minhash_sketch, tid is ignored */
+void minhash_parallel_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+    (void) tid;
+    insert_parallel_values((minhash_sketch *) ctx, values);
+}
+
+
+
 float query_parallel(minhash_sketch *sketch, minhash_sketch *otherSketch) {
 
 	uint64_t i;
@@ -54,3 +111,21 @@ float query_parallel(minhash_sketch *sketch, minhash_sketch *otherSketch) {
     fprintf(stderr, "[query] actual count %d\n", count);
 	return count/(float)sketch->size;
 }
+
+/** Set size estimates under the read side of the lock, otherSketch is not locked */
+void estimate_parallel(minhash_sketch *sketch, const sketch_t *otherSketch, set_estimates *out) {
+
+#ifdef LOCKS
+    pthread_mutex_lock(&(sketch->lock));
+#elif defined(RW_LOCKS)
+    pthread_rwlock_rdlock(&(sketch->rw_lock));
+#endif
+
+    estimate_sets(sketch->sketch, otherSketch, sketch->size, hash_functions_modulus(sketch->hash_functions, sketch->hash_type), out);
+
+#ifdef LOCKS
+    pthread_mutex_unlock(&(sketch->lock));
+#elif defined(RW_LOCKS)
+    pthread_rwlock_unlock(&(sketch->rw_lock));
+#endif
+}
@@ -0,0 +1,279 @@
+#include <minhash.h>
+#include <configuration.h>
+#include <arena.h>
+
+
+void init_values_sharded_minhash(sharded_minhash *sketch, uint64_t size) {
+/**
+* Insert the elements from 0 to size into the sketch that is, generate a sketch for the set composed by the elements in [0, size]
+* The initial set is stored in the first shard, the merged view takes care of spreading it to queries
+*/
+
+    uint64_t i;
+    for (i = 0; i < size; i++) {
+        basic_insert(sketch->shards[0], sketch->size, sketch->hash_functions, sketch->hash_type, i);
+    }
+    __atomic_store_n(&(sketch->versions[0].version), 1, __ATOMIC_RELEASE);
+}
+
+
+static size_t shard_bytes(uint64_t sketch_size) {
+    size_t bytes = sketch_size * sizeof(sketch_t);
+    return bytes < 64 ? 64 : bytes;
+}
+
+void init_sharded_minhash(sharded_minhash **sketch, void *hash_functions, uint64_t sketch_size, int init_size, uint32_t hash_type, uint32_t N) {
+
+    *sketch = malloc(sizeof(sharded_minhash));
+    if (*sketch == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating sharded_minhash\n");
+        exit(1);
+    }
+
+    (*sketch)->N = N;
+    (*sketch)->size = sketch_size;
+
+    (*sketch)->hash_type = hash_type;
+    (*sketch)->hash_functions = hash_functions;
+
+    (*sketch)->shards = malloc(N * sizeof(sketch_t *));
+    if ((*sketch)->shards == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating shards array\n");
+        exit(1);
+    }
+
+    // each shard starts on its own cache line so that owners never share a line:
+    // arena blocks of 64 bytes and more are 64-byte aligned
+    uint32_t t;
+    uint64_t i;
+    for (t = 0; t < N; t++) {
+        (*sketch)->shards[t] = arena_alloc(shard_bytes(sketch_size));
+        for (i = 0; i < sketch_size; i++)
+            (*sketch)->shards[t][i] = INFTY;
+    }
+
+    if (posix_memalign((void **) &(*sketch)->versions, _Alignof(shard_version), N * sizeof(shard_version)) != 0) {
+        perror("posix_memalign failed for shard versions");
+        exit(EXIT_FAILURE);
+    }
+    for (t = 0; t < N; t++)
+        __atomic_store_n(&((*sketch)->versions[t].version), 0, __ATOMIC_RELAXED);
+
+    (*sketch)->merged = sketch_alloc(sketch_size);
+    for (i = 0; i < sketch_size; i++)
+        (*sketch)->merged[i] = INFTY;
+
+    __atomic_store_n(&(*sketch)->merged_stamp, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(*sketch)->seq, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(*sketch)->merge_lock, 0, __ATOMIC_RELEASE);
+
+    if (init_size > 0)
+        init_values_sharded_minhash(*sketch, init_size);
+}
+
+
+void free_sharded_minhash(sharded_minhash *sketch) {
+
+    uint32_t t;
+    for (t = 0; t < sketch->N; t++)
+        arena_free(sketch->shards[t], shard_bytes(sketch->size));
+    free(sketch->shards);
+    free(sketch->versions);
+    sketch_free(sketch->merged, sketch->size);
+    free(sketch);
+}
+
+
+/**
+ * This function performs an insertion into the shard owned by the calling thread.
+ *
+ * The shard has a single writer, so slots are updated with plain stores and no atomics.
+ * When the element changes the shard, its version is published with a release store
+ * so that a merge reading the new version also reads the new slot values.
+ *
+ * @param sketch Pointer to the sharded MinHash structure.
+ * @param shard  Index of the shard owned by the calling thread (0 <= shard < N)
+ * @param elem   Element to be inserted into the sketch.
+ */
+void insert_sharded_minhash(sharded_minhash *sketch, uint32_t shard, uint64_t elem) {
+
+    if (basic_insert(sketch->shards[shard], sketch->size, sketch->hash_functions, sketch->hash_type, elem)) {
+        uint64_t v = __atomic_load_n(&(sketch->versions[shard].version), __ATOMIC_RELAXED);
+        __atomic_store_n(&(sketch->versions[shard].version), v + 1, __ATOMIC_RELEASE);
+    }
+}
+
+
+/**
+ * Insert a batch of elements into the shard owned by the calling thread.
+ * The version is published once for the whole batch, so queries merge at most once per batch.
+ */
+void insert_sharded_minhash_batch(sharded_minhash *sketch, uint32_t shard, const uint64_t *elems, size_t n) {
+
+    size_t i;
+    int changed = 0;
+    for (i = 0; i < n; i++)
+        changed |= basic_insert(sketch->shards[shard], sketch->size, sketch->hash_functions, sketch->hash_type, elems[i]);
+
+    if (changed) {
+        uint64_t v = __atomic_load_n(&(sketch->versions[shard].version), __ATOMIC_RELAXED);
+        __atomic_store_n(&(sketch->versions[shard].version), v + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/** ingest_sink of the sharded sketch: ctx is the sharded_minhash, tid is the shard */
+void sharded_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    insert_sharded_minhash_batch((sharded_minhash *) ctx, tid, keys, n);
+}
+
+
+/**
+ * Insert an element already hashed by the caller (see fanout.h) into the shard owned by the calling thread,
+ * publishing the version as insert_sharded_minhash does.
+ */
+void insert_sharded_minhash_values(sharded_minhash *sketch, uint32_t shard, const sketch_t *values) {
+
+    if (min_update(sketch->shards[shard], values, sketch->size)) {
+        uint64_t v = __atomic_load_n(&(sketch->versions[shard].version), __ATOMIC_RELAXED);
+        __atomic_store_n(&(sketch->versions[shard].version), v + 1, __ATOMIC_RELEASE);
+    }
+}
+
+/** values_sink of the sharded sketch: ctx is the sharded_minhash, tid is the shard */
+void sharded_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+    insert_sharded_minhash_values((sharded_minhash *) ctx, tid, values);
+}
+
+
+/**
+ * Return the version stamp of the shards, that is the sum of their versions.
+ * Versions only grow, so two equal stamps mean that no shard changed in between.
+ */
+uint64_t sharded_stamp(sharded_minhash *sketch) {
+
+    uint32_t t;
+    uint64_t stamp = 0;
+    for (t = 0; t < sketch->N; t++)
+        stamp += __atomic_load_n(&(sketch->versions[t].version), __ATOMIC_ACQUIRE);
+    return stamp;
+}
+
+
+/**
+ * Rebuild the merged view as the slot-wise minimum across the shards.
+ * Must be called while holding merge_lock. The stamp is taken before reading
+ * the shards: updates racing with the merge only make the view fresher than its stamp.
+ */
+static void sharded_merge(sharded_minhash *sketch) {
+
+    uint64_t s = __atomic_load_n(&(sketch->seq), __ATOMIC_RELAXED);
+    uint64_t stamp = sharded_stamp(sketch);
+    uint64_t i;
+    uint32_t t;
+
+    __atomic_store_n(&(sketch->seq), s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    for (i = 0; i < sketch->size; i++)
+        sketch->merged[i] = sketch->shards[0][i];
+    for (t = 1; t < sketch->N; t++) {
+        sketch_t *shard = sketch->shards[t];
+        for (i = 0; i < sketch->size; i++)
+            sketch->merged[i] = shard[i] < sketch->merged[i] ? shard[i] : sketch->merged[i];
+    }
+
+    __atomic_store_n(&(sketch->merged_stamp), stamp, __ATOMIC_RELAXED);
+    __atomic_store_n(&(sketch->seq), s + 2, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Wait for a merged view at least as fresh as stamp, merging the shards if nobody else is doing it.
+ * Returns the (even) sequence number the caller must validate its reads of merged against.
+ */
+static uint64_t sharded_fresh_view(sharded_minhash *sketch, uint64_t stamp) {
+
+    while (1) {
+        uint64_t s = __atomic_load_n(&(sketch->seq), __ATOMIC_ACQUIRE);
+        if (!(s & 1) && __atomic_load_n(&(sketch->merged_stamp), __ATOMIC_RELAXED) >= stamp)
+            return s;
+
+        uint32_t expected = 0;
+        if (__atomic_load_n(&(sketch->merge_lock), __ATOMIC_RELAXED) == 0 &&
+            __atomic_compare_exchange_n(&(sketch->merge_lock), &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            // another query thread may have merged while we were acquiring the lock
+            if (__atomic_load_n(&(sketch->merged_stamp), __ATOMIC_RELAXED) < stamp)
+                sharded_merge(sketch);
+            __atomic_store_n(&(sketch->merge_lock), 0, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+
+/**
+ * Copy into out the merged view of the shards, merging them only if they changed since the last merge.
+ */
+void sharded_snapshot(sharded_minhash *sketch, sketch_t *out) {
+
+    uint64_t stamp = sharded_stamp(sketch);
+    uint64_t i, s;
+
+    do {
+        s = sharded_fresh_view(sketch, stamp);
+        for (i = 0; i < sketch->size; i++)
+            out[i] = sketch->merged[i];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&(sketch->seq), __ATOMIC_RELAXED) != s);
+}
+
+void sharded_snapshot_source(void *ctx, sketch_t *out) {
+    sharded_snapshot((sharded_minhash *) ctx, out);
+}
+
+
+/**
+ * This function performs the query on the MinHash sketch.
+ *
+ * The similarity is computed on the merged view of the shards. The view is rebuilt
+ * only when a shard changed since the last merge, so repeated queries on an unchanged
+ * sketch cost the version check and the comparison only.
+ *
+ * @param sketch Pointer to the sharded MinHash structure.
+ * @param otherSketch Pointer to another MinHash sketch to compare against.
+ * @return float Similarity between the two sketches
+ */
+float query_sharded_minhash(sharded_minhash *sketch, sketch_t *otherSketch) {
+
+    uint64_t stamp = sharded_stamp(sketch);
+    uint64_t i, s;
+    int count;
+
+    do {
+        s = sharded_fresh_view(sketch, stamp);
+        count = 0;
+        for (i = 0; i < sketch->size; i++) {
+            if (IS_EQUAL(sketch->merged[i], otherSketch[i]))
+                count++;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&(sketch->seq), __ATOMIC_RELAXED) != s);
+
+    return count/(float)sketch->size;
+}
+
+
+/**
+ * Set size estimates on the merged view of the shards, validated against the sequence counter like the query.
+ */
+void estimate_sharded_minhash(sharded_minhash *sketch, const sketch_t *otherSketch, set_estimates *out) {
+
+    uint64_t stamp = sharded_stamp(sketch);
+    uint64_t M = hash_functions_modulus(sketch->hash_functions, sketch->hash_type);
+    uint64_t s;
+
+    do {
+        s = sharded_fresh_view(sketch, stamp);
+        estimate_sets(sketch->merged, otherSketch, sketch->size, M, out);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&(sketch->seq), __ATOMIC_RELAXED) != s);
+}
@@ -0,0 +1,577 @@
+#include <minhash.h>
+#include <configuration.h>
+#include <numa_alloc.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+
+#define SHM_ALIGN 64
+#define SHM_ATTACH_WAIT_MS 10000   // an attaching process waits this long for the creator to initialize the segment
+#define SHM_LIVENESS_SPINS (1 << 16)  // spins on a process, pending insertions or merge, between two checks that it is alive
+
+static inline uint64_t shm_align(uint64_t n) {
+	return (n + SHM_ALIGN - 1) & ~((uint64_t) SHM_ALIGN - 1);
+}
+
+/**
+ * The 128-bit CAS goes through libatomic, which reports it as not lock free since its loads write too.
+ * Processes share it only when it is the cmpxchg16b instruction and not a lock private to the process
+ */
+static int shm_cas_shared(void) {
+#if defined(__x86_64__)
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_CMPXCHG16B);
+#elif defined(__aarch64__)
+	return 1;
+#else
+	union shm_tagged probe;
+	return __atomic_is_lock_free(sizeof(probe.packed_value), &probe.packed_value);
+#endif
+}
+
+static inline void *shm_at(shm_minhash *sketch, uint64_t offset) {
+	return (char *) sketch->segment + offset;
+}
+
+static inline uint64_t shm_offset(shm_minhash *sketch, const void *ptr) {
+	return (uint64_t) ((const char *) ptr - (const char *) sketch->segment);
+}
+
+static inline sketch_t *record_sketch(shm_minhash *sketch, shm_record *record) {
+	return shm_at(sketch, record->sketch);
+}
+
+static inline shm_record *load_record(shm_minhash *sketch, int i) {
+	return shm_at(sketch, __atomic_load_n(&sketch->segment->sketches[i], __ATOMIC_ACQUIRE));
+}
+
+
+static inline uint32_t record_index(shm_minhash *sketch, shm_record *record) {
+	return (uint32_t) (record - (shm_record *) shm_at(sketch, sketch->segment->records));
+}
+
+
+/** --- Processes: the pending counts of conc_minhash, kept per process --- */
+
+/** A process is dead once it is gone, or a zombie its parent did not wait for yet */
+static int shm_pid_dead(int32_t pid) {
+
+	if (kill((pid_t) pid, 0) != 0)
+		return errno == ESRCH;
+
+	char path[64], stat[256];
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+	FILE *f = fopen(path, "r");
+	if (f == NULL)
+		return errno == ENOENT;
+	size_t n = fread(stat, 1, sizeof(stat) - 1, f);
+	fclose(f);
+	stat[n] = '\0';
+	// the state follows the command name, which is in parentheses and may contain any character
+	char *state = strrchr(stat, ')');
+	return state != NULL && (state[2] == 'Z' || state[2] == 'X');
+}
+
+/** Take back the slot of the dead process pid: its pending counts are dropped, the merges waiting for them go on */
+static void shm_proc_reclaim(shm_segment *segment, shm_proc *proc, int32_t pid) {
+
+	// only one process reclaims the slot, and not after it was given to another process
+	if (!__atomic_compare_exchange_n(&proc->pid, &pid, -1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return;
+	uint32_t r;
+	for (r = 0; r < SHM_RECORDS; r++)
+		__atomic_store_n(&proc->pending[r], 0, __ATOMIC_RELEASE);
+	__atomic_fetch_sub(&segment->attached, 1, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&proc->pid, 0, __ATOMIC_RELEASE);
+}
+
+/** A free slot for the calling process, the slots of dead processes reclaimed if none is free */
+static shm_proc *shm_proc_attach(shm_segment *segment) {
+
+	int32_t self = (int32_t) getpid();
+	uint32_t p;
+	int pass;
+	for (pass = 0; pass < 2; pass++) {
+		for (p = 0; p < SHM_PROCS; p++) {
+			shm_proc *proc = &segment->procs[p];
+			int32_t pid = __atomic_load_n(&proc->pid, __ATOMIC_ACQUIRE);
+			if (pass == 1 && pid > 0 && shm_pid_dead(pid)) {
+				shm_proc_reclaim(segment, proc, pid);
+				pid = 0;
+			}
+			if (pid == 0 && __atomic_compare_exchange_n(&proc->pid, &pid, self, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+				return proc;
+		}
+	}
+	fprintf(stderr, "The %d process slots of the shared memory sketch are taken by live processes\n", SHM_PROCS);
+	exit(1);
+}
+
+/** Wait until no process has an insertion pending on record, reclaiming the slots of the dead ones */
+static void shm_drain(shm_minhash *sketch, shm_record *record) {
+
+	shm_segment *segment = sketch->segment;
+	uint32_t r = record_index(sketch, record), p;
+	for (p = 0; p < SHM_PROCS; p++) {
+		shm_proc *proc = &segment->procs[p];
+		uint64_t spins = 0;
+		while (__atomic_load_n(&proc->pending[r], __ATOMIC_SEQ_CST) != 0) {
+			if (++spins % SHM_LIVENESS_SPINS)
+				continue;
+			int32_t pid = __atomic_load_n(&proc->pid, __ATOMIC_ACQUIRE);
+			if (pid > 0 && shm_pid_dead(pid))
+				shm_proc_reclaim(segment, proc, pid);
+		}
+	}
+}
+
+/** Reclaim the slot of the dead process pid, if it still has one */
+static void shm_proc_reclaim_pid(shm_segment *segment, int32_t pid) {
+
+	uint32_t p;
+	for (p = 0; p < SHM_PROCS; p++)
+		if (__atomic_load_n(&segment->procs[p].pid, __ATOMIC_ACQUIRE) == pid)
+			shm_proc_reclaim(segment, &segment->procs[p], pid);
+}
+
+
+/** Count a pending insertion of the process on the insert record, then add 1 to its insert count, as
+ *  FetchAndInc128 of conc_minhash. The word written by the increment is returned in word. A record being
+ *  merged (negative insert count) is not counted: counting up from -N it would take insertions again */
+static shm_record *shm_fetch_and_inc(shm_minhash *sketch, union shm_tagged *word) {
+
+	union shm_tagged current, next;
+	shm_record *record;
+	for (;;) {
+		record = shm_at(sketch, __atomic_load_n(&sketch->segment->sketches[1], __ATOMIC_SEQ_CST));
+		_Atomic uint32_t *pending = &sketch->proc->pending[record_index(sketch, record)];
+		__atomic_fetch_add(pending, 1, __ATOMIC_SEQ_CST);
+
+		current.packed_value = __atomic_load_n(&record->word.packed_value, __ATOMIC_SEQ_CST);
+		next = current;
+		if ((int32_t) (current.counter & MASK) >= 0)
+			next.counter++;
+		if (__atomic_compare_exchange_n(&record->word.packed_value, &current.packed_value, next.packed_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			*word = next;
+			return record;
+		}
+		__atomic_fetch_sub(pending, 1, __ATOMIC_RELEASE);
+	}
+}
+
+/** The insertion of the process on record is no longer pending */
+static inline void shm_insert_release(shm_minhash *sketch, shm_record *record) {
+	__atomic_fetch_sub(&sketch->proc->pending[record_index(sketch, record)], 1, __ATOMIC_RELEASE);
+}
+
+
+/** --- Segment --- */
+
+void create_shm_minhash(shm_minhash **sketch, const char *name, void *hash_functions, uint64_t sketch_size, uint32_t hash_type, uint32_t N, uint32_t b) {
+
+	if (!shm_cas_shared()) {
+		fprintf(stderr, "The 128-bit CAS is not an instruction on this machine, it cannot be shared by processes\n");
+		exit(1);
+	}
+	// with b = 1 the threshold is 0 and every insertion triggers a merge before it can insert
+	if (b < 2 || N == 0) {
+		fprintf(stderr, "The shared memory sketch needs b >= 2 and N >= 1 (b = %u, N = %u)\n", b, N);
+		exit(1);
+	}
+
+	uint64_t records = shm_align(sizeof(shm_segment));
+	uint64_t sketches = records + shm_align(SHM_RECORDS * sizeof(shm_record));
+	uint64_t sketch_bytes = shm_align(sketch_size * sizeof(sketch_t));
+	uint64_t hash_image = sketches + SHM_RECORDS * sketch_bytes;
+	uint64_t bytes = hash_image + shm_align(hash_functions_image_bytes(hash_functions, hash_type, sketch_size));
+
+	int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (fd < 0) {
+		perror("shm_open failed when creating the shared memory sketch");
+		exit(EXIT_FAILURE);
+	}
+	if (ftruncate(fd, (off_t) bytes) != 0) {
+		perror("ftruncate failed for the shared memory sketch");
+		exit(EXIT_FAILURE);
+	}
+	shm_segment *segment = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		perror("mmap failed for the shared memory sketch");
+		exit(EXIT_FAILURE);
+	}
+
+	*sketch = malloc(sizeof(shm_minhash));
+	if (*sketch == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating shm_minhash\n");
+		exit(1);
+	}
+	(*sketch)->segment = segment;
+
+	segment->magic = SHM_MAGIC;
+	segment->version = SHM_VERSION;
+	segment->slot_bytes = sizeof(sketch_t);
+	segment->bytes = bytes;
+	segment->size = sketch_size;
+	segment->hash_type = hash_type;
+	segment->N = N;
+	segment->b = b;
+	segment->hash_image = hash_image;
+	segment->records = records;
+	hash_functions_export(hash_functions, hash_type, sketch_size, shm_at(*sketch, hash_image));
+
+	// record 0 is the query record, record 1 the insert one, both empty
+	shm_record *record = shm_at(*sketch, records);
+	uint64_t r, i;
+	for (r = 0; r < SHM_RECORDS; r++) {
+		record[r].word.generation = 0;
+		record[r].word.counter = 0;
+		record[r].sketch = sketches + r * sketch_bytes;
+		sketch_t *slots = record_sketch(*sketch, &record[r]);
+		for (i = 0; i < sketch_size; i++)
+			slots[i] = INFTY;
+	}
+	__atomic_store_n(&segment->sketches[0], shm_offset(*sketch, &record[0]), __ATOMIC_RELAXED);
+	__atomic_store_n(&segment->sketches[1], shm_offset(*sketch, &record[1]), __ATOMIC_RELAXED);
+	__atomic_store_n(&segment->merges, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&segment->merger, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&segment->attached, 1, __ATOMIC_RELAXED);
+	// the process slots are zero, as the whole new segment
+	(*sketch)->proc = shm_proc_attach(segment);
+	__atomic_store_n(&segment->ready, 1, __ATOMIC_RELEASE);
+
+	(*sketch)->hash_functions = hash_functions_import(shm_at(*sketch, hash_image), hash_type, sketch_size);
+	(*sketch)->size = sketch_size;
+	(*sketch)->hash_type = hash_type;
+	(*sketch)->N = N;
+	(*sketch)->b = b;
+}
+
+void attach_shm_minhash(shm_minhash **sketch, const char *name) {
+
+	int fd = shm_open(name, O_RDWR, 0);
+	if (fd < 0) {
+		perror("shm_open failed when attaching the shared memory sketch");
+		exit(EXIT_FAILURE);
+	}
+
+	// the segment has its size once the creator truncated it, and its content once ready is set
+	struct stat st;
+	int waited = 0;
+	while (fstat(fd, &st) == 0 && st.st_size < (off_t) sizeof(shm_segment) && waited < SHM_ATTACH_WAIT_MS) {
+		usleep(1000);
+		waited++;
+	}
+	if (st.st_size < (off_t) sizeof(shm_segment)) {
+		fprintf(stderr, "Shared memory sketch %s was not created in %d ms\n", name, SHM_ATTACH_WAIT_MS);
+		exit(1);
+	}
+	shm_segment *segment = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		perror("mmap failed for the shared memory sketch");
+		exit(EXIT_FAILURE);
+	}
+	while (!__atomic_load_n(&segment->ready, __ATOMIC_ACQUIRE) && waited < SHM_ATTACH_WAIT_MS) {
+		usleep(1000);
+		waited++;
+	}
+	if (!__atomic_load_n(&segment->ready, __ATOMIC_ACQUIRE) || segment->magic != SHM_MAGIC || segment->version != SHM_VERSION ||
+	    segment->slot_bytes != sizeof(sketch_t) || segment->bytes != (uint64_t) st.st_size) {
+		fprintf(stderr, "Shared memory sketch %s is not initialized or was created by an incompatible build\n", name);
+		exit(1);
+	}
+
+	*sketch = malloc(sizeof(shm_minhash));
+	if (*sketch == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating shm_minhash\n");
+		exit(1);
+	}
+	(*sketch)->segment = segment;
+	(*sketch)->size = segment->size;
+	(*sketch)->hash_type = segment->hash_type;
+	(*sketch)->N = segment->N;
+	(*sketch)->b = segment->b;
+	(*sketch)->hash_functions = hash_functions_import(shm_at(*sketch, segment->hash_image), segment->hash_type, segment->size);
+	__atomic_fetch_add(&segment->attached, 1, __ATOMIC_ACQ_REL);
+	(*sketch)->proc = shm_proc_attach(segment);
+}
+
+void detach_shm_minhash(shm_minhash *sketch) {
+
+	__atomic_store_n(&sketch->proc->pid, 0, __ATOMIC_RELEASE);
+	__atomic_fetch_sub(&sketch->segment->attached, 1, __ATOMIC_ACQ_REL);
+	free(sketch->hash_functions);
+	munmap(sketch->segment, sketch->segment->bytes);
+	free(sketch);
+}
+
+void unlink_shm_minhash(const char *name) {
+
+	if (shm_unlink(name) != 0 && errno != ENOENT)
+		perror("shm_unlink failed for the shared memory sketch");
+}
+
+
+/** --- Merge and insertion: the protocol of concurrent_merge and conc_insert_acquire on records --- */
+
+/**
+ * Merge, run by the writer which set the insert counter to -N, or by a process which took the merge
+ * over from it once it died: every step may run again after a partial run, so a merge is restarted
+ * from step 1.
+ *
+ *   1. Wait until the writers of every process complete their pending insertions, or die
+ *   2. Publish the insert record as the query record
+ *   3. Recycle the record after it in the ring: once no stale writer counts on it, bump its
+ *      generation and reset its counter, then copy the new query sketch into it
+ *   4. Publish it as the insert record
+ *
+ * The recycled record was the query record two merges ago. Queries still reading it see its
+ * generation change and read the query record again.
+ */
+static void shm_merge(shm_minhash *sketch, shm_record *insert) {
+
+	shm_segment *segment = sketch->segment;
+
+	// Step 1
+	shm_drain(sketch, insert);
+
+	// Step 2
+	__atomic_store_n(&segment->sketches[0], shm_offset(sketch, insert), __ATOMIC_RELEASE);
+
+	// Step 3: a writer which loaded the record before it retired only adds to its counter and takes it back
+	shm_record *records = shm_at(sketch, segment->records);
+	shm_record *next = &records[(insert - records + 1) % SHM_RECORDS];
+	union shm_tagged current, fresh;
+	do {
+		shm_drain(sketch, next);
+		current.packed_value = __atomic_load_n(&next->word.packed_value, __ATOMIC_SEQ_CST);
+		fresh.generation = current.generation + 1;
+		fresh.counter = 0;
+	} while (!__atomic_compare_exchange_n(&next->word.packed_value, &current.packed_value, fresh.packed_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memcpy(record_sketch(sketch, next), record_sketch(sketch, insert), sketch->size * sizeof(sketch_t));
+
+	// Step 4
+	__atomic_store_n(&segment->sketches[1], shm_offset(sketch, next), __ATOMIC_RELEASE);
+	__atomic_fetch_add(&segment->merges, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * The merges are serialized by segment->merger, the pid of the process merging: a writer above the
+ * threshold takes it before it sets the insert counter to -N, and gives it back once the new insert
+ * record is published. Taken with pid 0, or with the pid of a dead process when expected is that pid
+ */
+static int shm_merger_claim(shm_minhash *sketch, int32_t expected) {
+
+	return __atomic_compare_exchange_n(&sketch->segment->merger, &expected, (int32_t) getpid(), 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+/**
+ * Merge of record, generation generation, by the caller which holds segment->merger: the insert
+ * counter is set to -N unless a merger which died already did, then the merge runs. Nothing to
+ * do if the record was merged meanwhile
+ */
+static void shm_merge_claimed(shm_minhash *sketch, shm_record *record, uint64_t generation) {
+
+	const int32_t threshold = (int32_t) ((sketch->b - 1) * sketch->N);
+	union shm_tagged current, next;
+	current.packed_value = __atomic_load_n(&record->word.packed_value, __ATOMIC_SEQ_CST);
+	while (current.generation == generation && load_record(sketch, 1) == record) {
+		int32_t insert_cnt = (int32_t) (current.counter & MASK);
+		if (insert_cnt < 0) {
+			shm_merge(sketch, record);
+			break;
+		}
+		if (insert_cnt <= threshold)
+			break;
+		next.generation = current.generation;
+		next.counter = (int64_t) (((uint64_t) current.counter & ~MASK) | (uint32_t) -(int32_t) sketch->N);
+		if (__atomic_compare_exchange_n(&record->word.packed_value, &current.packed_value, next.packed_value, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+			shm_merge(sketch, record);
+			break;
+		}
+	}
+	__atomic_store_n(&sketch->segment->merger, 0, __ATOMIC_RELEASE);
+}
+
+/**
+ * Wait until the merge of record completes: the record is replaced, or it was recycled and published
+ * again since. The merge is taken when nobody holds segment->merger, and taken over, with the slot of
+ * the merger reclaimed, when the process holding it died
+ */
+static void shm_merge_wait(shm_minhash *sketch, shm_record *record, uint64_t generation) {
+
+	uint64_t spins = 0;
+	while (load_record(sketch, 1) == record && __atomic_load_n(&record->word.generation, __ATOMIC_ACQUIRE) == generation) {
+		int32_t merger = __atomic_load_n(&sketch->segment->merger, __ATOMIC_ACQUIRE);
+		if (merger == 0 && shm_merger_claim(sketch, 0)) {
+			shm_merge_claimed(sketch, record, generation);
+			continue;
+		}
+		if (++spins % SHM_LIVENESS_SPINS || merger <= 0 || !shm_pid_dead(merger))
+			continue;
+		if (shm_merger_claim(sketch, merger)) {
+			shm_proc_reclaim_pid(sketch->segment, merger);
+			shm_merge_claimed(sketch, record, generation);
+		}
+	}
+}
+
+/** The insert record, with the pending insertion of the caller counted: see conc_insert_acquire */
+static shm_record *shm_insert_acquire(shm_minhash *sketch) {
+
+	const int32_t threshold = (int32_t) ((sketch->b - 1) * sketch->N);
+	union shm_tagged word;
+	shm_record *record;
+
+	while (1) {
+
+		record = shm_fetch_and_inc(sketch, &word);
+		int32_t insert_cnt = (int32_t) (word.counter & MASK);
+
+		// threshold not reached: insert, if no merge published another record since the increment
+		if (insert_cnt >= 0 && insert_cnt <= threshold) {
+			if (load_record(sketch, 1) == record)
+				return record;
+			shm_insert_release(sketch, record);
+			continue;
+		}
+		shm_insert_release(sketch, record);
+
+		// above the threshold: the writer which takes the merger sets the insert counter to -N and merges
+		if (insert_cnt > threshold && shm_merger_claim(sketch, 0))
+			shm_merge_claimed(sketch, record, word.generation);
+		shm_merge_wait(sketch, record, word.generation);
+	}
+}
+
+void insert_shm_minhash(shm_minhash *sketch, uint64_t elem) {
+
+	shm_record *record = shm_insert_acquire(sketch);
+	concurrent_basic_insert(record_sketch(sketch, record), sketch->size, sketch->hash_functions, sketch->hash_type, elem);
+	shm_insert_release(sketch, record);
+}
+
+void insert_shm_minhash_values(shm_minhash *sketch, const sketch_t *values) {
+
+	shm_record *record = shm_insert_acquire(sketch);
+	concurrent_min_update(record_sketch(sketch, record), values, sketch->size);
+	shm_insert_release(sketch, record);
+}
+
+void insert_shm_minhash_batch(shm_minhash *sketch, const uint64_t *elems, size_t n) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		insert_shm_minhash(sketch, elems[i]);
+}
+
+/** ingest_sink of the shared memory sketch: ctx is the shm_minhash of the process, tid is ignored */
+void shm_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+	(void) tid;
+	insert_shm_minhash_batch((shm_minhash *) ctx, keys, n);
+}
+
+/** values_sink of the shared memory sketch: ctx is the shm_minhash of the process, tid is ignored */
+void shm_minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+	(void) tid;
+	insert_shm_minhash_values((shm_minhash *) ctx, values);
+}
+
+
+/** --- Queries --- */
+
+/**
+ * Start reading the query record, as conc_query_values: its generation is read while it is the query record,
+ * which no writer modifies until it is recycled. The values read are those of the query sketch unless
+ * query_read_retry, after them, sees the generation changed or another query record published
+ */
+static shm_record *query_read_begin(shm_minhash *sketch, uint64_t *generation) {
+
+	shm_record *record;
+	do {
+		record = load_record(sketch, 0);
+		*generation = __atomic_load_n(&record->word.generation, __ATOMIC_ACQUIRE);
+	} while (load_record(sketch, 0) != record);
+	return record;
+}
+
+static int query_read_retry(shm_minhash *sketch, shm_record *record, uint64_t generation) {
+
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&record->word.generation, __ATOMIC_RELAXED) != generation || load_record(sketch, 0) != record;
+}
+
+/** Copy of the query sketch into out */
+static void query_copy(shm_minhash *sketch, sketch_t *out) {
+
+	shm_record *record;
+	uint64_t generation;
+	do {
+		record = query_read_begin(sketch, &generation);
+		memcpy(out, record_sketch(sketch, record), sketch->size * sizeof(sketch_t));
+	} while (query_read_retry(sketch, record, generation));
+}
+
+/**
+ * This function performs the query on the shared memory sketch, like concurrent_query: the
+ * insertions since the last merge are not seen.
+ *
+ * @param sketch Handle of the calling process on the segment.
+ * @param otherSketch Pointer to another MinHash sketch to compare against.
+ * @return float Similarity between the two sketches
+ */
+float query_shm_minhash(shm_minhash *sketch, sketch_t *otherSketch) {
+
+	shm_record *record;
+	uint64_t generation, i;
+	int count;
+	do {
+		record = query_read_begin(sketch, &generation);
+		const sketch_t *values = record_sketch(sketch, record);
+		count = 0;
+		for (i = 0; i < sketch->size; i++)
+			count += IS_EQUAL(values[i], otherSketch[i]);
+	} while (query_read_retry(sketch, record, generation));
+
+	return count/(float)sketch->size;
+}
+
+/**
+ * Snapshot of the insert record, validated by its generation as in conc_minhash_snapshot: each merge
+ * copies the query sketch into the new insert record, which is thus the minimum of the two. The
+ * insertions in flight are in out in part or not at all. The collect holds if the record is still the
+ * insert record with the same generation after it, and is checked to be the insert one before it too:
+ * a recycled record gets its new generation before the merge copies the query sketch into it
+ */
+int shm_minhash_snapshot(shm_minhash *sketch, sketch_t *out) {
+
+	int r;
+	for (r = 0; r < SNAPSHOT_RETRIES; r++) {
+		shm_record *record = load_record(sketch, 1);
+		uint64_t generation = __atomic_load_n(&record->word.generation, __ATOMIC_ACQUIRE);
+		if (load_record(sketch, 1) != record)
+			continue;
+
+		memcpy(out, record_sketch(sketch, record), sketch->size * sizeof(sketch_t));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (load_record(sketch, 1) == record && __atomic_load_n(&record->word.generation, __ATOMIC_RELAXED) == generation)
+			return 1;
+	}
+
+	query_copy(sketch, out);
+	return 0;
+}
+
+void shm_minhash_snapshot_source(void *ctx, sketch_t *out) {
+	shm_minhash_snapshot((shm_minhash *) ctx, out);
+}
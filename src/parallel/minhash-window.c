@@ -0,0 +1,273 @@
+#include <minhash.h>
+#include <numa_alloc.h>
+#include <arena.h>
+
+
+static void fill_infty(sketch_t *sketch, uint64_t size) {
+
+    uint64_t i;
+    for (i = 0; i < size; i++)
+        sketch[i] = INFTY;
+}
+
+/** Merge into sketch everything a closed bucket holds: its query sketch and its insert sketch, with the insertions since its last merge */
+static void merge_bucket(sketch_t *sketch, conc_minhash *bucket) {
+
+    union tagged_pointer *query_sketch = __atomic_load_n(&(bucket->sketches[0]), __ATOMIC_ACQUIRE);
+    union tagged_pointer *insert_sketch = __atomic_load_n(&(bucket->sketches[1]), __ATOMIC_ACQUIRE);
+    merge(sketch, query_sketch->sketch, bucket->size);
+    merge(sketch, insert_sketch->sketch, bucket->size);
+}
+
+static conc_minhash *new_bucket(window_minhash *window) {
+
+    conc_minhash *bucket;
+    init_conc_minhash(&bucket, window->hash_functions, window->size, 0, window->hash_type, window->N, window->b);
+    return bucket;
+}
+
+
+void init_window_minhash(window_minhash **window, void *hash_functions, uint64_t sketch_size, uint32_t hash_type, uint32_t N, uint32_t b, uint32_t W, uint64_t width, uint64_t now) {
+
+    if (W < 2 || width == 0) {
+        fprintf(stderr, "A window needs at least 2 buckets of non zero width, got %u buckets of width %lu\n", W, width);
+        exit(1);
+    }
+
+    *window = malloc(sizeof(window_minhash));
+    if (*window == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating window_minhash\n");
+        exit(1);
+    }
+
+    (*window)->W = W;
+    (*window)->width = width;
+    (*window)->start = now;
+    (*window)->size = sketch_size;
+    (*window)->hash_type = hash_type;
+    (*window)->hash_functions = hash_functions;
+    (*window)->N = N;
+    (*window)->b = b;
+
+    // the ring fills up with the first W rotations
+    (*window)->buckets = calloc(W, sizeof(conc_minhash *));
+    (*window)->writers = calloc(W, sizeof(uint64_t));
+    (*window)->suffix = malloc(W * sizeof(sketch_t *));
+    if ((*window)->buckets == NULL || (*window)->writers == NULL || (*window)->suffix == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating the ring of %u buckets\n", W);
+        exit(1);
+    }
+    uint32_t i;
+    for (i = 0; i < W; i++)
+        (*window)->suffix[i] = sketch_alloc(sketch_size);
+    (*window)->buckets[0] = new_bucket(*window);
+    (*window)->retired = NULL;
+
+    (*window)->front_begin = 1;
+    (*window)->front_end = 0;
+    (*window)->back = sketch_alloc(sketch_size);
+    (*window)->closed = sketch_alloc(sketch_size);
+    fill_infty((*window)->back, sketch_size);
+    fill_infty((*window)->closed, sketch_size);
+
+    __atomic_store_n(&(*window)->seq, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&(*window)->current, 0, __ATOMIC_RELEASE);
+}
+
+void free_window_minhash(window_minhash *window) {
+
+    uint32_t i;
+    for (i = 0; i < window->W; i++) {
+        if (window->buckets[i] != NULL)
+            free_conc_minhash(window->buckets[i]);
+        sketch_free(window->suffix[i], window->size);
+    }
+    if (window->retired != NULL)
+        free_conc_minhash(window->retired);
+    free(window->buckets);
+    free((void *) window->writers);
+    free(window->suffix);
+    sketch_free(window->back, window->size);
+    sketch_free(window->closed, window->size);
+    free(window);
+}
+
+
+/**
+ * Enter the open bucket: count the writer on its ring slot, then check the bucket is still open.
+ * A rotation publishes the new bucket before reading the count of the closed one, so either it waits
+ * for this writer or the writer sees the new bucket and retries on it (both sides sequentially consistent).
+ */
+static uint64_t window_writer_enter(window_minhash *window) {
+
+    uint64_t c;
+    for (;;) {
+        c = __atomic_load_n(&window->current, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&window->writers[c % window->W], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&window->current, __ATOMIC_SEQ_CST) == c)
+            return c;
+        __atomic_fetch_sub(&window->writers[c % window->W], 1, __ATOMIC_RELEASE);
+    }
+}
+
+static void window_writer_exit(window_minhash *window, uint64_t c) {
+    __atomic_fetch_sub(&window->writers[c % window->W], 1, __ATOMIC_RELEASE);
+}
+
+/** Insert elem into the open bucket, through the insertion path of conc_minhash */
+void insert_window_minhash(window_minhash *window, uint64_t elem) {
+
+    uint64_t c = window_writer_enter(window);
+    insert_conc_minhash(window->buckets[c % window->W], elem);
+    window_writer_exit(window, c);
+}
+
+void insert_window_minhash_batch(window_minhash *window, const uint64_t *elems, size_t n) {
+
+    uint64_t c = window_writer_enter(window);
+    insert_conc_minhash_batch(window->buckets[c % window->W], elems, n);
+    window_writer_exit(window, c);
+}
+
+/** ingest_sink of the window: ctx is the window_minhash, tid is ignored */
+void window_minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    (void) tid;
+    insert_window_minhash_batch((window_minhash *) ctx, keys, n);
+}
+
+
+/**
+ * Close the open bucket c and open bucket c + 1, which takes the ring slot of the expiring bucket c + 1 - W.
+ *
+ * Bucket c + 1 is published first, then the rotation waits for the writers still inside an insertion into c:
+ * once they are done bucket c takes no more insertions and is merged into the back, none of them is lost.
+ *
+ * The front loses its oldest bucket; once it is empty it is rebuilt as the suffix minima of the closed
+ * buckets, newest to oldest, and the back restarts empty: W - 1 merges every W - 1 rotations. The minimum
+ * of the closed buckets is the suffix of the oldest front bucket merged with the back. The sequence counter
+ * is odd from the opening of c + 1 until it is published, so a query reads c either as the open bucket or
+ * among the closed ones.
+ */
+void window_rotate(window_minhash *window) {
+
+    const uint32_t W = window->W;
+    uint64_t c = __atomic_load_n(&window->current, __ATOMIC_RELAXED);
+    uint64_t oldest = c + 2 >= W ? c + 2 - W : 0;  // oldest bucket still in the window once c + 1 opens
+    uint64_t i, j;
+
+    // the expired bucket is freed one rotation later, queries may still be reading its query sketch
+    conc_minhash **slot = &window->buckets[(c + 1) % W];
+    if (window->retired != NULL)
+        free_conc_minhash(window->retired);
+    window->retired = *slot;
+    *slot = new_bucket(window);
+
+    uint64_t s = __atomic_load_n(&window->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&window->seq, s + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store_n(&window->current, c + 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&window->writers[c % W], __ATOMIC_SEQ_CST) != 0)
+        ;
+
+    merge_bucket(window->back, window->buckets[c % W]);
+
+    if (window->front_begin < oldest)
+        window->front_begin = oldest;
+    if (window->front_begin > window->front_end) {
+        for (i = c + 1; i-- > oldest; ) {
+            sketch_t *suffix = window->suffix[i % W];
+            if (i == c)
+                fill_infty(suffix, window->size);
+            else
+                memcpy(suffix, window->suffix[(i + 1) % W], window->size * sizeof(sketch_t));
+            merge_bucket(suffix, window->buckets[i % W]);
+        }
+        window->front_begin = oldest;
+        window->front_end = c;
+        fill_infty(window->back, window->size);
+    }
+
+    const sketch_t *front = window->suffix[window->front_begin % W];
+    for (j = 0; j < window->size; j++)
+        window->closed[j] = front[j] < window->back[j] ? front[j] : window->back[j];
+
+    __atomic_store_n(&window->seq, s + 2, __ATOMIC_RELEASE);
+}
+
+void window_advance(window_minhash *window, uint64_t now) {
+
+    if (now < window->start + window->width)
+        return;
+
+    uint64_t elapsed = (now - window->start) / window->width;
+    uint64_t r;
+    // after W rotations every bucket of the window has expired, further ones would only rotate empty buckets
+    for (r = 0; r < elapsed && r < window->W; r++)
+        window_rotate(window);
+    window->start += elapsed * window->width;
+}
+
+
+/** The open bucket, whose query sketch is read as by concurrent_query (see conc_query_values) */
+static conc_minhash *open_bucket(window_minhash *window) {
+    return window->buckets[__atomic_load_n(&window->current, __ATOMIC_ACQUIRE) % window->W];
+}
+
+static uint64_t window_read_begin(window_minhash *window) {
+
+    uint64_t s;
+    while ((s = __atomic_load_n(&window->seq, __ATOMIC_ACQUIRE)) & 1)
+        ;
+    return s;
+}
+
+static int window_read_retry(window_minhash *window, uint64_t s) {
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&window->seq, __ATOMIC_RELAXED) != s;
+}
+
+
+void window_snapshot(window_minhash *window, sketch_t *out) {
+
+    uint64_t s, i, version;
+    conc_minhash *bucket;
+    do {
+        s = window_read_begin(window);
+        bucket = open_bucket(window);
+        const sketch_t *open = conc_query_values(bucket, &version);
+        for (i = 0; i < window->size; i++)
+            out[i] = open[i] < window->closed[i] ? open[i] : window->closed[i];
+    } while (window_read_retry(window, s) || conc_query_retry(bucket, version));
+}
+
+/**
+ * This function performs the query over the last W buckets.
+ *
+ * The window sketch is not materialized: each slot is the minimum of the closed buckets and of the
+ * open one, merged while comparing. Like concurrent_query, insertions still pending in the insert
+ * sketch of the open bucket are not seen.
+ *
+ * @param window Pointer to the sliding window structure.
+ * @param otherSketch Pointer to another MinHash sketch to compare against.
+ * @return float Similarity between the window and otherSketch
+ */
+float query_window_minhash(window_minhash *window, sketch_t *otherSketch) {
+
+    uint64_t s, i, version;
+    conc_minhash *bucket;
+    int count;
+    do {
+        s = window_read_begin(window);
+        bucket = open_bucket(window);
+        const sketch_t *open = conc_query_values(bucket, &version);
+        count = 0;
+        for (i = 0; i < window->size; i++) {
+            sketch_t v = open[i] < window->closed[i] ? open[i] : window->closed[i];
+            count += IS_EQUAL(v, otherSketch[i]);
+        }
+    } while (window_read_retry(window, s) || conc_query_retry(bucket, version));
+
+    return count/(float)window->size;
+}
@@ -5,13 +5,70 @@
 
 void insert(minhash_sketch *sketch, uint64_t elem) {
 
-
-        basic_insert(sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, elem);
+	if (sketch->watches.count)
+		watch_insert(&sketch->watches, sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, elem);
+	else
+		basic_insert(sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, elem);
 
 	
 }
 
 
+/**
+ * Insert a batch of elements, e.g. the keys produced by the ingestion layer.
+ */
+void insert_batch(minhash_sketch *sketch, const uint64_t *elems, size_t n) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		insert(sketch, elems[i]);
+}
+
+/** ingest_sink of the serial sketch: ctx is the minhash_sketch, tid is ignored */
+void minhash_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+	(void) tid;
+	insert_batch((minhash_sketch *) ctx, keys, n);
+}
+
+
+/**
+ * Insert an element already hashed by the caller: values[i] is its hash value for slot i (see fanout.h).
+ */
+void insert_values(minhash_sketch *sketch, const sketch_t *values) {
+
+	if (sketch->watches.count)
+		watch_min_update(&sketch->watches, sketch->sketch, values, 0, sketch->size);
+	else
+		min_update(sketch->sketch, values, sketch->size);
+}
+
+/** values_sink of the serial sketch: ctx is the minhash_sketch, tid is ignored */
+void minhash_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+	(void) tid;
+	insert_values((minhash_sketch *) ctx, values);
+}
+
+
+/**
+ * Insert elem with the given weight by consistent weighted sampling. The similarity returned by
+ * query between two weighted sketches estimates the weighted Jaccard similarity of their sets.
+ */
+void insert_weighted(minhash_sketch *sketch, uint64_t elem, double weight) {
+
+	if (!sketch->watches.count) {
+		weighted_insert(sketch->sketch, sketch->size, sketch->hash_functions, sketch->hash_type, elem, weight);
+		return;
+	}
+
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, n;
+	for (i = 0; i < sketch->size; i += MIN_UPDATE_BLOCK) {
+		n = sketch->size - i < MIN_UPDATE_BLOCK ? sketch->size - i : MIN_UPDATE_BLOCK;
+		weighted_values(sketch->hash_functions, sketch->hash_type, i, n, elem, weight, values);
+		watch_min_update(&sketch->watches, sketch->sketch, values, i, n);
+	}
+}
+
 
 float query(minhash_sketch *sketch, minhash_sketch *otherSketch) {
 
@@ -24,3 +81,30 @@ float query(minhash_sketch *sketch, minhash_sketch *otherSketch) {
     //fprintf(stderr, "[query] actual count %d\n", count);
 	return count/(float)sketch->size;
 }
+
+void estimate_minhash(minhash_sketch *sketch, const sketch_t *otherSketch, set_estimates *out) {
+
+	estimate_sets(sketch->sketch, otherSketch, sketch->size, hash_functions_modulus(sketch->hash_functions, sketch->hash_type), out);
+}
+
+
+/**
+ * Watch the similarity of the sketch to reference: from now on the insertions keep the number of
+ * slots equal to it, and query_watched returns the similarity query would compute, in O(1).
+ *
+ * @return int id of the pair, for query_watched and minhash_unwatch
+ */
+int minhash_watch(minhash_sketch *sketch, const sketch_t *reference) {
+
+	return watch_add(&sketch->watches, reference, sketch->sketch, sketch->size);
+}
+
+void minhash_unwatch(minhash_sketch *sketch, int id) {
+
+	watch_remove(&sketch->watches, id);
+}
+
+float query_watched(minhash_sketch *sketch, int id) {
+
+	return watch_similarity(&sketch->watches, id, sketch->size);
+}
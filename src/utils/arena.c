@@ -0,0 +1,201 @@
+#define _GNU_SOURCE
+
+#include <arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+
+#ifdef HUGEPAGE_ARENA
+
+typedef struct free_block {
+	struct free_block *next;
+} free_block;
+
+/** Per-thread state: a free list per class and the part of the current huge page not carved yet */
+typedef struct thread_cache {
+	free_block *free[ARENA_CLASSES];
+	char *bump;
+	char *end;
+	int registered;
+} thread_cache;
+
+static __thread thread_cache cache;
+
+// lists of the threads that exited, taken back whole by the first thread that runs out of a class
+static free_block *depot[ARENA_CLASSES];
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static _Atomic size_t hugetlb_bytes, thp_bytes, large_bytes;
+
+
+static size_t round_to_page(size_t size) {
+	return (size + ARENA_PAGE - 1) & ~(ARENA_PAGE - 1);
+}
+
+/** Map size bytes (a multiple of ARENA_PAGE) aligned to ARENA_PAGE */
+static void *map_pages(size_t size) {
+
+	void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (ptr != MAP_FAILED) {
+		__atomic_fetch_add(&hugetlb_bytes, size, __ATOMIC_RELAXED);
+		return ptr;
+	}
+
+	// no huge page reserved: over-map by a page, trim to an aligned range and ask for THP
+	char *raw = mmap(NULL, size + ARENA_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED) {
+		perror("mmap failed for arena pages");
+		exit(EXIT_FAILURE);
+	}
+	char *aligned = (char *) (((uintptr_t) raw + ARENA_PAGE - 1) & ~(ARENA_PAGE - 1));
+	if (aligned > raw)
+		munmap(raw, aligned - raw);
+	if (aligned + size < raw + size + ARENA_PAGE)
+		munmap(aligned + size, raw + size + ARENA_PAGE - (aligned + size));
+	madvise(aligned, size, MADV_HUGEPAGE);
+	__atomic_fetch_add(&thp_bytes, size, __ATOMIC_RELAXED);
+	return aligned;
+}
+
+static inline int size_class(size_t size) {
+	if (size <= (1UL << ARENA_MIN_SHIFT))
+		return 0;
+	return (64 - __builtin_clzl(size - 1)) - ARENA_MIN_SHIFT;
+}
+
+// on exit, the free lists of a thread are handed to the depot instead of being lost
+static void cache_release(void *arg) {
+
+	(void) arg;
+	pthread_mutex_lock(&depot_lock);
+	int c;
+	for (c = 0; c < ARENA_CLASSES; c++) {
+		free_block *list = cache.free[c];
+		if (list == NULL)
+			continue;
+		free_block *tail = list;
+		while (tail->next != NULL)
+			tail = tail->next;
+		tail->next = depot[c];
+		depot[c] = list;
+		cache.free[c] = NULL;
+	}
+	pthread_mutex_unlock(&depot_lock);
+}
+
+static void cache_key_create(void) {
+	pthread_key_create(&cache_key, cache_release);
+}
+
+/** Slow path: take the depot list of the class, or carve a new block from the current huge page */
+static void *cache_refill(int c) {
+
+	if (!cache.registered) {
+		pthread_once(&cache_key_once, cache_key_create);
+		pthread_setspecific(cache_key, &cache);
+		cache.registered = 1;
+	}
+
+	if (__atomic_load_n(&depot[c], __ATOMIC_RELAXED) != NULL) {
+		pthread_mutex_lock(&depot_lock);
+		free_block *list = depot[c];
+		depot[c] = NULL;
+		pthread_mutex_unlock(&depot_lock);
+		if (list != NULL) {
+			cache.free[c] = list->next;
+			return list;
+		}
+	}
+
+	size_t block = 1UL << (c + ARENA_MIN_SHIFT);
+	size_t align = block < 64 ? block : 64;
+	char *ptr = (char *) (((uintptr_t) cache.bump + align - 1) & ~(uintptr_t) (align - 1));
+	if (cache.bump == NULL || ptr + block > cache.end) {
+		// the tail of the previous page is left unused, at most one block of the largest class
+		cache.bump = map_pages(ARENA_PAGE);
+		cache.end = cache.bump + ARENA_PAGE;
+		ptr = cache.bump;
+	}
+	cache.bump = ptr + block;
+	return ptr;
+}
+
+void *arena_alloc(size_t size) {
+
+	if (size > (1UL << ARENA_MAX_SHIFT)) {
+		size_t mapped = round_to_page(size);
+		__atomic_fetch_add(&large_bytes, mapped, __ATOMIC_RELAXED);
+		return map_pages(mapped);
+	}
+
+	int c = size_class(size);
+	free_block *block = cache.free[c];
+	if (block != NULL) {
+		cache.free[c] = block->next;
+		return block;
+	}
+	return cache_refill(c);
+}
+
+void arena_free(void *ptr, size_t size) {
+
+	if (ptr == NULL)
+		return;
+	if (size > (1UL << ARENA_MAX_SHIFT)) {
+		// the mapping goes back to the kernel, usage reports what was mapped overall
+		munmap(ptr, round_to_page(size));
+		return;
+	}
+
+	int c = size_class(size);
+	free_block *block = (free_block *) ptr;
+	block->next = cache.free[c];
+	cache.free[c] = block;
+}
+
+void arena_get_usage(arena_usage *usage) {
+
+	usage->hugetlb_bytes = __atomic_load_n(&hugetlb_bytes, __ATOMIC_RELAXED);
+	usage->thp_bytes = __atomic_load_n(&thp_bytes, __ATOMIC_RELAXED);
+	usage->large_bytes = __atomic_load_n(&large_bytes, __ATOMIC_RELAXED);
+}
+
+#else
+
+void *arena_alloc(size_t size) {
+
+	void *ptr;
+	size_t align = size < 64 ? 16 : 64;
+	if (posix_memalign(&ptr, align, size) != 0) {
+		perror("posix_memalign failed for arena block");
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+void arena_free(void *ptr, size_t size) {
+	(void) size;
+	free(ptr);
+}
+
+void arena_get_usage(arena_usage *usage) {
+	usage->hugetlb_bytes = 0;
+	usage->thp_bytes = 0;
+	usage->large_bytes = 0;
+}
+
+#endif
+
+
+sketch_t *sketch_alloc(uint64_t size) {
+	return arena_alloc(size * sizeof(sketch_t));
+}
+
+void sketch_free(sketch_t *sketch, uint64_t size) {
+	arena_free(sketch, size * sizeof(sketch_t));
+}
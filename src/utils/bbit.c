@@ -0,0 +1,134 @@
+#include <bbit.h>
+
+
+int bbit_valid(uint32_t b) {
+	return b == 1 || b == 2 || b == 4 || b == 8;
+}
+
+
+uint64_t bbit_words(uint64_t size, uint32_t b) {
+	uint64_t per_word = 64 / b;
+	return (size + per_word - 1) / per_word;
+}
+
+
+void bbit_pack(const sketch_t *sketch, uint64_t size, uint32_t b, uint64_t *out) {
+// word w holds slots [w * 64/b, (w+1) * 64/b), slot first + j in bits [j*b, (j+1)*b)
+	uint64_t per_word = 64 / b;
+	uint64_t mask = (1ULL << b) - 1;
+	uint64_t w, j, words = bbit_words(size, b);
+
+	for (w = 0; w < words; w++) {
+		uint64_t first = w * per_word;
+		uint64_t n = size - first < per_word ? size - first : per_word;
+		uint64_t word = 0;
+		for (j = 0; j < n; j++)
+			word |= ((uint64_t) sketch[first + j] & mask) << (j * b);
+		out[w] = word;
+	}
+}
+
+
+bbit_sketch *bbit_compress(const sketch_t *sketch, uint64_t size, uint32_t b) {
+
+	if (!bbit_valid(b)) {
+		fprintf(stderr, "Invalid number of bits %u for b-bit sketch, must be 1, 2, 4 or 8\n", b);
+		exit(1);
+	}
+
+	bbit_sketch *bsketch = malloc(sizeof(bbit_sketch));
+	if (bsketch == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating bbit_sketch\n");
+		exit(1);
+	}
+
+	bsketch->b = b;
+	bsketch->size = size;
+	bsketch->words = bbit_words(size, b);
+	bsketch->bits = malloc(bsketch->words * sizeof(uint64_t));
+	if (bsketch->bits == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating b-bit sketch words\n");
+		exit(1);
+	}
+
+	bbit_pack(sketch, size, b, bsketch->bits);
+	return bsketch;
+}
+
+
+void bbit_free(bbit_sketch *sketch) {
+	free(sketch->bits);
+	free(sketch);
+}
+
+
+/**
+ * Count the slots that differ in two packed arrays.
+ *
+ * XOR leaves a non zero lane for each differing slot; OR-folding each lane into its lowest bit
+ * and masking gives one bit per differing slot, counted with popcount. The loop has no branches
+ * and b is a constant at each call site, so the compiler vectorizes it (VPOPCNTQ where available).
+ * Padding bits are zero in both arrays and never count as a mismatch.
+ */
+static inline uint64_t bbit_mismatches(const uint64_t *x, const uint64_t *y, uint64_t words, const uint32_t b) {
+
+	// lowest bit of each b-bit lane: 0xFF..FF, 0x55..55, 0x11..11, 0x01..01
+	const uint64_t lanes = ~0ULL / ((1ULL << b) - 1);
+
+	uint64_t w, mismatches = 0;
+	for (w = 0; w < words; w++) {
+		uint64_t d = x[w] ^ y[w];
+		if (b > 1) d |= d >> 1;
+		if (b > 2) d |= d >> 2;
+		if (b > 4) d |= d >> 4;
+		mismatches += __builtin_popcountll(d & lanes);
+	}
+	return mismatches;
+}
+
+
+uint64_t bbit_matches(const uint64_t *x, const uint64_t *y, uint64_t size, uint32_t b) {
+
+	uint64_t words = bbit_words(size, b);
+	switch (b) {
+	case 1:
+		return size - bbit_mismatches(x, y, words, 1);
+	case 2:
+		return size - bbit_mismatches(x, y, words, 2);
+	case 4:
+		return size - bbit_mismatches(x, y, words, 4);
+	case 8:
+		return size - bbit_mismatches(x, y, words, 8);
+	default:
+		fprintf(stderr, "Invalid number of bits %u for b-bit sketch, must be 1, 2, 4 or 8\n", b);
+		exit(1);
+	}
+}
+
+
+/**
+ * This function performs the query on two b-bit sketches.
+ *
+ * Two different minima still agree on their lowest b bits with probability C = 2^-b,
+ * so the raw match rate P overestimates the similarity J as P = J + (1 - J) * C.
+ * The estimate inverts this relation, J = (P - C) / (1 - C), clamped to [0, 1].
+ *
+ * @param sketch Pointer to the first b-bit sketch.
+ * @param otherSketch Pointer to the b-bit sketch to compare against.
+ * @return float Similarity between the two sketches
+ */
+float bbit_query(const bbit_sketch *sketch, const bbit_sketch *otherSketch) {
+
+	if (sketch->b != otherSketch->b || sketch->size != otherSketch->size) {
+		fprintf(stderr, "Cannot compare b-bit sketches with different b or size\n");
+		exit(1);
+	}
+
+	float p = bbit_matches(sketch->bits, otherSketch->bits, sketch->size, sketch->b) / (float) sketch->size;
+	float c = 1.0f / (float) (1U << sketch->b);
+	float j = (p - c) / (1.0f - c);
+
+	if (j < 0.0f) return 0.0f;
+	if (j > 1.0f) return 1.0f;
+	return j;
+}
@@ -0,0 +1,278 @@
+#include <checkpoint.h>
+#include <ingest.h>
+#include <arena.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+
+
+// the files of a checkpoint path: its two buffers and the file being written
+static char *path_with(const char *path, const char *suffix) {
+
+	size_t len = strlen(path) + strlen(suffix) + 1;
+	char *file = malloc(len);
+	if (file == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating a checkpoint file name\n");
+		exit(1);
+	}
+	snprintf(file, len, "%s%s", path, suffix);
+	return file;
+}
+
+static uint64_t header_checksum(const checkpoint_header *header) {
+	return prehash64(header, offsetof(checkpoint_header, header_checksum), CHECKPOINT_MAGIC);
+}
+
+static uint64_t payload_checksum(const sketch_t *sketch, uint64_t size) {
+	return prehash64(sketch, size * sizeof(sketch_t), CHECKPOINT_MAGIC);
+}
+
+
+uint64_t checkpoint_fingerprint(void *hash_functions, uint32_t hash_type, uint64_t size) {
+
+	const uint64_t probe = 0x9E3779B97F4A7C15ULL;
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, n, digest = size;
+	for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+		n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+		hash_values(hash_functions, hash_type, i, n, probe, values);
+		digest = prehash64(values, n * sizeof(sketch_t), digest);
+	}
+	return digest;
+}
+
+
+static int write_all(int fd, const void *data, size_t len) {
+
+	const char *p = data;
+	while (len > 0) {
+		ssize_t w = write(fd, p, len);
+		if (w < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += w;
+		len -= (size_t) w;
+	}
+	return 0;
+}
+
+// the rename is durable once the directory holding the files is synced
+static int sync_directory(const char *path) {
+
+	const char *slash = strrchr(path, '/');
+	char *dir = slash == NULL ? path_with(".", "") : strndup(path, slash == path ? 1 : (size_t) (slash - path));
+	if (dir == NULL) {
+		fprintf(stderr, "Error in strndup() when allocating a checkpoint directory name\n");
+		exit(1);
+	}
+	int fd = open(dir, O_RDONLY | O_DIRECTORY);
+	free(dir);
+	if (fd < 0)
+		return -1;
+	int ret = fsync(fd);
+	close(fd);
+	return ret;
+}
+
+int checkpoint_write(const char *path, uint64_t sequence, const sketch_t *sketch, uint64_t size, uint64_t fingerprint) {
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	checkpoint_header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CHECKPOINT_MAGIC;
+	header.version = CHECKPOINT_VERSION;
+	header.slot_bytes = sizeof(sketch_t);
+	header.size = size;
+	header.sequence = sequence;
+	header.timestamp = (uint64_t) now.tv_sec * 1000000 + (uint64_t) now.tv_usec;
+	header.fingerprint = fingerprint;
+	header.payload_checksum = payload_checksum(sketch, size);
+	header.header_checksum = header_checksum(&header);
+
+	char *tmp = path_with(path, ".tmp");
+	char *target = path_with(path, sequence & 1 ? ".1" : ".0");
+	int ret = -1, fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0) {
+		if (write_all(fd, &header, sizeof(header)) == 0 && write_all(fd, sketch, size * sizeof(sketch_t)) == 0 && fsync(fd) == 0)
+			ret = 0;
+		if (close(fd) != 0)
+			ret = -1;
+		// the older buffer is replaced whole or not at all, the newer one is never touched
+		if (ret == 0 && (rename(tmp, target) != 0 || sync_directory(path) != 0))
+			ret = -1;
+		if (ret != 0) {
+			int err = errno;
+			unlink(tmp);
+			errno = err;
+		}
+	}
+	free(target);
+	free(tmp);
+	return ret;
+}
+
+uint64_t checkpoint_read(const char *file, sketch_t *out, uint64_t size, uint64_t fingerprint) {
+
+	int fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return 0;
+
+	checkpoint_header header;
+	uint64_t sequence = 0;
+	sketch_t *payload = NULL;
+	ssize_t r = pread(fd, &header, sizeof(header), 0);
+	if (r != (ssize_t) sizeof(header) || header.magic != CHECKPOINT_MAGIC || header.header_checksum != header_checksum(&header))
+		goto out;
+	if (header.version != CHECKPOINT_VERSION || header.slot_bytes != sizeof(sketch_t) || header.size != size || header.fingerprint != fingerprint || header.sequence == 0)
+		goto out;
+
+	// read aside: out is only overwritten by a valid checkpoint
+	payload = malloc(size * sizeof(sketch_t));
+	if (payload == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating a checkpoint payload\n");
+		exit(1);
+	}
+	size_t len = size * sizeof(sketch_t), done = 0;
+	while (done < len) {
+		r = pread(fd, (char *) payload + done, len - done, (off_t) (sizeof(header) + done));
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			goto out;
+		done += (size_t) r;
+	}
+	if (header.payload_checksum != payload_checksum(payload, size))
+		goto out;
+
+	memcpy(out, payload, len);
+	sequence = header.sequence;
+out:
+	free(payload);
+	close(fd);
+	return sequence;
+}
+
+uint64_t checkpoint_recover(const char *path, sketch_t *out, uint64_t size, uint64_t fingerprint) {
+
+	char *files[2] = {path_with(path, ".0"), path_with(path, ".1")};
+	sketch_t *candidate = malloc(size * sizeof(sketch_t));
+	if (candidate == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating a checkpoint candidate\n");
+		exit(1);
+	}
+
+	uint64_t best = 0, sequence;
+	int i;
+	for (i = 0; i < 2; i++) {
+		sequence = checkpoint_read(files[i], candidate, size, fingerprint);
+		if (sequence > best) {
+			best = sequence;
+			memcpy(out, candidate, size * sizeof(sketch_t));
+		}
+		free(files[i]);
+	}
+	free(candidate);
+	return best;
+}
+
+
+/** One checkpoint, called with cp->lock held */
+static int checkpoint_now(checkpointer *cp) {
+
+	cp->source(cp->ctx, cp->snapshot);
+	if (cp->sequence > 0 && memcmp(cp->snapshot, cp->last, cp->size * sizeof(sketch_t)) == 0) {
+		cp->skipped++;
+		return 0;
+	}
+	if (checkpoint_write(cp->path, cp->sequence + 1, cp->snapshot, cp->size, cp->fingerprint) != 0) {
+		fprintf(stderr, "Checkpoint %lu of %s failed: %s\n", cp->sequence + 1, cp->path, strerror(errno));
+		cp->failed++;
+		return -1;
+	}
+	cp->sequence++;
+	cp->written++;
+	memcpy(cp->last, cp->snapshot, cp->size * sizeof(sketch_t));
+	return 0;
+}
+
+static void *checkpointer_thread(void *arg) {
+
+	checkpointer *cp = (checkpointer *) arg;
+	pthread_mutex_lock(&cp->lock);
+	while (!cp->stop) {
+		struct timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += cp->interval_ms / 1000;
+		deadline.tv_nsec += (long) (cp->interval_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (!cp->stop && pthread_cond_timedwait(&cp->wake, &cp->lock, &deadline) != ETIMEDOUT)
+			;
+		if (!cp->stop)
+			checkpoint_now(cp);
+	}
+	pthread_mutex_unlock(&cp->lock);
+	return NULL;
+}
+
+void checkpointer_start(checkpointer *cp, const char *path, checkpoint_source source, void *ctx, uint64_t size, uint64_t fingerprint, uint64_t interval_ms) {
+
+	cp->path = path_with(path, "");
+	cp->source = source;
+	cp->ctx = ctx;
+	cp->size = size;
+	cp->fingerprint = fingerprint;
+	cp->interval_ms = interval_ms > 0 ? interval_ms : 1;
+	cp->snapshot = sketch_alloc(size);
+	cp->last = sketch_alloc(size);
+	cp->written = cp->skipped = cp->failed = 0;
+	cp->stop = 0;
+
+	// numbered after the checkpoints already there, so that the next one is the newest
+	cp->sequence = checkpoint_recover(path, cp->last, size, fingerprint);
+
+	pthread_mutex_init(&cp->lock, NULL);
+	pthread_cond_init(&cp->wake, NULL);
+	if (pthread_create(&cp->thread, NULL, checkpointer_thread, cp) != 0) {
+		fprintf(stderr, "Error in pthread_create() when starting the checkpointer of %s\n", path);
+		exit(1);
+	}
+}
+
+int checkpointer_flush(checkpointer *cp) {
+
+	pthread_mutex_lock(&cp->lock);
+	int ret = checkpoint_now(cp);
+	pthread_mutex_unlock(&cp->lock);
+	return ret;
+}
+
+void checkpointer_stop(checkpointer *cp) {
+
+	pthread_mutex_lock(&cp->lock);
+	cp->stop = 1;
+	pthread_cond_signal(&cp->wake);
+	pthread_mutex_unlock(&cp->lock);
+	pthread_join(cp->thread, NULL);
+
+	checkpointer_flush(cp);
+
+	pthread_cond_destroy(&cp->wake);
+	pthread_mutex_destroy(&cp->lock);
+	sketch_free(cp->snapshot, cp->size);
+	sketch_free(cp->last, cp->size);
+	free(cp->path);
+}
@@ -0,0 +1,177 @@
+#include <collection.h>
+#include <minhash.h>
+#include <arena.h>
+
+
+// slots per cache line: every sketch of the slab starts on its own line
+#define LINE_SLOTS (64 / sizeof(sketch_t))
+
+static size_t slab_bytes(const sketch_collection *collection) {
+	return collection->n_sets * collection->stride * sizeof(sketch_t);
+}
+
+void collection_init(sketch_collection **collection, void *hash_functions, uint64_t size, uint32_t hash_type, uint64_t n_sets) {
+
+	*collection = malloc(sizeof(sketch_collection));
+	if (*collection == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating sketch_collection\n");
+		exit(1);
+	}
+
+	(*collection)->n_sets = n_sets;
+	(*collection)->size = size;
+	(*collection)->stride = (size + LINE_SLOTS - 1) / LINE_SLOTS * LINE_SLOTS;
+	(*collection)->hash_type = hash_type;
+	(*collection)->hash_functions = hash_functions;
+
+	// a single arena block: above the largest class it is a mapping of its own, in huge pages
+	(*collection)->slab = arena_alloc(slab_bytes(*collection));
+	memset((*collection)->slab, 0xFF, slab_bytes(*collection));  // every slot to INFTY
+}
+
+void collection_free(sketch_collection *collection) {
+
+	arena_free(collection->slab, slab_bytes(collection));
+	free(collection);
+}
+
+
+void collection_insert(sketch_collection *collection, uint64_t set, uint64_t elem) {
+
+	basic_insert(collection_sketch(collection, set), collection->size, collection->hash_functions, collection->hash_type, elem);
+}
+
+void collection_insert_concurrent(sketch_collection *collection, uint64_t set, uint64_t elem) {
+
+	sketch_t *sketch = collection_sketch(collection, set);
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, n;
+	for (i = 0; i < collection->size; i += MIN_UPDATE_BLOCK) {
+		n = collection->size - i < MIN_UPDATE_BLOCK ? collection->size - i : MIN_UPDATE_BLOCK;
+		hash_values(collection->hash_functions, collection->hash_type, i, n, elem, values);
+		concurrent_min_update(sketch + i, values, n);
+	}
+}
+
+void collection_insert_values(sketch_collection *collection, uint64_t set, const sketch_t *values) {
+
+	min_update(collection_sketch(collection, set), values, collection->size);
+}
+
+void collection_values_sink(void *ctx, uint32_t tid, const sketch_t *values) {
+
+	(void) tid;
+	collection_slot *slot = (collection_slot *) ctx;
+	concurrent_min_update(collection_sketch(slot->collection, slot->set), values, slot->collection->size);
+}
+
+
+/** --- Batched insertion grouped by set --- */
+
+typedef struct set_elem {
+	uint64_t set;
+	uint64_t elem;
+} set_elem;
+
+/** LSD radix sort of the pairs by set, 8 bits per pass over the bits an id of the collection can have */
+static set_elem *sort_by_set(set_elem *pairs, set_elem *tmp, size_t n, uint64_t n_sets) {
+
+	int bits = n_sets > 1 ? 64 - __builtin_clzll(n_sets - 1) : 1;
+	int shift;
+	for (shift = 0; shift < bits; shift += 8) {
+		size_t count[257] = {0};
+		size_t i;
+		for (i = 0; i < n; i++)
+			count[((pairs[i].set >> shift) & 0xFF) + 1]++;
+		for (i = 1; i < 257; i++)
+			count[i] += count[i - 1];
+		for (i = 0; i < n; i++)
+			tmp[count[(pairs[i].set >> shift) & 0xFF]++] = pairs[i];
+		set_elem *swap = pairs;
+		pairs = tmp;
+		tmp = swap;
+	}
+	return pairs;
+}
+
+/**
+ * Insert a group of elements of the same set. The slots are the outer loop: each block of
+ * MIN_UPDATE_BLOCK slots, and the hash functions of those slots, stay in L1 while every
+ * element of the group is hashed into it.
+ */
+static void insert_group(sketch_collection *collection, sketch_t *sketch, const set_elem *group, size_t m) {
+
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, j, n;
+	size_t e;
+	for (i = 0; i < collection->size; i += MIN_UPDATE_BLOCK) {
+		n = collection->size - i < MIN_UPDATE_BLOCK ? collection->size - i : MIN_UPDATE_BLOCK;
+		for (e = 0; e < m; e++) {
+			hash_values(collection->hash_functions, collection->hash_type, i, n, group[e].elem, values);
+			for (j = 0; j < n; j++)
+				if (values[j] < sketch[i + j])
+					sketch[i + j] = values[j];
+		}
+	}
+}
+
+void collection_insert_batch(sketch_collection *collection, const uint64_t *sets, const uint64_t *elems, size_t n) {
+
+	if (n == 0)
+		return;
+
+	set_elem *pairs = malloc(2 * n * sizeof(set_elem));
+	if (pairs == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating batch of %zu pairs\n", n);
+		exit(1);
+	}
+	size_t i;
+	for (i = 0; i < n; i++) {
+		if (sets[i] >= collection->n_sets) {
+			fprintf(stderr, "Set %lu out of the collection of %lu sets\n", sets[i], collection->n_sets);
+			exit(1);
+		}
+		pairs[i] = (set_elem) {sets[i], elems[i]};
+	}
+
+	set_elem *sorted = sort_by_set(pairs, pairs + n, n, collection->n_sets);
+
+	size_t start = 0;
+	for (i = 1; i <= n; i++) {
+		if (i == n || sorted[i].set != sorted[start].set) {
+			insert_group(collection, collection_sketch(collection, sorted[start].set), sorted + start, i - start);
+			start = i;
+		}
+	}
+	free(pairs);
+}
+
+
+/** --- Queries --- */
+
+// equal slots of two sketches; no branch in the loop, so the compiler vectorizes it
+static inline uint64_t equal_slots(const sketch_t *x, const sketch_t *y, uint64_t size) {
+
+	uint64_t i, count = 0;
+	for (i = 0; i < size; i++)
+		count += IS_EQUAL(x[i], y[i]);
+	return count;
+}
+
+float collection_query(const sketch_collection *collection, uint64_t set, uint64_t other_set) {
+
+	return equal_slots(collection_sketch(collection, set), collection_sketch(collection, other_set), collection->size) / (float) collection->size;
+}
+
+void collection_query_all(const sketch_collection *collection, const sketch_t *other, float *out) {
+
+	uint64_t s;
+	for (s = 0; s < collection->n_sets; s++)
+		out[s] = equal_slots(collection_sketch(collection, s), other, collection->size) / (float) collection->size;
+}
+
+void collection_estimate(const sketch_collection *collection, uint64_t set, uint64_t other_set, set_estimates *out) {
+
+	estimate_sets(collection_sketch(collection, set), collection_sketch(collection, other_set), collection->size,
+	              hash_functions_modulus(collection->hash_functions, collection->hash_type), out);
+}
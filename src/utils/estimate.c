@@ -0,0 +1,95 @@
+#include <math.h>
+
+#include <estimate.h>
+#include <minhash.h>
+
+
+uint64_t hash_functions_modulus(void *hash_functions, uint32_t hash_type) {
+// every function of the family shares the modulus of the first one
+	switch (hash_type) {
+	case 1:
+		return ((kwise_hash *) hash_functions)->M;
+	case 2:
+	case 3:
+		return ((tabulation_hash *) hash_functions)->M;
+	default:
+		return ((pairwise_hash *) hash_functions)->M;
+	}
+}
+
+
+/**
+ * The minimum of n uniform values in [0, 1) is u with -ln(1 - u) exponential of rate n, so over the
+ * k slots the sum S of -ln(1 - u) is Gamma(k, n) and (k - 1) / S is an unbiased estimator of n.
+ * For u << 1, -ln(1 - u) ~ u and S is the sum of the normalized minima. A slot holding h stands for
+ * u in [h / M, (h + 1) / M), its midpoint is used.
+ */
+static inline double slot_exponential(sketch_t h, uint64_t M) {
+	return -log1p(-(h + 0.5) / (double) M);
+}
+
+static inline double from_exponential_sum(double sum, uint64_t size) {
+	return size > 1 && sum > 0 ? (size - 1) / sum : 0;
+}
+
+
+double estimate_cardinality(const sketch_t *sketch, uint64_t size, uint64_t M) {
+
+	uint64_t i;
+	double sum = 0;
+	for (i = 0; i < size; i++) {
+		if (sketch[i] == INFTY)
+			return 0;  // every insertion writes all the slots, an empty one means an empty set
+		sum += slot_exponential(sketch[i], M);
+	}
+	return from_exponential_sum(sum, size);
+}
+
+
+double estimate_union(const sketch_t *sketch, const sketch_t *otherSketch, uint64_t size, uint64_t M) {
+
+	uint64_t i;
+	double sum = 0;
+	for (i = 0; i < size; i++) {
+		sketch_t h = sketch[i] < otherSketch[i] ? sketch[i] : otherSketch[i];
+		if (h == INFTY)
+			return 0;
+		sum += slot_exponential(h, M);
+	}
+	return from_exponential_sum(sum, size);
+}
+
+
+void estimate_sets(const sketch_t *sketch, const sketch_t *otherSketch, uint64_t size, uint64_t M, set_estimates *out) {
+
+	memset(out, 0, sizeof(set_estimates));
+	if (otherSketch == NULL) {
+		out->cardinality = estimate_cardinality(sketch, size, M);
+		return;
+	}
+
+	// -ln(1 - u) grows with u: the term of the merged slot is the smaller of the two terms
+	uint64_t i, count = 0, empty = 0, other_empty = 0;
+	double sum = 0, other_sum = 0, union_sum = 0;
+	for (i = 0; i < size; i++) {
+		double e = sketch[i] == INFTY ? INFINITY : slot_exponential(sketch[i], M);
+		double other_e = otherSketch[i] == INFTY ? INFINITY : slot_exponential(otherSketch[i], M);
+		empty += sketch[i] == INFTY;
+		other_empty += otherSketch[i] == INFTY;
+		count += IS_EQUAL(sketch[i], otherSketch[i]);
+		sum += e;
+		other_sum += other_e;
+		union_sum += e < other_e ? e : other_e;
+	}
+
+	out->cardinality = empty ? 0 : from_exponential_sum(sum, size);
+	out->other_cardinality = other_empty ? 0 : from_exponential_sum(other_sum, size);
+	out->union_size = isinf(union_sum) ? 0 : from_exponential_sum(union_sum, size);
+	if (out->cardinality == 0 || out->other_cardinality == 0)
+		return;  // nothing in common with an empty set, and two empty slots are not a match
+
+	out->jaccard = count / (double) size;
+	out->intersection = out->jaccard * out->union_size;
+	out->containment = out->intersection < out->cardinality ? out->intersection / out->cardinality : 1;
+	out->other_containment = out->intersection < out->other_cardinality ? out->intersection / out->other_cardinality : 1;
+}
@@ -0,0 +1,56 @@
+#include <fanout.h>
+#include <arena.h>
+#include <weighted.h>
+
+
+void hash_vector_init(hash_vector *vector, void *hash_functions, uint32_t hash_type, uint64_t size) {
+
+	vector->size = size;
+	vector->hash_type = hash_type;
+	vector->hash_functions = hash_functions;
+	vector->elem = 0;
+	vector->values = sketch_alloc(size);
+}
+
+void hash_vector_free(hash_vector *vector) {
+
+	sketch_free(vector->values, vector->size);
+}
+
+const sketch_t *hash_vector_compute(hash_vector *vector, uint64_t elem) {
+
+	hash_values(vector->hash_functions, vector->hash_type, 0, vector->size, elem, vector->values);
+	vector->elem = elem;
+	return vector->values;
+}
+
+const sketch_t *hash_vector_compute_weighted(hash_vector *vector, uint64_t elem, double weight) {
+
+	weighted_values(vector->hash_functions, vector->hash_type, 0, vector->size, elem, weight, vector->values);
+	vector->elem = elem;
+	return vector->values;
+}
+
+
+void fanout_insert(hash_vector *vector, const fanout_target *targets, uint32_t n_targets, uint32_t tid, uint64_t elem) {
+
+	const sketch_t *values = hash_vector_compute(vector, elem);
+	uint32_t t;
+	for (t = 0; t < n_targets; t++)
+		targets[t].sink(targets[t].ctx, tid, values);
+}
+
+void fanout_insert_weighted(hash_vector *vector, const fanout_target *targets, uint32_t n_targets, uint32_t tid, uint64_t elem, double weight) {
+
+	const sketch_t *values = hash_vector_compute_weighted(vector, elem, weight);
+	uint32_t t;
+	for (t = 0; t < n_targets; t++)
+		targets[t].sink(targets[t].ctx, tid, values);
+}
+
+void fanout_insert_batch(hash_vector *vector, const fanout_target *targets, uint32_t n_targets, uint32_t tid, const uint64_t *elems, size_t n) {
+
+	size_t i;
+	for (i = 0; i < n; i++)
+		fanout_insert(vector, targets, n_targets, tid, elems[i]);
+}
@@ -9,17 +9,61 @@ uint64_t pairwise_func(pairwise_hash *self, uint64_t x) {
 }
 
 
-/// Kwise hash function implementation
+/**
+ * Kwise hash function implementation: h(x) = sum_j c_j * x^j mod M, evaluated with Horner's rule.
+ *
+ * x is reduced first, so every product fits in 64 bits. Under the Mersenne modulus each step is
+ * reduced lazily with two folds (h stays below 2^32) and only the result is fully reduced,
+ * so no division is executed. Other moduli take one division per term.
+ */
 uint64_t kwise_func(kwise_hash *self, uint64_t x) {
 
-    uint64_t pow_x = 1;
-    uint64_t sum = 0;
-    uint32_t i = 0;
+    const uint32_t *c = self->coefficients;
+    uint64_t h = c[self->k * self->stride];
+    uint32_t j;
 
-    for (i = 0; i <= self->k; i++) {
-        sum = (sum + (pow_x * self->coefficients[i] % self->M)) % self->M;
-        pow_x = (pow_x * x) % self->M;
+    x %= self->M;
+
+    if (self->M == MERSENNE_31) {
+        for (j = self->k; j-- > 0; )
+            h = mersenne_fold(mersenne_fold(h * x + c[j * self->stride]));
+        h = mersenne_fold(h);
+        return h >= MERSENNE_31 ? h - MERSENNE_31 : h;
     }
 
-    return sum % self->M;
+    h %= self->M;
+    for (j = self->k; j-- > 0; )
+        h = (h * x + c[j * self->stride]) % self->M;
+    return h;
+}
+
+
+/// Simple tabulation hash function implementation: h(x) = T_0[x_0] ^ ... ^ T_7[x_7]
+uint64_t tabulation_func(tabulation_hash *self, uint64_t x) {
+
+    uint32_t h = 0;
+    uint32_t c;
+    for (c = 0; c < TAB_CHARS; c++, x >>= 8)
+        h ^= self->table[(c * TAB_ENTRIES + (x & 0xFF)) * self->stride];
+
+    return tabulation_range(h, self->M);
+}
+
+
+/**
+ * Twisted tabulation hash function implementation.
+ *
+ * The first TAB_CHARS - 1 chars are hashed as in simple tabulation; the low bits of the result
+ * are then XORed into the last char before its lookup, which gives the stronger (Chernoff-style)
+ * concentration bounds of twisted tabulation at the cost of one dependent lookup.
+ */
+uint64_t twisted_tabulation_func(tabulation_hash *self, uint64_t x) {
+
+    uint64_t h = 0;
+    uint32_t c;
+    for (c = 0; c < TAB_CHARS - 1; c++, x >>= 8)
+        h ^= self->twisted_table[(c * TAB_ENTRIES + (x & 0xFF)) * self->stride];
+    h = (h >> 32) ^ self->table[((x ^ h) & 0xFF) * self->stride];
+
+    return tabulation_range(h, self->M);
 }
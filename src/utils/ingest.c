@@ -0,0 +1,400 @@
+#include <ingest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/** --- 64-bit prehash, wyhash construction (public domain, Wang Yi) --- */
+
+static const uint64_t wyp[4] = {0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL, 0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL};
+
+static inline uint64_t wymix(uint64_t a, uint64_t b) {
+	__uint128_t r = (__uint128_t) a * b;
+	return (uint64_t) r ^ (uint64_t) (r >> 64);
+}
+
+static inline uint64_t wyr8(const uint8_t *p) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t wyr4(const uint8_t *p) {
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64_t wyr3(const uint8_t *p, size_t k) {
+	return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+
+uint64_t prehash64(const void *data, size_t len, uint64_t seed) {
+
+	const uint8_t *p = (const uint8_t *) data;
+	uint64_t a, b;
+
+	seed ^= wymix(seed ^ wyp[0], wyp[1]);
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (wyr4(p) << 32) | wyr4(p + ((len >> 3) << 2));
+			b = (wyr4(p + len - 4) << 32) | wyr4(p + len - 4 - ((len >> 3) << 2));
+		} else if (len > 0) {
+			a = wyr3(p, len);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+			do {
+				seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+				see1 = wymix(wyr8(p + 16) ^ wyp[2], wyr8(p + 24) ^ see1);
+				see2 = wymix(wyr8(p + 32) ^ wyp[3], wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+		while (i > 16) {
+			seed = wymix(wyr8(p) ^ wyp[1], wyr8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = wyr8(p + i - 16);
+		b = wyr8(p + i - 8);
+	}
+
+	__uint128_t r = (__uint128_t) (a ^ wyp[1]) * (b ^ seed);
+	return wymix((uint64_t) r ^ wyp[0] ^ len, (uint64_t) (r >> 64) ^ wyp[1]);
+}
+
+
+/** --- Shingling --- */
+
+// multiplier of the rolling polynomial hash, computed modulo 2^64
+#define ROLL_BASE 0x100000001b3ULL
+
+static uint64_t roll_power(uint32_t k) {
+	uint64_t pw = 1;
+	uint32_t i;
+	for (i = 0; i < k; i++)
+		pw *= ROLL_BASE;
+	return pw;
+}
+
+// the rolling value identifies the window, the mix spreads it over 64 bits
+static inline uint64_t shingle_key(uint64_t h, uint64_t seed) {
+	return wymix(h ^ seed ^ wyp[2], wyp[3]);
+}
+
+static inline int is_word_byte(uint8_t c) {
+	return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c >= 0x80;
+}
+
+/** Append a key to the batch and hand the batch to the sink when it is full */
+#define EMIT(key) do {                                              \
+		keys[n++] = (key);                                          \
+		if (n == INGEST_BATCH) {                                    \
+			conf->sink(conf->ctx, tid, keys, n);                    \
+			count += n;                                             \
+			n = 0;                                                  \
+		}                                                           \
+	} while (0)
+
+
+/**
+ * Character shingles: every window of k consecutive bytes is one key.
+ *
+ * The window is hashed with a rolling polynomial, each byte costs one multiply-add to enter the
+ * window and one to leave it, independently of k. A document shorter than k bytes is a single shingle.
+ */
+static uint64_t ingest_chars(const ingest_conf *conf, uint32_t tid, const uint8_t *p, size_t len) {
+
+	uint64_t keys[INGEST_BATCH];
+	uint64_t count = 0;
+	size_t n = 0, i;
+	const uint32_t k = conf->k;
+	const uint64_t pw = roll_power(k);
+	uint64_t h = 0;
+
+	for (i = 0; i < len; i++) {
+		h = h * ROLL_BASE + p[i];
+		if (i >= k)
+			h -= p[i - k] * pw;
+		if (i + 1 >= k)
+			EMIT(shingle_key(h, conf->seed));
+	}
+	if (len > 0 && len < k)
+		EMIT(shingle_key(h, conf->seed));
+
+	if (n > 0) {
+		conf->sink(conf->ctx, tid, keys, n);
+		count += n;
+	}
+	return count;
+}
+
+
+/**
+ * Word shingles: every window of k consecutive words is one key.
+ *
+ * Each word is prehashed and the word hashes are combined with the same rolling polynomial,
+ * keeping the last k word hashes in a ring to remove the one leaving the window. Separators
+ * are not part of the words, so any run of whitespace or punctuation gives the same keys.
+ */
+static uint64_t ingest_words(const ingest_conf *conf, uint32_t tid, const uint8_t *p, size_t len) {
+
+	uint64_t keys[INGEST_BATCH];
+	uint64_t ring[INGEST_MAX_WORDS];
+	uint64_t count = 0, words = 0;
+	size_t n = 0, i = 0, start;
+	const uint32_t k = conf->k;
+	const uint64_t pw = roll_power(k);
+	uint64_t h = 0;
+
+	while (i < len) {
+		while (i < len && !is_word_byte(p[i]))
+			i++;
+		start = i;
+		while (i < len && is_word_byte(p[i]))
+			i++;
+		if (start == i)
+			break;
+
+		uint64_t w = prehash64(p + start, i - start, conf->seed);
+		h = h * ROLL_BASE + w;
+		if (words >= k)
+			h -= ring[words % k] * pw;
+		ring[words % k] = w;
+		words++;
+		if (words >= k)
+			EMIT(shingle_key(h, conf->seed));
+	}
+	if (words > 0 && words < k)
+		EMIT(shingle_key(h, conf->seed));
+
+	if (n > 0) {
+		conf->sink(conf->ctx, tid, keys, n);
+		count += n;
+	}
+	return count;
+}
+
+
+uint64_t ingest_document(const ingest_conf *conf, uint32_t tid, const void *data, size_t len) {
+
+	if (conf->k == 0 || (conf->mode == SHINGLE_WORD && conf->k > INGEST_MAX_WORDS)) {
+		fprintf(stderr, "Invalid shingle length %u, must be at least 1 and at most %d for word shingles\n", conf->k, INGEST_MAX_WORDS);
+		exit(1);
+	}
+
+	switch (conf->mode) {
+	case SHINGLE_WORD:
+		return ingest_words(conf, tid, (const uint8_t *) data, len);
+	case SHINGLE_CHAR:
+		return ingest_chars(conf, tid, (const uint8_t *) data, len);
+	default:
+		fprintf(stderr, "Invalid shingle mode %u\n", conf->mode);
+		exit(1);
+	}
+}
+
+
+/** --- Key files --- */
+
+void ingest_file_open(ingest_file *file, const char *path, uint32_t format) {
+
+	if (format > INGEST_LINES) {
+		fprintf(stderr, "Invalid key file format %u\n", format);
+		exit(1);
+	}
+
+	file->format = format;
+	file->fd = open(path, O_RDONLY);
+	if (file->fd < 0) {
+		perror("open failed for key file");
+		exit(EXIT_FAILURE);
+	}
+
+	struct stat st;
+	if (fstat(file->fd, &st) != 0) {
+		perror("fstat failed for key file");
+		exit(EXIT_FAILURE);
+	}
+	file->len = (size_t) st.st_size;
+	file->data = NULL;
+	if (file->len == 0)
+		return;
+
+	void *data = mmap(NULL, file->len, PROT_READ, MAP_PRIVATE, file->fd, 0);
+	if (data == MAP_FAILED) {
+		perror("mmap failed for key file");
+		exit(EXIT_FAILURE);
+	}
+
+	// hints only: the file is read once front to back by each writer, a failure is not an error
+	madvise(data, file->len, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(data, file->len, MADV_HUGEPAGE);
+#endif
+	file->data = (const uint8_t *) data;
+
+	if (format == INGEST_BINARY && file->len % sizeof(uint64_t) != 0)
+		fprintf(stderr, "Key file length is not a multiple of 8, the last %zu bytes are ignored\n", file->len % sizeof(uint64_t));
+}
+
+
+void ingest_file_close(ingest_file *file) {
+
+	if (file->data != NULL)
+		munmap((void *) file->data, file->len);
+	close(file->fd);
+	file->data = NULL;
+	file->len = 0;
+}
+
+
+// first position >= pos where a line starts
+static size_t line_start(const ingest_file *file, size_t pos) {
+
+	if (pos >= file->len)
+		return file->len;
+	if (pos == 0)
+		return 0;
+	const uint8_t *nl = memchr(file->data + pos - 1, '\n', file->len - pos + 1);
+	return nl != NULL ? (size_t) (nl - file->data) + 1 : file->len;
+}
+
+
+/**
+ * Split the file as the test drivers split the insertions: each writer gets total / N items,
+ * the first total % N writers one more. Binary files are split by keys; text files are split
+ * by bytes and each line goes to the writer whose range contains its first byte.
+ */
+void ingest_file_chunk(const ingest_file *file, uint32_t N, uint32_t tid, size_t *begin, size_t *end) {
+
+	if (file->format == INGEST_BINARY) {
+		size_t keys = file->len / sizeof(uint64_t);
+		size_t chunk = keys / N, remainder = keys % N;
+		size_t first = tid * chunk + (tid < remainder ? tid : remainder);
+		*begin = first * sizeof(uint64_t);
+		*end = (first + chunk + (tid < remainder ? 1 : 0)) * sizeof(uint64_t);
+		return;
+	}
+
+	size_t chunk = file->len / N, remainder = file->len % N;
+	size_t first = tid * chunk + (tid < remainder ? tid : remainder);
+	*begin = line_start(file, first);
+	*end = line_start(file, first + chunk + (tid < remainder ? 1 : 0));
+}
+
+
+/**
+ * Feed the keys of [begin, end) to the sink. Binary keys are handed to the sink straight from the
+ * mapping, with no copy; text keys are parsed into a batch first. Empty lines are skipped.
+ */
+uint64_t ingest_file_range(const ingest_file *file, size_t begin, size_t end, ingest_sink sink, void *ctx, uint32_t tid, uint64_t seed) {
+
+	uint64_t count = 0;
+
+	if (file->format == INGEST_BINARY) {
+		const uint64_t *keys = (const uint64_t *) (file->data + begin);
+		size_t n = (end - begin) / sizeof(uint64_t), i;
+		for (i = 0; i < n; i += INGEST_BATCH) {
+			size_t b = n - i < INGEST_BATCH ? n - i : INGEST_BATCH;
+			sink(ctx, tid, keys + i, b);
+		}
+		return n;
+	}
+
+	uint64_t keys[INGEST_BATCH];
+	size_t n = 0;
+	const uint8_t *p = file->data + begin;
+	const uint8_t *stop = file->data + end;
+
+	while (p < stop) {
+		const uint8_t *nl = memchr(p, '\n', stop - p);
+		const uint8_t *eol = nl != NULL ? nl : stop;
+		const uint8_t *last = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+
+		if (last > p) {
+			if (file->format == INGEST_DECIMAL) {
+				uint64_t v = 0;
+				const uint8_t *q;
+				for (q = p; q < last && *q >= '0' && *q <= '9'; q++)
+					v = v * 10 + (*q - '0');
+				if (q > p)
+					keys[n++] = v;
+			} else {
+				keys[n++] = prehash64(p, last - p, seed);
+			}
+			if (n == INGEST_BATCH) {
+				sink(ctx, tid, keys, n);
+				count += n;
+				n = 0;
+			}
+		}
+		p = eol + 1;
+	}
+
+	if (n > 0) {
+		sink(ctx, tid, keys, n);
+		count += n;
+	}
+	return count;
+}
+
+
+typedef struct ingest_task_arg {
+	const ingest_file *file;
+	uint32_t N;
+	ingest_sink sink;
+	void *ctx;
+	uint64_t seed;
+	uint64_t *counts;  // keys of each worker
+} ingest_task_arg;
+
+static void ingest_task(void *arg, uint32_t tid) {
+
+	ingest_task_arg *targ = (ingest_task_arg *) arg;
+	size_t begin, end;
+	ingest_file_chunk(targ->file, targ->N, tid, &begin, &end);
+	targ->counts[tid] = ingest_file_range(targ->file, begin, end, targ->sink, targ->ctx, tid, targ->seed);
+}
+
+
+uint64_t ingest_file_pool(const ingest_file *file, worker_pool *pool, ingest_sink sink, void *ctx, uint64_t seed) {
+
+	ingest_task_arg targ = {file, pool->n, sink, ctx, seed, calloc(pool->n, sizeof(uint64_t))};
+	if (targ.counts == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating ingest counters\n");
+		exit(1);
+	}
+
+	worker_pool_run(pool, ingest_task, &targ);
+
+	uint64_t count = 0;
+	uint32_t t;
+	for (t = 0; t < pool->n; t++)
+		count += targ.counts[t];
+	free(targ.counts);
+	return count;
+}
+
+uint64_t ingest_file_parallel(const ingest_file *file, uint32_t N, ingest_sink sink, void *ctx, uint64_t seed) {
+
+	worker_pool pool;
+	worker_pool_start(&pool, N, NULL, PIN_NONE);
+	uint64_t count = ingest_file_pool(file, &pool, sink, ctx, seed);
+	worker_pool_stop(&pool);
+	return count;
+}
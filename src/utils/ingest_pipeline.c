@@ -0,0 +1,446 @@
+#include <ingest.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <linux/io_uring.h>
+
+
+/** --- Bounded MPMC queue of buffer indices (Vyukov) --- */
+
+typedef struct queue_cell {
+	_Atomic uint64_t seq;
+	uint32_t value;
+} queue_cell;
+
+typedef struct index_queue {
+	queue_cell *cells;
+	uint64_t mask;
+	_Atomic uint64_t head __attribute__((aligned(64)));  // next cell to pop
+	_Atomic uint64_t tail __attribute__((aligned(64)));  // next cell to push
+} index_queue;
+
+static void queue_init(index_queue *q, uint64_t capacity) {
+
+	uint64_t size = 1, i;
+	while (size < capacity)
+		size <<= 1;
+
+	q->cells = malloc(size * sizeof(queue_cell));
+	if (q->cells == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating pipeline queue\n");
+		exit(1);
+	}
+	for (i = 0; i < size; i++)
+		__atomic_store_n(&q->cells[i].seq, i, __ATOMIC_RELAXED);
+	q->mask = size - 1;
+	__atomic_store_n(&q->head, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&q->tail, 0, __ATOMIC_RELEASE);
+}
+
+/** A cell is free for position pos when its seq is pos, and full when its seq is pos + 1 */
+static int queue_push(index_queue *q, uint32_t value) {
+
+	uint64_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	queue_cell *cell;
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		int64_t dif = (int64_t) __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (int64_t) pos;
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return 0;  // full
+		} else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+		}
+	}
+	cell->value = value;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+static int queue_pop(index_queue *q, uint32_t *value) {
+
+	uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+	queue_cell *cell;
+	while (1) {
+		cell = &q->cells[pos & q->mask];
+		int64_t dif = (int64_t) __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) - (int64_t) (pos + 1);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			return 0;  // empty
+		} else {
+			pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+		}
+	}
+	*value = cell->value;
+	__atomic_store_n(&cell->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+
+/** --- Minimal io_uring, through the raw system calls --- */
+
+typedef struct uring {
+	int fd;
+	unsigned *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+	unsigned to_submit;  // queued entries not yet handed to the kernel
+} uring;
+
+static int uring_init(uring *r, unsigned entries) {
+
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	r->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+
+	r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_ring_size > r->sq_ring_size)
+			r->sq_ring_size = r->cq_ring_size;
+		r->cq_ring_size = r->sq_ring_size;
+	}
+
+	r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ring == MAP_FAILED) {
+		close(r->fd);
+		return -1;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ring = r->sq_ring;
+	} else {
+		r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ring == MAP_FAILED) {
+			munmap(r->sq_ring, r->sq_ring_size);
+			close(r->fd);
+			return -1;
+		}
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		if (r->cq_ring != r->sq_ring)
+			munmap(r->cq_ring, r->cq_ring_size);
+		munmap(r->sq_ring, r->sq_ring_size);
+		close(r->fd);
+		return -1;
+	}
+
+	r->sq_tail = (unsigned *) ((char *) r->sq_ring + p.sq_off.tail);
+	r->sq_mask = (unsigned *) ((char *) r->sq_ring + p.sq_off.ring_mask);
+	r->sq_array = (unsigned *) ((char *) r->sq_ring + p.sq_off.array);
+	r->cq_head = (unsigned *) ((char *) r->cq_ring + p.cq_off.head);
+	r->cq_tail = (unsigned *) ((char *) r->cq_ring + p.cq_off.tail);
+	r->cq_mask = (unsigned *) ((char *) r->cq_ring + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *) ((char *) r->cq_ring + p.cq_off.cqes);
+	r->to_submit = 0;
+	return 0;
+}
+
+static void uring_exit(uring *r) {
+
+	munmap(r->sqes, r->sqes_size);
+	if (r->cq_ring != r->sq_ring)
+		munmap(r->cq_ring, r->cq_ring_size);
+	munmap(r->sq_ring, r->sq_ring_size);
+	close(r->fd);
+}
+
+// queue a read, it is handed to the kernel by the next uring_wait
+static void uring_queue_read(uring *r, int fd, void *buf, unsigned len, uint64_t off, uint64_t user_data) {
+
+	unsigned tail = *r->sq_tail;
+	unsigned idx = tail & *r->sq_mask;
+	struct io_uring_sqe *sqe = &r->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t) (uintptr_t) buf;
+	sqe->len = len;
+	sqe->off = off;
+	sqe->user_data = user_data;
+	r->sq_array[idx] = idx;
+
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	r->to_submit++;
+}
+
+// submit the queued reads and wait for one completion
+static void uring_wait(uring *r, uint64_t *user_data, int32_t *res) {
+
+	while (1) {
+		unsigned head = *r->cq_head;
+		if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) && r->to_submit == 0) {
+			struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+			*user_data = cqe->user_data;
+			*res = cqe->res;
+			__atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+			return;
+		}
+		int ret = (int) syscall(__NR_io_uring_enter, r->fd, r->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("io_uring_enter failed");
+			exit(EXIT_FAILURE);
+		}
+		r->to_submit -= (unsigned) ret < r->to_submit ? (unsigned) ret : r->to_submit;
+	}
+}
+
+
+/** --- Pipeline --- */
+
+#define PIPELINE_STOP UINT32_MAX  // sentinel index telling a worker to exit
+
+typedef struct pipeline_buffer {
+	uint8_t *data;
+	size_t len;          // bytes read into data
+	uint64_t file_off;   // file offset of data[0]
+	uint64_t own_begin;  // keys (lines) starting in [own_begin, own_end) belong to this buffer
+	uint64_t own_end;
+} pipeline_buffer;
+
+typedef struct pipeline {
+	const ingest_pipeline_conf *conf;
+	uint64_t file_len;
+	pipeline_buffer *buffers;
+	index_queue filled;  // reader -> workers
+	index_queue free;    // workers -> reader
+	uint64_t *keys;      // keys parsed by each worker
+} pipeline;
+
+
+/**
+ * Feed the keys owned by a buffer to the sink. A text read starts one byte before the block, to tell
+ * whether the block starts on a line boundary, and runs PIPELINE_MAX_LINE bytes past it, to finish
+ * the last line: the buffer parses the lines whose first byte lies in its block.
+ */
+static uint64_t pipeline_parse(pipeline *pipe, pipeline_buffer *buf, uint32_t tid) {
+
+	const ingest_pipeline_conf *conf = pipe->conf;
+	ingest_file view = {-1, conf->format, buf->data, buf->len};
+
+	if (conf->format == INGEST_BINARY)
+		return ingest_file_range(&view, 0, buf->len, conf->sink, conf->ctx, tid, conf->seed);
+
+	size_t bounds[2];
+	uint64_t own[2] = {buf->own_begin, buf->own_end};
+	int i;
+	for (i = 0; i < 2; i++) {
+		size_t pos = own[i] - buf->file_off;
+		if (own[i] == 0 || own[i] >= pipe->file_len) {
+			bounds[i] = own[i] == 0 ? 0 : buf->len;
+			continue;
+		}
+		const uint8_t *nl = memchr(buf->data + pos - 1, '\n', buf->len - pos + 1);
+		if (nl == NULL) {
+			if (buf->file_off + buf->len < pipe->file_len) {
+				fprintf(stderr, "Line at offset %lu longer than %d bytes\n", own[i], PIPELINE_MAX_LINE);
+				exit(1);
+			}
+			bounds[i] = buf->len;
+		} else {
+			bounds[i] = (size_t) (nl - buf->data) + 1;
+		}
+	}
+
+	if (bounds[0] >= bounds[1])
+		return 0;  // a single line spans the whole block and belongs to an earlier one
+	return ingest_file_range(&view, bounds[0], bounds[1], conf->sink, conf->ctx, tid, conf->seed);
+}
+
+// task of the pool workers, until they pop the stop sentinel
+static void pipeline_worker_task(void *arg, uint32_t tid) {
+
+	pipeline *pipe = (pipeline *) arg;
+	uint32_t b;
+
+	while (1) {
+		while (!queue_pop(&pipe->filled, &b))
+			sched_yield();
+		if (b == PIPELINE_STOP)
+			break;
+		pipe->keys[tid] += pipeline_parse(pipe, &pipe->buffers[b], tid);
+		queue_push(&pipe->free, b);
+	}
+}
+
+
+// complete a short read synchronously, it only happens on signals or at the end of the file
+static void pipeline_complete_read(int fd, pipeline_buffer *buf, size_t want, size_t done) {
+
+	while (done < want) {
+		ssize_t r = pread(fd, buf->data + done, want - done, buf->file_off + done);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0) {
+			perror("pread failed for key file");
+			exit(EXIT_FAILURE);
+		}
+		if (r == 0)
+			break;
+		done += (size_t) r;
+	}
+	buf->len = done;
+}
+
+
+/**
+ * Run the pipeline on the calling thread, which acts as the reader.
+ *
+ * The reader keeps a read in flight for every free buffer; as soon as a read completes the
+ * buffer is pushed to the workers, which give it back once its keys are in the sketch.
+ * Without io_uring the reader falls back to pread, still overlapping with the workers.
+ */
+void ingest_pipeline(const char *path, const ingest_pipeline_conf *conf, ingest_pipeline_stats *stats) {
+
+	if (conf->workers == 0 || conf->buffers == 0 || conf->block_size == 0 || conf->block_size % sizeof(uint64_t) != 0 || conf->format > INGEST_LINES) {
+		fprintf(stderr, "Invalid pipeline configuration: workers and buffers must be > 0, block size a multiple of 8\n");
+		exit(1);
+	}
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror("open failed for key file");
+		exit(EXIT_FAILURE);
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		perror("fstat failed for key file");
+		exit(EXIT_FAILURE);
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	pipeline pipe;
+	pipe.conf = conf;
+	pipe.file_len = (uint64_t) st.st_size;
+
+	// text reads overlap the previous block by one byte and the next one by PIPELINE_MAX_LINE
+	size_t capacity = conf->block_size + (conf->format == INGEST_BINARY ? 0 : PIPELINE_MAX_LINE + 1);
+	pipe.buffers = malloc(conf->buffers * sizeof(pipeline_buffer));
+	if (pipe.buffers == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating pipeline buffers\n");
+		exit(1);
+	}
+	queue_init(&pipe.filled, conf->buffers + conf->workers);
+	queue_init(&pipe.free, conf->buffers);
+
+	uint32_t b;
+	for (b = 0; b < conf->buffers; b++) {
+		if (posix_memalign((void **) &pipe.buffers[b].data, 4096, capacity) != 0) {
+			perror("posix_memalign failed for pipeline buffer");
+			exit(EXIT_FAILURE);
+		}
+		queue_push(&pipe.free, b);
+	}
+
+	uring ring;
+	memset(&ring, 0, sizeof(ring));
+	int use_uring = conf->use_io_uring && uring_init(&ring, conf->buffers) == 0;
+
+	struct timeval t1, t2;
+	gettimeofday(&t1, NULL);
+
+	pipe.keys = calloc(conf->workers, sizeof(uint64_t));
+	if (pipe.keys == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating pipeline counters\n");
+		exit(1);
+	}
+	worker_pool pool;
+	worker_pool_start(&pool, conf->workers, conf->topo, conf->pin_policy);
+	worker_pool_submit(&pool, pipeline_worker_task, &pipe);
+
+	uint64_t next = 0;  // file offset of the next block
+	uint32_t in_flight = 0;
+	while (next < pipe.file_len || in_flight > 0) {
+
+		while (next < pipe.file_len && queue_pop(&pipe.free, &b)) {
+			pipeline_buffer *buf = &pipe.buffers[b];
+			uint64_t own_end = next + conf->block_size < pipe.file_len ? next + conf->block_size : pipe.file_len;
+			uint64_t read_end = own_end;
+			buf->own_begin = next;
+			buf->own_end = own_end;
+			buf->file_off = next;
+			if (conf->format != INGEST_BINARY) {
+				buf->file_off = next > 0 ? next - 1 : 0;
+				read_end = own_end + PIPELINE_MAX_LINE < pipe.file_len ? own_end + PIPELINE_MAX_LINE : pipe.file_len;
+			}
+			size_t want = (size_t) (read_end - buf->file_off);
+
+			if (use_uring) {
+				buf->len = want;
+				uring_queue_read(&ring, fd, buf->data, (unsigned) want, buf->file_off, b);
+				in_flight++;
+			} else {
+				pipeline_complete_read(fd, buf, want, 0);
+				queue_push(&pipe.filled, b);
+			}
+			next = own_end;
+		}
+
+		if (in_flight > 0) {
+			uint64_t user_data;
+			int32_t res;
+			uring_wait(&ring, &user_data, &res);
+			if (res < 0) {
+				fprintf(stderr, "io_uring read failed: %s\n", strerror(-res));
+				exit(1);
+			}
+			pipeline_buffer *buf = &pipe.buffers[user_data];
+			if ((size_t) res < buf->len)
+				pipeline_complete_read(fd, buf, buf->len, (size_t) res);
+			queue_push(&pipe.filled, (uint32_t) user_data);
+			in_flight--;
+		} else if (next < pipe.file_len) {
+			sched_yield();  // every buffer is being parsed
+		}
+	}
+
+	uint32_t w;
+	for (w = 0; w < conf->workers; w++)
+		while (!queue_push(&pipe.filled, PIPELINE_STOP))
+			sched_yield();
+
+	worker_pool_wait(&pool);
+	worker_pool_stop(&pool);
+	uint64_t keys = 0;
+	for (w = 0; w < conf->workers; w++)
+		keys += pipe.keys[w];
+
+	gettimeofday(&t2, NULL);
+
+	stats->keys = keys;
+	stats->bytes = pipe.file_len;
+	stats->seconds = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1e6;
+	stats->io_uring = use_uring;
+
+	if (use_uring)
+		uring_exit(&ring);
+	for (b = 0; b < conf->buffers; b++)
+		free(pipe.buffers[b].data);
+	free(pipe.buffers);
+	free(pipe.filled.cells);
+	free(pipe.free.cells);
+	free(pipe.keys);
+	close(fd);
+}
@@ -0,0 +1,218 @@
+#define _GNU_SOURCE
+
+#include <numa_alloc.h>
+#include <hash.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#ifdef NUMA
+#include <numa.h>
+#endif
+
+
+/** --- Node lookup and allocation --- */
+
+int node_count(void) {
+#ifdef NUMA
+    if (numa_available() < 0)
+        return 1;
+    return numa_max_node() + 1;
+#else
+    return 1;
+#endif
+}
+
+int current_node(void) {
+#ifdef NUMA
+    unsigned int cpu, node;
+    if (getcpu(&cpu, &node) != 0)
+        return 0;
+    return (int) node;
+#else
+    return 0;
+#endif
+}
+
+void *node_alloc(size_t size, int node) {
+
+    void *ptr;
+#ifdef NUMA
+    if (numa_available() >= 0) {
+        ptr = numa_alloc_onnode(size, node);
+        if (ptr == NULL) {
+            fprintf(stderr, "Error in numa_alloc_onnode() when allocating %zu bytes on node %d\n", size, node);
+            exit(1);
+        }
+        return ptr;
+    }
+#endif
+    (void) node;
+    ptr = malloc(size);
+    if (ptr == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating %zu bytes\n", size);
+        exit(1);
+    }
+    return ptr;
+}
+
+void node_free(void *ptr, size_t size) {
+#ifdef NUMA
+    if (numa_available() >= 0) {
+        numa_free(ptr, size);
+        return;
+    }
+#endif
+    (void) size;
+    free(ptr);
+}
+
+
+/** --- Replicas of the hash functions ---
+ *  A replica is a single allocation: the array of hash functions of every slot, followed by
+ *  the tables their pointers refer to. The tables are read-only once initialized, so each node
+ *  can read its own copy without any coherence traffic. The same layout is the image of the hash
+ *  functions exported to shared memory: another process imports it, with its own array pointing
+ *  at the tables of the image */
+
+#define REPLICA_ALIGN 64
+
+static size_t align_up(size_t n) {
+    return (n + REPLICA_ALIGN - 1) & ~((size_t) REPLICA_ALIGN - 1);
+}
+
+// size of the hash function of one slot
+static size_t hash_function_bytes(uint64_t hf_id) {
+    switch (hf_id) {
+        case 1:
+            return sizeof(kwise_hash);
+        case 2:
+        case 3:
+            return sizeof(tabulation_hash);
+        default:
+            return sizeof(pairwise_hash);
+    }
+}
+
+// size of the hash function array, and of the 32 and 64-bit tables following it
+static void replica_layout(const void *hash_functions, uint64_t hf_id, uint64_t size, size_t *head, size_t *table32, size_t *table64) {
+
+    *head = align_up(size * hash_function_bytes(hf_id));
+    *table32 = 0;
+    *table64 = 0;
+    switch (hf_id) {
+        case 1:
+            *table32 = (size_t) (((const kwise_hash *) hash_functions)->k + 1) * size * sizeof(uint32_t);
+            break;
+        case 2:
+            *table32 = (size_t) TAB_CHARS * TAB_ENTRIES * size * sizeof(uint32_t);
+            break;
+        case 3:
+            *table32 = (size_t) TAB_ENTRIES * size * sizeof(uint32_t);
+            *table64 = (size_t) (TAB_CHARS - 1) * TAB_ENTRIES * size * sizeof(uint64_t);
+            break;
+        default:
+            break;
+    }
+    *table32 = align_up(*table32);
+}
+
+// point the hash functions of every slot at the tables following the array at image, and at the code of this process
+static void relocate(void *hash_functions, char *image, uint64_t hf_id, uint64_t size, size_t head, size_t table32) {
+
+    uint64_t i;
+    switch (hf_id) {
+        case 1: {
+            kwise_hash *dst = hash_functions;
+            uint32_t *coefficients = (uint32_t *) (image + head);
+            for (i = 0; i < size; i++) {
+                dst[i].coefficients = coefficients + i;
+                dst[i].hash_function = kwise_func;
+            }
+            break;
+        }
+        case 2:
+        case 3: {
+            tabulation_hash *dst = hash_functions;
+            uint32_t *table = (uint32_t *) (image + head);
+            uint64_t *twisted_table = hf_id == 3 ? (uint64_t *) (image + head + table32) : NULL;
+            for (i = 0; i < size; i++) {
+                dst[i].table = table + i;
+                dst[i].twisted_table = twisted_table != NULL ? twisted_table + i : NULL;
+                dst[i].hash_function = hf_id == 3 ? twisted_tabulation_func : tabulation_func;
+            }
+            break;
+        }
+        default: {
+            pairwise_hash *dst = hash_functions;
+            for (i = 0; i < size; i++)
+                dst[i].hash_function = pairwise_func;
+            break;
+        }
+    }
+}
+
+size_t hash_functions_image_bytes(void *hash_functions, uint64_t hf_id, uint64_t size) {
+
+    size_t head, table32, table64;
+    replica_layout(hash_functions, hf_id, size, &head, &table32, &table64);
+    return head + table32 + table64;
+}
+
+void hash_functions_export(void *hash_functions, uint64_t hf_id, uint64_t size, void *image) {
+
+    size_t head, table32, table64;
+    replica_layout(hash_functions, hf_id, size, &head, &table32, &table64);
+
+    char *dst = image;
+    memcpy(dst, hash_functions, size * hash_function_bytes(hf_id));
+    switch (hf_id) {
+        case 1: {
+            kwise_hash *src = hash_functions;
+            memcpy(dst + head, src[0].coefficients, (size_t) (src[0].k + 1) * size * sizeof(uint32_t));
+            break;
+        }
+        case 2:
+        case 3: {
+            tabulation_hash *src = hash_functions;
+            memcpy(dst + head, src[0].table, (size_t) (hf_id == 3 ? 1 : TAB_CHARS) * TAB_ENTRIES * size * sizeof(uint32_t));
+            if (hf_id == 3)
+                memcpy(dst + head + table32, src[0].twisted_table, table64);
+            break;
+        }
+        default:
+            break;
+    }
+    relocate(dst, dst, hf_id, size, head, table32);
+}
+
+void *hash_functions_import(void *image, uint64_t hf_id, uint64_t size) {
+
+    size_t head, table32, table64;
+    replica_layout(image, hf_id, size, &head, &table32, &table64);
+
+    void *hash_functions = malloc(size * hash_function_bytes(hf_id));
+    if (hash_functions == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating imported hash functions\n");
+        exit(1);
+    }
+    memcpy(hash_functions, image, size * hash_function_bytes(hf_id));
+    relocate(hash_functions, image, hf_id, size, head, table32);
+    return hash_functions;
+}
+
+void *hash_functions_replicate(void *hash_functions, uint64_t hf_id, uint64_t size, int node) {
+
+    char *replica = node_alloc(hash_functions_image_bytes(hash_functions, hf_id, size), node);
+    hash_functions_export(hash_functions, hf_id, size, replica);
+    return replica;
+}
+
+void hash_functions_replica_free(void *replica, uint64_t hf_id, uint64_t size) {
+
+    size_t head, table32, table64;
+    replica_layout(replica, hf_id, size, &head, &table32, &table64);
+    node_free(replica, head + table32 + table64);
+}
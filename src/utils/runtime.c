@@ -0,0 +1,351 @@
+#define _GNU_SOURCE
+
+#include <runtime.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <dirent.h>
+
+
+/** --- Topology --- */
+
+static int read_sysfs_int(const char *path, int fallback) {
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return fallback;
+    int value;
+    if (fscanf(f, "%d", &value) != 1)
+        value = fallback;
+    fclose(f);
+    return value;
+}
+
+// the cpuN directory holds a nodeM link when the kernel has NUMA support
+static int cpu_node(int cpu) {
+
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0 && sscanf(entry->d_name + 4, "%d", &node) == 1)
+            break;
+    }
+    closedir(dir);
+    return node;
+}
+
+
+/** Sort key of a CPU: the orders of the policies are lexicographic orders on four attributes */
+typedef struct sort_item {
+    int key[4];
+    uint32_t idx;
+} sort_item;
+
+static int compare_items(const void *a, const void *b) {
+
+    const sort_item *x = a, *y = b;
+    int i;
+    for (i = 0; i < 4; i++)
+        if (x->key[i] != y->key[i])
+            return x->key[i] < y->key[i] ? -1 : 1;
+    return x->idx < y->idx ? -1 : x->idx > y->idx;
+}
+
+static uint32_t *sorted_order(const cpu_topology *topo, sort_item *items) {
+
+    uint32_t *order = malloc(topo->n_cpus * sizeof(uint32_t));
+    if (order == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating cpu order\n");
+        exit(1);
+    }
+    qsort(items, topo->n_cpus, sizeof(sort_item), compare_items);
+    uint32_t i;
+    for (i = 0; i < topo->n_cpus; i++)
+        order[i] = items[i].idx;
+    return order;
+}
+
+void topology_discover(cpu_topology *topo) {
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        perror("sched_getaffinity");
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t n = (uint32_t) CPU_COUNT(&allowed);
+    topo->cpus = malloc(n * sizeof(cpu_info));
+    int *core_ids = malloc(n * sizeof(int));     // (package, core_id) of each dense core
+    int *core_packages = malloc(n * sizeof(int));
+    int *core_siblings = calloc(n, sizeof(int));
+    topo->nodes = malloc(n * sizeof(int));
+    sort_item *items = malloc(n * sizeof(sort_item));
+    if (topo->cpus == NULL || core_ids == NULL || core_packages == NULL || core_siblings == NULL || topo->nodes == NULL || items == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating cpu topology\n");
+        exit(1);
+    }
+
+    topo->n_cpus = 0;
+    topo->n_cores = 0;
+    topo->n_packages = 0;
+    topo->n_nodes = 0;
+
+    int cpu;
+    char path[96];
+    for (cpu = 0; cpu < CPU_SETSIZE && topo->n_cpus < n; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        cpu_info *info = &topo->cpus[topo->n_cpus++];
+        info->cpu = cpu;
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+        info->package = read_sysfs_int(path, 0);
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+        int core_id = read_sysfs_int(path, cpu);
+        info->node = cpu_node(cpu);
+
+        uint32_t c;
+        for (c = 0; c < topo->n_cores; c++)
+            if (core_ids[c] == core_id && core_packages[c] == info->package)
+                break;
+        if (c == topo->n_cores) {
+            core_ids[c] = core_id;
+            core_packages[c] = info->package;
+            topo->n_cores++;
+        }
+        info->core = (int) c;
+        info->smt = core_siblings[c]++;
+
+        uint32_t k;
+        for (k = 0; k < topo->n_nodes && topo->nodes[k] != info->node; k++)
+            ;
+        if (k == topo->n_nodes)
+            topo->nodes[topo->n_nodes++] = info->node;
+    }
+
+    // packages are counted as distinct ids, cores are ranked inside their package for the scatter order
+    int *core_rank = malloc(topo->n_cores * sizeof(int));
+    if (core_rank == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating cpu topology\n");
+        exit(1);
+    }
+    uint32_t c, d;
+    for (c = 0; c < topo->n_cores; c++) {
+        core_rank[c] = 0;
+        int first = 1;
+        for (d = 0; d < c; d++) {
+            if (core_packages[d] == core_packages[c]) {
+                core_rank[c]++;
+                first = 0;
+            }
+        }
+        if (first)
+            topo->n_packages++;
+    }
+
+    uint32_t i;
+    for (i = 0; i < topo->n_cpus; i++) {
+        cpu_info *info = &topo->cpus[i];
+        items[i] = (sort_item) {{info->node, info->package, info->core, info->smt}, i};
+    }
+    topo->compact = sorted_order(topo, items);
+
+    for (i = 0; i < topo->n_cpus; i++) {
+        cpu_info *info = &topo->cpus[i];
+        items[i] = (sort_item) {{info->smt, info->node, info->package, info->core}, i};
+    }
+    topo->physical = sorted_order(topo, items);
+
+    for (i = 0; i < topo->n_cpus; i++) {
+        cpu_info *info = &topo->cpus[i];
+        items[i] = (sort_item) {{info->smt, core_rank[info->core], info->package, info->node}, i};
+    }
+    topo->scatter = sorted_order(topo, items);
+
+    free(core_rank);
+    free(core_ids);
+    free(core_packages);
+    free(core_siblings);
+    free(items);
+}
+
+void topology_free(cpu_topology *topo) {
+
+    free(topo->cpus);
+    free(topo->compact);
+    free(topo->scatter);
+    free(topo->physical);
+    free(topo->nodes);
+}
+
+void topology_print(const cpu_topology *topo) {
+
+    printf("Topology: %u CPUs, %u cores, %u packages, %u nodes\n", topo->n_cpus, topo->n_cores, topo->n_packages, topo->n_nodes);
+}
+
+
+/** --- Pinning policies --- */
+
+static const char *policy_names[] = {"none", "compact", "scatter", "physical", "node"};
+
+uint32_t parse_pin_policy(const char *arg) {
+
+    uint32_t p;
+    for (p = PIN_NONE; p <= PIN_NODE; p++)
+        if (strcmp(arg, policy_names[p]) == 0)
+            return p;
+    fprintf(stderr, "pin policy must be one of none, compact, scatter, physical, node\n");
+    exit(EXIT_FAILURE);
+}
+
+const char *pin_policy_name(uint32_t policy) {
+    return policy <= PIN_NODE ? policy_names[policy] : "unknown";
+}
+
+int topology_cpu(const cpu_topology *topo, uint32_t policy, uint32_t i) {
+
+    i %= topo->n_cpus;
+    switch (policy) {
+        case PIN_COMPACT:
+            return topo->cpus[topo->compact[i]].cpu;
+        case PIN_SCATTER:
+            return topo->cpus[topo->scatter[i]].cpu;
+        case PIN_PHYSICAL:
+            return topo->cpus[topo->physical[i]].cpu;
+        default:
+            return -1;
+    }
+}
+
+int topology_pin(const cpu_topology *topo, uint32_t policy, uint32_t i) {
+
+    if (policy == PIN_NONE)
+        return 0;
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (policy == PIN_NODE) {
+        int node = topo->nodes[i % topo->n_nodes];
+        uint32_t c;
+        for (c = 0; c < topo->n_cpus; c++)
+            if (topo->cpus[c].node == node)
+                CPU_SET(topo->cpus[c].cpu, &cpuset);
+    } else {
+        CPU_SET(topology_cpu(topo, policy, i), &cpuset);
+    }
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    if (ret != 0)
+        fprintf(stderr, "Failed to pin thread %u with policy %s: %s\n", i, pin_policy_name(policy), strerror(ret));
+    return ret;
+}
+
+
+/** --- Worker pool --- */
+
+typedef struct pool_worker {
+    worker_pool *pool;
+    uint32_t tid;
+} pool_worker;
+
+static void *pool_routine(void *arg) {
+
+    pool_worker *w = (pool_worker *) arg;
+    worker_pool *pool = w->pool;
+
+    if (pool->topo != NULL)
+        topology_pin(pool->topo, pool->policy, w->tid);
+
+    while (1) {
+        pthread_barrier_wait(&pool->start);
+        if (pool->stop)
+            break;
+        pool->task(pool->arg, w->tid);
+        pthread_barrier_wait(&pool->done);
+    }
+    return NULL;
+}
+
+void worker_pool_start(worker_pool *pool, uint32_t n, const cpu_topology *topo, uint32_t policy) {
+
+    if (n == 0) {
+        fprintf(stderr, "Error: a worker pool needs at least one worker\n");
+        exit(1);
+    }
+    pool->n = n;
+    pool->topo = topo;
+    pool->policy = policy;
+    pool->task = NULL;
+    pool->arg = NULL;
+    pool->stop = 0;
+
+    pool->threads = malloc(n * sizeof(pthread_t));
+    pool->workers = malloc(n * sizeof(pool_worker));
+    if (pool->threads == NULL || pool->workers == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating worker pool\n");
+        exit(1);
+    }
+    if (pthread_barrier_init(&pool->start, NULL, n + 1) || pthread_barrier_init(&pool->done, NULL, n + 1)
+        || pthread_barrier_init(&pool->barrier, NULL, n)) {
+        fprintf(stderr, "Error in pthread_barrier_init() when starting worker pool\n");
+        exit(1);
+    }
+
+    uint32_t w;
+    for (w = 0; w < n; w++) {
+        pool->workers[w].pool = pool;
+        pool->workers[w].tid = w;
+        if (pthread_create(&pool->threads[w], NULL, pool_routine, &pool->workers[w])) {
+            fprintf(stderr, "Error creating pool worker %u\n", w);
+            exit(1);
+        }
+    }
+}
+
+void worker_pool_submit(worker_pool *pool, pool_task task, void *arg) {
+
+    pool->task = task;
+    pool->arg = arg;
+    pthread_barrier_wait(&pool->start);
+}
+
+void worker_pool_wait(worker_pool *pool) {
+
+    pthread_barrier_wait(&pool->done);
+}
+
+void worker_pool_run(worker_pool *pool, pool_task task, void *arg) {
+
+    worker_pool_submit(pool, task, arg);
+    worker_pool_wait(pool);
+}
+
+void worker_pool_barrier(worker_pool *pool) {
+
+    pthread_barrier_wait(&pool->barrier);
+}
+
+void worker_pool_stop(worker_pool *pool) {
+
+    pool->stop = 1;
+    pthread_barrier_wait(&pool->start);
+
+    uint32_t w;
+    for (w = 0; w < pool->n; w++)
+        pthread_join(pool->threads[w], NULL);
+
+    pthread_barrier_destroy(&pool->start);
+    pthread_barrier_destroy(&pool->done);
+    pthread_barrier_destroy(&pool->barrier);
+    free(pool->threads);
+    free(pool->workers);
+}
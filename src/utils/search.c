@@ -0,0 +1,251 @@
+#include <search.h>
+#include <minhash.h>
+
+
+// hit a ranks after hit b
+static inline int hit_worse(const search_hit *a, const search_hit *b) {
+	return a->equal < b->equal || (a->equal == b->equal && a->set > b->set);
+}
+
+static int compare_hits(const void *x, const void *y) {
+	const search_hit *a = (const search_hit *) x, *b = (const search_hit *) y;
+	return hit_worse(a, b) - hit_worse(b, a);
+}
+
+/** Min-heap of the k best hits so far, the worst at the root */
+static void heap_sift_down(search_hit *heap, size_t count, size_t i) {
+
+	for (;;) {
+		size_t worst = i, left = 2 * i + 1, right = left + 1;
+		if (left < count && hit_worse(&heap[left], &heap[worst]))
+			worst = left;
+		if (right < count && hit_worse(&heap[right], &heap[worst]))
+			worst = right;
+		if (worst == i)
+			return;
+		search_hit tmp = heap[i];
+		heap[i] = heap[worst];
+		heap[worst] = tmp;
+		i = worst;
+	}
+}
+
+static void heap_push(search_hit *heap, size_t count, search_hit hit) {
+
+	size_t i = count;
+	heap[i] = hit;
+	while (i > 0 && hit_worse(&heap[i], &heap[(i - 1) / 2])) {
+		search_hit tmp = heap[i];
+		heap[i] = heap[(i - 1) / 2];
+		heap[(i - 1) / 2] = tmp;
+		i = (i - 1) / 2;
+	}
+}
+
+// equal slots of a block; no branch in the loop, so the compiler vectorizes it
+static inline uint64_t equal_block(const sketch_t *x, const sketch_t *y, uint64_t n) {
+
+	uint64_t i, count = 0;
+	for (i = 0; i < n; i++)
+		count += IS_EQUAL(x[i], y[i]);
+	return count;
+}
+
+
+/**
+ * Top k of the sets first .. last - 1 into heap, returning the number of hits.
+ *
+ * Once the heap is full a set enters only with more equal slots than the root: sets are visited in
+ * increasing id, so a tie never wins. Slots are compared one block at a time, and the comparison is
+ * abandoned as soon as the slots left cannot bring the count above the root.
+ *
+ * shared, if not NULL, is the best root among the workers searching the other ranges: k sets have at
+ * least that many equal slots, so a set is also abandoned once it cannot reach it. A tie with it may
+ * still win, by a lower id.
+ */
+static size_t top_k_range(const sketch_collection *collection, const sketch_t *query, size_t k, uint64_t first, uint64_t last, search_hit *heap, _Atomic uint64_t *shared) {
+
+	const uint64_t size = collection->size;
+	size_t count = 0;
+	uint64_t s, i, n;
+	for (s = first; s < last; s++) {
+		const sketch_t *sketch = collection_sketch(collection, s);
+		int full = count == k;
+		uint64_t bound = full ? heap[0].equal : 0;
+		uint64_t others = shared != NULL ? __atomic_load_n(shared, __ATOMIC_RELAXED) : 0;
+		uint64_t equal = 0;
+		for (i = 0; i < size; i += SEARCH_BLOCK) {
+			n = size - i < SEARCH_BLOCK ? size - i : SEARCH_BLOCK;
+			equal += equal_block(sketch + i, query + i, n);
+			if ((full && equal + (size - i - n) <= bound) || equal + (size - i - n) < others)
+				break;
+		}
+		if (i < size)
+			continue;
+
+		search_hit hit = {s, equal, equal / (float) size};
+		if (!full) {
+			heap_push(heap, count++, hit);
+		} else if (equal > bound) {
+			heap[0] = hit;
+			heap_sift_down(heap, count, 0);
+		} else {
+			continue;
+		}
+
+		// publish a higher root to the other workers
+		if (shared != NULL && count == k) {
+			uint64_t root = heap[0].equal;
+			while (root > others && !__atomic_compare_exchange_n(shared, &others, root, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				;
+		}
+	}
+	return count;
+}
+
+
+size_t collection_top_k(const sketch_collection *collection, const sketch_t *query, size_t k, search_hit *out) {
+
+	if (k == 0)
+		return 0;
+	size_t count = top_k_range(collection, query, k, 0, collection->n_sets, out, NULL);
+	qsort(out, count, sizeof(search_hit), compare_hits);
+	return count;
+}
+
+
+typedef struct top_k_task {
+	const sketch_collection *collection;
+	const sketch_t *query;
+	size_t k;
+	uint32_t workers;
+	search_hit *hits;    /// k hits for each worker
+	size_t *counts;
+	_Atomic uint64_t bound;  /// best root among the full heaps of the workers
+} top_k_task;
+
+/** Worker tid searches the tid-th contiguous range of sets */
+static void top_k_worker(void *arg, uint32_t tid) {
+
+	top_k_task *t = (top_k_task *) arg;
+	uint64_t n_sets = t->collection->n_sets;
+	uint64_t first = n_sets * tid / t->workers, last = n_sets * (tid + 1) / t->workers;
+	t->counts[tid] = top_k_range(t->collection, t->query, t->k, first, last, t->hits + tid * t->k, &t->bound);
+}
+
+size_t collection_top_k_parallel(const sketch_collection *collection, const sketch_t *query, size_t k, search_hit *out, worker_pool *pool) {
+
+	if (k == 0)
+		return 0;
+
+	top_k_task task = {collection, query, k, pool->n, NULL, NULL, 0};
+	task.hits = malloc(pool->n * k * sizeof(search_hit));
+	task.counts = malloc(pool->n * sizeof(size_t));
+	if (task.hits == NULL || task.counts == NULL) {
+		fprintf(stderr, "Error in malloc() when allocating the hits of %u workers\n", pool->n);
+		exit(1);
+	}
+	worker_pool_run(pool, top_k_worker, &task);
+
+	// the k best of the partial results, packed at the front
+	size_t total = 0;
+	uint32_t w;
+	for (w = 0; w < pool->n; w++) {
+		memmove(task.hits + total, task.hits + w * k, task.counts[w] * sizeof(search_hit));
+		total += task.counts[w];
+	}
+	qsort(task.hits, total, sizeof(search_hit), compare_hits);
+	size_t count = total < k ? total : k;
+	memcpy(out, task.hits, count * sizeof(search_hit));
+
+	free(task.counts);
+	free(task.hits);
+	return count;
+}
+
+
+/** --- Threshold join --- */
+
+typedef struct join_task {
+	const sketch_collection *collection;
+	uint64_t need;            /// least equal slots of a pair
+	join_sink sink;
+	void *ctx;
+	uint64_t tile;            /// sets in a tile
+	uint64_t tiles;           /// tiles in a row, the join covers tiles (I, J) with I <= J
+	_Atomic uint64_t next;    /// next tile to compare, in row order
+	_Atomic uint64_t pairs;
+} join_task;
+
+/** Pairs of tile I with tile J; on the diagonal only set < other_set */
+static uint64_t join_tile(join_task *t, uint32_t tid, uint64_t I, uint64_t J) {
+
+	const sketch_collection *collection = t->collection;
+	const uint64_t size = collection->size, need = t->need;
+	uint64_t a_last = (I + 1) * t->tile < collection->n_sets ? (I + 1) * t->tile : collection->n_sets;
+	uint64_t b_last = (J + 1) * t->tile < collection->n_sets ? (J + 1) * t->tile : collection->n_sets;
+	uint64_t a, b, i, n, pairs = 0;
+
+	for (a = I * t->tile; a < a_last; a++) {
+		const sketch_t *x = collection_sketch(collection, a);
+		for (b = I == J ? a + 1 : J * t->tile; b < b_last; b++) {
+			const sketch_t *y = collection_sketch(collection, b);
+			uint64_t equal = 0;
+			for (i = 0; i < size; i += SEARCH_BLOCK) {
+				n = size - i < SEARCH_BLOCK ? size - i : SEARCH_BLOCK;
+				equal += equal_block(x + i, y + i, n);
+				if (equal + (size - i - n) < need)
+					break;
+			}
+			if (i < size)
+				continue;
+			t->sink(t->ctx, tid, a, b, equal / (float) size);
+			pairs++;
+		}
+	}
+	return pairs;
+}
+
+/**
+ * Workers claim tiles in row order from a shared counter, so that a tile with many pairs or few
+ * abandoned comparisons does not hold back the others. Claims only grow, the row and column of
+ * the claimed tile are found walking forward from the previous one.
+ */
+static void join_worker(void *arg, uint32_t tid) {
+
+	join_task *t = (join_task *) arg;
+	const uint64_t total = t->tiles * (t->tiles + 1) / 2;
+	uint64_t I = 0, J = 0, at = 0, claim, pairs = 0;  // tile number at is (I, J)
+
+	while ((claim = __atomic_fetch_add(&t->next, 1, __ATOMIC_RELAXED)) < total) {
+		for (; at < claim; at++)
+			if (++J == t->tiles)
+				J = ++I;
+		pairs += join_tile(t, tid, I, J);
+	}
+	__atomic_fetch_add(&t->pairs, pairs, __ATOMIC_RELAXED);
+}
+
+uint64_t collection_join(const sketch_collection *collection, float threshold, join_sink sink, void *ctx, worker_pool *pool) {
+
+	const uint64_t size = collection->size;
+	// least count whose similarity, computed as by the queries, reaches threshold
+	uint64_t need = threshold > 0 ? (uint64_t) (threshold * size) : 0;
+	while (need > 0 && (need - 1) / (float) size >= threshold)
+		need--;
+	while (need <= size && need / (float) size < threshold)
+		need++;
+	if (need > size || collection->n_sets < 2)
+		return 0;
+
+	uint64_t tile = JOIN_TILE_BYTES / (collection->stride * sizeof(sketch_t));
+	if (tile == 0)
+		tile = 1;
+	join_task task = {collection, need, sink, ctx, tile, (collection->n_sets + tile - 1) / tile, 0, 0};
+
+	if (pool == NULL)
+		join_worker(&task, 0);
+	else
+		worker_pool_run(pool, join_worker, &task);
+	return task.pairs;
+}
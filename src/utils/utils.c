@@ -1,17 +1,115 @@
 #include <utils.h>
+#include <arena.h>
 
-int basic_insert(uint64_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem) {
+
+/**
+ * Multi-slot k-wise kernel: values[i] = h_i(x) for the count slots starting at self.
+ *
+ * The coefficient table is degree-major, so Horner's rule is run with the degree as the outer loop
+ * and the slots as the inner one, over contiguous coefficient rows: the inner loop has no
+ * dependency across slots and is vectorized by the compiler. Under the Mersenne modulus each step
+ * is reduced lazily with two folds, keeping acc below 2^32 so that acc * x is a 32x32 bit product.
+ */
+static void kwise_values(kwise_hash *self, uint64_t count, uint64_t x, sketch_t *values) {
+
+	const uint32_t *c = self->coefficients;
+	const uint64_t stride = self->stride;
+	const uint64_t M = self->M;
+	const uint32_t k = self->k;
+	uint64_t acc[MIN_UPDATE_BLOCK];
+	uint64_t i, b, n;
+	uint32_t j;
+
+	x %= M;
+
+	if (M != MERSENNE_31) {
+		for (i = 0; i < count; i++)
+			values[i] = self[i].hash_function(&self[i], x);
+		return;
+	}
+
+	for (b = 0; b < count; b += MIN_UPDATE_BLOCK) {
+		n = count - b < MIN_UPDATE_BLOCK ? count - b : MIN_UPDATE_BLOCK;
+
+		for (i = 0; i < n; i++)
+			acc[i] = c[k * stride + b + i];
+		for (j = k; j-- > 0; ) {
+			const uint32_t *row = c + j * stride + b;
+			for (i = 0; i < n; i++)
+				acc[i] = mersenne_fold(mersenne_fold((uint64_t) (uint32_t) acc[i] * (uint32_t) x + row[i]));
+		}
+		for (i = 0; i < n; i++) {
+			uint64_t h = mersenne_fold(acc[i]);
+			values[b + i] = h >= MERSENNE_31 ? h - MERSENNE_31 : h;
+		}
+	}
+}
+
+/**
+ * Multi-slot tabulation kernels: values[i] = h_i(x) for the count slots starting at self.
+ *
+ * The chars of x select one row per char of the interleaved table, the rows are contiguous
+ * across slots and the per slot hash is the XOR of the rows, so the loop is vectorized.
+ * Twisted tabulation adds a last lookup whose index depends on the slot, served by a gather.
+ */
+static void tabulation_values(tabulation_hash *self, uint64_t count, uint64_t x, sketch_t *values) {
+
+	const uint32_t *rows[TAB_CHARS];
+	const uint64_t M = self->M;
+	uint64_t i;
+	uint32_t c;
+
+	for (c = 0; c < TAB_CHARS; c++)
+		rows[c] = self->table + (c * TAB_ENTRIES + ((x >> (8 * c)) & 0xFF)) * self->stride;
+
+	for (i = 0; i < count; i++) {
+		uint32_t h = 0;
+		for (c = 0; c < TAB_CHARS; c++)
+			h ^= rows[c][i];
+		values[i] = tabulation_range(h, M);
+	}
+}
+
+static void twisted_tabulation_values(tabulation_hash *self, uint64_t count, uint64_t x, sketch_t *values) {
+
+	const uint64_t *rows[TAB_CHARS - 1];
+	const uint32_t *last = self->table;
+	const uint64_t last_char = x >> (8 * (TAB_CHARS - 1));
+	const uint64_t M = self->M;
+	uint64_t i;
+	uint32_t c;
+
+	for (c = 0; c < TAB_CHARS - 1; c++)
+		rows[c] = self->twisted_table + (c * TAB_ENTRIES + ((x >> (8 * c)) & 0xFF)) * self->stride;
+
+	for (i = 0; i < count; i++) {
+		uint64_t h = 0;
+		for (c = 0; c < TAB_CHARS - 1; c++)
+			h ^= rows[c][i];
+		uint32_t hl = (h >> 32) ^ last[((last_char ^ h) & 0xFF) * self->stride + i];
+		values[i] = tabulation_range(hl, M);
+	}
+}
+
+int basic_insert(sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem) {
 
         int insertion = 0;  // boolean function that takes track if at least one element insertion in the min hash has actually occured
 	uint64_t i;
 	switch (hash_type) {
-	case 1: {
-		kwise_hash *kwise_h_func = (kwise_hash *) hash_functions;
-		for (i = 0; i < size; i++) {
-			uint64_t val = kwise_h_func[i].hash_function(&kwise_h_func[i], elem);
-			if (val < sketch[i]){
-				sketch[i] = val;
-				insertion = 1;	
+	case 1:
+	case 2:
+	case 3: {
+		// the multi-slot kernels hash a block of slots at once
+		sketch_t values[MIN_UPDATE_BLOCK];
+		uint64_t j, n;
+		for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+			n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+			hash_values(hash_functions, hash_type, i, n, elem, values);
+			for (j = 0; j < n; j++) {
+				if (values[j] < sketch[i + j]) {
+					sketch[i + j] = values[j];
+					insertion = 1;
+				}
 			}
 		}
 		break;
@@ -33,7 +131,80 @@ int basic_insert(uint64_t *sketch, uint64_t size, void *hash_functions, uint32_t
 }
 
 
-int merge(uint64_t *sketch, uint64_t *other_sketch, uint64_t size) {
+void hash_values(void *hash_functions, uint32_t hash_type, uint64_t first, uint64_t count, uint64_t elem, sketch_t *values) {
+// values[i] is the hash value of elem computed by the hash function of slot first + i
+	uint64_t i;
+	switch (hash_type) {
+	case 1:
+		kwise_values((kwise_hash *) hash_functions + first, count, elem, values);
+		break;
+	case 2:
+		tabulation_values((tabulation_hash *) hash_functions + first, count, elem, values);
+		break;
+	case 3:
+		twisted_tabulation_values((tabulation_hash *) hash_functions + first, count, elem, values);
+		break;
+	default: {
+		pairwise_hash *pairwise_h_func = (pairwise_hash *) hash_functions + first;
+		for (i = 0; i < count; i++)
+			values[i] = pairwise_h_func[i].hash_function(&pairwise_h_func[i], elem);
+		break;
+	    }
+	}
+}
+
+
+int min_update(sketch_t *sketch, const sketch_t *values, uint64_t size) {
+// no branch in the loop: the compiler vectorizes it as a compare, a min and an or
+	uint64_t i;
+	int changed = 0;
+	for (i = 0; i < size; i++) {
+		changed |= values[i] < sketch[i];
+		sketch[i] = values[i] < sketch[i] ? values[i] : sketch[i];
+	}
+	return changed;
+}
+
+
+/**
+ * Concurrent min-update kernel: sketch[i] = min(sketch[i], values[i]) for each slot, using CAS.
+ *
+ * Each block of MIN_UPDATE_BLOCK slots is first compared against a relaxed snapshot of the
+ * sketch, producing a mask of the slots where values can win. This loop has no atomics
+ * and is vectorized by the compiler. Slots only decrease, so a stale read can only report
+ * a false candidate, never hide a real one. CAS is then issued only on candidate slots:
+ * once the sketch has warmed up almost no slot changes and almost no CAS is executed.
+ *
+ * @return number of slots actually updated
+ */
+uint64_t concurrent_min_update(sketch_t *sketch, const sketch_t *values, uint64_t size) {
+
+	uint64_t i, j, n, updated = 0;
+	sketch_t old;
+	for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+		n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+
+		uint64_t mask = 0;
+		for (j = 0; j < n; j++)
+			mask |= (uint64_t) (values[i + j] < sketch[i + j]) << j;
+
+		while (mask) {
+			j = i + __builtin_ctzll(mask);
+			mask &= mask - 1;
+			old = __atomic_load_n(&(sketch[j]), __ATOMIC_RELAXED);
+			while (values[j] < old) {
+				if (__atomic_compare_exchange_n(&(sketch[j]), &old, values[j], 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+					updated++;
+					break;
+				}
+			}
+		}
+	}
+	return updated;
+}
+
+
+int merge(sketch_t *sketch, sketch_t *other_sketch, uint64_t size) {
 // Merge other_sketch and sketch. The resulting sketch is written into sketch itself
 	uint64_t i;
 	int ismerge = 0;
@@ -45,13 +216,9 @@ int merge(uint64_t *sketch, uint64_t *other_sketch, uint64_t size) {
 	return ismerge;
 }
 
-uint64_t *copy_sketch(const uint64_t *sketch, uint64_t size) {
+sketch_t *copy_sketch(const sketch_t *sketch, uint64_t size) {
 // return a pointer to a copy of the sketch
-	uint64_t *copy = malloc(size * sizeof(uint64_t));
-	if (copy == NULL) {
-	        fprintf(stderr, "Error in malloc() when allocating copy array in copy_sketch\n");
-	        exit(1);
-	}
+	sketch_t *copy = sketch_alloc(size);
     
     	uint64_t i;
 	for (i = 0; i < size; i++)
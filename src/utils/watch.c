@@ -0,0 +1,128 @@
+#include <watch.h>
+#include <minhash.h>
+
+
+void watch_init(watch_list *watches) {
+
+	watches->count = 0;
+	uint32_t p;
+	for (p = 0; p < WATCH_MAX; p++) {
+		watches->pairs[p].reference = NULL;
+		__atomic_store_n(&watches->pairs[p].equal, 0, __ATOMIC_RELAXED);
+	}
+}
+
+int watch_add(watch_list *watches, const sketch_t *reference, const sketch_t *sketch, uint64_t size) {
+
+	uint32_t p;
+	for (p = 0; p < watches->count && watches->pairs[p].reference != NULL; p++)
+		;
+	if (p == WATCH_MAX) {
+		fprintf(stderr, "Cannot watch more than %d reference sketches\n", WATCH_MAX);
+		exit(1);
+	}
+
+	uint64_t i, equal = 0;
+	for (i = 0; i < size; i++)
+		equal += IS_EQUAL(sketch[i], reference[i]);
+	__atomic_store_n(&watches->pairs[p].equal, equal, __ATOMIC_RELAXED);
+	watches->pairs[p].reference = reference;
+	if (p == watches->count)
+		watches->count++;
+	return (int) p;
+}
+
+void watch_remove(watch_list *watches, int id) {
+
+	watches->pairs[id].reference = NULL;
+	while (watches->count > 0 && watches->pairs[watches->count - 1].reference == NULL)
+		watches->count--;
+}
+
+float watch_similarity(const watch_list *watches, int id, uint64_t size) {
+
+	return __atomic_load_n(&watches->pairs[id].equal, __ATOMIC_RELAXED) / (float) size;
+}
+
+
+/** Slot j goes from old to new: add the change of its equality to every watched reference */
+static inline void watch_slot(watch_list *watches, int64_t *delta, uint64_t j, sketch_t old, sketch_t new) {
+
+	uint32_t p;
+	for (p = 0; p < watches->count; p++) {
+		const sketch_t *reference = watches->pairs[p].reference;
+		if (reference != NULL)
+			delta[p] += (int64_t) IS_EQUAL(new, reference[j]) - (int64_t) IS_EQUAL(old, reference[j]);
+	}
+}
+
+static inline void watch_publish(watch_list *watches, const int64_t *delta) {
+
+	uint32_t p;
+	for (p = 0; p < watches->count; p++)
+		if (delta[p] != 0)
+			__atomic_fetch_add(&watches->pairs[p].equal, (uint64_t) delta[p], __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Like concurrent_min_update, each block of MIN_UPDATE_BLOCK slots is first compared into a mask of the
+ * slots values wins, in a loop the compiler vectorizes; only those slots are updated and compared with
+ * the references. The counts are published once, after the whole update.
+ */
+int watch_min_update(watch_list *watches, sketch_t *sketch, const sketch_t *values, uint64_t first, uint64_t count) {
+
+	int64_t delta[WATCH_MAX] = {0};
+	uint64_t i, j, n;
+	int changed = 0;
+	for (i = 0; i < count; i += MIN_UPDATE_BLOCK) {
+		n = count - i < MIN_UPDATE_BLOCK ? count - i : MIN_UPDATE_BLOCK;
+
+		uint64_t mask = 0;
+		for (j = 0; j < n; j++)
+			mask |= (uint64_t) (values[i + j] < sketch[first + i + j]) << j;
+		changed |= mask != 0;
+
+		while (mask) {
+			j = i + __builtin_ctzll(mask);
+			mask &= mask - 1;
+			watch_slot(watches, delta, first + j, sketch[first + j], values[j]);
+			sketch[first + j] = values[j];
+		}
+	}
+	watch_publish(watches, delta);
+	return changed;
+}
+
+int watch_insert(watch_list *watches, sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem) {
+
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, n;
+	int insertion = 0;
+	for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+		n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+		hash_values(hash_functions, hash_type, i, n, elem, values);
+		insertion |= watch_min_update(watches, sketch, values, i, n);
+	}
+	return insertion;
+}
+
+void watch_replace(watch_list *watches, const sketch_t *old, const sketch_t *new, uint64_t size) {
+
+	int64_t delta[WATCH_MAX] = {0};
+	uint64_t i, j, n;
+	for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+		n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+
+		uint64_t mask = 0;
+		for (j = 0; j < n; j++)
+			mask |= (uint64_t) (old[i + j] != new[i + j]) << j;
+
+		while (mask) {
+			j = i + __builtin_ctzll(mask);
+			mask &= mask - 1;
+			watch_slot(watches, delta, j, old[j], new[j]);
+		}
+	}
+	watch_publish(watches, delta);
+}
@@ -0,0 +1,152 @@
+#include <math.h>
+
+#include <weighted.h>
+#include <minhash.h>
+
+
+#define GOLDEN 0x9E3779B97F4A7C15ULL
+
+/** splitmix64 finalizer: a bijection of 64-bit words with full avalanche */
+static inline uint64_t mix64(uint64_t z) {
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/** Uniform in (0, 1): 52 random bits as the mantissa of a double in [1, 2), moved half a step off 0 */
+static inline double unit_open(uint64_t v) {
+	uint64_t bits = 0x3FF0000000000000ULL | (v >> 12);
+	double d;
+	memcpy(&d, &bits, sizeof(d));
+	return (d - 1.0) + 0x1p-53;
+}
+
+/**
+ * Natural logarithm of a positive normal double, accurate to a few ulps.
+ *
+ * x = 2^e * m with m in [sqrt(2)/2, sqrt(2)), then ln m = 2 atanh(s) with s = (m - 1) / (m + 1),
+ * |s| < 0.172, by its odd series up to s^13. Unlike log() it has no branch and no call, and e is
+ * made a double through the bits rather than converted from a 64-bit integer, which x86-64 has no
+ * vector instruction for before AVX-512, so the slot loop of weighted_values is vectorized; both
+ * paths use it, so their keys are identical.
+ */
+static inline double fast_log(double x) {
+
+	const uint64_t off = 0x3FE6A09E667F3BCDULL;  // bits of sqrt(2)/2
+	uint64_t bits;
+	memcpy(&bits, &x, sizeof(bits));
+	uint64_t tmp = bits - off;
+	uint64_t mbits = bits - (tmp & (0xFFFULL << 52));
+	double m;
+	memcpy(&m, &mbits, sizeof(m));
+	// the exponent is the top 12 bits of tmp, signed: biased by 2^11 into the mantissa of 2^52
+	uint64_t ebits = 0x4330000000000000ULL | ((tmp >> 52) ^ 0x800);
+	double e;
+	memcpy(&e, &ebits, sizeof(e));
+	e -= 0x1p52 + 0x800;
+
+	double f = m - 1.0;
+	double s = f / (2.0 + f);
+	double s2 = s * s;
+	double poly = s2 * (2.0 / 3 + s2 * (2.0 / 5 + s2 * (2.0 / 7 + s2 * (2.0 / 9 + s2 * (2.0 / 11 + s2 * (2.0 / 13))))));
+	return e * 0x1.62E42FEFA39EFp-1 + (2.0 * s + s * poly);
+}
+
+/**
+ * floor(x) for |x| < 2^51: round to nearest with the 1.5 * 2^52 shift, then step down if above x.
+ * Beyond, x itself: it is that large only for r below 2^-41, where r * t is ln_weight to the last bits.
+ * Selects rather than branches, so that the loop of weighted_values is if-converted
+ */
+static inline double floor_fast(double x) {
+
+	const double shift = 0x1.8p52;
+	double r = (x + shift) - shift;
+	r -= r > x ? 1.0 : 0.0;
+	return fabs(x) < 0x1p51 ? r : x;
+}
+
+/** Unsigned key with the order of the double: negative values have all bits flipped, positive ones the sign bit set */
+static inline sketch_t order_key(double ln_a) {
+
+#ifdef SKETCH_32BIT
+	float f = (float) ln_a;
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits ^ ((0U - (bits >> 31)) | 0x80000000U);
+#else
+	uint64_t bits;
+	memcpy(&bits, &ln_a, sizeof(bits));
+	return bits ^ ((0ULL - (bits >> 63)) | 0x8000000000000000ULL);
+#endif
+}
+
+/**
+ * ICWS key of one slot. h is the hash value of elem for the slot, from the hash family of the sketch:
+ * with the element and the slot it seeds the five uniforms of the sample, so that every sketch built
+ * with the same hash functions draws the same r, c and beta for the same element.
+ */
+static inline sketch_t icws_key(sketch_t h, uint64_t slot, uint64_t elem, double ln_weight) {
+
+	uint64_t seed = elem + GOLDEN * ((uint64_t) h + 1) + 0xD1B54A32D192ED03ULL * slot;
+	double r = -fast_log(unit_open(mix64(seed + GOLDEN)) * unit_open(mix64(seed + 2 * GOLDEN)));
+	double c = -fast_log(unit_open(mix64(seed + 3 * GOLDEN)) * unit_open(mix64(seed + 4 * GOLDEN)));
+	double beta = unit_open(mix64(seed + 5 * GOLDEN));
+
+	double t = floor_fast(ln_weight / r + beta);
+	return order_key(fast_log(c) - r * (t - beta + 1.0));
+}
+
+
+/**
+ * The slot loop is vectorized on any x86-64 (2 lanes of SSE2). The clones run it 4 and 8 lanes wide
+ * where the CPU has AVX2 or AVX-512, picked once when the library is loaded, unless the whole build is
+ * native already (NATIVE_ARCH)
+ */
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__) && !defined(__AVX2__)
+#define WEIGHTED_CLONES __attribute__((target_clones("arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define WEIGHTED_CLONES
+#endif
+
+WEIGHTED_CLONES
+void weighted_values(void *hash_functions, uint32_t hash_type, uint64_t first, uint64_t count, uint64_t elem, double weight, sketch_t *values) {
+
+	uint64_t i, b, n;
+	if (!(weight > 0)) {
+		for (i = 0; i < count; i++)
+			values[i] = INFTY;
+		return;
+	}
+
+	const double ln_weight = log(weight);
+	sketch_t h[MIN_UPDATE_BLOCK];
+	for (b = 0; b < count; b += MIN_UPDATE_BLOCK) {
+		n = count - b < MIN_UPDATE_BLOCK ? count - b : MIN_UPDATE_BLOCK;
+		hash_values(hash_functions, hash_type, first + b, n, elem, h);
+		for (i = 0; i < n; i++)
+			values[b + i] = icws_key(h[i], first + b + i, elem, ln_weight);
+	}
+}
+
+sketch_t weighted_value(void *hash_functions, uint32_t hash_type, uint64_t slot, uint64_t elem, double weight) {
+
+	if (!(weight > 0))
+		return INFTY;
+	sketch_t h;
+	hash_values(hash_functions, hash_type, slot, 1, elem, &h);
+	return icws_key(h, slot, elem, log(weight));
+}
+
+
+int weighted_insert(sketch_t *sketch, uint64_t size, void *hash_functions, uint32_t hash_type, uint64_t elem, double weight) {
+
+	sketch_t values[MIN_UPDATE_BLOCK];
+	uint64_t i, n;
+	int insertion = 0;
+	for (i = 0; i < size; i += MIN_UPDATE_BLOCK) {
+		n = size - i < MIN_UPDATE_BLOCK ? size - i : MIN_UPDATE_BLOCK;
+		weighted_values(hash_functions, hash_type, i, n, elem, weight, values);
+		insertion |= min_update(sketch + i, values, n);
+	}
+	return insertion;
+}
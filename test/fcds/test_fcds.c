@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 struct minhash_configuration conf = {
     .sketch_size = 128,          /// Number of hash functions / sketch size
@@ -19,16 +20,16 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     fcds_sketch *sketch;
     long n_inserts;
     uint64_t startsize;
+    struct timeval end;
+    worker_pool *pool;
+    void *(*routine)(void *);
 } thread_arg_t;
 
 
-pthread_barrier_t barrier;
-
-
 static double elapsed_ms(struct timeval start, struct timeval end) {
     double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
     elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
@@ -56,12 +57,12 @@ void minhash_print(fcds_sketch *sketch) {
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < sketch->size; i++) {
-        printf(" %lu, ", sketch->global_sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch->global_sketch[i]);
     }
     printf("\n");
 }
 
-void local_insert(uint64_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
+void local_insert(sketch_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
 
     long i;
     uint32_t insertion_counter = 0;
@@ -75,13 +76,17 @@ void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
 
     fcds_sketch *t_sketch = targ->sketch;
-    uint64_t *local_sketch = t_sketch->local_sketches[targ->tid];
     _Atomic uint32_t *propi = &(t_sketch->prop[targ->tid]);
 
+    // the pool pinned this worker, move the local sketch to its node
+    fcds_writer_bind(t_sketch, targ->tid);
+    sketch_t *local_sketch = t_sketch->local_sketches[targ->tid];
+    void *hash_functions = fcds_writer_hash_functions(t_sketch, targ->tid);
+
     // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
-    local_insert(local_sketch, t_sketch->hash_functions, t_sketch->hash_type, t_sketch->size,
+    local_insert(local_sketch, hash_functions, t_sketch->hash_type, t_sketch->size,
         propi, targ->n_inserts, targ->startsize, t_sketch->b);
         
         
@@ -91,13 +96,15 @@ void *thread_insert(void *arg) {
             // DO NOTHING
             ;                                
     } // Since only two threads uses this prop, the busy-wait should be ok
+
+    gettimeofday(&targ->end, NULL);
        
     
 if (0) {
     uint64_t i;
-    printf("Local sketch of %lu : \n", targ->tid);
+    printf("Local sketch of %u : \n", targ->tid);
     for(i=0; i < t_sketch->size; i++) {
-        printf(" %lu, ", local_sketch[i]);
+        printf(" %lu, ", (uint64_t) local_sketch[i]);
     }
     printf("\n");
 }
@@ -111,12 +118,12 @@ void *thread_query(void *arg) {
     fcds_sketch *t_sketch = targ->sketch;
 
     // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
     for (int i = 0; i < 1000000; i++)
 	   query_fcds(t_sketch, t_sketch->global_sketch);
 	
-    fprintf(stderr, "Query thread %lu done\n", targ->tid);
+    fprintf(stderr, "Query thread %u done\n", targ->tid);
     return NULL;
 }
 
@@ -129,12 +136,17 @@ void *propagator_routine(void *arg) {
     return NULL;
 }
 
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targ = &((thread_arg_t *) arg)[tid];
+    targ->routine(targ);
+}
+
 
 int main(int argc, const char*argv[]) {
 
     if (argc < 7) {
         fprintf(stderr,
-                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads>\n",
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> [pin policy]\n",
                 argv[0]);
         return 1;
     }
@@ -145,6 +157,7 @@ int main(int argc, const char*argv[]) {
     long num_threads = parse_arg(argv[4], "num_threads", 2);
     long threshold = parse_arg(argv[5], "threshold", 1);
     long num_query_threads = parse_arg(argv[6], "num_query_threads", 0);
+    uint32_t pin_policy = argc > 7 ? parse_pin_policy(argv[7]) : PIN_COMPACT;
 
 
     
@@ -162,11 +175,17 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_fcds(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads + num_query_threads);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    // the propagator runs for the whole program on its own thread, the writers and queries run on the pool
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + num_query_threads, &topo, pin_policy);
 
-    pthread_t threads[conf.N+1 + num_query_threads]; // consider #writers + propagator
-    thread_arg_t targs[conf.N+1 + num_query_threads]; 
+    pthread_t propagator_thread;
+    thread_arg_t targs[conf.N+1 + num_query_threads]; // consider #writers + propagator
 
     uint64_t chunk_size = n_inserts / conf.N;
     uint64_t remainder = n_inserts % conf.N;
@@ -181,38 +200,26 @@ int main(int argc, const char*argv[]) {
         targs[i].n_inserts = inserts_for_thread;
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
+        targs[i].pool = &pool;
+        targs[i].routine = thread_insert;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
     
     
     for (; i < conf.N + num_query_threads; i++){
         targs[i].tid = i;
         targs[i].sketch = sketch;
-        int rc = pthread_create(&threads[i], NULL, thread_query, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread query %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
+        targs[i].routine = thread_query;
     }
-    
-    pthread_barrier_wait(&barrier);
-
 
-    if (i >= conf.N) {
-        targs[i].tid = i;
-        targs[i].sketch = sketch;
-        int rc = pthread_create(&threads[i], NULL, propagator_routine, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
+    targs[i].tid = i;
+    targs[i].sketch = sketch;
+    int rc = pthread_create(&propagator_thread, NULL, propagator_routine, &targs[i]);
+    if (rc) {
+        fprintf(stderr, "Error creating propagator thread %lu\n", i);
+        exit(1);
     }
 
     struct timeval start, end;
@@ -220,32 +227,25 @@ int main(int argc, const char*argv[]) {
     // Get the start time
     gettimeofday(&start, NULL);
 
-
-    long j;
-    for (j = 0; j < conf.N; j++) {
-        pthread_join(threads[j], NULL);
-    }
+    worker_pool_run(&pool, worker_task, targs);
 
     // Get the end time
     gettimeofday(&end, NULL);
 
-    printf("Insertion elapsed time: %.3f ms\n", elapsed_ms(start, end));
-
-    gettimeofday(&start, NULL);
-    // Join query threads
-    long q;
-    for (q = 0; q < num_query_threads; q++) {
-        //pthread_cancel(threads[q]);
-        pthread_join(threads[conf.N + q], NULL); // or conf.N + q
+    // the insertions end with the last writer
+    double insertion_ms = 0.0;
+    long j;
+    for (j = 0; j < conf.N; j++) {
+        double t = elapsed_ms(start, targs[j].end);
+        if (t > insertion_ms) insertion_ms = t;
     }
 
-
-    pthread_barrier_destroy(&barrier);
-    // Get the end time
-    gettimeofday(&end, NULL);
-
+    printf("Insertion elapsed time: %.3f ms\n", insertion_ms);
     printf("Total elapsed time: %.3f ms\n", elapsed_ms(start, end));
 
+    worker_pool_stop(&pool);
+    topology_free(&topo);
+
 
 
     /*minhash_sketch *serial_sketch;
@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 
@@ -26,13 +27,14 @@ typedef struct {
     long n_inserts;
     uint64_t startsize;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
+    const cpu_topology *topo;
+    uint32_t pin_policy;
+    uint32_t pin_index;  // the propagator is placed after the writers of the pool
     double prob;
 } thread_arg_t;
 
 
-pthread_barrier_t barrier;
-
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
 {
@@ -57,12 +59,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -72,6 +74,7 @@ void *propagator_routine(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
 
     fcds_sketch *t_sketch = targ->sketch;
+    topology_pin(targ->topo, targ->pin_policy, targ->pin_index);
     propagator(t_sketch);
 
     return NULL;
@@ -83,13 +86,16 @@ void *thread_routine(void *arg) {
     struct timeval t1, t2;
     fcds_sketch *t_sketch = targ->sketch;
     double prob = targ->prob;
-    uint64_t *local_sketch = t_sketch->local_sketches[targ->tid];
     _Atomic uint32_t *propi = &(t_sketch->prop[targ->tid]);
     uint32_t insertion_counter = 0;
 
-    pin_thread_to_core(targ->core_id);
+    // move the local sketch to the node of the writer
+    fcds_writer_bind(t_sketch, targ->tid);
+    sketch_t *local_sketch = t_sketch->local_sketches[targ->tid];
+    void *hash_functions = fcds_writer_hash_functions(t_sketch, targ->tid);
 
-    pthread_barrier_wait(&barrier);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
     long i;
@@ -97,7 +103,7 @@ void *thread_routine(void *arg) {
     for (i=0; i < targ->n_inserts;i++) {
         //printf("[%lu] insertion number %ld\n", targ->tid, i);
         if (rand_r(&state) < prob*RAND_MAX) {
-            insert_fcds(local_sketch, t_sketch->hash_functions, t_sketch->hash_type, 
+            insert_fcds(local_sketch, hash_functions, t_sketch->hash_type, 
                 t_sketch->size, &insertion_counter, propi, t_sketch->b, i+targ->startsize);
         } else {
             query_fcds(t_sketch, t_sketch->global_sketch);
@@ -110,6 +116,11 @@ void *thread_routine(void *arg) {
     return NULL;
 }
 
+// worker w of the pool is the writer w + 1, thread 0 is the propagator
+void writer_task(void *arg, uint32_t tid) {
+    thread_routine(&((thread_arg_t *) arg)[tid + 1]);
+}
+
 
 
 
@@ -118,13 +129,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 7) {
         fprintf(stderr,
-                "Usage: %s <number of operations> <sketch_size> <initial size> <num_threads> <threshold insertion>  <write probability> <hash coefficient>\n",
+                "Usage: %s <number of operations> <sketch_size> <initial size> <num_threads> <threshold insertion>  <write probability> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_ops = parse_arg(argv[1], "n_ops", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -136,6 +145,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[7], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 8 ? parse_pin_policy(argv[8]) : PIN_COMPACT;
 
     // when finished debugging remove comment
     //srand(time(NULL)); 
@@ -159,10 +169,15 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_fcds(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads - 1);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N - 1, &topo, pin_policy);
 
-    pthread_t threads[conf.N]; // consider #writers + propagator
+    pthread_t propagator_thread;
     thread_arg_t targs[conf.N]; 
 
     uint64_t chunk_size = n_ops / (conf.N - 1);
@@ -180,95 +195,46 @@ int main(int argc, const char*argv[]) {
     /** launch propagator */
     targs[i].tid = i;
     targs[i].sketch = sketch;
-    int rc = pthread_create(&threads[i], NULL, propagator_routine, &targs[i]);
+    targs[i].topo = &topo;
+    targs[i].pin_policy = pin_policy;
+    targs[i].pin_index = conf.N - 1;
+    int rc = pthread_create(&propagator_thread, NULL, propagator_routine, &targs[i]);
     if (rc) {
         fprintf(stderr, "Error creating propagator thread %lu\n", i);
         exit(1);
     }
 
-    /** launch writer threads */
-    for (i = 1; i < conf.N-1; i++) {
-    
-    
-    
-            // determine work size and starting position for thread i
-	if (i < remainder + 1) {
-		// First 'remainder' threads get the base chunk plus one
-	    inserts_for_thread = chunk_size + 1;
-		
-		//  start position is offset by the work done by previous threads.
-		// The previous 'i' threads each got (chunk_size + 1).
-	    current_start = startsize + ((i-1) * (chunk_size + 1));
-	} else {
-		// Remaining threads get only the base chunk size
-	    inserts_for_thread = chunk_size;
-		
-		//  start position is calculated as:
-		// (Work of the 'remainder' threads) + (Work of the preceding 'chunk_size' threads)
-	    current_start = startsize + 
-			(remainder * (chunk_size + 1)) + 
-			(((i-1) - remainder) * chunk_size);
-	}
-
-        
+    /** prepare writer threads */
+    for (i = 1; i < conf.N; i++) {
+        // First 'remainder' threads get the base chunk plus one, each thread starts where the previous one ended
+        inserts_for_thread = (uint64_t) i < remainder + 1 ? chunk_size + 1 : chunk_size;
+
         targs[i].tid = i;
         targs[i].n_inserts = inserts_for_thread;
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
         targs[i].prob      = prob;
-        targs[i].core_id = i % num_cores;  
+        targs[i].pool      = &pool;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_routine, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
-    
-    
-    if (i < remainder + 1) {
-        inserts_for_thread = chunk_size + 1;
-    
-        current_start = startsize + ((i-1) * (chunk_size + 1));
-    } else {
-        inserts_for_thread = chunk_size;
-        current_start = startsize + 
-                        (remainder * (chunk_size + 1)) + // Total work of the first remainder threads
-                        (((i-1) - remainder) * chunk_size);  // total work of the preceding chunk_size threads
-    }
-    
-    targs[i].tid = i;
-    targs[i].n_inserts = inserts_for_thread;
-    targs[i].startsize = current_start;
-    targs[i].sketch = sketch;
-    targs[i].prob      = prob;
-
-
-    targs[i].core_id = i % num_cores;
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_routine(&targs[i]);
-   
+    worker_pool_run(&pool, writer_task, targs);
+
+    gettimeofday(&writer_end, NULL);
+    // Get the end time
 
     long j;
-    for (j = 1; j < conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
+    for (j = 1; j < conf.N; j++) {
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
         if (t > insert_max) insert_max = t;
     }
 
-    insert_sum += targs[j].elapsed;
-    if (targs[j].elapsed < insert_min) insert_min = targs[j].elapsed;
-    if (targs[j].elapsed > insert_max) insert_max = targs[j].elapsed;
-    gettimeofday(&writer_end, NULL);
-    // Get the end time
-
     gettimeofday(&global_end, NULL);
 
 
@@ -281,7 +247,9 @@ int main(int argc, const char*argv[]) {
     printf("Total program elapsed time: %.3f ms\n",
            elapsed_ms(global_start, global_end));
     
-    pthread_barrier_destroy(&barrier);
+    // the propagator never returns, it is left running until the process exits
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
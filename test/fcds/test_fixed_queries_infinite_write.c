@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -21,19 +22,20 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     fcds_sketch *sketch;
     long n_queries;
     uint64_t startsize;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
 } thread_arg_t;
 
 
 
 long to_insert;
 unsigned long count_ins;
-pthread_barrier_t barrier;
+_Atomic long queries_running;   // query threads still running, the last one to finish stops the writers
+_Atomic int stop_writers;
 
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
@@ -59,12 +61,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -74,24 +76,30 @@ void minhash_print(uint64_t *sketch, size_t size) {
 void *thread_query(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
 
+    struct timeval t1, t2;
     fcds_sketch *t_sketch = targ->sketch;
 
-    // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
+    gettimeofday(&t1, NULL);
     for (int i = 0; i < targ->n_queries; i++)
        query_fcds(t_sketch, t_sketch->global_sketch);
-    
-    fprintf(stderr, "Query thread %lu done\n", targ->tid);
+    gettimeofday(&t2, NULL);
+    targ->elapsed = elapsed_ms(t1, t2);
+
+    if (atomic_fetch_sub(&queries_running, 1) == 1)
+        atomic_store(&stop_writers, 1);
+    fprintf(stderr, "Query thread %u done\n", targ->tid);
     return NULL;
 }
 
 
-void local_insert(uint64_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
+void local_insert(sketch_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
 
     long i;
     uint32_t insertion_counter = 0;
-    for (;;) {
+    while (!atomic_load_explicit(&stop_writers, memory_order_relaxed)) {
         i = __sync_fetch_and_add(&to_insert, 1);
         insert_fcds(sketch, hash_functions, hash_type, size, &insertion_counter, prop, b, i+startsize);
         __sync_fetch_and_add(&count_ins, 1);
@@ -114,15 +122,17 @@ void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
 
     fcds_sketch *t_sketch = targ->sketch;
-    uint64_t *local_sketch = t_sketch->local_sketches[targ->tid];
     _Atomic uint32_t *propi = &(t_sketch->prop[targ->tid]);
 
-    pin_thread_to_core(targ->core_id);
+    // the pool pinned this worker, move the local sketch to its node
+    fcds_writer_bind(t_sketch, targ->tid);
+    sketch_t *local_sketch = t_sketch->local_sketches[targ->tid];
+    void *hash_functions = fcds_writer_hash_functions(t_sketch, targ->tid);
 
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
-    local_insert(local_sketch, t_sketch->hash_functions, t_sketch->hash_type, t_sketch->size,
+    local_insert(local_sketch, hash_functions, t_sketch->hash_type, t_sketch->size,
         propi, 0, targ->startsize, t_sketch->b);
         
         
@@ -141,6 +151,15 @@ void *thread_insert(void *arg) {
     return NULL;
 }
 
+/** slot 0 is the propagator, pool worker tid runs slot tid + 1: writers up to N - 1, then the query threads */
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targ = &((thread_arg_t *) arg)[tid + 1];
+    if (targ->tid < conf.N)
+        thread_insert(targ);
+    else
+        thread_query(targ);
+}
+
 
 
 
@@ -149,13 +168,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 7) {
         fprintf(stderr,
-                "Usage: %s <number of queries> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <hash coefficient> \n",
+                "Usage: %s <number of queries> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_queries = parse_arg(argv[1], "n_queries", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -167,6 +184,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[7], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 8 ? parse_pin_policy(argv[8]) : PIN_COMPACT;
 
 
     // when finished debugging remove comment
@@ -191,10 +209,17 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_fcds(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads + num_query_threads - 1);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    // the propagator runs for the whole program on its own thread, writers and queries run on the pool
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N - 1 + num_query_threads, &topo, pin_policy);
+    atomic_store(&queries_running, num_query_threads);
 
-    pthread_t threads[conf.N + num_query_threads]; // consider #writers + propagator
+    pthread_t propagator_thread;
     thread_arg_t targs[conf.N + num_query_threads]; 
 
     uint64_t chunk_size = n_queries / num_query_threads;
@@ -213,56 +238,39 @@ int main(int argc, const char*argv[]) {
     /** launch propagator */
     targs[i].tid = i;
     targs[i].sketch = sketch;
-    int rc = pthread_create(&threads[i], NULL, propagator_routine, &targs[i]);
+    int rc = pthread_create(&propagator_thread, NULL, propagator_routine, &targs[i]);
     if (rc) {
         fprintf(stderr, "Error creating propagator thread %lu\n", i);
         exit(1);
     }
 
-    /** launch writer threads */
+    /** prepare writer threads, they insert until the last query thread is done */
     for (i=1; i < conf.N; i++){
         targs[i].tid = i;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread query %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
     }
 
-    /** launch query threads */
+    /** prepare query threads */
     for (; i < num_query_threads+conf.N-1; i++) {
-
-        
         targs[i].tid = i;
         targs[i].n_queries = queries_for_thread;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;  
-
-
-        int rc = pthread_create(&threads[i], NULL, thread_query, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
     }
-    
-    
+
     targs[i].tid = i;
     targs[i].sketch = sketch;
     targs[i].n_queries = remainder;
-    targs[i].core_id = i % num_cores;
+    targs[i].pool = &pool;
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_query(&targs[i]);
-   
+    worker_pool_run(&pool, worker_task, targs);
 
     long j;
     for (j = conf.N; j < num_query_threads+conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -282,7 +290,8 @@ int main(int argc, const char*argv[]) {
 
     printf("Number of insertions %lu\n", count_ins);
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -20,17 +21,18 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     fcds_sketch *sketch;
     long n_inserts;
     uint64_t startsize;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
 } thread_arg_t;
 
 
 unsigned long count_queries;
-pthread_barrier_t barrier;
+_Atomic long writers_running;   // writer threads still running, the last one to finish stops the queries
+_Atomic int stop_queries;
 
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
@@ -56,12 +58,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -79,14 +81,10 @@ void *thread_query(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     fcds_sketch *t_sketch = targ->sketch;
 
-    pin_thread_to_core(targ->core_id);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
-
-    // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
-
-    int i;
-    for (;;) {
+    while (!atomic_load_explicit(&stop_queries, memory_order_relaxed)) {
        query_fcds(t_sketch, t_sketch->global_sketch);
        __sync_fetch_and_add(&count_queries, 1);
     }
@@ -95,7 +93,7 @@ void *thread_query(void *arg) {
     return NULL;
 }
 
-void local_insert(uint64_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
+void local_insert(sketch_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
 
     long i;
     uint32_t insertion_counter = 0;
@@ -108,15 +106,17 @@ void local_insert(uint64_t *sketch, void *hash_functions, uint32_t hash_type, ui
 void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     fcds_sketch *t_sketch = targ->sketch;
-    uint64_t *local_sketch = t_sketch->local_sketches[targ->tid];
     
      _Atomic uint32_t *propi = &(t_sketch->prop[targ->tid]);
 
-    pin_thread_to_core(targ->core_id);
+    // the pool pinned this worker, move the local sketch to its node
+    fcds_writer_bind(t_sketch, targ->tid);
+    sketch_t *local_sketch = t_sketch->local_sketches[targ->tid];
+    void *hash_functions = fcds_writer_hash_functions(t_sketch, targ->tid);
 
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
-    local_insert(local_sketch, t_sketch->hash_functions, t_sketch->hash_type, t_sketch->size,
+    local_insert(local_sketch, hash_functions, t_sketch->hash_type, t_sketch->size,
         propi, targ->n_inserts, targ->startsize, t_sketch->b);
         
         
@@ -126,12 +126,22 @@ void *thread_insert(void *arg) {
             // DO NOTHING
             ;                                
     } // Since only two threads uses this prop, the busy-wait should be ok
-       
-    
+
+    if (atomic_fetch_sub(&writers_running, 1) == 1)
+        atomic_store(&stop_queries, 1);
     //fprintf(stderr, "[thread_insert] %u has finished \n", gettid()%t_sketch->N);
     return NULL;
 }
 
+/** slot 0 is the propagator, pool worker tid runs slot tid + 1: writers up to N - 1, then the query threads */
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targ = &((thread_arg_t *) arg)[tid + 1];
+    if (targ->tid < conf.N)
+        thread_insert(targ);
+    else
+        thread_query(targ);
+}
+
 
 
 
@@ -139,13 +149,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 7) {
         fprintf(stderr,
-                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <hash coefficient> \n",
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_inserts = parse_arg(argv[1], "n_inserts", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -157,6 +165,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[7], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 8 ? parse_pin_policy(argv[8]) : PIN_COMPACT;
 
 
     // when finished debugging remove comment
@@ -181,10 +190,17 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_fcds(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads + num_query_threads - 1);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    // the propagator runs for the whole program on its own thread, writers and queries run on the pool
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N - 1 + num_query_threads, &topo, pin_policy);
+    atomic_store(&writers_running, conf.N - 1);
 
-    pthread_t threads[conf.N + num_query_threads]; // consider #writers + propagator
+    pthread_t propagator_thread;
     thread_arg_t targs[conf.N + num_query_threads]; 
 
     uint64_t chunk_size = n_inserts / (conf.N - 1);
@@ -201,13 +217,13 @@ int main(int argc, const char*argv[]) {
     /** launch propagator */
     targs[i].tid = i;
     targs[i].sketch = sketch;
-    int rc = pthread_create(&threads[i], NULL, propagator_routine, &targs[i]);
+    int rc = pthread_create(&propagator_thread, NULL, propagator_routine, &targs[i]);
     if (rc) {
         fprintf(stderr, "Error creating propagator thread %lu\n", i);
         exit(1);
     }
 
-    /** launch writer threads */
+    /** prepare writer threads */
     for (i=1; i < conf.N-1; i++) {
 
 
@@ -233,28 +249,16 @@ int main(int argc, const char*argv[]) {
         targs[i].n_inserts = inserts_for_thread;
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
-
-        targs[i].core_id = i % num_cores;  
+        targs[i].pool = &pool;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
     
-    /** launch query threads */
+    /** prepare query threads, they query until the last writer thread is done */
     for (i=conf.N; i < conf.N + num_query_threads; i++){
         targs[i].tid = i;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;
-        int rc = pthread_create(&threads[i], NULL, thread_query, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread query %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
     }
     
     
@@ -285,18 +289,15 @@ int main(int argc, const char*argv[]) {
     targs[i].n_inserts = inserts_for_thread;
     targs[i].startsize = current_start;
     targs[i].sketch = sketch;
-
-    targs[i].core_id = i % num_cores;
+    targs[i].pool = &pool;
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_insert(&targs[i]);
-   
+    worker_pool_run(&pool, worker_task, targs);
 
     long j;
     for (j = 1; j < conf.N-1; j++) { 
-        // j = num_query_threads + 1 because of the propagator
-        pthread_join(threads[j], NULL);
+        // j starts at 1 because of the propagator
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -323,7 +324,8 @@ int main(int argc, const char*argv[]) {
 
     printf("Number of queries %lu\n", count_queries);
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
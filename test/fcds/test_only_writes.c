@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -20,17 +21,15 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     fcds_sketch *sketch;
     long n_inserts;
     uint64_t startsize;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
 } thread_arg_t;
 
 
-pthread_barrier_t barrier;
-
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
 {
@@ -55,18 +54,18 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
 
 
-void local_insert(uint64_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
+void local_insert(sketch_t *sketch, void *hash_functions, uint32_t hash_type, uint64_t size, _Atomic uint32_t *prop, long n_inserts, uint64_t startsize,  uint32_t b) {
 
     long i;
     uint32_t insertion_counter = 0;
@@ -92,15 +91,17 @@ void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
 
     fcds_sketch *t_sketch = targ->sketch;
-    uint64_t *local_sketch = t_sketch->local_sketches[targ->tid];
     _Atomic uint32_t *propi = &(t_sketch->prop[targ->tid]);
 
-    pin_thread_to_core(targ->core_id);
+    // the pool pinned this worker, move the local sketch to its node
+    fcds_writer_bind(t_sketch, targ->tid);
+    sketch_t *local_sketch = t_sketch->local_sketches[targ->tid];
+    void *hash_functions = fcds_writer_hash_functions(t_sketch, targ->tid);
 
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
-    local_insert(local_sketch, t_sketch->hash_functions, t_sketch->hash_type, t_sketch->size,
+    local_insert(local_sketch, hash_functions, t_sketch->hash_type, t_sketch->size,
         propi, targ->n_inserts, targ->startsize, t_sketch->b);
         
         
@@ -119,6 +120,11 @@ void *thread_insert(void *arg) {
     return NULL;
 }
 
+/** slot 0 is the propagator, pool worker tid runs writer tid + 1 */
+void writer_task(void *arg, uint32_t tid) {
+    thread_insert(&((thread_arg_t *) arg)[tid + 1]);
+}
+
 
 
 
@@ -126,13 +132,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 6) {
         fprintf(stderr,
-                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <hash coefficient> \n",
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_inserts = parse_arg(argv[1], "n_inserts", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -143,6 +147,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[6], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 7 ? parse_pin_policy(argv[7]) : PIN_COMPACT;
 
 
     // when finished debugging remove comment
@@ -167,10 +172,16 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_fcds(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads-1);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    // the propagator runs for the whole program on its own thread, the writers run on the pool
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N - 1, &topo, pin_policy);
 
-    pthread_t threads[conf.N]; // consider #writers + propagator
+    pthread_t propagator_thread;
     thread_arg_t targs[conf.N]; 
 
     uint64_t chunk_size = n_inserts / conf.N;
@@ -185,12 +196,12 @@ int main(int argc, const char*argv[]) {
 
 
 
-    /** launch writer threads */
+    /** launch propagator and prepare writer threads */
     long i = 0;
 
     targs[i].tid = i;
     targs[i].sketch = sketch;
-    int rc = pthread_create(&threads[i], NULL, propagator_routine, &targs[i]);
+    int rc = pthread_create(&propagator_thread, NULL, propagator_routine, &targs[i]);
     if (rc) {
         fprintf(stderr, "Error creating propagator thread %lu\n", i);
         exit(1);
@@ -203,16 +214,9 @@ int main(int argc, const char*argv[]) {
         targs[i].n_inserts = inserts_for_thread;
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
-
-        targs[i].core_id = i % num_cores;  
+        targs[i].pool = &pool;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
     
     
@@ -220,18 +224,15 @@ int main(int argc, const char*argv[]) {
     targs[i].n_inserts = remainder;
     targs[i].startsize = current_start;
     targs[i].sketch = sketch;
-
-    targs[i].core_id = i % num_cores;
+    targs[i].pool = &pool;
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_insert(&targs[i]);
-   
+    worker_pool_run(&pool, writer_task, targs);
 
     long j;
     for (j = 1; j < conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -256,7 +257,8 @@ int main(int argc, const char*argv[]) {
     printf("Total program elapsed time: %.3f ms\n",
            elapsed_ms(global_start, global_end));
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
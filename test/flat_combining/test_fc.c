@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <runtime.h>
+
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 0,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+    .N = 0,
+    .b = 0,
+};
+
+
+
+typedef struct {
+    uint32_t tid;
+    fc_minhash *sketch;
+    long n_inserts;
+    uint64_t startsize;
+    double elapsed;
+    worker_pool *pool;
+} thread_arg_t;
+
+
+static void print_params(long n_inserts, long ssize, long startsize,
+                         long num_threads_total, long num_query_threads)
+{
+    printf("=== Parameters ===\n");
+    printf("Number of insertions     : %ld\n", n_inserts);
+    printf("Sketch size              : %ld\n", ssize);
+    printf("Initial size             : %ld\n", startsize);
+    printf("Number of writer threads : %ld\n", num_threads_total);
+    printf("Number of query threads  : %ld\n", num_query_threads);
+    printf("Hash type                : %lu\n", conf.hash_type);
+    printf("Prime modulus            : %lu\n", conf.prime_modulus);
+    printf("Coefficient k-wise       : %d\n", conf.k);
+    printf("====================\n");
+}
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+int do_compare_with_serial(fc_minhash *sketch,
+                         void *hash_functions,
+                         uint64_t sketch_size,
+                         uint64_t init_size,
+                         long n_inserts,
+                         uint64_t remainder,
+                         int hash_type)
+{
+    minhash_sketch *serial_sketch;
+
+    // Initialize serial version
+    minhash_init(&serial_sketch, hash_functions, sketch_size, init_size, hash_type);
+
+    // Perform serial insertions
+    for (uint64_t i = 0; i < n_inserts + init_size - remainder; i++) {
+        insert(serial_sketch, i);
+    }
+
+    // Compare serial vs flat-combining sketch results
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < sketch->size; i++) {
+        if (serial_sketch->sketch[i] == sketch->sketch[i])
+            count++;
+        else
+            printf("different %lu - %lu --- %lu!\n",
+                   i, (uint64_t) serial_sketch->sketch[i], (uint64_t) sketch->sketch[i]);
+    }
+
+    minhash_free(serial_sketch);
+
+    if (count == sketch->size) {
+        printf("Test passed: flat-combining sketch matches the serial one\n");
+        return 0;
+    }
+    printf("Test failed: %lu/%lu elements match.\n", count, sketch->size);
+    return 1;
+}
+
+
+void *thread_insert(void *arg) {
+    thread_arg_t *targ = (thread_arg_t *)arg;
+    struct timeval t1, t2;
+    fc_minhash *t_sketch = targ->sketch;
+
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
+
+    gettimeofday(&t1, NULL);
+    long i;
+    for (i = 0; i < targ->n_inserts; i++)
+        insert_fc_minhash(t_sketch, targ->tid, i+targ->startsize);
+
+    gettimeofday(&t2, NULL);
+    targ->elapsed = elapsed_ms(t1, t2);
+    return NULL;
+}
+
+void *thread_query(void *arg) {
+    thread_arg_t *targ = (thread_arg_t *)arg;
+    struct timeval t1, t2;
+    fc_minhash *t_sketch = targ->sketch;
+
+    // Synchronize all threads before starting insertion
+    worker_pool_barrier(targ->pool);
+
+    gettimeofday(&t1, NULL);
+    int i;
+    for (i = 0; i < 1000000; i++)
+       query_fc_minhash(t_sketch, t_sketch->sketch);
+
+    gettimeofday(&t2, NULL);
+    targ->elapsed = elapsed_ms(t1, t2);
+    fprintf(stderr, "Query thread %u done\n", targ->tid);
+    return NULL;
+}
+
+/** Workers 0 .. N - 1 insert, the others query */
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targs = (thread_arg_t *) arg;
+    if (tid < conf.N)
+        thread_insert(&targs[tid]);
+    else
+        thread_query(&targs[tid]);
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 6) {
+        fprintf(stderr,
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <num_query_threads> [pin policy]\n",
+                argv[0]);
+        return 1;
+    }
+
+    long n_inserts = parse_arg(argv[1], "n_inserts", 1);
+    long ssize = parse_arg(argv[2], "sketch_size", 1);
+    long startsize = parse_arg(argv[3], "start_size", 0);
+    long num_threads = parse_arg(argv[4], "num_threads", 1);
+    long num_query_threads = parse_arg(argv[5], "num_query_threads", 0);
+    uint32_t pin_policy = argc > 6 ? parse_pin_policy(argv[6]) : PIN_COMPACT;
+
+    struct timeval global_start, global_end;
+    double insert_sum = 0.0, insert_min = 1e12, insert_max = 0.0;
+    double query_sum = 0.0, query_min = 1e12, query_max = 0.0;
+
+    conf.sketch_size = (uint64_t) ssize;
+    if (startsize > 0) conf.init_size = (uint64_t) startsize;
+
+    conf.N = num_threads;
+
+    print_params(n_inserts, conf.sketch_size, conf.init_size, conf.N, num_query_threads);
+    read_configuration(conf);
+
+
+    fc_minhash *sketch;
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    init_fc_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N);
+
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
+
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + num_query_threads, &topo, pin_policy);
+
+    thread_arg_t targs[conf.N + num_query_threads];
+
+    uint64_t chunk_size = n_inserts / conf.N;
+    uint64_t remainder = n_inserts % conf.N;
+    uint64_t current_start = startsize;
+
+    printf("Number of inserts %lu, inserts for threads %lu\n", n_inserts, chunk_size);
+
+
+    gettimeofday(&global_start, NULL);  // GLOBAL TIME
+
+    /** prepare writer threads */
+    long i;
+    for (i = 0; i < conf.N; i++) {
+
+        targs[i].tid = i;
+        targs[i].n_inserts = chunk_size;
+        targs[i].startsize = current_start;
+        targs[i].sketch = sketch;
+        targs[i].pool = &pool;
+
+        current_start += chunk_size;
+    }
+
+
+    /** prepare query threads */
+    for (; i < conf.N + num_query_threads; i++){
+        targs[i].tid = i;
+        targs[i].sketch = sketch;
+        targs[i].pool = &pool;
+    }
+
+    worker_pool_run(&pool, worker_task, targs);
+
+    long j;
+    for (j = 0; j < conf.N; j++) {
+        double t = targs[j].elapsed;
+        insert_sum += t;
+        if (t < insert_min) insert_min = t;
+        if (t > insert_max) insert_max = t;
+    }
+
+    long q;
+    for (q = 0; q < num_query_threads; q++) {
+        double t = targs[conf.N + q].elapsed;
+        query_sum += t;
+        if (t < query_min) query_min = t;
+        if (t > query_max) query_max = t;
+    }
+
+    gettimeofday(&global_end, NULL);
+
+    printf("Writer thread times: avg %.3f ms, min %.3f ms, max %.3f ms\n",
+       insert_sum / conf.N, insert_min, insert_max);
+    if (num_query_threads > 0)
+        printf("Query thread times: avg %.3f ms, min %.3f ms, max %.3f ms\n",
+           query_sum / num_query_threads, query_min, query_max);
+
+    printf("Total program elapsed time: %.3f ms\n",
+           elapsed_ms(global_start, global_end));
+
+    worker_pool_stop(&pool);
+    topology_free(&topo);
+
+    int ret = do_compare_with_serial(sketch, hash_functions, sketch->size, conf.init_size, n_inserts, remainder, conf.hash_type);
+
+    free_fc_minhash(sketch);
+    return ret;
+}
@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -20,18 +21,16 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     conc_minhash *sketch;
     long n_inserts;
     uint64_t startsize;
     long algorithm;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
+    void *(*routine)(void *);
 } thread_arg_t;
 
-
-pthread_barrier_t barrier;
-
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
 {
@@ -55,12 +54,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -107,10 +106,9 @@ void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     struct timeval t1, t2;
     conc_minhash *t_sketch = targ->sketch;
-    
-    pin_thread_to_core(targ->core_id);
 
-    pthread_barrier_wait(&barrier);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
     long i;
@@ -133,13 +131,8 @@ void *thread_query(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     struct timeval t1, t2;
     conc_minhash *t_sketch = targ->sketch;
-    
 
-    pin_thread_to_core(targ->core_id);
-
-
-    // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
     int i;
@@ -148,10 +141,15 @@ void *thread_query(void *arg) {
 
     gettimeofday(&t2, NULL);
     targ->elapsed = elapsed_ms(t1, t2);
-    fprintf(stderr, "Query thread %lu done\n", targ->tid);
+    fprintf(stderr, "Query thread %u done\n", targ->tid);
     return NULL;
 }
 
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targ = &((thread_arg_t *) arg)[tid];
+    targ->routine(targ);
+}
+
 
 int main(int argc, const char*argv[]) {
 
@@ -160,13 +158,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 8) {
         fprintf(stderr,
-                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <algorithm>\n",
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <algorithm> [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_inserts = parse_arg(argv[1], "n_inserts", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -174,6 +170,7 @@ int main(int argc, const char*argv[]) {
     long threshold = parse_arg(argv[5], "threshold", 1);
     long num_query_threads = parse_arg(argv[6], "num_query_threads", 0);
     long algorithm = parse_arg(argv[7], "algorithm", 0); //0 is baseline version, 1 is paper version
+    uint32_t pin_policy = argc > 8 ? parse_pin_policy(argv[8]) : PIN_COMPACT;
 
 
 
@@ -201,10 +198,14 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_conc_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads + num_query_threads + 1);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + num_query_threads, &topo, pin_policy);
 
-    pthread_t threads[conf.N + num_query_threads]; // consider #writers + propagator
     thread_arg_t targs[conf.N + num_query_threads]; 
 
     uint64_t chunk_size = n_inserts / conf.N;
@@ -217,7 +218,7 @@ int main(int argc, const char*argv[]) {
 
     gettimeofday(&global_start, NULL);  // GLOBAL TIME
 
-    /** launch writer threads */
+    /** prepare writer threads */
     long i;
     for (i = 0; i < conf.N; i++) {
 
@@ -227,41 +228,28 @@ int main(int argc, const char*argv[]) {
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
         targs[i].algorithm = algorithm;
-
-        targs[i].core_id = i % num_cores;  
+        targs[i].pool = &pool;
+        targs[i].routine = thread_insert;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
     
     
-    /** launch query threads */
+    /** prepare query threads */
     for (; i < conf.N + num_query_threads; i++){
         targs[i].tid = i;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;
-        int rc = pthread_create(&threads[i], NULL, thread_query, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread query %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
+        targs[i].routine = thread_query;
     }
-    
-    pthread_barrier_wait(&barrier);
-
-   
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
+    worker_pool_run(&pool, worker_task, targs);
+
     long j;
     for (j = 0; j < conf.N; j++) {
-        pthread_join(threads[j], NULL);
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -276,11 +264,9 @@ int main(int argc, const char*argv[]) {
     gettimeofday(&query_start, NULL);
 
 
-    // Join query threads
+    // Query threads
     long q;
     for (q = 0; q < num_query_threads; q++) {
-        //pthread_cancel(threads[q]);
-        pthread_join(threads[conf.N + q], NULL); // or conf.N + q
         double t = targs[conf.N + q].elapsed;
         query_sum += t;
         if (t < query_min) query_min = t;
@@ -308,7 +294,8 @@ int main(int argc, const char*argv[]) {
     printf("Total program elapsed time: %.3f ms\n",
            elapsed_ms(global_start, global_end));
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 
@@ -27,13 +28,11 @@ typedef struct {
     uint64_t startsize;
     long algorithm;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
     double prob;
 } thread_arg_t;
 
 
-pthread_barrier_t barrier;
-
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
 {
@@ -58,12 +57,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -112,9 +111,8 @@ void *thread_routine(void *arg) {
     conc_minhash *t_sketch = targ->sketch;
     double prob = targ->prob;
 
-    pin_thread_to_core(targ->core_id);
-
-    pthread_barrier_wait(&barrier);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
     long i;
@@ -138,6 +136,10 @@ void *thread_routine(void *arg) {
     return NULL;
 }
 
+void writer_task(void *arg, uint32_t tid) {
+    thread_routine(&((thread_arg_t *) arg)[tid]);
+}
+
 
 
 
@@ -148,13 +150,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 8) {
         fprintf(stderr,
-                "Usage: %s <number of operations> <sketch_size> <initial size> <num_threads> <threshold insertion> <algorithm> <write probability> <hash coefficient>\n",
+                "Usage: %s <number of operations> <sketch_size> <initial size> <num_threads> <threshold insertion> <algorithm> <write probability> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_ops = parse_arg(argv[1], "n_ops", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -167,6 +167,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[8], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 9 ? parse_pin_policy(argv[9]) : PIN_COMPACT;
 
     // when finished debugging remove comment
     //srand(time(NULL)); 
@@ -190,10 +191,14 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_conc_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N, &topo, pin_policy);
 
-    pthread_t threads[conf.N]; // consider #writers + propagator
     thread_arg_t targs[conf.N]; 
 
     uint64_t chunk_size = n_ops / conf.N;
@@ -206,87 +211,36 @@ int main(int argc, const char*argv[]) {
 
     gettimeofday(&global_start, NULL);  // GLOBAL TIME
 
-    /** launch writer threads */
+    /** prepare writer threads */
     long i;
-    for (i = 0; i < conf.N-1; i++) {
-
-        
-
-        // determine work size and starting position for thread i
-	if (i < remainder) {
-		// First 'remainder' threads get the base chunk plus one
-	    inserts_for_thread = chunk_size + 1;
-		
-		//  start position is offset by the work done by previous threads.
-		// The previous 'i' threads each got (chunk_size + 1).
-	    current_start = startsize + (i * (chunk_size + 1));
-	} else {
-		// Remaining threads get only the base chunk size
-	    inserts_for_thread = chunk_size;
-		
-		//  start position is calculated as:
-		// (Work of the 'remainder' threads) + (Work of the preceding 'chunk_size' threads)
-	    current_start = startsize + 
-			(remainder * (chunk_size + 1)) + 
-			((i - remainder) * chunk_size);
-	}
-	targs[i].tid = i;
+    for (i = 0; i < conf.N; i++) {
+        // First 'remainder' threads get the base chunk plus one, each thread starts where the previous one ended
+        inserts_for_thread = (uint64_t) i < remainder ? chunk_size + 1 : chunk_size;
+
+        targs[i].tid       = i;
         targs[i].n_inserts = inserts_for_thread;
         targs[i].startsize = current_start;
-	targs[i].sketch    = sketch;
-	targs[i].algorithm = algorithm;
-	targs[i].prob      = prob;
-	targs[i].core_id   = i % num_cores;  
-
-	current_start += inserts_for_thread;
-
-	int rc = pthread_create(&threads[i], NULL, thread_routine, &targs[i]);
-	if (rc) {
-	    fprintf(stderr, "Error creating thread %lu\n", i);
-	    exit(1);
-	}
-    }
-    
-    if (i < remainder) {
-        inserts_for_thread = chunk_size + 1;
-    
-        current_start = startsize + (i * (chunk_size + 1));
-    } else {
-        inserts_for_thread = chunk_size;
-        current_start = startsize + 
-                        (remainder * (chunk_size + 1)) + // Total work of the first remainder threads
-                        ((i - remainder) * chunk_size);  // total work of the preceding chunk_size threads
-    }
-    
-    
-    targs[i].tid       = i;
-    targs[i].n_inserts = inserts_for_thread;
-    targs[i].startsize = current_start;
-    targs[i].sketch    = sketch;
-    targs[i].algorithm = algorithm;
-    targs[i].prob      = prob;
-
+        targs[i].sketch    = sketch;
+        targs[i].algorithm = algorithm;
+        targs[i].prob      = prob;
+        targs[i].pool      = &pool;
 
-    targs[i].core_id   = i % num_cores;
+        current_start += inserts_for_thread;
+    }
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_routine(&targs[i]);
-   
+    worker_pool_run(&pool, writer_task, targs);
 
     long j;
-    for (j = 0; j < conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
+    for (j = 0; j < conf.N; j++) {
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
         if (t > insert_max) insert_max = t;
     }
 
-    insert_sum += targs[j].elapsed;
-    if (targs[j].elapsed < insert_min) insert_min = targs[j].elapsed;
-    if (targs[j].elapsed > insert_max) insert_max = targs[j].elapsed;
     gettimeofday(&writer_end, NULL);
     // Get the end time
 
@@ -302,7 +256,8 @@ int main(int argc, const char*argv[]) {
     printf("Total program elapsed time: %.3f ms\n",
            elapsed_ms(global_start, global_end));
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
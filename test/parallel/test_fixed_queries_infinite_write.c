@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -20,18 +21,19 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     conc_minhash *sketch;
     long n_queries;
     uint64_t startsize;
     long algorithm;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
 } thread_arg_t;
 
 long to_insert;
 unsigned long count_ins;
-pthread_barrier_t barrier;
+_Atomic long queries_running;   // query threads still running, the last one to finish stops the writers
+_Atomic int stop_writers;
 
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
@@ -57,12 +59,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -106,19 +108,21 @@ void do_compare_with_serial(conc_minhash *sketch,
 
 void *thread_query(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
+    struct timeval t1, t2;
     conc_minhash *t_sketch = targ->sketch;
 
-    pin_thread_to_core(targ->core_id);
-
-
-    // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
-
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
+    gettimeofday(&t1, NULL);
     int i;
     for (i=0; i < targ->n_queries; i++)
        concurrent_query(t_sketch, t_sketch->sketches[0]->sketch);
+    gettimeofday(&t2, NULL);
+    targ->elapsed = elapsed_ms(t1, t2);
 
+    if (atomic_fetch_sub(&queries_running, 1) == 1)
+        atomic_store(&stop_writers, 1);
     //fprintf(stderr, "Thread finished %lu\n", targ->tid);
     return NULL;
 }
@@ -127,14 +131,12 @@ void *thread_query(void *arg) {
 void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     conc_minhash *t_sketch = targ->sketch;
-    
-    pin_thread_to_core(targ->core_id);
 
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
     long i;
 
-    for (;;) {
+    while (!atomic_load_explicit(&stop_writers, memory_order_relaxed)) {
         //printf("[%lu] insertion number %ld\n", targ->tid, i);
         i = __sync_fetch_and_add(&to_insert, 1);
         if (!targ->algorithm) {
@@ -149,7 +151,13 @@ void *thread_insert(void *arg) {
     return NULL;
 }
 
-
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targ = &((thread_arg_t *) arg)[tid];
+    if (tid < conf.N)
+        thread_insert(targ);
+    else
+        thread_query(targ);
+}
 
 
 int main(int argc, const char*argv[]) {
@@ -159,13 +167,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 8) {
         fprintf(stderr,
-                "Usage: %s <number of queries> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <algorithm> <hash coefficient>\n",
+                "Usage: %s <number of queries> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <algorithm> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_queries = parse_arg(argv[1], "n_queries", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -178,6 +184,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[8], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 9 ? parse_pin_policy(argv[9]) : PIN_COMPACT;
 
 
 
@@ -203,10 +210,15 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_conc_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads + num_query_threads);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + num_query_threads, &topo, pin_policy);
+    atomic_store(&queries_running, num_query_threads);
 
-    pthread_t threads[conf.N + num_query_threads]; // consider #writers + propagator
     thread_arg_t targs[conf.N + num_query_threads]; 
 
     uint64_t chunk_size = n_queries / num_query_threads;
@@ -220,52 +232,35 @@ int main(int argc, const char*argv[]) {
     gettimeofday(&global_start, NULL);  // GLOBAL TIME
 
 
-    /** launch query threads */
+    /** prepare writer threads, they insert until the last query thread is done */
     long i;
     for (i=0; i < conf.N; i++){
         targs[i].tid = i;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;
         targs[i].algorithm = algorithm;
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread query %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
     }
 
-    /** launch writer threads */
+    /** prepare query threads */
     for (; i < num_query_threads+conf.N-1; i++) {
-
-        
         targs[i].tid = i;
         targs[i].n_queries = queries_for_thread;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;  
-
-
-        int rc = pthread_create(&threads[i], NULL, thread_query, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
     }
-    
-    
+
     targs[i].tid = i;
     targs[i].sketch = sketch;
     targs[i].n_queries = remainder;
-    targs[i].core_id = i % num_cores;
+    targs[i].pool = &pool;
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_query(&targs[i]);
-   
+    worker_pool_run(&pool, worker_task, targs);
 
     long j;
     for (j = conf.N; j < num_query_threads+conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -292,7 +287,8 @@ int main(int argc, const char*argv[]) {
 
     printf("Number of insertions %lu\n", count_ins);
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
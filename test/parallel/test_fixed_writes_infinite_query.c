@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -20,17 +21,19 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     conc_minhash *sketch;
     long n_inserts;
     uint64_t startsize;
     long algorithm;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
+    void *(*routine)(void *);
 } thread_arg_t;
 
 unsigned long count_queries;
-pthread_barrier_t barrier;
+_Atomic long writers_running;   // writer threads still running, the last one to finish stops the queries
+_Atomic int stop_queries;
 
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
@@ -56,12 +59,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -107,14 +110,10 @@ void *thread_query(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     conc_minhash *t_sketch = targ->sketch;
 
-    pin_thread_to_core(targ->core_id);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
-
-    // Synchronize all threads before starting insertion
-    pthread_barrier_wait(&barrier);
-
-    int i;
-    for (;;) {
+    while (!atomic_load_explicit(&stop_queries, memory_order_relaxed)) {
        concurrent_query(t_sketch, t_sketch->sketches[0]->sketch);
        __sync_fetch_and_add(&count_queries, 1);
     }
@@ -128,10 +127,8 @@ void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     struct timeval t1, t2;
     conc_minhash *t_sketch = targ->sketch;
-    
-    pin_thread_to_core(targ->core_id);
 
-    pthread_barrier_wait(&barrier);
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
     long i;
@@ -146,10 +143,18 @@ void *thread_insert(void *arg) {
     
     gettimeofday(&t2, NULL);
     targ->elapsed = elapsed_ms(t1, t2);
+
+    if (atomic_fetch_sub(&writers_running, 1) == 1)
+        atomic_store(&stop_queries, 1);
     //fprintf(stderr, "[thread_insert] %u has finished \n", gettid()%t_sketch->N);
     return NULL;
 }
 
+void worker_task(void *arg, uint32_t tid) {
+    thread_arg_t *targ = &((thread_arg_t *) arg)[tid];
+    targ->routine(targ);
+}
+
 
 
 
@@ -160,13 +165,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 8) {
         fprintf(stderr,
-                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <algorithm> <hash coefficient>\n",
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <num_query_threads> <algorithm> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_inserts = parse_arg(argv[1], "n_inserts", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -180,6 +183,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[8], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 9 ? parse_pin_policy(argv[9]) : PIN_COMPACT;
 
 
     // when finished debugging remove comment
@@ -204,10 +208,15 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_conc_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads + num_query_threads);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + num_query_threads, &topo, pin_policy);
+    atomic_store(&writers_running, conf.N);
 
-    pthread_t threads[conf.N + num_query_threads]; // consider #writers + propagator
     thread_arg_t targs[conf.N + num_query_threads]; 
 
     uint64_t chunk_size = n_inserts / conf.N;
@@ -221,20 +230,16 @@ int main(int argc, const char*argv[]) {
     gettimeofday(&global_start, NULL);  // GLOBAL TIME
 
 
-    /** launch query threads */
+    /** prepare query threads, they query until the last writer thread is done */
     long i;
     for (i=0; i < num_query_threads; i++){
         targs[i].tid = i;
         targs[i].sketch = sketch;
-        targs[i].core_id = i % num_cores;
-        int rc = pthread_create(&threads[i], NULL, thread_query, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread query %lu\n", i);
-            exit(1);
-        }
+        targs[i].pool = &pool;
+        targs[i].routine = thread_query;
     }
 
-    /** launch writer threads */
+    /** prepare writer threads */
     for (; i < num_query_threads+conf.N-1; i++) {
 
 	if (i < num_query_threads+ remainder) { // takes into account that the first num_query_threads threads are for query
@@ -259,16 +264,10 @@ int main(int argc, const char*argv[]) {
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
         targs[i].algorithm = algorithm;
-
-        targs[i].core_id = i % num_cores;  
+        targs[i].pool = &pool;
+        targs[i].routine = thread_insert;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
     
     if (i < remainder) {
@@ -288,18 +287,16 @@ int main(int argc, const char*argv[]) {
     targs[i].startsize = current_start;
     targs[i].sketch = sketch;
     targs[i].algorithm = algorithm;
-
-    targs[i].core_id = i % num_cores;
+    targs[i].pool = &pool;
+    targs[i].routine = thread_insert;
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_insert(&targs[i]);
-   
+    worker_pool_run(&pool, worker_task, targs);
 
     long j;
     for (j = num_query_threads; j < num_query_threads+conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -326,7 +323,8 @@ int main(int argc, const char*argv[]) {
 
     printf("Number of queries %lu\n", count_queries);
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
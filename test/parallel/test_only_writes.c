@@ -5,6 +5,7 @@
 
 #include <minhash.h>
 #include <configuration.h>
+#include <runtime.h>
 
 
 struct minhash_configuration conf = {
@@ -20,18 +21,16 @@ struct minhash_configuration conf = {
 
 
 typedef struct {
-    pthread_t tid;
+    uint32_t tid;
     conc_minhash *sketch;
     long n_inserts;
     uint64_t startsize;
     long algorithm;
     double elapsed;
-    unsigned int core_id;
+    worker_pool *pool;
 } thread_arg_t;
 
 
-pthread_barrier_t barrier;
-
 static void print_params(long n_inserts, long ssize, long startsize,
                          long num_threads_total, long num_query_threads, long threshold)
 {
@@ -56,12 +55,12 @@ static inline double elapsed_ms(struct timeval start, struct timeval end) {
     return elapsed;
 }
 
-void minhash_print(uint64_t *sketch, size_t size) {
+void minhash_print(sketch_t *sketch, size_t size) {
 
     uint64_t i;
     printf("Global sketch Value: \n");
     for(i=0; i < size; i++) {
-        printf(" %lu, ", sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch[i]);
     }
     printf("\n");
 }
@@ -108,10 +107,9 @@ void *thread_insert(void *arg) {
     thread_arg_t *targ = (thread_arg_t *)arg;
     struct timeval t1, t2;
     conc_minhash *t_sketch = targ->sketch;
-    
-    pin_thread_to_core(targ->core_id);
 
-    pthread_barrier_wait(&barrier);
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
 
     gettimeofday(&t1, NULL);
     long i;
@@ -130,6 +128,10 @@ void *thread_insert(void *arg) {
     return NULL;
 }
 
+void writer_task(void *arg, uint32_t tid) {
+    thread_insert(&((thread_arg_t *) arg)[tid]);
+}
+
 
 
 
@@ -140,13 +142,11 @@ int main(int argc, const char*argv[]) {
 
     if (argc < 7) {
         fprintf(stderr,
-                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <algorithm> <hash coefficient>\n",
+                "Usage: %s <number of insertions> <sketch_size> <initial size> <num_threads> <threshold insertion> <algorithm> [hash coefficient] [pin policy]\n",
                 argv[0]);
         return 1;
     }
 
-    int num_cores = sysconf(_SC_NPROCESSORS_ONLN);
-
     long n_inserts = parse_arg(argv[1], "n_inserts", 1);
     long ssize = parse_arg(argv[2], "sketch_size", 1);
     long startsize = parse_arg(argv[3], "start_size", 0);
@@ -159,6 +159,7 @@ int main(int argc, const char*argv[]) {
         long k_cofficient = parse_arg(argv[7], "hash coefficient", 1);
         conf.k = k_cofficient;
     }
+    uint32_t pin_policy = argc > 8 ? parse_pin_policy(argv[8]) : PIN_COMPACT;
 
     // when finished debugging remove comment
     //srand(time(NULL)); 
@@ -182,10 +183,14 @@ int main(int argc, const char*argv[]) {
     void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
     init_conc_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N, conf.b);
 
-    pthread_barrier_init(&barrier, NULL, num_threads);
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
 
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N, &topo, pin_policy);
 
-    pthread_t threads[conf.N]; // consider #writers + propagator
     thread_arg_t targs[conf.N]; 
 
     uint64_t chunk_size = n_inserts / conf.N;
@@ -198,7 +203,7 @@ int main(int argc, const char*argv[]) {
 
     gettimeofday(&global_start, NULL);  // GLOBAL TIME
 
-    /** launch writer threads */
+    /** prepare writer threads */
     long i;
     for (i = 0; i < conf.N-1; i++) {
 
@@ -208,16 +213,9 @@ int main(int argc, const char*argv[]) {
         targs[i].startsize = current_start;
         targs[i].sketch = sketch;
         targs[i].algorithm = algorithm;
-
-        targs[i].core_id = i % num_cores;  
+        targs[i].pool = &pool;
 
         current_start += inserts_for_thread;
-
-        int rc = pthread_create(&threads[i], NULL, thread_insert, &targs[i]);
-        if (rc) {
-            fprintf(stderr, "Error creating thread %lu\n", i);
-            exit(1);
-        }
     }
     
     
@@ -226,18 +224,15 @@ int main(int argc, const char*argv[]) {
     targs[i].startsize = current_start;
     targs[i].sketch = sketch;
     targs[i].algorithm = algorithm;
-
-    targs[i].core_id = i % num_cores;
+    targs[i].pool = &pool;
 
     // Get the start time
     gettimeofday(&writer_start, NULL);
 
-    thread_insert(&targs[i]);
-   
+    worker_pool_run(&pool, writer_task, targs);
 
     long j;
     for (j = 0; j < conf.N-1; j++) {
-        pthread_join(threads[j], NULL);
         double t = targs[j].elapsed;
         insert_sum += t;
         if (t < insert_min) insert_min = t;
@@ -262,7 +257,8 @@ int main(int argc, const char*argv[]) {
     printf("Total program elapsed time: %.3f ms\n",
            elapsed_ms(global_start, global_end));
     
-    pthread_barrier_destroy(&barrier);
+    worker_pool_stop(&pool);
+    topology_free(&topo);
 
     //minhash_print(sketch->sketches[1]->sketch, sketch->size);
 
@@ -0,0 +1,390 @@
+#include <signal.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <minhash.h>
+#include <configuration.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+    .N = 4,
+    .b = 50,
+};
+
+#define CHUNK 64
+#define QUERY_TIMEOUT_S 120
+#define KILL_ATTEMPTS 50
+#define KILL_DELAY_US 20000
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+/** Ingest process p: attaches the segment at its own address and inserts its share of [0, n) */
+static int writer_process(const char *name, uint32_t p, long n) {
+
+    shm_minhash *sketch;
+    attach_shm_minhash(&sketch, name);
+    uint64_t keys[CHUNK];
+    long i, j;
+    for (i = (long) p * CHUNK; i < n; i += (long) conf.N * CHUNK) {
+        size_t k = 0;
+        for (j = i; j < n && j < i + CHUNK; j++)
+            keys[k++] = (uint64_t) j;
+        shm_minhash_sink(sketch, p, keys, k);
+    }
+    detach_shm_minhash(sketch);
+    return 0;
+}
+
+/**
+ * Query process: snapshots taken while the others insert are states of the sketch, no slot below the
+ * final sketch and none above the previous fresh snapshot. Fails if some slot is wrong
+ */
+static int query_process(const char *name, const sketch_t *final, uint32_t writers) {
+
+    shm_minhash *sketch;
+    attach_shm_minhash(&sketch, name);
+    uint64_t size = sketch->size, i, fresh = 0, stale = 0;
+    int wrong = 0;
+    sketch_t *out = malloc(size * sizeof(sketch_t));
+    sketch_t *previous = malloc(size * sizeof(sketch_t));
+    if (out == NULL || previous == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshots\n");
+        exit(1);
+    }
+    for (i = 0; i < size; i++)
+        previous[i] = INFTY;
+
+    // until every insertion is seen and the writers detached, or QUERY_TIMEOUT_S seconds
+    struct timeval start, now;
+    gettimeofday(&start, NULL);
+    int complete = 0;
+    while (!complete) {
+        gettimeofday(&now, NULL);
+        if (elapsed_ms(start, now) > QUERY_TIMEOUT_S * 1000.0) {
+            printf("query process: the insertions of the writers are not seen after %d s\n", QUERY_TIMEOUT_S);
+            wrong++;
+            break;
+        }
+        int writing = __atomic_load_n(&sketch->segment->attached, __ATOMIC_ACQUIRE) > 2;
+        if (shm_minhash_snapshot(sketch, out)) {
+            for (i = 0; i < size; i++)
+                wrong += out[i] < final[i] || out[i] > previous[i];
+            memcpy(previous, out, size * sizeof(sketch_t));
+            fresh++;
+            complete = !writing && memcmp(out, final, size * sizeof(sketch_t)) == 0;
+        } else {
+            for (i = 0; i < size; i++)
+                wrong += out[i] < final[i];
+            stale++;
+        }
+        float similarity = query_shm_minhash(sketch, (sketch_t *) final);
+        wrong += similarity < 0 || similarity > 1;
+    }
+    printf("query process: %lu fresh and %lu stale snapshots during the insertions of %u processes\n", fresh, stale, writers);
+    fflush(stdout);
+
+    free(previous);
+    free(out);
+    detach_shm_minhash(sketch);
+    return wrong > 0;
+}
+
+/** Victim process: inserts the keys of [0, n) over and over until it is killed */
+static int victim_process(const char *name, long n) {
+
+    shm_minhash *sketch;
+    attach_shm_minhash(&sketch, name);
+    long i;
+    for (i = 0; ; i = (i + 1) % n)
+        insert_shm_minhash(sketch, (uint64_t) i);
+    return 0;
+}
+
+/** The slot of process pid in the segment, NULL if it has none */
+static shm_proc *proc_of(shm_minhash *sketch, pid_t pid) {
+
+    uint32_t p;
+    for (p = 0; p < SHM_PROCS; p++)
+        if (__atomic_load_n(&sketch->segment->procs[p].pid, __ATOMIC_ACQUIRE) == (int32_t) pid)
+            return &sketch->segment->procs[p];
+    return NULL;
+}
+
+static int has_pending(shm_proc *proc) {
+
+    uint32_t r;
+    for (r = 0; r < SHM_RECORDS; r++)
+        if (__atomic_load_n(&proc->pending[r], __ATOMIC_ACQUIRE) != 0)
+            return 1;
+    return 0;
+}
+
+/**
+ * Writers inserting every key of [0, n) after a killed process, under a watchdog: a sketch which waits
+ * for the killed process forever fails. Then the sketch is the serial one and the slot of the killed
+ * process is reclaimed
+ */
+static int check_writers_after(shm_minhash *sketch, const char *name, const sketch_t *serial, long n, pid_t victim) {
+
+    uint32_t p, running = conf.N;
+    pid_t writers[conf.N];
+    fflush(stdout);
+    for (p = 0; p < conf.N; p++) {
+        writers[p] = fork();
+        if (writers[p] < 0) {
+            perror("fork failed for an ingest process");
+            exit(EXIT_FAILURE);
+        }
+        if (writers[p] == 0)
+            _exit(writer_process(name, p, n));
+    }
+    int ret = 0, status;
+    struct timeval start, now;
+    gettimeofday(&start, NULL);
+    while (running > 0) {
+        gettimeofday(&now, NULL);
+        if (ret == 0 && elapsed_ms(start, now) > QUERY_TIMEOUT_S * 1000.0) {
+            printf("Test failed: the writers after a killed process do not complete in %d s\n", QUERY_TIMEOUT_S);
+            for (p = 0; p < conf.N; p++)
+                if (writers[p] > 0)
+                    kill(writers[p], SIGKILL);
+            ret = 1;
+        }
+        for (p = 0; p < conf.N; p++) {
+            if (writers[p] <= 0 || waitpid(writers[p], &status, WNOHANG) != writers[p])
+                continue;
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                ret = 1;
+            writers[p] = 0;
+            running--;
+        }
+        usleep(1000);
+    }
+    if (ret != 0)
+        return ret;
+
+    sketch_t *out = malloc(conf.sketch_size * sizeof(sketch_t));
+    if (out == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshot\n");
+        exit(1);
+    }
+    // the victim inserted keys of [0, n) as well: whatever part of them it completed, the sketch is the serial one
+    if (!shm_minhash_snapshot(sketch, out) || memcmp(out, serial, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the shared sketch after a killed process differs from the serial sketch\n");
+        ret = 1;
+    }
+    if (proc_of(sketch, victim) != NULL || __atomic_load_n(&sketch->segment->attached, __ATOMIC_ACQUIRE) != 1) {
+        printf("Test failed: the slot of the killed process is not reclaimed\n");
+        ret = 1;
+    }
+    free(out);
+    return ret;
+}
+
+/** Victim process inserting [0, n) over and over into a new segment, merged every b - 1 rounds */
+static pid_t fork_victim(shm_minhash **sketch, const char *name, void *hash_functions, long n, uint32_t b) {
+
+    unlink_shm_minhash(name);
+    create_shm_minhash(sketch, name, hash_functions, conf.sketch_size, conf.hash_type, conf.N, b);
+    fflush(stdout);
+    pid_t victim = fork();
+    if (victim < 0) {
+        perror("fork failed for the victim process");
+        exit(EXIT_FAILURE);
+    }
+    if (victim == 0)
+        _exit(victim_process(name, n));
+    return victim;
+}
+
+/** Kill the victim, left dead but not reaped: its slot stays taken by the zombie until some process reclaims it */
+static void kill_victim(pid_t victim) {
+
+    siginfo_t info;
+    kill(victim, SIGKILL);
+    waitid(P_PID, (id_t) victim, &info, WEXITED | WNOWAIT);
+}
+
+/**
+ * A process killed in the middle of an insertion leaves it pending: the merges of the writers after it
+ * reclaim its slot instead of waiting for it forever, and lose none of their insertions. The victim is
+ * reaped only at the end, so the merges see it first as a zombie
+ */
+static int check_killed_writer(const char *name, void *hash_functions, const sketch_t *serial, long n) {
+
+    shm_minhash *sketch = NULL;
+    pid_t victim = 0;
+    int attempt;
+    for (attempt = 0; attempt < KILL_ATTEMPTS; attempt++) {
+        victim = fork_victim(&sketch, name, hash_functions, n, conf.b);
+        usleep(KILL_DELAY_US);
+        kill_victim(victim);
+        shm_proc *proc = proc_of(sketch, victim);
+        if (proc != NULL && has_pending(proc))
+            break;
+        waitpid(victim, NULL, 0);
+        detach_shm_minhash(sketch);
+    }
+    if (attempt == KILL_ATTEMPTS) {
+        printf("No process was killed in the middle of an insertion in %d attempts: the reclamation is not checked\n", KILL_ATTEMPTS);
+        unlink_shm_minhash(name);
+        return 0;
+    }
+
+    int ret = check_writers_after(sketch, name, serial, n, victim);
+    if (ret == 0)
+        printf("A process killed in the middle of an insertion (attempt %d) is reclaimed by the merges of %u writers\n", attempt + 1, conf.N);
+    waitpid(victim, NULL, 0);
+
+    detach_shm_minhash(sketch);
+    unlink_shm_minhash(name);
+    return ret;
+}
+
+/**
+ * A process killed in the middle of a merge holds the merger of the segment: the writers waiting for the
+ * merge take it over instead of waiting for it forever. b = 2 merges every N + 1 insertions, so the
+ * victim is caught merging by polling the merger
+ */
+static int check_killed_merger(const char *name, void *hash_functions, const sketch_t *serial, long n) {
+
+    shm_minhash *sketch = NULL;
+    pid_t victim = 0;
+    int attempt, polls;
+    for (attempt = 0; attempt < KILL_ATTEMPTS; attempt++) {
+        victim = fork_victim(&sketch, name, hash_functions, n, 2);
+        for (polls = 0; polls < KILL_DELAY_US && __atomic_load_n(&sketch->segment->merger, __ATOMIC_ACQUIRE) != (int32_t) victim; polls++)
+            usleep(1);
+        kill_victim(victim);
+        if (__atomic_load_n(&sketch->segment->merger, __ATOMIC_ACQUIRE) == (int32_t) victim)
+            break;
+        waitpid(victim, NULL, 0);
+        detach_shm_minhash(sketch);
+    }
+    if (attempt == KILL_ATTEMPTS) {
+        printf("No process was killed in the middle of a merge in %d attempts: the takeover is not checked\n", KILL_ATTEMPTS);
+        unlink_shm_minhash(name);
+        return 0;
+    }
+
+    int ret = check_writers_after(sketch, name, serial, n, victim);
+    if (ret == 0 && __atomic_load_n(&sketch->segment->merger, __ATOMIC_ACQUIRE) != 0) {
+        printf("Test failed: the merger of the segment is still taken after the writers\n");
+        ret = 1;
+    }
+    if (ret == 0)
+        printf("A process killed in the middle of a merge (attempt %d) is taken over by %u writers\n", attempt + 1, conf.N);
+    waitpid(victim, NULL, 0);
+
+    detach_shm_minhash(sketch);
+    unlink_shm_minhash(name);
+    return ret;
+}
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> <num_processes> [sketch_size] [b]\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 1);
+    conf.N = (uint32_t) parse_arg(argv[2], "num_processes", 1);
+    if (argc > 3) conf.sketch_size = (uint64_t) parse_arg(argv[3], "sketch_size", 1);
+    if (argc > 4) conf.b = (uint32_t) parse_arg(argv[4], "b", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    minhash_sketch *serial;
+    minhash_init(&serial, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    long i;
+    for (i = 0; i < n; i++)
+        insert(serial, i);
+
+    char name[64];
+    snprintf(name, sizeof(name), "/minhash-test-%d", (int) getpid());
+    unlink_shm_minhash(name);
+    shm_minhash *sketch;
+    create_shm_minhash(&sketch, name, hash_functions, conf.sketch_size, conf.hash_type, conf.N, conf.b);
+
+    // one writer per process and a process querying, each with its own mapping of the segment
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    uint32_t p;
+    fflush(stdout);
+    for (p = 0; p <= conf.N; p++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork failed for an ingest process");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0)
+            _exit(p < conf.N ? writer_process(name, p, n) : query_process(name, serial->sketch, conf.N));
+    }
+    int ret = 0, status;
+    for (p = 0; p <= conf.N; p++) {
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            printf("Test failed: a process exited abnormally or saw a snapshot which is no state of the sketch\n");
+            ret = 1;
+        }
+    }
+    gettimeofday(&t2, NULL);
+    printf("%ld insertions by %u processes into one shared sketch: %.3f ms, %lu merges\n",
+           n, conf.N, elapsed_ms(t1, t2), (uint64_t) __atomic_load_n(&sketch->segment->merges, __ATOMIC_ACQUIRE));
+
+    // the insertions of every process are in the shared sketch, hashed with the functions of the segment
+    sketch_t *out = malloc(conf.sketch_size * sizeof(sketch_t));
+    if (out == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshot\n");
+        exit(1);
+    }
+    if (!shm_minhash_snapshot(sketch, out) || memcmp(out, serial->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the shared sketch differs from the serial sketch of every insertion\n");
+        ret = 1;
+    }
+    if (__atomic_load_n(&sketch->segment->attached, __ATOMIC_ACQUIRE) != 1) {
+        printf("Test failed: %u processes are still attached\n", __atomic_load_n(&sketch->segment->attached, __ATOMIC_ACQUIRE));
+        ret = 1;
+    }
+
+    // the former setup: a private sketch per process, merged offline
+    minhash_sketch *merged;
+    minhash_init(&merged, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    gettimeofday(&t1, NULL);
+    for (p = 0; p < conf.N; p++) {
+        minhash_sketch *private;
+        minhash_init(&private, hash_functions, conf.sketch_size, 0, conf.hash_type);
+        for (i = (long) p; i < n; i += conf.N)
+            insert(private, i);
+        merge(merged->sketch, private->sketch, conf.sketch_size);
+        minhash_free(private);
+    }
+    gettimeofday(&t2, NULL);
+    printf("%u private sketches merged offline: %.3f ms of insertions on one core\n", conf.N, elapsed_ms(t1, t2));
+
+    free(out);
+    minhash_free(merged);
+    detach_shm_minhash(sketch);
+    unlink_shm_minhash(name);
+
+    ret |= check_killed_writer(name, hash_functions, serial->sketch, n);
+    ret |= check_killed_merger(name, hash_functions, serial->sketch, n);
+    minhash_free(serial);
+
+    if (ret == 0)
+        printf("Test passed: %u processes inserted into one shared sketch and queried it while it changed\n", conf.N);
+    return ret;
+}
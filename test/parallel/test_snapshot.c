@@ -0,0 +1,280 @@
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <runtime.h>
+#include <arena.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+    .N = 4,
+    .b = 50,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+typedef struct snapshot_arg {
+    conc_minhash *sketch;
+    const sketch_t *final;   /// serial sketch of every element: a lower bound of any state
+    long n;
+    uint32_t writers;
+    int snapshots;           /// 0: the writers run alone
+    _Atomic uint32_t done;
+    uint64_t fresh, stale;   /// snapshots with and without the pending insertions
+    int wrong;
+} snapshot_arg;
+
+/**
+ * Worker 0 takes snapshots while the others insert [0, n). A fresh snapshot is a state of the sketch:
+ * no slot below the final sketch, none above the query sketch published before it, and no slot above
+ * the previous fresh snapshot, since slots only decrease
+ */
+static void snapshot_task(void *arg, uint32_t tid) {
+
+    snapshot_arg *a = (snapshot_arg *) arg;
+    if (tid > 0) {
+        long i;
+        for (i = tid - 1; i < a->n; i += a->writers)
+            insert_conc_minhash(a->sketch, i);
+        __atomic_fetch_add(&a->done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    if (!a->snapshots)
+        return;
+
+    uint64_t size = a->sketch->size, i;
+    sketch_t *out = malloc(size * sizeof(sketch_t));
+    sketch_t *previous = malloc(size * sizeof(sketch_t));
+    if (out == NULL || previous == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshots\n");
+        exit(1);
+    }
+    for (i = 0; i < size; i++)
+        previous[i] = INFTY;
+
+    do {
+        const sketch_t *query_sketch = __atomic_load_n(&(a->sketch->sketches[0]), __ATOMIC_ACQUIRE)->sketch;
+        if (conc_minhash_snapshot(a->sketch, out)) {
+            for (i = 0; i < size; i++)
+                a->wrong += out[i] < a->final[i] || out[i] > query_sketch[i] || out[i] > previous[i];
+            memcpy(previous, out, size * sizeof(sketch_t));
+            a->fresh++;
+        } else {
+            for (i = 0; i < size; i++)
+                a->wrong += out[i] < a->final[i];
+            a->stale++;
+        }
+    } while (__atomic_load_n(&a->done, __ATOMIC_ACQUIRE) < a->writers);
+
+    free(previous);
+    free(out);
+}
+
+
+typedef struct vector_arg {
+    conc_minhash *sketch;
+    const sketch_t *vectors; /// n hash vectors of size slots, inserted whole by insert_conc_minhash_values
+    uint64_t n;
+    uint32_t writers;
+    _Atomic uint64_t *completed; /// vectors each writer inserted so far
+    _Atomic uint32_t done;
+    uint64_t fresh, stale, missing;
+} vector_arg;
+
+/**
+ * Worker 0 takes snapshots while the others insert the vectors, writer w the vectors w, w + writers...
+ * A fresh snapshot holds entirely every vector whose insertion completed before it started, whether
+ * other insertions are in flight or not
+ */
+static void vector_task(void *arg, uint32_t tid) {
+
+    vector_arg *a = (vector_arg *) arg;
+    uint64_t size = a->sketch->size, v, i;
+    uint32_t w;
+    if (tid > 0) {
+        for (v = tid - 1; v < a->n; v += a->writers) {
+            insert_conc_minhash_values(a->sketch, a->vectors + v * size);
+            __atomic_fetch_add(&a->completed[tid - 1], 1, __ATOMIC_RELEASE);
+        }
+        __atomic_fetch_add(&a->done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    sketch_t *out = malloc(size * sizeof(sketch_t));
+    uint64_t *completed = malloc(a->writers * sizeof(uint64_t));
+    if (out == NULL || completed == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshot\n");
+        exit(1);
+    }
+    do {
+        for (w = 0; w < a->writers; w++)
+            completed[w] = __atomic_load_n(&a->completed[w], __ATOMIC_ACQUIRE);
+        if (!conc_minhash_snapshot(a->sketch, out)) {
+            a->stale++;
+            continue;
+        }
+        a->fresh++;
+        for (w = 0; w < a->writers; w++)
+            for (v = w; v < completed[w] * a->writers; v += a->writers) {
+                const sketch_t *values = a->vectors + v * size;
+                for (i = 0; i < size && out[i] <= values[i]; i++)
+                    ;
+                a->missing += i < size;
+            }
+    } while (__atomic_load_n(&a->done, __ATOMIC_ACQUIRE) < a->writers);
+    free(completed);
+    free(out);
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> <num_threads> [sketch_size] [b]\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 1);
+    conf.N = (uint32_t) parse_arg(argv[2], "num_threads", 1);
+    if (argc > 3) conf.sketch_size = (uint64_t) parse_arg(argv[3], "sketch_size", 1);
+    if (argc > 4) conf.b = (uint32_t) parse_arg(argv[4], "b", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    minhash_sketch *serial;
+    minhash_init(&serial, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    long i;
+    for (i = 0; i < n; i++)
+        insert(serial, i);
+
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + 1, NULL, PIN_NONE);
+
+    // writers alone, then with a thread taking snapshots all along
+    int ret = 0, run;
+    double elapsed[2];
+    conc_minhash *sketch = NULL;
+    snapshot_arg arg;
+    for (run = 0; run < 2; run++) {
+        if (sketch != NULL)
+            free_conc_minhash(sketch);
+        init_conc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N, conf.b);
+        arg = (snapshot_arg) {sketch, serial->sketch, n, conf.N, run, 0, 0, 0, 0};
+        struct timeval t1, t2;
+        gettimeofday(&t1, NULL);
+        worker_pool_run(&pool, snapshot_task, &arg);
+        gettimeofday(&t2, NULL);
+        elapsed[run] = elapsed_ms(t1, t2);
+    }
+    worker_pool_stop(&pool);
+    printf("%ld insertions by %u writers: %.3f ms alone, %.3f ms with %lu fresh and %lu stale snapshots\n",
+           n, conf.N, elapsed[0], elapsed[1], arg.fresh, arg.stale);
+    if (arg.wrong) {
+        printf("Test failed: %d slots of the snapshots taken during the insertions are not a state of the sketch\n", arg.wrong);
+        ret = 1;
+    }
+
+    // once the writers are done the snapshot is the minimum of the query and the insert sketch
+    sketch_t *out = malloc(conf.sketch_size * sizeof(sketch_t));
+    if (out == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshot\n");
+        exit(1);
+    }
+    uint64_t s;
+    int fresh = conc_minhash_snapshot(sketch, out);
+    for (s = 0; s < conf.sketch_size; s++) {
+        sketch_t q = sketch->sketches[0]->sketch[s], w = sketch->sketches[1]->sketch[s];
+        if (out[s] != (q < w ? q : w))
+            break;
+    }
+    if (!fresh || s < conf.sketch_size) {
+        printf("Test failed: the snapshot of the quiescent sketch differs from its query and insert sketches\n");
+        ret = 1;
+    }
+
+    // insertions of whole hash vectors, of random values that no two vectors share
+    const uint64_t n_vectors = 2000;
+    sketch_t *vectors = malloc(n_vectors * conf.sketch_size * sizeof(sketch_t));
+    if (vectors == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating hash vectors\n");
+        exit(1);
+    }
+    for (s = 0; s < n_vectors * conf.sketch_size; s++)
+        vectors[s] = (sketch_t) ((((uint64_t) random() << 31) ^ (uint64_t) random()) >> 1);
+    free_conc_minhash(sketch);
+    init_conc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N, conf.b);
+    _Atomic uint64_t *completed = calloc(conf.N, sizeof(uint64_t));
+    if (completed == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating counters\n");
+        exit(1);
+    }
+    worker_pool_start(&pool, conf.N + 1, NULL, PIN_NONE);
+    vector_arg varg = {sketch, vectors, n_vectors, conf.N, completed, 0, 0, 0, 0};
+    worker_pool_run(&pool, vector_task, &varg);
+    worker_pool_stop(&pool);
+    printf("%lu vector insertions by %u writers: %lu fresh and %lu stale snapshots\n", n_vectors, conf.N, varg.fresh, varg.stale);
+    if (varg.missing) {
+        printf("Test failed: %lu vectors inserted before a snapshot are missing from it\n", varg.missing);
+        ret = 1;
+    }
+    free(completed);
+
+    // an insertion stalled halfway, as a writer between conc_insert_acquire and conc_insert_release:
+    // the snapshot does not wait for it, and holds the slots it updated so far
+    free_conc_minhash(sketch);
+    init_conc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N, conf.b);
+    _Atomic(union tagged_pointer *) insert_sketch = FetchAndInc128(&(sketch->sketches[1]), 1 + ((int64_t) 1 << PENDING_OFFSET));
+    for (s = 0; s < conf.sketch_size / 2; s++)
+        insert_sketch->sketch[s] = vectors[s];
+    if (!conc_minhash_snapshot(sketch, out) || memcmp(out, vectors, conf.sketch_size / 2 * sizeof(sketch_t)) != 0
+        || out[conf.sketch_size - 1] != INFTY) {
+        printf("Test failed: the snapshot during an insertion applied halfway is stale or not the state of the sketch\n");
+        ret = 1;
+    }
+    for (; s < conf.sketch_size; s++)
+        insert_sketch->sketch[s] = vectors[s];
+    FetchAndInc128(&insert_sketch, -((int64_t) 1 << PENDING_OFFSET));
+    if (!conc_minhash_snapshot(sketch, out) || memcmp(out, vectors, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the snapshot misses the insertion once it completed\n");
+        ret = 1;
+    }
+
+    // a merge of concurrent_merge_0 halfway: the new insert sketch is published empty, the old one is
+    // not the query sketch yet. No fresh snapshot may miss the insertions of the old one
+    _Atomic(union tagged_pointer *) empty = alloc_aligned_tagged_pointer(sketch_alloc(conf.sketch_size), 0);
+    init_empty_sketch_conc_minhash(empty->sketch, conf.sketch_size);
+    __atomic_store_n(&(sketch->insert_counter), -((int64_t) conf.N), __ATOMIC_RELEASE);
+    __atomic_store_n(&(sketch->sketches[1]), empty, __ATOMIC_RELEASE);
+    if (conc_minhash_snapshot(sketch, out) && memcmp(out, vectors, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the snapshot during a merge misses the insertions of the previous insert sketch\n");
+        ret = 1;
+    }
+    __atomic_store_n(&(sketch->sketches[0]), insert_sketch, __ATOMIC_RELEASE);
+    memcpy(empty->sketch, insert_sketch->sketch, conf.sketch_size * sizeof(sketch_t));
+    __atomic_store_n(&(sketch->insert_counter), 0, __ATOMIC_RELEASE);
+    if (!conc_minhash_snapshot(sketch, out) || memcmp(out, vectors, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the snapshot after a merge is stale or misses insertions\n");
+        ret = 1;
+    }
+
+    free(vectors);
+    free(out);
+    free_conc_minhash(sketch);
+    minhash_free(serial);
+
+    if (ret == 0)
+        printf("Test passed: snapshots taken during the insertions are states of the sketch, with every insertion completed before them\n");
+    return ret;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <runtime.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+    .N = 4,
+    .b = 8,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+/** Elements of bucket i of the stream: n of them, overlapping with the next bucket by half */
+static inline uint64_t bucket_elem(uint64_t bucket, uint64_t j, uint64_t n) {
+    return bucket * (n / 2) + j;
+}
+
+/** Serial sketch of buckets first .. last, the reference of the window */
+static void serial_window(minhash_sketch *serial, uint64_t first, uint64_t last, uint64_t n) {
+
+    uint64_t i, j;
+    for (j = 0; j < serial->size; j++)
+        serial->sketch[j] = INFTY;
+    for (i = first; i <= last; i++)
+        for (j = 0; j < n; j++)
+            insert(serial, bucket_elem(i, j, n));
+}
+
+
+typedef struct insert_arg {
+    window_minhash *window;
+    uint64_t bucket;
+    uint64_t n;
+    uint32_t writers;
+} insert_arg;
+
+static void insert_task(void *arg, uint32_t tid) {
+
+    insert_arg *a = (insert_arg *) arg;
+    uint64_t j;
+    for (j = tid; j < a->n; j += a->writers)
+        insert_window_minhash(a->window, bucket_elem(a->bucket, j, a->n));
+}
+
+
+typedef struct race_arg {
+    window_minhash *window;
+    uint64_t n;
+    uint32_t writers;
+    uint32_t rotations;
+    _Atomic uint64_t inserted;
+} race_arg;
+
+/** Worker 0 rotates the window while the others insert elements 0 .. n - 1 */
+static void race_task(void *arg, uint32_t tid) {
+
+    race_arg *a = (race_arg *) arg;
+    uint64_t j;
+    if (tid == 0) {
+        uint32_t r;
+        for (r = 1; r <= a->rotations; r++) {
+            while (atomic_load(&a->inserted) < r * a->n / (a->rotations + 1))
+                ;
+            window_rotate(a->window);
+        }
+        return;
+    }
+    for (j = tid - 1; j < a->n; j += a->writers) {
+        insert_window_minhash(a->window, j);
+        atomic_fetch_add(&a->inserted, 1);
+    }
+}
+
+/**
+ * Rotations racing with the writers, in a window long enough that no bucket expires: once the last bucket
+ * is closed the window must be the sketch of every element, an insertion into a bucket already merged is lost
+ */
+static int check_rotation_race(void *hash_functions, minhash_sketch *serial, uint64_t n, sketch_t *snapshot) {
+
+    const uint32_t rotations = 62;
+    window_minhash *window;
+    init_window_minhash(&window, hash_functions, conf.sketch_size, conf.hash_type, conf.N, conf.b, rotations + 2, 1, 0);
+
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N + 1, NULL, PIN_NONE);
+    race_arg arg = {window, n, conf.N, rotations, 0};
+    worker_pool_run(&pool, race_task, &arg);
+    worker_pool_stop(&pool);
+    window_rotate(window);
+
+    uint64_t j;
+    for (j = 0; j < serial->size; j++)
+        serial->sketch[j] = INFTY;
+    for (j = 0; j < n; j++)
+        insert(serial, j);
+    window_snapshot(window, snapshot);
+    free_window_minhash(window);
+
+    if (memcmp(snapshot, serial->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: an insertion racing with %u rotations is missing from the window\n", rotations);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 5) {
+        fprintf(stderr,
+            "Usage: %s <elements per bucket> <sketch_size> <buckets in the window> <num_threads>\n", argv[0]);
+        exit(1);
+    }
+
+    uint64_t n = (uint64_t) parse_arg(argv[1], "n_elements", 2);
+    conf.sketch_size = (uint64_t) parse_arg(argv[2], "sketch_size", 1);
+    uint32_t W = (uint32_t) parse_arg(argv[3], "W", 2);
+    conf.N = (uint32_t) parse_arg(argv[4], "num_threads", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    const uint64_t width = 10;
+    window_minhash *window;
+    init_window_minhash(&window, hash_functions, conf.sketch_size, conf.hash_type, conf.N, conf.b, W, width, 0);
+
+    minhash_sketch *serial;
+    minhash_init(&serial, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    sketch_t *snapshot = malloc(conf.sketch_size * sizeof(sketch_t));
+    if (snapshot == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating snapshot\n");
+        exit(1);
+    }
+
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N, NULL, PIN_NONE);
+    insert_arg arg = {window, 0, n, conf.N};
+
+    // each bucket is filled by the writers, then closed: the window must hold exactly its last W - 1 closed buckets
+    int ret = 0;
+    uint64_t bucket, rounds = 3 * (uint64_t) W + 1;
+    struct timeval t1, t2;
+    double rotate_ms = 0;
+    for (bucket = 0; bucket < rounds; bucket++) {
+        arg.bucket = bucket;
+        worker_pool_run(&pool, insert_task, &arg);
+
+        gettimeofday(&t1, NULL);
+        window_advance(window, (bucket + 1) * width + width / 2);
+        gettimeofday(&t2, NULL);
+        rotate_ms += elapsed_ms(t1, t2);
+
+        uint64_t first = bucket + 2 >= W ? bucket + 2 - W : 0;
+        serial_window(serial, first, bucket, n);
+        window_snapshot(window, snapshot);
+        if (memcmp(snapshot, serial->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+            printf("Test failed: after closing bucket %lu the window differs from buckets %lu .. %lu\n", bucket, first, bucket);
+            ret = 1;
+            break;
+        }
+        if (query_window_minhash(window, serial->sketch) != 1) {
+            printf("Test failed: after closing bucket %lu the window query differs from the snapshot\n", bucket);
+            ret = 1;
+            break;
+        }
+    }
+    printf("%lu rotations of a window of %u buckets: %.3f ms\n", rounds, W, rotate_ms);
+
+    // the open bucket is seen once its insertions are merged into its query sketch
+    arg.bucket = rounds;
+    worker_pool_run(&pool, insert_task, &arg);
+    window_snapshot(window, snapshot);
+    serial_window(serial, rounds + 1 - W, rounds, n);
+    uint64_t i;
+    for (i = 0; i < conf.sketch_size; i++)
+        if (snapshot[i] < serial->sketch[i]) {
+            printf("Test failed: slot %lu of the window holds a value of no bucket of the window\n", i);
+            ret = 1;
+            break;
+        }
+
+    // a gap longer than the window expires every bucket
+    window_advance(window, (rounds + W + 5) * width);
+    window_snapshot(window, snapshot);
+    for (i = 0; i < conf.sketch_size; i++)
+        if (snapshot[i] != INFTY) {
+            printf("Test failed: the window is not empty after a gap of more than %u buckets\n", W);
+            ret = 1;
+            break;
+        }
+
+    worker_pool_stop(&pool);
+    if (ret == 0)
+        ret = check_rotation_race(hash_functions, serial, n, snapshot);
+    free(snapshot);
+    minhash_free(serial);
+    free_window_minhash(window);
+
+    if (ret == 0)
+        printf("Test passed: the window holds the last %u buckets over %lu rotations, none of the insertions racing with a rotation is lost\n", W, rounds);
+    return ret;
+}
@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <pthread.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <runtime.h>
+
+
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+    .N = 0,
+    .b = 0,
+};
+
+
+
+typedef struct {
+    uint32_t tid;
+    sharded_minhash *sketch;
+    long n_inserts;
+    uint64_t startsize;
+    double elapsed;
+    worker_pool *pool;
+    double prob;
+} thread_arg_t;
+
+
+static void print_params(long n_inserts, long ssize, long startsize, long num_threads_total)
+{
+    printf("=== Parameters ===\n");
+    printf("Number of operations     : %ld\n", n_inserts);
+    printf("Sketch size              : %ld\n", ssize);
+    printf("Initial size             : %ld\n", startsize);
+    printf("Number of threads        : %ld\n", num_threads_total);
+    printf("Hash type                : %lu\n", conf.hash_type);
+    printf("Prime modulus            : %lu\n", conf.prime_modulus);
+    printf("Coefficient k-wise       : %d\n", conf.k);
+    printf("====================\n");
+}
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+void *thread_routine(void *arg) {
+    thread_arg_t *targ = (thread_arg_t *)arg;
+    struct timeval t1, t2;
+    sharded_minhash *t_sketch = targ->sketch;
+    double prob = targ->prob;
+
+    // workers are pinned by the pool, synchronize them before starting the operations
+    worker_pool_barrier(targ->pool);
+
+    gettimeofday(&t1, NULL);
+    long i;
+    unsigned int state = targ->tid;
+    for (i = 0; i < targ->n_inserts; i++) {
+        if (rand_r(&state) < prob*RAND_MAX) {
+            insert_sharded_minhash(t_sketch, targ->tid, i+targ->startsize);
+        } else {
+            query_sharded_minhash(t_sketch, t_sketch->merged);
+        }
+    }
+
+    gettimeofday(&t2, NULL);
+    targ->elapsed = elapsed_ms(t1, t2);
+    return NULL;
+}
+
+void worker_task(void *arg, uint32_t tid) {
+    thread_routine(&((thread_arg_t *) arg)[tid]);
+}
+
+
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 6) {
+        fprintf(stderr,
+                "Usage: %s <number of operations> <sketch_size> <initial size> <num_threads> <write probability> [hash coefficient] [pin policy]\n",
+                argv[0]);
+        return 1;
+    }
+
+    long n_ops = parse_arg(argv[1], "n_ops", 1);
+    long ssize = parse_arg(argv[2], "sketch_size", 1);
+    long startsize = parse_arg(argv[3], "start_size", 0);
+    long num_threads = parse_arg(argv[4], "num_threads", 1);
+    double prob = parse_double(argv[5], "probability", 0);
+
+    if (argc > 6) {
+        long k_cofficient = parse_arg(argv[6], "hash coefficient", 1);
+        conf.k = k_cofficient;
+    }
+    uint32_t pin_policy = argc > 7 ? parse_pin_policy(argv[7]) : PIN_COMPACT;
+
+    struct timeval global_start, global_end;
+    struct timeval writer_start, writer_end;
+    double insert_sum = 0.0, insert_min = 1e12, insert_max = 0.0;
+
+    conf.sketch_size = (uint64_t) ssize;
+    if (startsize > 0) conf.init_size = (uint64_t) startsize;
+
+    conf.N = num_threads;
+
+    print_params(n_ops, conf.sketch_size, conf.init_size, conf.N);
+    read_configuration(conf);
+
+
+    sharded_minhash *sketch;
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    init_sharded_minhash(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type, conf.N);
+
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+    printf("Pin policy               : %s\n", pin_policy_name(pin_policy));
+
+    worker_pool pool;
+    worker_pool_start(&pool, conf.N, &topo, pin_policy);
+
+    thread_arg_t targs[conf.N];
+
+    uint64_t chunk_size = n_ops / conf.N;
+    uint64_t remainder = n_ops % conf.N;
+
+    printf("Number of operations %lu, operations for threads %lu\n", n_ops, chunk_size);
+
+
+    gettimeofday(&global_start, NULL);  // GLOBAL TIME
+
+    /** prepare worker threads */
+    long i;
+    for (i = 0; i < conf.N; i++) {
+
+        // First 'remainder' threads get the base chunk plus one
+        uint64_t ops_for_thread = chunk_size + ((uint64_t) i < remainder ? 1 : 0);
+        uint64_t current_start = startsize + i * chunk_size + ((uint64_t) i < remainder ? (uint64_t) i : remainder);
+
+        targs[i].tid       = i;
+        targs[i].n_inserts = ops_for_thread;
+        targs[i].startsize = current_start;
+        targs[i].sketch    = sketch;
+        targs[i].prob      = prob;
+        targs[i].pool      = &pool;
+    }
+
+    gettimeofday(&writer_start, NULL);
+
+    worker_pool_run(&pool, worker_task, targs);
+
+    long j;
+    for (j = 0; j < conf.N; j++) {
+        double t = targs[j].elapsed;
+        insert_sum += t;
+        if (t < insert_min) insert_min = t;
+        if (t > insert_max) insert_max = t;
+    }
+    gettimeofday(&writer_end, NULL);
+
+    gettimeofday(&global_end, NULL);
+
+
+    printf("Threads finished. Elapsed wall-clock time: %.3f ms\n",
+       elapsed_ms(writer_start, writer_end));
+    printf("Thread times: avg %.3f ms, min %.3f ms, max %.3f ms\n",
+       insert_sum / conf.N, insert_min, insert_max);
+
+
+    printf("Total program elapsed time: %.3f ms\n",
+           elapsed_ms(global_start, global_end));
+
+    worker_pool_stop(&pool);
+    topology_free(&topo);
+
+    free_sharded_minhash(sketch);
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <arena.h>
+#include <runtime.h>
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+/** Blocks of every class (and one above the largest) must be aligned, writable and disjoint */
+static int check_classes(void) {
+
+    int ret = 0;
+    uint8_t *blocks[ARENA_CLASSES + 1];
+    size_t sizes[ARENA_CLASSES + 1];
+    int c;
+    for (c = 0; c <= ARENA_CLASSES; c++) {
+        // an odd size inside the class, rounded up by the arena
+        sizes[c] = (1UL << (c + ARENA_MIN_SHIFT)) - (c > 0 ? 3 : 0);
+        blocks[c] = arena_alloc(sizes[c]);
+        size_t align = sizes[c] < 64 ? 16 : 64;
+        if ((uintptr_t) blocks[c] % align != 0) {
+            printf("block of %zu bytes at %p is not %zu-byte aligned\n", sizes[c], (void *) blocks[c], align);
+            ret = 1;
+        }
+        memset(blocks[c], c + 1, sizes[c]);
+    }
+    for (c = 0; c <= ARENA_CLASSES; c++) {
+        size_t i;
+        for (i = 0; i < sizes[c]; i++) {
+            if (blocks[c][i] != (uint8_t) (c + 1)) {
+                printf("block of %zu bytes overwritten at byte %zu\n", sizes[c], i);
+                ret = 1;
+                break;
+            }
+        }
+    }
+
+#ifdef HUGEPAGE_ARENA
+    // a freed block is the next one served for its class
+    for (c = 0; c < ARENA_CLASSES; c++) {
+        arena_free(blocks[c], sizes[c]);
+        uint8_t *again = arena_alloc(sizes[c]);
+        if (again != blocks[c]) {
+            printf("class of %zu bytes does not reuse the freed block\n", sizes[c]);
+            ret = 1;
+        }
+        blocks[c] = again;
+    }
+#endif
+
+    for (c = 0; c <= ARENA_CLASSES; c++)
+        arena_free(blocks[c], sizes[c]);
+    return ret;
+}
+
+
+typedef struct churn_arg {
+    uint64_t sketch_size;
+    uint64_t rounds;
+    sketch_t **handoff;  /// sketches allocated by worker w and freed by worker w + 1
+    int *errors;
+} churn_arg;
+
+/** Every worker allocates, fills and checks sketches, then frees the sketches another worker allocated */
+static void churn_task(void *arg, uint32_t tid) {
+
+    churn_arg *a = (churn_arg *) arg;
+    const uint64_t live = 64;
+    sketch_t *sketches[live];
+    uint64_t r, s, i;
+    for (r = 0; r < a->rounds; r++) {
+        for (s = 0; s < live; s++) {
+            sketches[s] = sketch_alloc(a->sketch_size);
+            for (i = 0; i < a->sketch_size; i++)
+                sketches[s][i] = (sketch_t) (tid * 1000003 + s * 131 + i);
+        }
+        for (s = 0; s < live; s++) {
+            for (i = 0; i < a->sketch_size; i++)
+                if (sketches[s][i] != (sketch_t) (tid * 1000003 + s * 131 + i))
+                    a->errors[tid]++;
+            if (s == 0 && r == a->rounds - 1)
+                a->handoff[tid] = sketches[s];
+            else
+                sketch_free(sketches[s], a->sketch_size);
+        }
+    }
+}
+
+static void handoff_task(void *arg, uint32_t tid) {
+
+    churn_arg *a = (churn_arg *) arg;
+    // blocks freed by a thread other than the allocating one move to the free list of the freeing thread,
+    // the sketch of the last worker is freed by the main thread
+    if (tid > 0)
+        sketch_free(a->handoff[tid - 1], a->sketch_size);
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 4) {
+        fprintf(stderr,
+            "Usage: %s <number of sketches> <sketch size> <num_threads>\n", argv[0]);
+        exit(1);
+    }
+
+    long n_sketches = parse_arg(argv[1], "number of sketches", 1);
+    long ssize = parse_arg(argv[2], "sketch size", 1);
+    long num_threads = parse_arg(argv[3], "num_threads", 1);
+
+    int ret = check_classes();
+
+    // concurrent churn with cross-thread frees, then the workers exit and their free lists go to the depot
+    worker_pool pool;
+    int errors[num_threads];
+    sketch_t *handoff[num_threads];
+    memset(errors, 0, sizeof(errors));
+    churn_arg arg = {(uint64_t) ssize, 16, handoff, errors};
+    worker_pool_start(&pool, (uint32_t) num_threads, NULL, PIN_NONE);
+    worker_pool_run(&pool, churn_task, &arg);
+    worker_pool_run(&pool, handoff_task, &arg);
+    worker_pool_stop(&pool);
+    sketch_free(handoff[num_threads - 1], ssize);
+    long t;
+    for (t = 0; t < num_threads; t++) {
+        if (errors[t]) {
+            printf("worker %ld: %d slots of its sketches were overwritten\n", t, errors[t]);
+            ret = 1;
+        }
+    }
+
+    // many small sketches: arena against malloc, allocation plus first touch, then free
+    sketch_t **sketches = malloc(n_sketches * sizeof(sketch_t *));
+    if (sketches == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating sketch pointers\n");
+        exit(1);
+    }
+    struct timeval t1, t2, t3, t4;
+    long s;
+    gettimeofday(&t1, NULL);
+    for (s = 0; s < n_sketches; s++) {
+        sketches[s] = sketch_alloc(ssize);
+        memset(sketches[s], 0xFF, ssize * sizeof(sketch_t));
+    }
+    for (s = 0; s < n_sketches; s++)
+        sketch_free(sketches[s], ssize);
+    gettimeofday(&t2, NULL);
+    for (s = 0; s < n_sketches; s++) {
+        sketches[s] = sketch_alloc(ssize);
+        memset(sketches[s], 0xFF, ssize * sizeof(sketch_t));
+    }
+    for (s = 0; s < n_sketches; s++)
+        sketch_free(sketches[s], ssize);
+    gettimeofday(&t3, NULL);
+    for (s = 0; s < n_sketches; s++) {
+        sketches[s] = malloc(ssize * sizeof(sketch_t));
+        memset(sketches[s], 0xFF, ssize * sizeof(sketch_t));
+    }
+    for (s = 0; s < n_sketches; s++)
+        free(sketches[s]);
+    gettimeofday(&t4, NULL);
+    free(sketches);
+
+    arena_usage usage;
+    arena_get_usage(&usage);
+    printf("%ld sketches of %ld slots: arena %.3f ms (reused %.3f ms), malloc %.3f ms\n",
+           n_sketches, ssize, elapsed_ms(t1, t2), elapsed_ms(t2, t3), elapsed_ms(t3, t4));
+    printf("Arena mapped: %zu MB MAP_HUGETLB, %zu MB THP advised, %zu MB for large blocks\n",
+           usage.hugetlb_bytes >> 20, usage.thp_bytes >> 20, usage.large_bytes >> 20);
+
+    if (ret == 0)
+        printf("Test passed: arena blocks are aligned, disjoint and reused across threads\n");
+    return ret;
+}
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <bbit.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 1024,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+/** Check that every slot of the packed sketch holds the lowest b bits of the original slot */
+static int check_packing(const sketch_t *sketch, const bbit_sketch *bsketch) {
+
+    uint64_t per_word = 64 / bsketch->b;
+    uint64_t mask = (1ULL << bsketch->b) - 1;
+    uint64_t i;
+    for (i = 0; i < bsketch->size; i++) {
+        uint64_t packed = (bsketch->bits[i / per_word] >> ((i % per_word) * bsketch->b)) & mask;
+        if (packed != ((uint64_t) sketch[i] & mask)) {
+            printf("slot %lu packed %lu, expected %lu\n", i, packed, (uint64_t) sketch[i] & mask);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of insertions> <sketch_size> [number of queries]\n", argv[0]);
+        exit(1);
+    }
+
+    long n_inserts = parse_arg(argv[1], "n_inserts", 2);
+    long ssize = parse_arg(argv[2], "sketch_size", 1);
+    long n_queries = argc > 3 ? parse_arg(argv[3], "n_queries", 1) : 100000;
+
+    conf.sketch_size = (uint64_t) ssize;
+    read_configuration(conf);
+
+    minhash_sketch *sketch;
+    minhash_sketch *sketch2;
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    minhash_init(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type);
+    minhash_init(&sketch2, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type);
+
+    // the two sets overlap on half of each, so their Jaccard similarity is 1/3
+    long i;
+    for (i = 0; i < n_inserts; i++) {
+        insert(sketch, i);
+        insert(sketch2, i + n_inserts / 2);
+    }
+
+    float full = query(sketch, sketch2);
+    printf("Full sketch similarity: %.4f (%lu bytes)\n", full, conf.sketch_size * sizeof(sketch_t));
+
+    int ret = 0;
+    uint32_t b;
+    for (b = 1; b <= 8; b <<= 1) {
+        bbit_sketch *bsketch = bbit_compress(sketch->sketch, sketch->size, b);
+        bbit_sketch *bsketch2 = bbit_compress(sketch2->sketch, sketch2->size, b);
+
+        if (check_packing(sketch->sketch, bsketch) || check_packing(sketch2->sketch, bsketch2)) {
+            printf("Test failed: wrong packing for b = %u\n", b);
+            ret = 1;
+        }
+
+        // equal minima always agree on their low bits
+        uint64_t matches = bbit_matches(bsketch->bits, bsketch2->bits, bsketch->size, b);
+        if (matches < (uint64_t) (full * sketch->size + 0.5f)) {
+            printf("Test failed: b = %u counts %lu matches, fewer than the full sketch\n", b, matches);
+            ret = 1;
+        }
+
+        struct timeval t1, t2;
+        float estimate = 0;
+        gettimeofday(&t1, NULL);
+        long q;
+        for (q = 0; q < n_queries; q++)
+            estimate = bbit_query(bsketch, bsketch2);
+        gettimeofday(&t2, NULL);
+
+        printf("b = %u: similarity %.4f (%lu bytes), %ld queries in %.3f ms\n",
+               b, estimate, bsketch->words * sizeof(uint64_t), n_queries, elapsed_ms(t1, t2));
+
+        if (estimate < full - 0.15f || estimate > full + 0.15f) {
+            printf("Test failed: b = %u estimate %.4f too far from %.4f\n", b, estimate, full);
+            ret = 1;
+        }
+
+        bbit_free(bsketch);
+        bbit_free(bsketch2);
+    }
+
+    struct timeval t1, t2;
+    float similarity = 0;
+    gettimeofday(&t1, NULL);
+    for (i = 0; i < n_queries; i++)
+        similarity = query(sketch, sketch2);
+    gettimeofday(&t2, NULL);
+    printf("full: similarity %.4f, %ld queries in %.3f ms\n", similarity, n_queries, elapsed_ms(t1, t2));
+
+    minhash_free(sketch);
+    minhash_free(sketch2);
+
+    if (ret == 0)
+        printf("Test passed: b-bit sketches agree with the full sketch\n");
+    return ret;
+}
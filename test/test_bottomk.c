@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <bottomk.h>
+#include <runtime.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 256,          /// k
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+static int compare_values(const void *x, const void *y) {
+    sketch_t a = *(const sketch_t *) x, b = *(const sketch_t *) y;
+    return (a > b) - (a < b);
+}
+
+
+/** The sketch must hold the k smallest distinct hash values of elems, computed by sorting all of them */
+static int check_exact(const bottomk_sketch *sketch, void *hash_functions, const uint64_t *elems, size_t n) {
+
+    sketch_t *all = malloc(n * sizeof(sketch_t));
+    if (all == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating hash values\n");
+        exit(1);
+    }
+    size_t i, distinct = 0;
+    for (i = 0; i < n; i++)
+        hash_values(hash_functions, conf.hash_type, 0, 1, elems[i], &all[i]);
+    qsort(all, n, sizeof(sketch_t), compare_values);
+    for (i = 0; i < n; i++)
+        if (i == 0 || all[i] != all[distinct - 1])
+            all[distinct++] = all[i];
+
+    uint64_t expected = distinct < sketch->k ? distinct : sketch->k;
+    int ret = sketch->count != expected || memcmp(sketch->values, all, expected * sizeof(sketch_t)) != 0;
+    free(all);
+    return ret;
+}
+
+
+typedef struct insert_arg {
+    conc_bottomk *sketch;
+    const uint64_t *elems;
+    size_t n;
+    uint32_t writers;
+    _Atomic uint32_t done;   /// writers finished
+    uint64_t snapshots;      /// taken by the reader
+    int torn;                /// snapshots that were not a valid bottom-k
+} insert_arg;
+
+/** Worker 0 takes snapshots while the others insert their share of the elements and flush their buffers */
+static void insert_task(void *arg, uint32_t tid) {
+
+    insert_arg *a = (insert_arg *) arg;
+    if (tid > 0) {
+        size_t i;
+        for (i = tid - 1; i < a->n; i += a->writers)
+            insert_conc_bottomk(a->sketch, tid, a->elems[i]);
+        conc_bottomk_flush(a->sketch, tid);
+        __atomic_fetch_add(&a->done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    bottomk_sketch *snapshot;
+    init_bottomk(&snapshot, a->sketch->hash_functions, a->sketch->k, 0, a->sketch->hash_type);
+    do {
+        conc_bottomk_snapshot(a->sketch, snapshot);
+        uint64_t i;
+        for (i = 1; i < snapshot->count; i++)
+            if (snapshot->values[i - 1] >= snapshot->values[i])
+                a->torn++;
+        a->snapshots++;
+        sched_yield();
+    } while (__atomic_load_n(&a->done, __ATOMIC_ACQUIRE) < a->writers);
+    free_bottomk(snapshot);
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 4) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> <k> <num_threads>\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 20);
+    long k = parse_arg(argv[2], "k", 2);
+    long num_threads = parse_arg(argv[3], "num_threads", 1);
+    conf.sketch_size = (uint64_t) k;
+    read_configuration(conf);
+
+    // one function for the bottom-k sketches, k of them for the MinHash comparison
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    // A = [0, n) and B = [n/2, n/2 + n): J = 1/3
+    uint64_t *elems = malloc((n + n / 2) * sizeof(uint64_t));
+    if (elems == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating elements\n");
+        exit(1);
+    }
+    long i;
+    for (i = 0; i < n + n / 2; i++)
+        elems[i] = (uint64_t) i;
+
+    int ret = 0;
+    bottomk_sketch *a, *b, *small;
+    init_bottomk(&a, hash_functions, k, 0, conf.hash_type);
+    init_bottomk(&b, hash_functions, k, 0, conf.hash_type);
+    init_bottomk(&small, hash_functions, k, 10, conf.hash_type);
+
+    insert_bottomk_batch(a, elems, n);
+    insert_bottomk_batch(b, elems + n / 2, n);
+
+    if (check_exact(a, hash_functions, elems, n) || check_exact(b, hash_functions, elems + n / 2, n) || check_exact(small, hash_functions, elems, 10)) {
+        printf("Test failed: a sketch differs from the k smallest hash values of its set\n");
+        ret = 1;
+    }
+
+    float similarity = query_bottomk(a, b);
+    double cardinality = bottomk_cardinality(a);
+    double tolerance = 5.0 / sqrt((double) k);
+    printf("similarity %.4f expected %.4f, cardinality %.1f expected %ld, small cardinality %.1f\n",
+           similarity, 1 / 3.0, cardinality, n, bottomk_cardinality(small));
+    if (fabs(similarity - 1 / 3.0) > tolerance / 2 || fabs(cardinality - n) / n > tolerance || bottomk_cardinality(small) != 10) {
+        printf("Test failed: estimates out of the tolerance of %.1f%%\n", tolerance * 100);
+        ret = 1;
+    }
+    if (query_bottomk(a, a) != 1) {
+        printf("Test failed: a sketch is not identical to itself\n");
+        ret = 1;
+    }
+
+    // per element cost against a MinHash sketch with k slots
+    bottomk_sketch *timed;
+    minhash_sketch *minhash;
+    init_bottomk(&timed, hash_functions, k, 0, conf.hash_type);
+    minhash_init(&minhash, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    struct timeval t1, t2, t3;
+    gettimeofday(&t1, NULL);
+    insert_bottomk_batch(timed, elems, n);
+    gettimeofday(&t2, NULL);
+    insert_batch(minhash, elems, n);
+    gettimeofday(&t3, NULL);
+    printf("%ld insertions with k = %ld: bottom-k %.3f ms, MinHash %.3f ms\n", n, k, elapsed_ms(t1, t2), elapsed_ms(t2, t3));
+    free_bottomk(timed);
+    minhash_free(minhash);
+
+    // concurrent writers with a small threshold, so that merges race with the snapshots of worker 0
+    conc_bottomk *conc;
+    uint32_t workers = (uint32_t) num_threads + 1;
+    init_conc_bottomk(&conc, hash_functions, k, 0, conf.hash_type, workers, 8);
+    insert_arg arg = {conc, elems, (size_t) n, (uint32_t) num_threads, 0, 0, 0};
+    worker_pool pool;
+    worker_pool_start(&pool, workers, NULL, PIN_NONE);
+    worker_pool_run(&pool, insert_task, &arg);
+    worker_pool_stop(&pool);
+
+    bottomk_sketch *snapshot;
+    init_bottomk(&snapshot, hash_functions, k, 0, conf.hash_type);
+    conc_bottomk_snapshot(conc, snapshot);
+    printf("%ld writers: %lu snapshots during the insertions\n", num_threads, arg.snapshots);
+    if (arg.torn) {
+        printf("Test failed: %d snapshots were not sorted\n", arg.torn);
+        ret = 1;
+    }
+    if (check_exact(snapshot, hash_functions, elems, n)) {
+        printf("Test failed: the concurrent sketch differs from the k smallest hash values of the set\n");
+        ret = 1;
+    }
+    if (query_conc_bottomk(conc, b) != similarity || conc_bottomk_cardinality(conc) != cardinality) {
+        printf("Test failed: the concurrent sketch estimates differ from the serial ones\n");
+        ret = 1;
+    }
+
+    free_bottomk(snapshot);
+    free_conc_bottomk(conc);
+    free_bottomk(small);
+    free_bottomk(b);
+    free_bottomk(a);
+    free(elems);
+
+    if (ret == 0)
+        printf("Test passed: serial and concurrent bottom-k sketches hold the k smallest hash values\n");
+    return ret;
+}
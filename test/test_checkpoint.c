@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <runtime.h>
+#include <ingest.h>
+#include <checkpoint.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 256,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+#if defined(FCDS) || defined(CONC_MINHASH) || defined(FLAT_COMBINING) || defined(SHARDED)
+    .N = 4,
+    .b = 50,
+#endif
+};
+
+static uint32_t writers = 4;
+
+#define CHUNK 64
+#define INTERVAL_MS 5
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+/** The engine of this build, fed through its sinks. Engines with a checkpoint source are checkpointed
+ *  while the writers run, the others once they are done */
+typedef struct engine {
+    void *sketch;
+    void *ctx;       /// ctx of the sinks
+} engine;
+
+#ifdef FCDS
+void *propagator_routine(void *arg) {
+    propagator((fcds_sketch *) arg);
+    return NULL;
+}
+#endif
+
+static void engine_new(engine *e, void *hash_functions) {
+
+#if defined(CONC_MINHASH)
+    conc_minhash *sketch;
+    init_conc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N, conf.b);
+    e->sketch = e->ctx = sketch;
+#elif defined(FCDS)
+    fcds_sketch *sketch;
+    init_fcds(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N, conf.b);
+    fcds_writer *fcds_writers = calloc(conf.N, sizeof(fcds_writer));
+    if (fcds_writers == NULL) {
+        fprintf(stderr, "Error in calloc() when allocating writers\n");
+        exit(1);
+    }
+    uint32_t w;
+    for (w = 0; w < conf.N; w++)
+        fcds_writers[w].sketch = sketch;
+    // the propagator never returns, it is left running until the process exits
+    pthread_t prop_thread;
+    if (pthread_create(&prop_thread, NULL, propagator_routine, sketch)) {
+        fprintf(stderr, "Error creating propagator thread\n");
+        exit(1);
+    }
+    e->sketch = sketch;
+    e->ctx = fcds_writers;
+#elif defined(FLAT_COMBINING)
+    fc_minhash *sketch;
+    init_fc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N);
+    e->sketch = e->ctx = sketch;
+#elif defined(SHARDED)
+    sharded_minhash *sketch;
+    init_sharded_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, conf.N);
+    e->sketch = e->ctx = sketch;
+#else
+    minhash_sketch *sketch;
+    minhash_init(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    e->sketch = e->ctx = sketch;
+#endif
+}
+
+#if defined(CONC_MINHASH)
+#define ENGINE_SINK conc_minhash_sink
+#define ENGINE_VALUES_SINK conc_minhash_values_sink
+#define ENGINE_SOURCE conc_minhash_snapshot_source
+#elif defined(FCDS)
+#define ENGINE_SINK fcds_sink
+#define ENGINE_VALUES_SINK fcds_values_sink
+#define ENGINE_SOURCE fcds_snapshot_source
+#elif defined(FLAT_COMBINING)
+#define ENGINE_SINK fc_minhash_sink
+#define ENGINE_VALUES_SINK fc_minhash_values_sink
+#elif defined(SHARDED)
+#define ENGINE_SINK sharded_minhash_sink
+#define ENGINE_VALUES_SINK sharded_minhash_values_sink
+#define ENGINE_SOURCE sharded_snapshot_source
+#elif defined(LOCKS) || defined(RW_LOCKS)
+#define ENGINE_SINK minhash_parallel_sink
+#define ENGINE_VALUES_SINK minhash_parallel_values_sink
+#else
+#define ENGINE_SINK minhash_sink
+#define ENGINE_VALUES_SINK minhash_values_sink
+#endif
+
+/** Everything the engine holds, once its writers are done */
+static void engine_state(void *sketch, sketch_t *out) {
+
+#if defined(CONC_MINHASH)
+    conc_minhash_snapshot((conc_minhash *) sketch, out);
+#elif defined(FCDS)
+    // the pending propagations end first, then the local sketches are merged in
+    fcds_sketch *fcds = (fcds_sketch *) sketch;
+    uint32_t w;
+    for (w = 0; w < fcds->N; w++)
+        while (__atomic_load_n(&fcds->prop[w], __ATOMIC_ACQUIRE) != 0)
+            ;
+    memcpy(out, fcds->global_sketch, conf.sketch_size * sizeof(sketch_t));
+    for (w = 0; w < fcds->N; w++)
+        merge(out, fcds->local_sketches[w], conf.sketch_size);
+#elif defined(FLAT_COMBINING)
+    memcpy(out, ((fc_minhash *) sketch)->sketch, conf.sketch_size * sizeof(sketch_t));
+#elif defined(SHARDED)
+    sharded_snapshot((sharded_minhash *) sketch, out);
+#else
+    memcpy(out, ((minhash_sketch *) sketch)->sketch, conf.sketch_size * sizeof(sketch_t));
+#endif
+}
+
+#ifndef ENGINE_SOURCE
+#define ENGINE_SOURCE engine_state
+#define QUIESCENT_SOURCE 1
+#endif
+
+
+typedef struct insert_arg {
+    engine *e;
+    long n;
+    _Atomic uint32_t done;
+} insert_arg;
+
+static void insert_task(void *arg, uint32_t tid) {
+
+    insert_arg *a = (insert_arg *) arg;
+    uint64_t keys[CHUNK];
+    long i, j;
+    for (i = (long) tid * CHUNK; i < a->n; i += (long) writers * CHUNK) {
+        size_t n = 0;
+        for (j = i; j < a->n && j < i + CHUNK; j++)
+            keys[n++] = (uint64_t) j;
+        ENGINE_SINK(a->e->ctx, tid, keys, n);
+    }
+    __atomic_fetch_add(&a->done, 1, __ATOMIC_RELEASE);
+}
+
+
+static int below(const sketch_t *sketch, const sketch_t *bound) {
+
+    uint64_t i;
+    for (i = 0; i < conf.sketch_size; i++)
+        if (sketch[i] < bound[i])
+            return 1;
+    return 0;
+}
+
+static void corrupt(const char *file, off_t offset) {
+
+    int fd = open(file, O_RDWR);
+    unsigned char byte;
+    if (fd < 0 || pread(fd, &byte, 1, offset) != 1) {
+        fprintf(stderr, "Cannot read %s to corrupt it\n", file);
+        exit(1);
+    }
+    byte ^= 0x40;
+    if (pwrite(fd, &byte, 1, offset) != 1) {
+        fprintf(stderr, "Cannot write %s to corrupt it\n", file);
+        exit(1);
+    }
+    close(fd);
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> <num_threads> [sketch_size] [checkpoint directory]\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 1);
+    writers = (uint32_t) parse_arg(argv[2], "num_threads", 1);
+#if defined(FCDS) || defined(CONC_MINHASH) || defined(FLAT_COMBINING) || defined(SHARDED)
+    conf.N = writers;
+#endif
+    if (argc > 3) conf.sketch_size = (uint64_t) parse_arg(argv[3], "sketch_size", 1);
+    read_configuration(conf);
+
+    char dir[] = "/tmp/minhash-checkpoint-XXXXXX";
+    char path[4096], file0[4200], file1[4200];
+    if (argc > 4)
+        snprintf(path, sizeof(path), "%s/sketch", argv[4]);
+    else if (mkdtemp(dir) != NULL)
+        snprintf(path, sizeof(path), "%s/sketch", dir);
+    else {
+        perror("mkdtemp failed for the checkpoint directory");
+        exit(1);
+    }
+    snprintf(file0, sizeof(file0), "%s.0", path);
+    snprintf(file1, sizeof(file1), "%s.1", path);
+    unlink(file0);
+    unlink(file1);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    void *other_functions = hash_functions_init(2, conf.sketch_size, conf.prime_modulus, conf.k);
+    uint64_t fingerprint = checkpoint_fingerprint(hash_functions, conf.hash_type, conf.sketch_size);
+
+    int ret = 0;
+    if (fingerprint != checkpoint_fingerprint(hash_functions, conf.hash_type, conf.sketch_size) ||
+        fingerprint == checkpoint_fingerprint(other_functions, 2, conf.sketch_size)) {
+        printf("Test failed: the fingerprint does not identify the hash functions\n");
+        ret = 1;
+    }
+
+    // serial sketches of the first half and of every element: two successive states
+    minhash_sketch *half, *final;
+    minhash_init(&half, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&final, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    long i;
+    for (i = 0; i < n; i++) {
+        if (i < n / 2)
+            insert(half, i);
+        insert(final, i);
+    }
+    sketch_t *recovered = malloc(conf.sketch_size * sizeof(sketch_t));
+    sketch_t *state = malloc(conf.sketch_size * sizeof(sketch_t));
+    if (recovered == NULL || state == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating sketches\n");
+        exit(1);
+    }
+
+    // the newest valid checkpoint is recovered, a damaged one falls back to the other buffer
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    if (checkpoint_write(path, 1, half->sketch, conf.sketch_size, fingerprint) != 0 ||
+        checkpoint_write(path, 2, final->sketch, conf.sketch_size, fingerprint) != 0) {
+        perror("checkpoint_write failed");
+        exit(1);
+    }
+    gettimeofday(&t2, NULL);
+    printf("checkpoint of %lu slots: %.3f ms\n", conf.sketch_size, elapsed_ms(t1, t2) / 2);
+
+    if (checkpoint_recover(path, recovered, conf.sketch_size, fingerprint) != 2 ||
+        memcmp(recovered, final->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: recovery does not load the newest checkpoint\n");
+        ret = 1;
+    }
+    if (checkpoint_recover(path, recovered, conf.sketch_size, fingerprint ^ 1) != 0 ||
+        checkpoint_recover(path, recovered, conf.sketch_size + 1, fingerprint) != 0) {
+        printf("Test failed: a checkpoint of other hash functions or of another size is recovered\n");
+        ret = 1;
+    }
+    corrupt(file0, (off_t) (sizeof(checkpoint_header) + conf.sketch_size / 2 * sizeof(sketch_t)));
+    if (checkpoint_recover(path, recovered, conf.sketch_size, fingerprint) != 1 ||
+        memcmp(recovered, half->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: a corrupted payload is recovered instead of the previous checkpoint\n");
+        ret = 1;
+    }
+    corrupt(file1, (off_t) offsetof(checkpoint_header, sequence));
+    if (checkpoint_recover(path, recovered, conf.sketch_size, fingerprint) != 0) {
+        printf("Test failed: a corrupted header is recovered\n");
+        ret = 1;
+    }
+    if (truncate(file0, sizeof(checkpoint_header) + 8) != 0) {
+        perror("truncate failed for checkpoint");
+        exit(1);
+    }
+    if (checkpoint_read(file0, recovered, conf.sketch_size, fingerprint) != 0) {
+        printf("Test failed: a torn checkpoint is recovered\n");
+        ret = 1;
+    }
+    unlink(file0);
+    unlink(file1);
+
+    // writers alone, then with the checkpointer running every INTERVAL_MS
+    worker_pool pool;
+    worker_pool_start(&pool, writers, NULL, PIN_NONE);
+    engine alone, live;
+    engine_new(&alone, hash_functions);
+    insert_arg arg = {&alone, n, 0};
+    gettimeofday(&t1, NULL);
+    worker_pool_run(&pool, insert_task, &arg);
+    gettimeofday(&t2, NULL);
+    double alone_ms = elapsed_ms(t1, t2);
+
+    engine_new(&live, hash_functions);
+    arg = (insert_arg) {&live, n, 0};
+    checkpointer cp;
+#ifndef QUIESCENT_SOURCE
+    checkpointer_start(&cp, path, ENGINE_SOURCE, live.sketch, conf.sketch_size, fingerprint, INTERVAL_MS);
+#endif
+    gettimeofday(&t1, NULL);
+    worker_pool_submit(&pool, insert_task, &arg);
+
+    // what a crash would leave at any time: a state of the sketch, newer than the one recovered before
+    uint64_t sequence, last = 0, recoveries = 0;
+    while (__atomic_load_n(&arg.done, __ATOMIC_ACQUIRE) < writers) {
+        sequence = checkpoint_recover(path, recovered, conf.sketch_size, fingerprint);
+        if (sequence > 0 && (sequence < last || below(recovered, final->sketch))) {
+            printf("Test failed: checkpoint %lu recovered during the insertions is not a state of the sketch\n", sequence);
+            ret = 1;
+        }
+        last = sequence > last ? sequence : last;
+        recoveries++;
+        usleep(1000);
+    }
+    worker_pool_wait(&pool);
+    gettimeofday(&t2, NULL);
+    engine_state(live.sketch, state);
+#ifdef QUIESCENT_SOURCE
+    checkpointer_start(&cp, path, ENGINE_SOURCE, live.sketch, conf.sketch_size, fingerprint, INTERVAL_MS);
+#endif
+    checkpointer_stop(&cp);
+    printf("%ld insertions by %u writers: %.3f ms alone, %.3f ms with %lu checkpoints written, %lu unchanged, %lu failed\n",
+           n, writers, alone_ms, elapsed_ms(t1, t2), cp.written, cp.skipped, cp.failed);
+
+    // the last checkpoint is taken on stop: nothing inserted is lost
+    sequence = checkpoint_recover(path, recovered, conf.sketch_size, fingerprint);
+    ENGINE_SOURCE(live.sketch, state);
+    if (sequence != cp.sequence || cp.failed || memcmp(recovered, state, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the checkpoint taken on stop is not the last state of the sketch\n");
+        ret = 1;
+    }
+
+    // a new engine restored from the checkpoint and checkpointed again: the numbering goes on from the recovered one
+    engine restored;
+    engine_new(&restored, hash_functions);
+    ENGINE_VALUES_SINK(restored.ctx, 0, recovered);
+    engine_state(restored.sketch, state);
+    if (memcmp(recovered, state, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the restored engine differs from the checkpoint\n");
+        ret = 1;
+    }
+    uint64_t previous = cp.sequence;
+    checkpointer_start(&cp, path, ENGINE_SOURCE, restored.sketch, conf.sketch_size, fingerprint, INTERVAL_MS);
+    uint64_t resumed = cp.sequence;
+    checkpointer_stop(&cp);
+    if (resumed != previous || checkpoint_recover(path, recovered, conf.sketch_size, fingerprint) < previous) {
+        printf("Test failed: checkpoints after a restart are not numbered after the recovered one\n");
+        ret = 1;
+    }
+    worker_pool_stop(&pool);
+    printf("%lu recoveries during the insertions, newest checkpoint %lu\n", recoveries, last);
+
+    unlink(file0);
+    unlink(file1);
+    if (argc <= 4)
+        rmdir(dir);
+    free(state);
+    free(recovered);
+    minhash_free(final);
+    minhash_free(half);
+
+    if (ret == 0)
+        printf("Test passed: checkpoints are recovered newest first, intact and as states of the sketch\n");
+    return ret;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <collection.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+/** Every set of the collection must hold the sketch a standalone minhash_sketch builds from the same elements */
+static int check_against_serial(const sketch_collection *collection, void *hash_functions, const uint64_t *sets, const uint64_t *elems, size_t n, uint64_t set) {
+
+    minhash_sketch *serial;
+    minhash_init(&serial, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    size_t i;
+    for (i = 0; i < n; i++)
+        if (sets[i] == set)
+            insert(serial, elems[i]);
+
+    int ret = memcmp(serial->sketch, collection_sketch(collection, set), conf.sketch_size * sizeof(sketch_t)) != 0;
+    if (ret)
+        printf("set %lu differs from the serial sketch of its elements\n", set);
+    minhash_free(serial);
+    return ret;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 4) {
+        fprintf(stderr,
+            "Usage: %s <number of sets> <number of insertions> <sketch_size>\n", argv[0]);
+        exit(1);
+    }
+
+    long n_sets = parse_arg(argv[1], "n_sets", 2);
+    long n_inserts = parse_arg(argv[2], "n_inserts", 1);
+    long ssize = parse_arg(argv[3], "sketch_size", 1);
+    conf.sketch_size = (uint64_t) ssize;
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    // elements of a few thousand distinct values, spread over random sets
+    uint64_t *sets = malloc(n_inserts * sizeof(uint64_t));
+    uint64_t *elems = malloc(n_inserts * sizeof(uint64_t));
+    if (sets == NULL || elems == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating insertions\n");
+        exit(1);
+    }
+    long i;
+    for (i = 0; i < n_inserts; i++) {
+        sets[i] = (uint64_t) random() % n_sets;
+        elems[i] = (uint64_t) random() % 5000;
+    }
+
+    sketch_collection *single, *concurrent, *batched;
+    collection_init(&single, hash_functions, conf.sketch_size, conf.hash_type, n_sets);
+    collection_init(&concurrent, hash_functions, conf.sketch_size, conf.hash_type, n_sets);
+    collection_init(&batched, hash_functions, conf.sketch_size, conf.hash_type, n_sets);
+
+    struct timeval t1, t2, t3, t4;
+    gettimeofday(&t1, NULL);
+    for (i = 0; i < n_inserts; i++)
+        collection_insert(single, sets[i], elems[i]);
+    gettimeofday(&t2, NULL);
+    for (i = 0; i < n_inserts; i++)
+        collection_insert_concurrent(concurrent, sets[i], elems[i]);
+    gettimeofday(&t3, NULL);
+    collection_insert_batch(batched, sets, elems, n_inserts);
+    gettimeofday(&t4, NULL);
+
+    int ret = 0;
+    size_t slab = n_sets * single->stride * sizeof(sketch_t);
+    if (memcmp(single->slab, concurrent->slab, slab) != 0 || memcmp(single->slab, batched->slab, slab) != 0) {
+        printf("Test failed: single, concurrent and batched insertion give different collections\n");
+        ret = 1;
+    }
+    uint64_t set;
+    for (set = 0; set < 4; set++)
+        if (check_against_serial(batched, hash_functions, sets, elems, n_inserts, set)) ret = 1;
+
+    // the bulk query must agree with the pairwise one
+    float *similarities = malloc(n_sets * sizeof(float));
+    if (similarities == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating similarities\n");
+        exit(1);
+    }
+    struct timeval q1, q2;
+    gettimeofday(&q1, NULL);
+    collection_query_all(batched, collection_sketch(batched, 0), similarities);
+    gettimeofday(&q2, NULL);
+    for (set = 0; set < (uint64_t) n_sets; set++) {
+        if (similarities[set] != collection_query(batched, 0, set)) {
+            printf("Test failed: bulk query of set %lu gives %f instead of %f\n", set, similarities[set], collection_query(batched, 0, set));
+            ret = 1;
+            break;
+        }
+    }
+    if (similarities[0] != 1.0f) {
+        printf("Test failed: set 0 is not identical to itself\n");
+        ret = 1;
+    }
+
+    printf("%ld insertions into %ld sets of %ld slots (slab %.1f MB)\n", n_inserts, n_sets, ssize, slab / 1048576.0);
+    printf("Insert: single %.3f ms, concurrent %.3f ms, batched by set %.3f ms\n",
+           elapsed_ms(t1, t2), elapsed_ms(t2, t3), elapsed_ms(t3, t4));
+    printf("Bulk query over all sets: %.3f ms\n", elapsed_ms(q1, q2));
+
+    collection_free(single);
+    collection_free(concurrent);
+    collection_free(batched);
+    free(similarities);
+    free(sets);
+    free(elems);
+
+    if (ret == 0)
+        printf("Test passed: collection sketches match the serial ones\n");
+    return ret;
+}
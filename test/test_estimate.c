@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <collection.h>
+#include <estimate.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 1024,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+#ifdef FCDS
+void *propagator_routine(void *arg) {
+    propagator((fcds_sketch *) arg);
+    return NULL;
+}
+#endif
+
+
+// relative error allowed: about five standard deviations of the estimators for the sketch size
+static double tolerance;
+
+static int check(const char *name, double estimate, double expected) {
+
+    double error = expected == 0 ? estimate : fabs(estimate - expected) / expected;
+    printf("%-24s %14.4f expected %14.4f\n", name, estimate, expected);
+    if (error > tolerance) {
+        printf("Test failed: %s is %.2f instead of %.2f\n", name, estimate, expected);
+        return 1;
+    }
+    return 0;
+}
+
+static int check_pair(const set_estimates *e, double a, double b, double common) {
+
+    int ret = 0;
+    ret |= check("cardinality", e->cardinality, a);
+    ret |= check("other cardinality", e->other_cardinality, b);
+    ret |= check("union", e->union_size, a + b - common);
+    ret |= check("jaccard", e->jaccard, common / (a + b - common));
+    ret |= check("intersection", e->intersection, common);
+    ret |= check("containment", e->containment, common / a);
+    ret |= check("other containment", e->other_containment, common / b);
+    return ret;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> [sketch_size]\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 4);
+    if (argc > 2) conf.sketch_size = (uint64_t) parse_arg(argv[2], "sketch_size", 16);
+    read_configuration(conf);
+    tolerance = 5.0 / sqrt((double) conf.sketch_size);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    uint64_t M = hash_functions_modulus(hash_functions, conf.hash_type);
+
+    // A = [0, n) and B = [n/2, n/2 + n): n/2 elements in common
+    uint64_t *elems = malloc((n + n / 2) * sizeof(uint64_t));
+    if (elems == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating elements\n");
+        exit(1);
+    }
+    long i;
+    for (i = 0; i < n + n / 2; i++)
+        elems[i] = (uint64_t) i;
+
+    minhash_sketch *a, *b, *small, *empty;
+    minhash_init(&a, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&b, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&small, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&empty, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    insert_batch(a, elems, n);
+    insert_batch(b, elems + n / 2, n);
+    insert_batch(small, elems, 10);
+
+    int ret = 0;
+    set_estimates e;
+
+    printf("--- serial sketches, |A| = |B| = %ld, %ld in common\n", n, n / 2);
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    estimate_sets(a->sketch, b->sketch, conf.sketch_size, M, &e);
+    gettimeofday(&t2, NULL);
+    ret |= check_pair(&e, n, n, n / 2);
+    printf("estimate_sets on %lu slots: %.3f ms\n", conf.sketch_size, elapsed_ms(t1, t2));
+
+    if (estimate_union(a->sketch, b->sketch, conf.sketch_size, M) != e.union_size ||
+        estimate_cardinality(a->sketch, conf.sketch_size, M) != e.cardinality) {
+        printf("Test failed: estimate_union and estimate_cardinality disagree with estimate_sets\n");
+        ret = 1;
+    }
+
+    ret |= check("small cardinality", estimate_cardinality(small->sketch, conf.sketch_size, M), 10);
+    if (estimate_cardinality(empty->sketch, conf.sketch_size, M) != 0) {
+        printf("Test failed: an empty sketch has a non zero cardinality\n");
+        ret = 1;
+    }
+    estimate_sets(a->sketch, empty->sketch, conf.sketch_size, M, &e);
+    if (e.other_cardinality != 0 || e.intersection != 0 || e.jaccard != 0) {
+        printf("Test failed: estimates against an empty sketch must be 0\n");
+        ret = 1;
+    }
+
+    // the engine wrappers read the sketch in place and must agree with the kernel
+    estimate_minhash(a, NULL, &e);
+    if (e.cardinality != estimate_cardinality(a->sketch, conf.sketch_size, M) || e.union_size != 0) {
+        printf("Test failed: estimate_minhash without other sketch\n");
+        ret = 1;
+    }
+
+    sketch_collection *collection;
+    collection_init(&collection, hash_functions, conf.sketch_size, conf.hash_type, 2);
+    uint64_t *sets = calloc(n + n / 2, sizeof(uint64_t));
+    if (sets == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating sets\n");
+        exit(1);
+    }
+    collection_insert_batch(collection, sets, elems, n);
+    for (i = 0; i < n; i++)
+        sets[i] = 1;
+    collection_insert_batch(collection, sets, elems + n / 2, n);
+    set_estimates reference, ce;
+    estimate_sets(a->sketch, b->sketch, conf.sketch_size, M, &reference);
+    collection_estimate(collection, 0, 1, &ce);
+    if (memcmp(&ce, &reference, sizeof(set_estimates)) != 0) {
+        printf("Test failed: collection_estimate differs from the estimates of the serial sketches\n");
+        ret = 1;
+    }
+
+    // the engine of this build, filled by one writer through its ingestion sink
+#if defined(CONC_MINHASH)
+    printf("--- concurrent engine\n");
+    conc_minhash *engine;
+    init_conc_minhash(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1, 100);
+    conc_minhash_sink(engine, 0, elems, n);
+    concurrent_estimate(engine, b->sketch, &e);
+#elif defined(FCDS)
+    printf("--- FCDS engine\n");
+    fcds_sketch *engine;
+    init_fcds(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1, 100);
+    fcds_writer writer = {engine, 0};
+    // the propagator never returns, it is left running until the process exits
+    pthread_t prop_thread;
+    if (pthread_create(&prop_thread, NULL, propagator_routine, engine)) {
+        fprintf(stderr, "Error creating propagator thread\n");
+        exit(1);
+    }
+    fcds_sink(&writer, 0, elems, n);
+    estimate_fcds(engine, b->sketch, &e);
+#elif defined(FLAT_COMBINING)
+    printf("--- flat combining engine\n");
+    fc_minhash *engine;
+    init_fc_minhash(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1);
+    fc_minhash_sink(engine, 0, elems, n);
+    estimate_fc_minhash(engine, b->sketch, &e);
+#elif defined(SHARDED)
+    printf("--- sharded engine\n");
+    sharded_minhash *engine;
+    init_sharded_minhash(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1);
+    sharded_minhash_sink(engine, 0, elems, n);
+    estimate_sharded_minhash(engine, b->sketch, &e);
+#elif defined(LOCKS) || defined(RW_LOCKS)
+    printf("--- lock-based engine\n");
+    minhash_sketch *engine;
+    minhash_init(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_parallel_sink(engine, 0, elems, n);
+    estimate_parallel(engine, b->sketch, &e);
+#else
+    printf("--- serial engine\n");
+    estimate_minhash(a, b->sketch, &e);
+#endif
+    ret |= check_pair(&e, n, n, n / 2);
+
+    collection_free(collection);
+    free(sets);
+    free(elems);
+    minhash_free(a);
+    minhash_free(b);
+    minhash_free(small);
+    minhash_free(empty);
+
+    if (ret == 0)
+        printf("Test passed: cardinality, union, intersection and containment estimates within %.1f%%\n", tolerance * 100);
+    return ret;
+}
@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <collection.h>
+#include <fanout.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 256,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+#define N_TARGETS 4
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+#ifdef FCDS
+void *propagator_routine(void *arg) {
+    propagator((fcds_sketch *) arg);
+    return NULL;
+}
+#endif
+
+
+static int check_sketch(const char *name, const sketch_t *sketch, const sketch_t *expected) {
+
+    if (memcmp(sketch, expected, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: %s differs from the sketch built by plain insertion\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr,
+            "Usage: %s <number of insertions> [sketch_size]\n", argv[0]);
+        exit(1);
+    }
+
+    long n_inserts = parse_arg(argv[1], "n_inserts", 1);
+    if (argc > 2) conf.sketch_size = (uint64_t) parse_arg(argv[2], "sketch_size", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    // reference: one sketch built by plain insertion
+    minhash_sketch *reference;
+    minhash_init(&reference, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    long i;
+    for (i = 0; i < n_inserts; i++)
+        insert(reference, i);
+
+    // targets: a serial sketch, a set of a collection and the engine of this build, all fed by one hash per element
+    minhash_sketch *serial;
+    minhash_init(&serial, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    sketch_collection *collection;
+    collection_init(&collection, hash_functions, conf.sketch_size, conf.hash_type, 16);
+    collection_slot slot = {collection, 7};
+
+    fanout_target targets[3] = {
+        {minhash_values_sink, serial},
+        {collection_values_sink, &slot},
+        {NULL, NULL},
+    };
+
+#if defined(CONC_MINHASH)
+    conc_minhash *engine;
+    init_conc_minhash(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1, 100);
+    targets[2] = (fanout_target) {conc_minhash_values_sink, engine};
+#elif defined(FCDS)
+    fcds_sketch *engine;
+    init_fcds(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1, 100);
+    fcds_writer writer = {engine, 0};
+    // the propagator never returns, it is left running until the process exits
+    pthread_t prop_thread;
+    if (pthread_create(&prop_thread, NULL, propagator_routine, engine)) {
+        fprintf(stderr, "Error creating propagator thread\n");
+        exit(1);
+    }
+    targets[2] = (fanout_target) {fcds_values_sink, &writer};
+#elif defined(FLAT_COMBINING)
+    fc_minhash *engine;
+    init_fc_minhash(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1);
+    targets[2] = (fanout_target) {fc_minhash_values_sink, engine};
+#elif defined(SHARDED)
+    sharded_minhash *engine;
+    init_sharded_minhash(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type, 1);
+    targets[2] = (fanout_target) {sharded_minhash_values_sink, engine};
+#elif defined(LOCKS) || defined(RW_LOCKS)
+    minhash_sketch *engine;
+    minhash_init(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    targets[2] = (fanout_target) {minhash_parallel_values_sink, engine};
+#else
+    minhash_sketch *engine;
+    minhash_init(&engine, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    targets[2] = (fanout_target) {minhash_values_sink, engine};
+#endif
+
+    hash_vector vector;
+    hash_vector_init(&vector, hash_functions, conf.hash_type, conf.sketch_size);
+    for (i = 0; i < n_inserts; i++)
+        fanout_insert(&vector, targets, 3, 0, i);
+
+    int ret = 0;
+    ret |= check_sketch("serial target", serial->sketch, reference->sketch);
+    ret |= check_sketch("collection target", collection_sketch(collection, 7), reference->sketch);
+
+#if defined(CONC_MINHASH)
+    // the pending insertions included
+    sketch_t result[conf.sketch_size];
+    conc_minhash_snapshot(engine, result);
+#elif defined(FCDS)
+    sketch_t result[conf.sketch_size];
+    uint64_t s;
+    for (s = 0; s < conf.sketch_size; s++)
+        result[s] = engine->global_sketch[s] < engine->local_sketches[0][s] ? engine->global_sketch[s] : engine->local_sketches[0][s];
+#elif defined(FLAT_COMBINING)
+    sketch_t *result = engine->sketch;
+#elif defined(SHARDED)
+    sketch_t result[conf.sketch_size];
+    sharded_snapshot(engine, result);
+#else
+    sketch_t *result = engine->sketch;
+#endif
+    ret |= check_sketch("engine target", result, reference->sketch);
+
+    // cost of N_TARGETS targets: one hash vector applied to each, against one insertion per target
+    minhash_sketch *sketches[N_TARGETS];
+    fanout_target serial_targets[N_TARGETS];
+    int t;
+    for (t = 0; t < N_TARGETS; t++) {
+        minhash_init(&sketches[t], hash_functions, conf.sketch_size, 0, conf.hash_type);
+        serial_targets[t] = (fanout_target) {minhash_values_sink, sketches[t]};
+    }
+    struct timeval t1, t2, t3;
+    gettimeofday(&t1, NULL);
+    for (i = 0; i < n_inserts; i++)
+        for (t = 0; t < N_TARGETS; t++)
+            insert(sketches[t], i);
+    gettimeofday(&t2, NULL);
+    for (i = 0; i < n_inserts; i++)
+        fanout_insert(&vector, serial_targets, N_TARGETS, 0, i);
+    gettimeofday(&t3, NULL);
+
+    printf("%ld insertions into %d sketches of %lu slots: separate %.3f ms, fan-out %.3f ms\n",
+           n_inserts, N_TARGETS, conf.sketch_size, elapsed_ms(t1, t2), elapsed_ms(t2, t3));
+
+    for (t = 0; t < N_TARGETS; t++)
+        minhash_free(sketches[t]);
+    hash_vector_free(&vector);
+    collection_free(collection);
+    minhash_free(serial);
+    minhash_free(reference);
+
+    if (ret == 0)
+        printf("Test passed: fan-out insertion matches plain insertion on every target\n");
+    return ret;
+}
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <ingest.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 2,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+#if defined(FCDS) || defined(CONC_MINHASH) || defined(FLAT_COMBINING) || defined(SHARDED)
+    .N = 0,
+    .b = 0,
+#endif
+};
+
+
+/** Sink accumulating the number of keys and their sum, safe for concurrent writers */
+typedef struct key_summary {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+} key_summary;
+
+static void summary_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    (void) tid;
+    key_summary *s = (key_summary *) ctx;
+    uint64_t sum = 0;
+    size_t i;
+    for (i = 0; i < n; i++)
+        sum += keys[i];
+    __atomic_fetch_add(&s->count, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->sum, sum, __ATOMIC_RELAXED);
+}
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+/** Write the keys 0 .. n_keys-1 in the given format, returns the expected sum of the keys read back */
+static uint64_t write_key_file(const char *path, uint32_t format, long n_keys) {
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("fopen failed for key file");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t sum = 0;
+    long i;
+    for (i = 0; i < n_keys; i++) {
+        uint64_t key = (uint64_t) i;
+        switch (format) {
+        case INGEST_BINARY:
+            fwrite(&key, sizeof(key), 1, f);
+            sum += key;
+            break;
+        case INGEST_DECIMAL:
+            // Windows line endings and empty lines must be tolerated
+            fprintf(f, i % 1000 == 0 ? "%lu\r\n\n" : "%lu\n", key);
+            sum += key;
+            break;
+        default: {
+            char line[32];
+            int len = snprintf(line, sizeof(line), "key-%lu", key);
+            fprintf(f, "%s\n", line);
+            sum += prehash64(line, len, 0);
+            break;
+            }
+        }
+    }
+    fclose(f);
+    return sum;
+}
+
+
+/** Compare a sketch built by the engine with the serial sketch of the keys 0 .. n_keys-1 */
+static int compare_with_serial(const sketch_t *engine_sketch, void *hash_functions, long n_keys) {
+
+    minhash_sketch *serial_sketch;
+    minhash_init(&serial_sketch, hash_functions, conf.sketch_size, 0, conf.hash_type);
+
+    long i;
+    for (i = 0; i < n_keys; i++)
+        insert(serial_sketch, i);
+
+    uint64_t s, count = 0;
+    for (s = 0; s < conf.sketch_size; s++)
+        count += serial_sketch->sketch[s] == engine_sketch[s];
+
+    minhash_free(serial_sketch);
+    if (count != conf.sketch_size) {
+        printf("Test failed: %lu/%lu slots match the serial sketch\n", count, conf.sketch_size);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+                "Usage: %s <number of keys> <num_threads> [binary key file]\n",
+                argv[0]);
+        return 1;
+    }
+
+    long n_keys = parse_arg(argv[1], "n_keys", 1);
+    long num_threads = parse_arg(argv[2], "num_threads", 1);
+
+    read_configuration(conf);
+
+    int ret = 0;
+    char path[] = "/tmp/minhash_keysXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp failed for key file");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    // every format, split across 1 .. num_threads writers, must deliver every key exactly once
+    static const char *format_names[] = {"binary", "decimal", "lines"};
+    uint32_t format;
+    for (format = INGEST_BINARY; format <= INGEST_LINES; format++) {
+        uint64_t expected = write_key_file(path, format, n_keys);
+        ingest_file file;
+        ingest_file_open(&file, path, format);
+
+        long t;
+        for (t = 1; t <= num_threads; t++) {
+            key_summary summary = {0, 0};
+            uint64_t n = ingest_file_parallel(&file, t, summary_sink, &summary, 0);
+            if (n != (uint64_t) n_keys || summary.count != (uint64_t) n_keys || summary.sum != expected) {
+                printf("Test failed: %s file with %ld writers, %lu/%ld keys\n", format_names[format], t, (uint64_t) summary.count, n_keys);
+                ret = 1;
+            }
+        }
+        ingest_file_close(&file);
+    }
+
+    // feed the engine of this build with num_threads writers and check the result
+    const char *source = argc > 3 ? argv[3] : path;
+    if (argc <= 3)
+        write_key_file(path, INGEST_BINARY, n_keys);
+
+    ingest_file file;
+    ingest_file_open(&file, source, INGEST_BINARY);
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    struct timeval t1, t2;
+    uint64_t n;
+    long writers = num_threads;
+
+#if defined(CONC_MINHASH)
+    conc_minhash *sketch;
+    init_conc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, num_threads, 1000);
+    gettimeofday(&t1, NULL);
+    n = ingest_file_parallel(&file, num_threads, conc_minhash_sink, sketch, 0);
+    gettimeofday(&t2, NULL);
+
+    // slots are the minimum of the query and the insertion sketch
+    sketch_t result[conf.sketch_size];
+    uint64_t s;
+    for (s = 0; s < conf.sketch_size; s++)
+        result[s] = sketch->sketches[0]->sketch[s] < sketch->sketches[1]->sketch[s] ? sketch->sketches[0]->sketch[s] : sketch->sketches[1]->sketch[s];
+#elif defined(FLAT_COMBINING)
+    fc_minhash *sketch;
+    init_fc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, num_threads);
+    gettimeofday(&t1, NULL);
+    n = ingest_file_parallel(&file, num_threads, fc_minhash_sink, sketch, 0);
+    gettimeofday(&t2, NULL);
+    sketch_t *result = sketch->sketch;
+#elif defined(SHARDED)
+    sharded_minhash *sketch;
+    init_sharded_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, num_threads);
+    gettimeofday(&t1, NULL);
+    n = ingest_file_parallel(&file, num_threads, sharded_minhash_sink, sketch, 0);
+    gettimeofday(&t2, NULL);
+    sketch_t result[conf.sketch_size];
+    sharded_snapshot(sketch, result);
+#else
+    // engines without a standalone writer path are fed through the serial sketch by a single writer
+    minhash_sketch *sketch;
+    minhash_init(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    writers = 1;
+    gettimeofday(&t1, NULL);
+    n = ingest_file_parallel(&file, writers, minhash_sink, sketch, 0);
+    gettimeofday(&t2, NULL);
+    sketch_t *result = sketch->sketch;
+#endif
+
+    printf("Ingested %lu keys (%.1f MB) with %ld writers in %.3f ms: %.1f MB/s\n",
+           n, file.len / 1e6, writers, elapsed_ms(t1, t2), file.len / 1e3 / elapsed_ms(t1, t2));
+
+    if (argc <= 3 && compare_with_serial(result, hash_functions, n_keys))
+        ret = 1;
+
+    ingest_file_close(&file);
+    unlink(path);
+
+    if (ret == 0)
+        printf("Test passed: key files are ingested completely and the sketch matches the serial one\n");
+    return ret;
+}
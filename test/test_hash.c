@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 1024,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 0,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+static const char *hash_names[] = {"pairwise", "k-wise", "simple tabulation", "twisted tabulation"};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+/** Check that the multi-slot kernel agrees with the per slot hash functions and stays below the modulus */
+static int check_hash_values(void *hash_functions, uint32_t hash_type, uint64_t size) {
+
+    sketch_t values[size];
+    uint64_t t, i;
+    for (t = 0; t < 1000; t++) {
+        uint64_t x = t < 500 ? t : ((uint64_t) random() << 33) ^ (uint64_t) random();
+        hash_values(hash_functions, hash_type, 0, size, x, values);
+        for (i = 0; i < size; i++) {
+            uint64_t expected;
+            switch (hash_type) {
+            case 1: expected = ((kwise_hash *) hash_functions)[i].hash_function(&((kwise_hash *) hash_functions)[i], x); break;
+            case 2:
+            case 3: expected = ((tabulation_hash *) hash_functions)[i].hash_function(&((tabulation_hash *) hash_functions)[i], x); break;
+            default: expected = ((pairwise_hash *) hash_functions)[i].hash_function(&((pairwise_hash *) hash_functions)[i], x); break;
+            }
+            if (values[i] != expected || values[i] >= conf.prime_modulus) {
+                printf("slot %lu of %lu: kernel %lu, hash function %lu\n", i, x, (uint64_t) values[i], expected);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of insertions> <sketch_size>\n", argv[0]);
+        exit(1);
+    }
+
+    long n_inserts = parse_arg(argv[1], "n_inserts", 2);
+    long ssize = parse_arg(argv[2], "sketch_size", 1);
+
+    conf.sketch_size = (uint64_t) ssize;
+    read_configuration(conf);
+
+    int ret = 0;
+    uint32_t hash_type;
+    for (hash_type = 0; hash_type < 4; hash_type++) {
+        minhash_sketch *sketch;
+        minhash_sketch *sketch2;
+
+        conf.hash_type = hash_type;
+        void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+        if (check_hash_values(hash_functions, hash_type, conf.sketch_size)) {
+            printf("Test failed: %s kernel differs from the hash functions\n", hash_names[hash_type]);
+            ret = 1;
+        }
+
+        minhash_init(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type);
+        minhash_init(&sketch2, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type);
+
+        // the two sets overlap on half of each, so their Jaccard similarity is 1/3
+        struct timeval t1, t2;
+        gettimeofday(&t1, NULL);
+        long i;
+        for (i = 0; i < n_inserts; i++) {
+            insert(sketch, i);
+            insert(sketch2, i + n_inserts / 2);
+        }
+        gettimeofday(&t2, NULL);
+
+        float similarity = query(sketch, sketch2);
+        printf("%-20s: similarity %.4f, %ld inserts in %.3f ms\n",
+               hash_names[hash_type], similarity, 2 * n_inserts, elapsed_ms(t1, t2));
+
+        if (similarity < 1.0f / 3 - 0.1f || similarity > 1.0f / 3 + 0.1f) {
+            printf("Test failed: %s similarity %.4f too far from 1/3\n", hash_names[hash_type], similarity);
+            ret = 1;
+        }
+
+        minhash_free(sketch);
+        minhash_free(sketch2);
+    }
+
+    if (ret == 0)
+        printf("Test passed: all hash families agree with their kernels and estimate the similarity\n");
+    return ret;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <ingest.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 2,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+
+/** Sink collecting the keys, used to check the shingling */
+typedef struct key_buffer {
+    uint64_t *keys;
+    size_t n;
+    size_t capacity;
+    uint64_t calls;
+} key_buffer;
+
+static void collect_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    (void) tid;
+    key_buffer *buf = (key_buffer *) ctx;
+    assert(n > 0 && n <= INGEST_BATCH);
+    assert(buf->n + n <= buf->capacity);
+    memcpy(buf->keys + buf->n, keys, n * sizeof(uint64_t));
+    buf->n += n;
+    buf->calls++;
+}
+
+static void null_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    (void) ctx; (void) tid; (void) keys; (void) n;
+}
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+static int check_prehash(void) {
+
+    uint8_t data[64];
+    uint64_t hashes[2 * 65];
+    uint32_t i, j;
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = (uint8_t) (i * 37 + 11);
+
+    for (i = 0; i <= sizeof(data); i++) {
+        hashes[i] = prehash64(data, i, 0);
+        hashes[65 + i] = prehash64(data, i, 42);
+        if (hashes[i] != prehash64(data, i, 0)) {
+            printf("prehash64 is not deterministic on length %u\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < 2 * 65; i++)
+        for (j = i + 1; j < 2 * 65; j++)
+            if (hashes[i] == hashes[j]) {
+                printf("prehash64 collision between %u and %u\n", i, j);
+                return 1;
+            }
+    return 0;
+}
+
+
+/** The rolling hash of each window must be the hash of the window ingested on its own */
+static int check_char_shingles(const char *text, uint32_t k) {
+
+    size_t len = strlen(text);
+    uint64_t keys[len + 1], single[1];
+    key_buffer buf = {keys, 0, len + 1, 0};
+    key_buffer one = {single, 0, 1, 0};
+    ingest_conf c = {SHINGLE_CHAR, k, 7, collect_sink, &buf};
+    ingest_conf c1 = {SHINGLE_CHAR, k, 7, collect_sink, &one};
+
+    uint64_t n = ingest_document(&c, 0, text, len);
+    if (n != (len >= k ? len - k + 1 : 1) || n != buf.n) {
+        printf("char shingles: %lu keys from %zu bytes with k = %u\n", n, len, k);
+        return 1;
+    }
+
+    size_t i;
+    for (i = 0; i + k <= len; i++) {
+        one.n = 0;
+        ingest_document(&c1, 0, text + i, k);
+        if (single[0] != keys[i]) {
+            printf("char shingles: rolling key %zu differs from the key of the window\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int check_word_shingles(void) {
+
+    const char *a = "The quick  brown fox, jumps over\tthe lazy dog!";
+    const char *b = "  The quick brown\nfox jumps -- over the lazy dog";
+    uint64_t ka[16], kb[16], kc[16];
+    key_buffer bufa = {ka, 0, 16, 0}, bufb = {kb, 0, 16, 0}, bufc = {kc, 0, 16, 0};
+    ingest_conf ca = {SHINGLE_WORD, 3, 7, collect_sink, &bufa};
+    ingest_conf cb = {SHINGLE_WORD, 3, 7, collect_sink, &bufb};
+    ingest_conf cc = {SHINGLE_WORD, 3, 7, collect_sink, &bufc};
+
+    ingest_document(&ca, 0, a, strlen(a));
+    ingest_document(&cb, 0, b, strlen(b));
+    if (bufa.n != 7 || bufb.n != 7 || memcmp(ka, kb, 7 * sizeof(uint64_t)) != 0) {
+        printf("word shingles depend on the separators (%zu, %zu keys)\n", bufa.n, bufb.n);
+        return 1;
+    }
+
+    // the shingle "brown fox jumps" is the same wherever it appears
+    ingest_document(&cc, 0, "brown fox jumps", 15);
+    if (bufc.n != 1 || kc[0] != ka[2]) {
+        printf("word shingles: rolling key differs from the key of the window\n");
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <text size in KB> <shingle length>\n", argv[0]);
+        exit(1);
+    }
+
+    long kbytes = parse_arg(argv[1], "text size", 1);
+    long k = parse_arg(argv[2], "shingle length", 1);
+
+    read_configuration(conf);
+
+    int ret = 0;
+    if (check_prehash()) ret = 1;
+    if (check_char_shingles("abcabcabcabcabc", 3) || check_char_shingles("ab", 3) || check_char_shingles("abcdefghijklmnopqrstuvwxyz0123456789", 12)) ret = 1;
+    if (check_word_shingles()) ret = 1;
+
+    // pseudo random text of words of 1 to 8 letters
+    size_t len = (size_t) kbytes * 1024;
+    char *text = malloc(len);
+    if (text == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating text\n");
+        exit(1);
+    }
+    unsigned int state = 1;
+    size_t i = 0;
+    while (i < len) {
+        int w = 1 + rand_r(&state) % 8;
+        while (w-- > 0 && i < len)
+            text[i++] = 'a' + rand_r(&state) % 26;
+        if (i < len)
+            text[i++] = ' ';
+    }
+
+    // keys fed through the sink in batches must give the same sketch as inserting them one by one
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    minhash_sketch *sketch, *sketch2;
+    minhash_init(&sketch, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type);
+    minhash_init(&sketch2, hash_functions, conf.sketch_size, conf.init_size, conf.hash_type);
+
+    key_buffer buf = {malloc(len * sizeof(uint64_t)), 0, len, 0};
+    if (buf.keys == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating keys\n");
+        exit(1);
+    }
+    ingest_conf collect = {SHINGLE_CHAR, (uint32_t) k, 0, collect_sink, &buf};
+    ingest_conf to_sketch = {SHINGLE_CHAR, (uint32_t) k, 0, minhash_sink, sketch};
+    ingest_document(&collect, 0, text, len);
+    ingest_document(&to_sketch, 0, text, len);
+    for (i = 0; i < buf.n; i++)
+        insert(sketch2, buf.keys[i]);
+    if (buf.calls < buf.n / INGEST_BATCH || query(sketch, sketch2) != 1.0f) {
+        printf("Test failed: sketch fed by the sink differs from the one built from the keys\n");
+        ret = 1;
+    }
+
+    // throughput of the shingling alone and of the full pipeline into the sketch
+    uint32_t mode;
+    for (mode = SHINGLE_CHAR; mode <= SHINGLE_WORD; mode++) {
+        ingest_conf shingle_only = {mode, (uint32_t) k, 0, null_sink, NULL};
+        ingest_conf full = {mode, (uint32_t) k, 0, minhash_sink, sketch};
+        struct timeval t1, t2, t3;
+
+        gettimeofday(&t1, NULL);
+        uint64_t n = ingest_document(&shingle_only, 0, text, len);
+        gettimeofday(&t2, NULL);
+        ingest_document(&full, 0, text, len);
+        gettimeofday(&t3, NULL);
+
+        printf("%s %ld-shingles: %lu keys, shingling %.1f MB/s, into the sketch %.1f MB/s\n",
+               mode == SHINGLE_CHAR ? "char" : "word", k, n,
+               len / 1e3 / elapsed_ms(t1, t2), len / 1e3 / elapsed_ms(t2, t3));
+    }
+
+    free(buf.keys);
+    free(text);
+    minhash_free(sketch);
+    minhash_free(sketch2);
+
+    if (ret == 0)
+        printf("Test passed: shingles and batched insertion are consistent\n");
+    return ret;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <collection.h>
+#include <search.h>
+#include <runtime.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+// set s holds [s STEP, s STEP + ELEMS): sets d apart have similarity (ELEMS - d STEP) / (ELEMS + d STEP)
+#define STEP 8
+#define ELEMS 256
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+typedef struct pair_matrix {
+    uint64_t n_sets;
+    _Atomic uint8_t *seen;     /// seen[a * n_sets + b]: times pair (a, b) was emitted
+    int wrong;                 /// pairs emitted out of order or with a wrong similarity
+    const sketch_collection *collection;
+} pair_matrix;
+
+static void matrix_sink(void *ctx, uint32_t tid, uint64_t set, uint64_t other_set, float similarity) {
+    (void) tid;
+    pair_matrix *m = (pair_matrix *) ctx;
+    if (set >= other_set || other_set >= m->n_sets || similarity != collection_query(m->collection, set, other_set)) {
+        __atomic_fetch_add(&m->wrong, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_fetch_add(&m->seen[set * m->n_sets + other_set], 1, __ATOMIC_RELAXED);
+}
+
+/** Every pair at or above threshold in the nested query loop must have been emitted once, no other pair */
+static int check_pairs(const char *name, pair_matrix *m, const uint8_t *expected, uint64_t pairs, uint64_t expected_pairs) {
+
+    uint64_t a, b;
+    int ret = m->wrong != 0 || pairs != expected_pairs;
+    for (a = 0; a < m->n_sets; a++)
+        for (b = a + 1; b < m->n_sets; b++)
+            ret |= m->seen[a * m->n_sets + b] != expected[a * m->n_sets + b];
+    if (ret)
+        printf("%s: %lu pairs instead of %lu, %d wrong\n", name, pairs, expected_pairs, m->wrong);
+    memset((void *) m->seen, 0, m->n_sets * m->n_sets);
+    m->wrong = 0;
+    return ret;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 4) {
+        fprintf(stderr,
+            "Usage: %s <number of sets> <threshold> <num_threads> [sketch_size]\n", argv[0]);
+        exit(1);
+    }
+
+    long n_sets = parse_arg(argv[1], "n_sets", 2);
+    float threshold = atof(argv[2]);
+    long num_threads = parse_arg(argv[3], "num_threads", 1);
+    if (argc > 4) conf.sketch_size = (uint64_t) parse_arg(argv[4], "sketch_size", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    sketch_collection *collection;
+    collection_init(&collection, hash_functions, conf.sketch_size, conf.hash_type, n_sets);
+    uint64_t a, b, e;
+    for (a = 0; a < (uint64_t) n_sets; a++)
+        for (e = 0; e < ELEMS; e++)
+            collection_insert(collection, a, a * STEP + e);
+
+    // the nested query loop
+    uint8_t *expected = calloc(n_sets * n_sets, 1);
+    pair_matrix matrix = {n_sets, calloc(n_sets * n_sets, 1), 0, collection};
+    if (expected == NULL || matrix.seen == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating pair matrices\n");
+        exit(1);
+    }
+    struct timeval t1, t2, t3, t4;
+    uint64_t expected_pairs = 0;
+    gettimeofday(&t1, NULL);
+    for (a = 0; a < (uint64_t) n_sets; a++)
+        for (b = a + 1; b < (uint64_t) n_sets; b++)
+            if (collection_query(collection, a, b) >= threshold) {
+                expected[a * n_sets + b] = 1;
+                expected_pairs++;
+            }
+    gettimeofday(&t2, NULL);
+
+    int ret = 0;
+    uint64_t pairs = collection_join(collection, threshold, matrix_sink, &matrix, NULL);
+    gettimeofday(&t3, NULL);
+    ret |= check_pairs("serial join", &matrix, expected, pairs, expected_pairs);
+
+    worker_pool pool;
+    worker_pool_start(&pool, num_threads, NULL, PIN_NONE);
+    gettimeofday(&t4, NULL);
+    pairs = collection_join(collection, threshold, matrix_sink, &matrix, &pool);
+    struct timeval t5;
+    gettimeofday(&t5, NULL);
+    ret |= check_pairs("parallel join", &matrix, expected, pairs, expected_pairs);
+    printf("%lu pairs of %ld sets of %lu slots at similarity >= %.2f: nested queries %.3f ms, join %.3f ms, %ld workers %.3f ms\n",
+           expected_pairs, n_sets, conf.sketch_size, threshold, elapsed_ms(t1, t2), elapsed_ms(t2, t3), num_threads, elapsed_ms(t4, t5));
+
+    // threshold 0 emits every pair, above 1 none
+    uint64_t all = (uint64_t) n_sets * (n_sets - 1) / 2;
+    for (a = 0; a < (uint64_t) n_sets; a++)
+        for (b = a + 1; b < (uint64_t) n_sets; b++)
+            expected[a * n_sets + b] = 1;
+    pairs = collection_join(collection, 0, matrix_sink, &matrix, &pool);
+    ret |= check_pairs("join at 0", &matrix, expected, pairs, all);
+    memset(expected, 0, n_sets * n_sets);
+    pairs = collection_join(collection, 1.5f, matrix_sink, &matrix, &pool);
+    ret |= check_pairs("join above 1", &matrix, expected, pairs, 0);
+
+    worker_pool_stop(&pool);
+    free((void *) matrix.seen);
+    free(expected);
+    collection_free(collection);
+
+    if (ret == 0)
+        printf("Test passed: serial and parallel joins emit the pairs of the nested query loop\n");
+    return ret;
+}
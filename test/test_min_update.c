@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <runtime.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 1024,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+/** n hash vectors of size slots, values below the modulus */
+static sketch_t *random_vectors(uint64_t n, uint64_t size) {
+
+    sketch_t *vectors = malloc(n * size * sizeof(sketch_t));
+    if (vectors == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating hash vectors\n");
+        exit(1);
+    }
+    uint64_t i;
+    for (i = 0; i < n * size; i++)
+        vectors[i] = (sketch_t) ((uint64_t) random() % conf.prime_modulus);
+    return vectors;
+}
+
+static void fill_infty(sketch_t *sketch, uint64_t size) {
+    uint64_t i;
+    for (i = 0; i < size; i++)
+        sketch[i] = INFTY;
+}
+
+
+/** One writer: both kernels leave the same sketch, and the CAS kernel counts exactly the slots that changed */
+static int check_single_writer(const sketch_t *vectors, uint64_t n, uint64_t size) {
+
+    sketch_t *serial = malloc(size * sizeof(sketch_t));
+    sketch_t *concurrent = malloc(size * sizeof(sketch_t));
+    if (serial == NULL || concurrent == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating sketches\n");
+        exit(1);
+    }
+    fill_infty(serial, size);
+    fill_infty(concurrent, size);
+
+    uint64_t v, i;
+    int ret = 0;
+    for (v = 0; v < n && ret == 0; v++) {
+        const sketch_t *values = vectors + v * size;
+        uint64_t expected = 0;
+        for (i = 0; i < size; i++)
+            expected += values[i] < serial[i];
+        int changed = min_update(serial, values, size);
+        uint64_t updated = concurrent_min_update(concurrent, values, size);
+        if (updated != expected || changed != (expected > 0)) {
+            printf("vector %lu of size %lu: %lu slots smaller, min_update %d, concurrent_min_update %lu\n", v, size, expected, changed, updated);
+            ret = 1;
+        } else if (memcmp(serial, concurrent, size * sizeof(sketch_t)) != 0) {
+            printf("vector %lu of size %lu: the kernels leave different sketches\n", v, size);
+            ret = 1;
+        }
+    }
+    free(concurrent);
+    free(serial);
+    return ret;
+}
+
+
+typedef struct update_arg {
+    sketch_t *sketch;
+    const sketch_t *vectors;
+    uint64_t n, size;
+    uint32_t threads;
+} update_arg;
+
+static void update_task(void *arg, uint32_t tid) {
+
+    update_arg *u = (update_arg *) arg;
+    uint64_t v;
+    for (v = tid; v < u->n; v += u->threads)
+        concurrent_min_update(u->sketch, u->vectors + v * u->size, u->size);
+}
+
+/** Writers racing on one sketch: no update is lost, the sketch is the serial minimum of every vector */
+static int check_concurrent_writers(worker_pool *pool, const sketch_t *vectors, uint64_t n, uint64_t size) {
+
+    sketch_t *serial = malloc(size * sizeof(sketch_t));
+    sketch_t *shared = malloc(size * sizeof(sketch_t));
+    if (serial == NULL || shared == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating sketches\n");
+        exit(1);
+    }
+    fill_infty(serial, size);
+    fill_infty(shared, size);
+
+    uint64_t v;
+    for (v = 0; v < n; v++)
+        min_update(serial, vectors + v * size, size);
+
+    update_arg arg = {shared, vectors, n, size, pool->n};
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    worker_pool_run(pool, update_task, &arg);
+    gettimeofday(&t2, NULL);
+    printf("%lu vectors of %lu slots min-updated by %u writers: %.3f ms\n", n, size, pool->n, elapsed_ms(t1, t2));
+
+    int ret = memcmp(serial, shared, size * sizeof(sketch_t)) != 0;
+    if (ret)
+        printf("size %lu: the sketch of %u concurrent writers differs from the serial minimum\n", size, pool->n);
+    free(shared);
+    free(serial);
+    return ret;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of vectors> <sketch_size> [num_threads]\n", argv[0]);
+        exit(1);
+    }
+
+    uint64_t n = (uint64_t) parse_arg(argv[1], "n_vectors", 1);
+    conf.sketch_size = (uint64_t) parse_arg(argv[2], "sketch_size", 1);
+    uint32_t threads = argc > 3 ? (uint32_t) parse_arg(argv[3], "num_threads", 1) : 4;
+
+    worker_pool pool;
+    worker_pool_start(&pool, threads, NULL, PIN_NONE);
+
+    // the size itself, a partial last block and a sketch shorter than a block
+    uint64_t sizes[] = {conf.sketch_size, conf.sketch_size + MIN_UPDATE_BLOCK / 2 + 5, MIN_UPDATE_BLOCK / 2 - 3};
+    int ret = 0;
+    uint32_t s;
+    for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        sketch_t *vectors = random_vectors(n, sizes[s]);
+        ret |= check_single_writer(vectors, n, sizes[s]);
+        ret |= check_concurrent_writers(&pool, vectors, n, sizes[s]);
+        free(vectors);
+    }
+    worker_pool_stop(&pool);
+
+    if (ret == 0)
+        printf("Test passed: concurrent_min_update matches min_update, alone and with %u writers\n", threads);
+    else
+        printf("Test failed\n");
+    return ret;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <numa_alloc.h>
+
+#ifdef NUMA
+#include <numaif.h>
+#endif
+
+struct minhash_configuration conf = {
+    .sketch_size = 1024,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 0,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+static const char *hash_names[] = {"pairwise", "k-wise", "simple tabulation", "twisted tabulation"};
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+/** Memory returned by node_alloc must be usable and, with NUMA, backed by pages of the requested node */
+static int check_node_alloc(size_t size) {
+
+    int node;
+    for (node = 0; node < node_count(); node++) {
+        uint8_t *ptr = node_alloc(size, node);
+        memset(ptr, 0xAB, size);
+#ifdef NUMA
+        int page_node = -1;
+        if (get_mempolicy(&page_node, NULL, 0, ptr, MPOL_F_NODE | MPOL_F_ADDR) != 0) {
+            perror("get_mempolicy");
+            return 1;
+        }
+        if (page_node != node) {
+            printf("node_alloc: memory requested on node %d is on node %d\n", node, page_node);
+            return 1;
+        }
+#endif
+        node_free(ptr, size);
+    }
+    return 0;
+}
+
+
+/** A replica must compute the same hash values as the original without sharing any of its memory */
+static int check_replica(void *hash_functions, uint32_t hash_type, uint64_t size, int node) {
+
+    void *replica = hash_functions_replicate(hash_functions, hash_type, size, node);
+
+    sketch_t values[size], replica_values[size];
+    uint64_t t;
+    for (t = 0; t < 1000; t++) {
+        uint64_t x = t < 500 ? t : ((uint64_t) random() << 33) ^ (uint64_t) random();
+        hash_values(hash_functions, hash_type, 0, size, x, values);
+        hash_values(replica, hash_type, 0, size, x, replica_values);
+        if (memcmp(values, replica_values, sizeof(values)) != 0) {
+            printf("%s replica on node %d: hash values of %lu differ\n", hash_names[hash_type], node, x);
+            return 1;
+        }
+    }
+
+    int shared = 0;
+    switch (hash_type) {
+    case 1: shared = ((kwise_hash *) replica)->coefficients == ((kwise_hash *) hash_functions)->coefficients; break;
+    case 2:
+    case 3: shared = ((tabulation_hash *) replica)->table == ((tabulation_hash *) hash_functions)->table; break;
+    default: break;
+    }
+    if (shared) {
+        printf("%s replica on node %d shares the tables of the original\n", hash_names[hash_type], node);
+        return 1;
+    }
+
+    hash_functions_replica_free(replica, hash_type, size);
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of inserts> <sketch size>\n", argv[0]);
+        exit(1);
+    }
+
+    long n_inserts = parse_arg(argv[1], "n_inserts", 1);
+    long ssize = parse_arg(argv[2], "sketch size", 1);
+    conf.sketch_size = (uint64_t) ssize;
+
+    read_configuration(conf);
+    printf("NUMA nodes: %d, running on node %d\n", node_count(), current_node());
+
+    int ret = 0;
+    if (check_node_alloc(1 << 20)) ret = 1;
+
+    uint32_t hash_type;
+    for (hash_type = 0; hash_type <= 3; hash_type++) {
+        void *hash_functions = hash_functions_init(hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+        int node;
+        for (node = 0; node < node_count(); node++)
+            if (check_replica(hash_functions, hash_type, conf.sketch_size, node)) ret = 1;
+
+        // inserting with the replica of the local node gives the same sketch, report the cost of both
+        void *replica = hash_functions_replicate(hash_functions, hash_type, conf.sketch_size, current_node());
+        minhash_sketch *sketch, *replica_sketch;
+        minhash_init(&sketch, hash_functions, conf.sketch_size, 0, hash_type);
+        minhash_init(&replica_sketch, replica, conf.sketch_size, 0, hash_type);
+
+        struct timeval t1, t2, t3;
+        long i;
+        gettimeofday(&t1, NULL);
+        for (i = 0; i < n_inserts; i++)
+            insert(sketch, i);
+        gettimeofday(&t2, NULL);
+        for (i = 0; i < n_inserts; i++)
+            insert(replica_sketch, i);
+        gettimeofday(&t3, NULL);
+
+        if (query(sketch, replica_sketch) != 1.0f) {
+            printf("Test failed: %s sketch built with the local replica differs\n", hash_names[hash_type]);
+            ret = 1;
+        }
+        printf("%-20s inserts: shared tables %.3f ms, local replica %.3f ms\n",
+               hash_names[hash_type], elapsed_ms(t1, t2), elapsed_ms(t2, t3));
+
+        minhash_free(sketch);
+        minhash_free(replica_sketch);
+        hash_functions_replica_free(replica, hash_type, conf.sketch_size);
+    }
+
+    if (ret == 0)
+        printf("Test passed: node allocations and hash table replicas are consistent\n");
+    return ret;
+}
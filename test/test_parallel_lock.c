@@ -39,7 +39,7 @@ void minhash_print(minhash_sketch *sketch) {
     uint64_t i;
     printf("Value: \n");
     for(i=0; i < sketch->size; i++) {
-        printf(" %lu, ", sketch->sketch[i]);
+        printf(" %lu, ", (uint64_t) sketch->sketch[i]);
     }
     printf("\n");
 }
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <ingest.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 128,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 2,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+#if defined(FCDS) || defined(CONC_MINHASH) || defined(FLAT_COMBINING) || defined(SHARDED)
+    .N = 0,
+    .b = 0,
+#endif
+};
+
+
+/** Sink accumulating the number of keys and their sum, safe for concurrent writers */
+typedef struct key_summary {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+} key_summary;
+
+static void summary_sink(void *ctx, uint32_t tid, const uint64_t *keys, size_t n) {
+    (void) tid;
+    key_summary *s = (key_summary *) ctx;
+    uint64_t sum = 0;
+    size_t i;
+    for (i = 0; i < n; i++)
+        sum += keys[i];
+    __atomic_fetch_add(&s->count, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->sum, sum, __ATOMIC_RELAXED);
+}
+
+
+#ifdef FCDS
+void *propagator_routine(void *arg) {
+    propagator((fcds_sketch *) arg);
+    return NULL;
+}
+#endif
+
+
+/** Write the keys 0 .. n_keys-1 in the given format, returns the expected sum of the keys read back */
+static uint64_t write_key_file(const char *path, uint32_t format, long n_keys) {
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        perror("fopen failed for key file");
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t sum = 0;
+    long i;
+    for (i = 0; i < n_keys; i++) {
+        uint64_t key = (uint64_t) i;
+        switch (format) {
+        case INGEST_BINARY:
+            fwrite(&key, sizeof(key), 1, f);
+            sum += key;
+            break;
+        case INGEST_DECIMAL:
+            // Windows line endings and empty lines must be tolerated
+            fprintf(f, i % 1000 == 0 ? "%lu\r\n\n" : "%lu\n", key);
+            sum += key;
+            break;
+        default: {
+            // line lengths vary, so that lines straddle the block boundaries at every offset
+            char line[64];
+            int len = snprintf(line, sizeof(line), "key-%lu-%.*s", key, (int) (i % 23), "abcdefghijklmnopqrstuvw");
+            fprintf(f, "%s\n", line);
+            sum += prehash64(line, len, 0);
+            break;
+            }
+        }
+    }
+    fclose(f);
+    return sum;
+}
+
+
+/** Compare a sketch built by the engine with the serial sketch of the keys 0 .. n_keys-1 */
+static int compare_with_serial(const sketch_t *engine_sketch, void *hash_functions, long n_keys) {
+
+    minhash_sketch *serial_sketch;
+    minhash_init(&serial_sketch, hash_functions, conf.sketch_size, 0, conf.hash_type);
+
+    long i;
+    for (i = 0; i < n_keys; i++)
+        insert(serial_sketch, i);
+
+    uint64_t s, count = 0;
+    for (s = 0; s < conf.sketch_size; s++)
+        count += serial_sketch->sketch[s] == engine_sketch[s];
+
+    minhash_free(serial_sketch);
+    if (count != conf.sketch_size) {
+        printf("Test failed: %lu/%lu slots match the serial sketch\n", count, conf.sketch_size);
+        return 1;
+    }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+                "Usage: %s <number of keys> <num_threads> [binary key file] [block size in KB] [buffers] [pin policy]\n",
+                argv[0]);
+        return 1;
+    }
+
+    long n_keys = parse_arg(argv[1], "n_keys", 1);
+    long num_threads = parse_arg(argv[2], "num_threads", 1);
+    long block_kb = argc > 4 ? parse_arg(argv[4], "block size", 1) : 1024;
+    long n_buffers = argc > 5 ? parse_arg(argv[5], "buffers", 1) : 8;
+    uint32_t pin_policy = argc > 6 ? parse_pin_policy(argv[6]) : PIN_NONE;
+
+    read_configuration(conf);
+
+    int ret = 0;
+    char path[] = "/tmp/minhash_keysXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp failed for key file");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    // every format, through io_uring and pread, with small blocks and 1 .. num_threads workers,
+    // must deliver every key exactly once
+    static const char *format_names[] = {"binary", "decimal", "lines"};
+    uint32_t format;
+    for (format = INGEST_BINARY; format <= INGEST_LINES; format++) {
+        uint64_t expected = write_key_file(path, format, n_keys);
+
+        int use_io_uring;
+        for (use_io_uring = 0; use_io_uring <= 1; use_io_uring++) {
+            long t;
+            for (t = 1; t <= num_threads; t++) {
+                key_summary summary = {0, 0};
+                ingest_pipeline_conf pc = {format, (uint32_t) t, 4, 4096 + 8 * t, use_io_uring, summary_sink, &summary, 0, NULL, PIN_NONE};
+                ingest_pipeline_stats stats;
+                ingest_pipeline(path, &pc, &stats);
+                if (stats.keys != (uint64_t) n_keys || summary.count != (uint64_t) n_keys || summary.sum != expected) {
+                    printf("Test failed: %s file, %s, %ld workers, %lu/%ld keys\n", format_names[format],
+                           use_io_uring ? "io_uring" : "pread", t, (uint64_t) summary.count, n_keys);
+                    ret = 1;
+                }
+            }
+        }
+    }
+
+    // feed the engine of this build with num_threads workers and check the result
+    const char *source = argc > 3 ? argv[3] : path;
+    if (argc <= 3)
+        write_key_file(path, INGEST_BINARY, n_keys);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+    cpu_topology topo;
+    topology_discover(&topo);
+    ingest_pipeline_conf pc = {INGEST_BINARY, (uint32_t) num_threads, (uint32_t) n_buffers, (size_t) block_kb * 1024, 1, NULL, NULL, 0, &topo, pin_policy};
+    ingest_pipeline_stats stats;
+
+#if defined(CONC_MINHASH)
+    conc_minhash *sketch;
+    init_conc_minhash(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, num_threads, 1000);
+    pc.sink = conc_minhash_sink;
+    pc.ctx = sketch;
+    ingest_pipeline(source, &pc, &stats);
+
+    // the pending insertions included
+    sketch_t result[conf.sketch_size];
+    conc_minhash_snapshot(sketch, result);
+#elif defined(FCDS)
+    fcds_sketch *sketch;
+    init_fcds(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type, num_threads, 100);
+    fcds_writer writers[num_threads];
+    long t;
+    for (t = 0; t < num_threads; t++) {
+        writers[t].sketch = sketch;
+        writers[t].insertion_counter = 0;
+    }
+    // the propagator never returns, it is left running until the process exits
+    pthread_t prop_thread;
+    if (pthread_create(&prop_thread, NULL, propagator_routine, sketch)) {
+        fprintf(stderr, "Error creating propagator thread\n");
+        exit(1);
+    }
+    pc.sink = fcds_sink;
+    pc.ctx = writers;
+    ingest_pipeline(source, &pc, &stats);
+
+    // every writer is done waiting for its propagations: slots are the minimum of the global and the local sketches
+    sketch_t result[conf.sketch_size];
+    uint64_t s;
+    for (s = 0; s < conf.sketch_size; s++) {
+        result[s] = sketch->global_sketch[s];
+        for (t = 0; t < num_threads; t++)
+            if (sketch->local_sketches[t][s] < result[s])
+                result[s] = sketch->local_sketches[t][s];
+    }
+#else
+    // other engines are fed through the serial sketch by a single worker
+    minhash_sketch *sketch;
+    minhash_init(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    pc.workers = 1;
+    pc.sink = minhash_sink;
+    pc.ctx = sketch;
+    ingest_pipeline(source, &pc, &stats);
+    sketch_t *result = sketch->sketch;
+#endif
+
+    printf("Ingested %lu keys (%.1f MB) through %s with %u workers (%s pinning) in %.3f s: %.3f GB/s\n",
+           stats.keys, stats.bytes / 1e6, stats.io_uring ? "io_uring" : "pread", pc.workers, pin_policy_name(pin_policy),
+           stats.seconds, stats.bytes / 1e9 / stats.seconds);
+
+    if (argc <= 3 && compare_with_serial(result, hash_functions, n_keys))
+        ret = 1;
+
+    unlink(path);
+    topology_free(&topo);
+
+    if (ret == 0)
+        printf("Test passed: the pipeline ingests key files completely and the sketch matches the serial one\n");
+    return ret;
+}
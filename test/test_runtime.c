@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include <configuration.h>
+#include <runtime.h>
+
+
+static const char *policy_args[] = {"none", "compact", "scatter", "physical", "node"};
+
+
+/** Every order of the topology must be a permutation of the allowed CPUs */
+static int check_order(const cpu_topology *topo, const uint32_t *order, const char *name) {
+
+    uint8_t seen[topo->n_cpus];
+    memset(seen, 0, sizeof(seen));
+    uint32_t i;
+    for (i = 0; i < topo->n_cpus; i++) {
+        if (order[i] >= topo->n_cpus || seen[order[i]]) {
+            printf("%s order is not a permutation of the CPUs (position %u)\n", name, i);
+            return 1;
+        }
+        seen[order[i]] = 1;
+    }
+    return 0;
+}
+
+/** The first n_cores CPUs of the physical and scatter orders must be on distinct cores */
+static int check_distinct_cores(const cpu_topology *topo, const uint32_t *order, const char *name) {
+
+    uint8_t used[topo->n_cores];
+    memset(used, 0, sizeof(used));
+    uint32_t i;
+    for (i = 0; i < topo->n_cores; i++) {
+        int core = topo->cpus[order[i]].core;
+        if (used[core]) {
+            printf("%s order places two of the first %u threads on core %d\n", name, topo->n_cores, core);
+            return 1;
+        }
+        used[core] = 1;
+    }
+    return 0;
+}
+
+
+typedef struct pin_arg {
+    worker_pool *pool;
+    int *cpus;      /// CPU observed by each worker, 0 when the barrier check passed
+    uint64_t *sums; /// per worker result of the run
+    uint64_t round;
+} pin_arg;
+
+static void pin_task(void *arg, uint32_t tid) {
+
+    pin_arg *p = (pin_arg *) arg;
+    p->cpus[tid] = sched_getcpu();
+    p->sums[tid] += p->round * 1000 + tid;
+}
+
+static void barrier_check_task(void *arg, uint32_t tid) {
+
+    pin_arg *p = (pin_arg *) arg;
+    worker_pool *pool = p->pool;
+    p->sums[tid] = tid + 1;
+    worker_pool_barrier(pool);
+    // after the barrier every worker has written its slot
+    uint64_t sum = 0;
+    uint32_t w;
+    for (w = 0; w < pool->n; w++)
+        sum += p->sums[w];
+    p->cpus[tid] = sum == (uint64_t) pool->n * (pool->n + 1) / 2 ? 0 : -1;
+}
+
+
+/** Run a pool with policy several times: each worker must sit on the CPU of the policy and see every round */
+static int check_pool(const cpu_topology *topo, uint32_t policy, uint32_t n, uint64_t rounds) {
+
+    int cpus[n];
+    uint64_t sums[n];
+    memset(sums, 0, sizeof(sums));
+    worker_pool pool;
+    pin_arg arg = {&pool, cpus, sums, 0};
+
+    worker_pool_start(&pool, n, topo, policy);
+    for (arg.round = 0; arg.round < rounds; arg.round++)
+        worker_pool_run(&pool, pin_task, &arg);
+
+    int ret = 0;
+    uint32_t w;
+    for (w = 0; w < n; w++) {
+        uint64_t expected = 1000 * rounds * (rounds - 1) / 2 + rounds * w;
+        if (sums[w] != expected) {
+            printf("%s pool: worker %u ran %lu instead of %lu\n", pin_policy_name(policy), w, sums[w], expected);
+            ret = 1;
+        }
+        int cpu = topology_cpu(topo, policy, w);
+        if (cpu >= 0 && cpus[w] != cpu) {
+            printf("%s pool: worker %u runs on CPU %d, expected %d\n", pin_policy_name(policy), w, cpus[w], cpu);
+            ret = 1;
+        }
+        if (policy == PIN_NODE) {
+            uint32_t c;
+            for (c = 0; c < topo->n_cpus && topo->cpus[c].cpu != cpus[w]; c++)
+                ;
+            if (c == topo->n_cpus || topo->cpus[c].node != topo->nodes[w % topo->n_nodes]) {
+                printf("node pool: worker %u runs on CPU %d outside its node\n", w, cpus[w]);
+                ret = 1;
+            }
+        }
+    }
+
+    // the in-task barrier must hold every worker until all of them wrote their slot, run it twice to reuse it
+    int r;
+    for (r = 0; r < 2; r++) {
+        memset(sums, 0, sizeof(sums));
+        worker_pool_run(&pool, barrier_check_task, &arg);
+        for (w = 0; w < n; w++) {
+            if (cpus[w] != 0) {
+                printf("%s pool: worker %u passed the barrier before the others\n", pin_policy_name(policy), w);
+                ret = 1;
+            }
+        }
+    }
+
+    worker_pool_stop(&pool);
+    return ret;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr,
+            "Usage: %s <number of workers>\n", argv[0]);
+        exit(1);
+    }
+
+    long n_workers = parse_arg(argv[1], "number of workers", 1);
+
+    cpu_topology topo;
+    topology_discover(&topo);
+    topology_print(&topo);
+
+    int ret = 0;
+    if (check_order(&topo, topo.compact, "compact")) ret = 1;
+    if (check_order(&topo, topo.scatter, "scatter")) ret = 1;
+    if (check_order(&topo, topo.physical, "physical")) ret = 1;
+    if (check_distinct_cores(&topo, topo.physical, "physical")) ret = 1;
+    if (check_distinct_cores(&topo, topo.scatter, "scatter")) ret = 1;
+
+    uint32_t policy;
+    for (policy = PIN_NONE; policy <= PIN_NODE; policy++) {
+        if (parse_pin_policy(policy_args[policy]) != policy || strcmp(pin_policy_name(policy), policy_args[policy]) != 0) {
+            printf("pin policy %s does not round trip\n", policy_args[policy]);
+            ret = 1;
+        }
+        if (check_pool(&topo, policy, (uint32_t) n_workers, 8)) ret = 1;
+    }
+
+    topology_free(&topo);
+
+    if (ret == 0)
+        printf("Test passed: orders, pinning and worker pool reuse are consistent\n");
+    return ret;
+}
@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <collection.h>
+#include <search.h>
+#include <runtime.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 256,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+// set s of the collection holds the elements of pattern (7 s) % PATTERNS, pattern p being [p STEP, p STEP + ELEMS):
+// sets of nearby patterns overlap, and sets of the same pattern tie
+#define PATTERNS 1000
+#define STEP 8
+#define ELEMS 256
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+static float *scores;   /// similarity of every set, for the brute force ranking
+
+static int compare_sets(const void *x, const void *y) {
+    uint64_t a = *(const uint64_t *) x, b = *(const uint64_t *) y;
+    if (scores[a] != scores[b])
+        return scores[a] < scores[b] ? 1 : -1;
+    return (a > b) - (a < b);
+}
+
+/** The hits must be the first count sets of the brute force ranking, with their similarities */
+static int check_hits(const char *name, const search_hit *hits, size_t count, const uint64_t *ranking, size_t expected) {
+
+    size_t i;
+    if (count != expected) {
+        printf("%s: %zu hits instead of %zu\n", name, count, expected);
+        return 1;
+    }
+    for (i = 0; i < count; i++)
+        if (hits[i].set != ranking[i] || hits[i].similarity != scores[ranking[i]]) {
+            printf("%s: hit %zu is set %lu (%.4f) instead of set %lu (%.4f)\n", name, i, hits[i].set, hits[i].similarity, ranking[i], scores[ranking[i]]);
+            return 1;
+        }
+    return 0;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 4) {
+        fprintf(stderr,
+            "Usage: %s <number of sets> <k> <num_threads> [sketch_size]\n", argv[0]);
+        exit(1);
+    }
+
+    long n_sets = parse_arg(argv[1], "n_sets", 1);
+    long k = parse_arg(argv[2], "k", 1);
+    long num_threads = parse_arg(argv[3], "num_threads", 1);
+    if (argc > 4) conf.sketch_size = (uint64_t) parse_arg(argv[4], "sketch_size", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    sketch_collection *patterns, *collection;
+    collection_init(&patterns, hash_functions, conf.sketch_size, conf.hash_type, PATTERNS);
+    collection_init(&collection, hash_functions, conf.sketch_size, conf.hash_type, n_sets);
+    uint64_t p, e;
+    long s;
+    for (p = 0; p < PATTERNS; p++)
+        for (e = 0; e < ELEMS; e++)
+            collection_insert(patterns, p, p * STEP + e);
+    for (s = 0; s < n_sets; s++)
+        memcpy(collection_sketch(collection, s), collection_sketch(patterns, (7 * s) % PATTERNS), conf.sketch_size * sizeof(sketch_t));
+    const sketch_t *query = collection_sketch(patterns, PATTERNS / 2);
+
+    // brute force: every similarity, then a full sort
+    struct timeval t1, t2, t3, t4;
+    scores = malloc(n_sets * sizeof(float));
+    uint64_t *ranking = malloc(n_sets * sizeof(uint64_t));
+    search_hit *hits = malloc((n_sets + 1) * sizeof(search_hit));
+    if (scores == NULL || ranking == NULL || hits == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating the rankings\n");
+        exit(1);
+    }
+    gettimeofday(&t1, NULL);
+    collection_query_all(collection, query, scores);
+    for (s = 0; s < n_sets; s++)
+        ranking[s] = (uint64_t) s;
+    qsort(ranking, n_sets, sizeof(uint64_t), compare_sets);
+    gettimeofday(&t2, NULL);
+
+    int ret = 0;
+    size_t expected = k < n_sets ? (size_t) k : (size_t) n_sets;
+    size_t count = collection_top_k(collection, query, k, hits);
+    gettimeofday(&t3, NULL);
+    ret |= check_hits("serial top k", hits, count, ranking, expected);
+
+    worker_pool pool;
+    worker_pool_start(&pool, num_threads, NULL, PIN_NONE);
+    struct timeval t5;
+    gettimeofday(&t4, NULL);
+    count = collection_top_k_parallel(collection, query, k, hits, &pool);
+    gettimeofday(&t5, NULL);
+    ret |= check_hits("parallel top k", hits, count, ranking, expected);
+    printf("top %ld of %ld sets of %lu slots: brute force %.3f ms, top k %.3f ms, %ld workers %.3f ms\n",
+           k, n_sets, conf.sketch_size, elapsed_ms(t1, t2), elapsed_ms(t2, t3), num_threads, elapsed_ms(t4, t5));
+
+    // corner cases: the nearest set alone, and more hits asked than sets
+    count = collection_top_k_parallel(collection, query, 1, hits, &pool);
+    ret |= check_hits("top 1", hits, count, ranking, 1);
+    count = collection_top_k(collection, query, n_sets + 1, hits);
+    ret |= check_hits("serial top n + 1", hits, count, ranking, n_sets);
+    count = collection_top_k_parallel(collection, query, n_sets + 1, hits, &pool);
+    ret |= check_hits("parallel top n + 1", hits, count, ranking, n_sets);
+
+    worker_pool_stop(&pool);
+    free(hits);
+    free(ranking);
+    free(scores);
+    collection_free(collection);
+    collection_free(patterns);
+
+    if (ret == 0)
+        printf("Test passed: serial and parallel top k match the brute force ranking\n");
+    return ret;
+}
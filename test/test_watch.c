@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <fanout.h>
+#include <runtime.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 1024,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+#define QUERIES 100000
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+#if defined(CONC_MINHASH)
+typedef struct insert_arg {
+    conc_minhash *sketch;
+    long n;
+    uint32_t writers;
+    int watched;
+    _Atomic uint32_t done;
+    int invalid;       /// watched similarities out of [0, 1] seen by worker 0
+} insert_arg;
+
+/** Worker 0 reads the watched similarity while the others insert [0, n), merging every b insertions each */
+static void insert_task(void *arg, uint32_t tid) {
+
+    insert_arg *a = (insert_arg *) arg;
+    if (tid > 0) {
+        long i;
+        for (i = tid - 1; i < a->n; i += a->writers)
+            insert_conc_minhash(a->sketch, i);
+        __atomic_fetch_add(&a->done, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    do {
+        float similarity = concurrent_query_watched(a->sketch, a->watched);
+        a->invalid += similarity < 0 || similarity > 1;
+    } while (__atomic_load_n(&a->done, __ATOMIC_ACQUIRE) < a->writers);
+}
+#endif
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> <num_threads> [sketch_size]\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 4);
+    long num_threads = parse_arg(argv[2], "num_threads", 1);
+    if (argc > 3) conf.sketch_size = (uint64_t) parse_arg(argv[3], "sketch_size", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    // references: A = [0, n) and B = [n/2, n/2 + n)
+    minhash_sketch *a, *b;
+    minhash_init(&a, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&b, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    long i;
+    for (i = 0; i < n; i++) {
+        insert(a, i);
+        insert(b, n / 2 + i);
+    }
+
+    // the watched sketch grows to A through every insertion path, the counts must follow each step
+    int ret = 0;
+    minhash_sketch *sketch;
+    minhash_init(&sketch, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    int watch_a = minhash_watch(sketch, a->sketch);
+    int watch_b = minhash_watch(sketch, b->sketch);
+    int unwatched = minhash_watch(sketch, b->sketch);
+    minhash_unwatch(sketch, unwatched);
+
+    uint64_t *elems = malloc(n * sizeof(uint64_t));
+    if (elems == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating elements\n");
+        exit(1);
+    }
+    for (i = 0; i < n; i++)
+        elems[i] = (uint64_t) i;
+    hash_vector vector;
+    hash_vector_init(&vector, hash_functions, conf.hash_type, conf.sketch_size);
+
+    long step;
+    for (step = 0; step < 4; step++) {
+        long first = step * n / 4, last = (step + 1) * n / 4;
+        if (step == 0)
+            for (i = first; i < last; i++)
+                insert(sketch, i);
+        else if (step == 1)
+            insert_batch(sketch, elems + first, last - first);
+        else
+            for (i = first; i < last; i++)
+                insert_values(sketch, hash_vector_compute(&vector, i));
+        if (query_watched(sketch, watch_a) != query(sketch, a) || query_watched(sketch, watch_b) != query(sketch, b)) {
+            printf("Test failed: after step %ld the watched similarities are %.4f %.4f instead of %.4f %.4f\n", step,
+                   query_watched(sketch, watch_a), query_watched(sketch, watch_b), query(sketch, a), query(sketch, b));
+            ret = 1;
+        }
+    }
+    if (query_watched(sketch, watch_a) != 1) {
+        printf("Test failed: a sketch of A is not identical to the sketch of A\n");
+        ret = 1;
+    }
+    // a pair registered on a non empty sketch starts from the equal slots
+    int late = minhash_watch(sketch, b->sketch);
+    if (late != unwatched || query_watched(sketch, late) != query(sketch, b)) {
+        printf("Test failed: a pair registered late does not start from the current similarity\n");
+        ret = 1;
+    }
+
+    // the monitoring pattern: one pair queried many times
+    struct timeval t1, t2, t3;
+    volatile float sink = 0;
+    gettimeofday(&t1, NULL);
+    for (i = 0; i < QUERIES; i++)
+        sink += query(sketch, b);
+    gettimeofday(&t2, NULL);
+    for (i = 0; i < QUERIES; i++)
+        sink += query_watched(sketch, watch_b);
+    gettimeofday(&t3, NULL);
+    printf("%d queries of %lu slots: full %.3f ms, watched %.3f ms\n", QUERIES, conf.sketch_size, elapsed_ms(t1, t2), elapsed_ms(t2, t3));
+
+#if defined(CONC_MINHASH)
+    // merges publish a new query sketch: the count must follow it while worker 0 reads it
+    conc_minhash *conc;
+    uint32_t writers = (uint32_t) num_threads;
+    init_conc_minhash(&conc, hash_functions, conf.sketch_size, 0, conf.hash_type, writers, 50);
+    insert_arg arg = {conc, n, writers, conc_minhash_watch(conc, b->sketch), 0, 0};
+    worker_pool pool;
+    worker_pool_start(&pool, writers + 1, NULL, PIN_NONE);
+    worker_pool_run(&pool, insert_task, &arg);
+    worker_pool_stop(&pool);
+
+    float watched = concurrent_query_watched(conc, arg.watched);
+    float expected = concurrent_query(conc, b->sketch);
+    printf("%u writers: watched similarity of the query sketch %.4f, full query %.4f\n", writers, watched, expected);
+    if (arg.invalid || watched != expected) {
+        printf("Test failed: the watched count of the concurrent sketch differs from its query sketch\n");
+        ret = 1;
+    }
+    free_conc_minhash(conc);
+#elif defined(LOCKS) || defined(RW_LOCKS)
+    minhash_sketch *locked;
+    minhash_init(&locked, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    int watched = minhash_watch(locked, b->sketch);
+    for (i = 0; i < n; i++)
+        insert_parallel(locked, i);
+    if (query_watched(locked, watched) != query_parallel(locked, b)) {
+        printf("Test failed: the watched count of the lock-based sketch differs from its query\n");
+        ret = 1;
+    }
+    minhash_free(locked);
+#else
+    (void) num_threads;
+#endif
+
+    hash_vector_free(&vector);
+    free(elems);
+    minhash_free(sketch);
+    minhash_free(b);
+    minhash_free(a);
+
+    if (ret == 0)
+        printf("Test passed: watched similarities follow the insertions and merges\n");
+    return ret;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <minhash.h>
+#include <configuration.h>
+#include <weighted.h>
+#include <fanout.h>
+
+struct minhash_configuration conf = {
+    .sketch_size = 256,          /// Number of hash functions / sketch size
+    .prime_modulus = (1ULL << 31) - 1,       /// Large prime for hashing (M)
+    .hash_type = 1,        /// ID for hash function pointer
+    .init_size = 0,                 /// Initial elements to insert (optional)
+    .k = 5,
+};
+
+// integer weights, so that a weighted set is also a multiset of (element, copy) tokens
+#define MAX_COPIES 8
+static inline double weight_a(uint64_t e) { return 1 + e % 5; }
+static inline double weight_b(uint64_t e) { return 1 + e % 3; }
+
+
+static inline double elapsed_ms(struct timeval start, struct timeval end) {
+    double elapsed = (end.tv_sec - start.tv_sec) * 1000.0;
+    elapsed += (end.tv_usec - start.tv_usec) / 1000.0;
+    return elapsed;
+}
+
+
+int main(int argc, const char*argv[]) {
+
+    if (argc < 2) {
+        fprintf(stderr,
+            "Usage: %s <number of elements> [sketch_size]\n", argv[0]);
+        exit(1);
+    }
+
+    long n = parse_arg(argv[1], "n_elements", 2);
+    if (argc > 2) conf.sketch_size = (uint64_t) parse_arg(argv[2], "sketch_size", 1);
+    read_configuration(conf);
+
+    void *hash_functions = hash_functions_init(conf.hash_type, conf.sketch_size, conf.prime_modulus, conf.k);
+
+    // A = [0, n) and B = [n/2, n/2 + n), weighted
+    uint64_t e;
+    double sum_min = 0, sum_max = 0;
+    for (e = 0; e < (uint64_t) (n + n / 2); e++) {
+        double wa = e < (uint64_t) n ? weight_a(e) : 0;
+        double wb = e >= (uint64_t) (n / 2) ? weight_b(e) : 0;
+        sum_min += wa < wb ? wa : wb;
+        sum_max += wa > wb ? wa : wb;
+    }
+    double expected = sum_min / sum_max;
+
+    int ret = 0;
+    minhash_sketch *a, *b, *reversed;
+    minhash_init(&a, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&b, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&reversed, hash_functions, conf.sketch_size, 0, conf.hash_type);
+
+    struct timeval t1, t2, t3, t4;
+    gettimeofday(&t1, NULL);
+    for (e = 0; e < (uint64_t) n; e++)
+        insert_weighted(a, e, weight_a(e));
+    gettimeofday(&t2, NULL);
+    for (e = n / 2; e < (uint64_t) (n + n / 2); e++)
+        insert_weighted(b, e, weight_b(e));
+
+    // consistent samples: the sketch does not depend on the order of insertion, and weight 0 is no insertion
+    for (e = n; e-- > 0; ) {
+        insert_weighted(reversed, e, weight_a(e));
+        insert_weighted(reversed, e + n * 4, 0);
+    }
+    if (memcmp(a->sketch, reversed->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: the weighted sketch depends on the order of insertion\n");
+        ret = 1;
+    }
+
+    // the vectorized kernel must give the keys of the slot by slot reference
+    sketch_t *values = malloc(conf.sketch_size * sizeof(sketch_t));
+    if (values == NULL) {
+        fprintf(stderr, "Error in malloc() when allocating values\n");
+        exit(1);
+    }
+    uint64_t i, mismatches = 0;
+    for (e = 0; e < 1000; e++) {
+        weighted_values(hash_functions, conf.hash_type, 0, conf.sketch_size, e, 0.25 + e % 7, values);
+        for (i = 0; i < conf.sketch_size; i++)
+            mismatches += values[i] != weighted_value(hash_functions, conf.hash_type, i, e, 0.25 + e % 7);
+    }
+    if (mismatches) {
+        printf("Test failed: %lu keys of weighted_values differ from weighted_value\n", mismatches);
+        ret = 1;
+    }
+
+    // scalar path: one slot at a time
+    minhash_sketch *scalar;
+    minhash_init(&scalar, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    gettimeofday(&t3, NULL);
+    for (e = 0; e < (uint64_t) n; e++)
+        for (i = 0; i < conf.sketch_size; i++) {
+            sketch_t v = weighted_value(hash_functions, conf.hash_type, i, e, weight_a(e));
+            if (v < scalar->sketch[i])
+                scalar->sketch[i] = v;
+        }
+    gettimeofday(&t4, NULL);
+    printf("%ld weighted insertions into %lu slots: vectorized %.3f ms, scalar %.3f ms\n",
+           n, conf.sketch_size, elapsed_ms(t1, t2), elapsed_ms(t3, t4));
+    if (memcmp(a->sketch, scalar->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: scalar and vectorized weighted insertion give different sketches\n");
+        ret = 1;
+    }
+
+    // the query kernel estimates the weighted Jaccard similarity
+    float similarity = query(a, b);
+    double tolerance = 5.0 * sqrt(expected * (1 - expected) / conf.sketch_size);
+    printf("weighted similarity %.4f expected %.4f\n", similarity, expected);
+    if (fabs(similarity - expected) > tolerance) {
+        printf("Test failed: weighted similarity off by more than %.4f\n", tolerance);
+        ret = 1;
+    }
+
+    // the former approximation: one unweighted insertion per copy of each element
+    minhash_sketch *copies_a, *copies_b;
+    minhash_init(&copies_a, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    minhash_init(&copies_b, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    uint64_t c;
+    gettimeofday(&t1, NULL);
+    for (e = 0; e < (uint64_t) n; e++)
+        for (c = 0; c < (uint64_t) weight_a(e); c++)
+            insert(copies_a, e * MAX_COPIES + c);
+    gettimeofday(&t2, NULL);
+    for (e = n / 2; e < (uint64_t) (n + n / 2); e++)
+        for (c = 0; c < (uint64_t) weight_b(e); c++)
+            insert(copies_b, e * MAX_COPIES + c);
+    printf("inserting copies: %.3f ms, similarity %.4f\n", elapsed_ms(t1, t2), query(copies_a, copies_b));
+
+    // any engine takes weighted elements through the fan-out path
+    minhash_sketch *target;
+    minhash_init(&target, hash_functions, conf.sketch_size, 0, conf.hash_type);
+    fanout_target targets[1] = {{minhash_values_sink, target}};
+    hash_vector vector;
+    hash_vector_init(&vector, hash_functions, conf.hash_type, conf.sketch_size);
+    for (e = 0; e < (uint64_t) n; e++)
+        fanout_insert_weighted(&vector, targets, 1, 0, e, weight_a(e));
+    if (memcmp(a->sketch, target->sketch, conf.sketch_size * sizeof(sketch_t)) != 0) {
+        printf("Test failed: fan-out weighted insertion differs from insert_weighted\n");
+        ret = 1;
+    }
+
+    hash_vector_free(&vector);
+    minhash_free(target);
+    minhash_free(copies_a);
+    minhash_free(copies_b);
+    minhash_free(scalar);
+    free(values);
+    minhash_free(reversed);
+    minhash_free(b);
+    minhash_free(a);
+
+    if (ret == 0)
+        printf("Test passed: weighted sketches are consistent and estimate the weighted Jaccard similarity\n");
+    return ret;
+}